@@ -0,0 +1,115 @@
+/*
+ * Adaptive sampling interval.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "adaptive_rate.h"
+
+/* Weight of the newest sample in the slope and variance averages */
+#define ALPHA		0.25
+#define MAX_GROWTH	2
+
+void adaptive_rate_init(struct adaptive_rate *a,
+			const struct adaptive_rate_config *cfg)
+{
+	memset(a, 0, sizeof(*a));
+	a->cfg = *cfg;
+}
+
+long adaptive_rate_next(struct adaptive_rate *a, int64_t timestamp,
+			int64_t value, long interval_ms)
+{
+	double dt, d, err, budget, target;
+	long next;
+
+	a->samples++;
+
+	if (!a->primed) {
+		a->primed = true;
+		a->first_ts = timestamp;
+		a->last_ts = timestamp;
+		a->last_value = value;
+		return interval_ms;
+	}
+
+	dt = (timestamp - a->last_ts) / 1e6;
+
+	if (dt <= 0)
+		return interval_ms;
+
+	d = value - a->last_value;
+	err = d - a->slope * dt;
+	a->slope += ALPHA * (d / dt - a->slope);
+	a->var += ALPHA * (err * err - a->var);
+	a->last_ts = timestamp;
+	a->last_value = value;
+
+	if (fabs(d) >= a->cfg.delta) {
+		a->excursions++;
+		next = a->cfg.min_ms;
+	} else {
+		/* Expected drift plus one standard deviation of noise */
+		budget = a->cfg.delta / 2.0 - sqrt(a->var);
+
+		if (budget <= 0)
+			target = a->cfg.min_ms;
+		else if (fabs(a->slope) * a->cfg.max_ms <= budget)
+			target = a->cfg.max_ms;
+		else
+			target = budget / fabs(a->slope);
+
+		if (target > (double)interval_ms * MAX_GROWTH)
+			target = (double)interval_ms * MAX_GROWTH;
+
+		next = target;
+	}
+
+	if (next < a->cfg.min_ms)
+		next = a->cfg.min_ms;
+
+	if (next > a->cfg.max_ms)
+		next = a->cfg.max_ms;
+
+	if (next != interval_ms)
+		a->changes++;
+
+	return next;
+}
+
+void adaptive_rate_print(const char *name, const struct adaptive_rate *a)
+{
+	double span_ms = (a->last_ts - a->first_ts) / 1e6;
+	double fixed = span_ms / a->cfg.min_ms + 1;
+
+	if (a->samples < 2) {
+		printf("%s: adaptive %llu samples\n", name,
+		       (unsigned long long)a->samples);
+		return;
+	}
+
+	printf("%s: adaptive %llu samples, mean interval %.0f ms, %llu "
+	       "changes, %llu excursions, %.1fx fewer samples than every "
+	       "%ld ms\n", name, (unsigned long long)a->samples,
+	       span_ms / (a->samples - 1), (unsigned long long)a->changes,
+	       (unsigned long long)a->excursions, fixed / a->samples,
+	       a->cfg.min_ms);
+}
+
+int adaptive_rate_parse(struct adaptive_rate_config *cfg, const char *arg)
+{
+	long min_ms, max_ms;
+	char end;
+
+	if (sscanf(arg, "%ld:%ld%c", &min_ms, &max_ms, &end) != 2 ||
+	    min_ms <= 0 || max_ms < min_ms)
+		return -EINVAL;
+
+	cfg->min_ms = min_ms;
+	cfg->max_ms = max_ms;
+
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * Adaptive sampling interval.
+ *
+ * Every sample updates an exponentially weighted slope (units per ms) and
+ * the rolling variance of how far the sample landed from the slope's
+ * prediction. The next interval is the longest one over which the signal
+ * is expected to move less than delta / 2, noise included, clamped to
+ * [min_ms, max_ms]. A flat channel backs off by at most a factor of two
+ * per sample; a step of delta or more drops straight to min_ms. An
+ * excursion larger than delta that lasts longer than max_ms is therefore
+ * always seen, and sampled at the full rate while it lasts.
+ */
+
+#ifndef ADAPTIVE_RATE_H
+#define ADAPTIVE_RATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct adaptive_rate_config {
+	long min_ms;
+	long max_ms;
+	int64_t delta;			/* same units as the samples */
+};
+
+struct adaptive_rate {
+	struct adaptive_rate_config cfg;
+	bool primed;
+	int64_t first_ts, last_ts;	/* ns */
+	int64_t last_value;
+	double slope;			/* units per ms, signed */
+	double var;			/* of the prediction error */
+	uint64_t samples;
+	uint64_t changes;		/* interval changes */
+	uint64_t excursions;		/* steps of delta or more */
+};
+
+void adaptive_rate_init(struct adaptive_rate *a,
+			const struct adaptive_rate_config *cfg);
+
+/* Feeds the sample just taken, returns the interval to use next. */
+long adaptive_rate_next(struct adaptive_rate *a, int64_t timestamp,
+			int64_t value, long interval_ms);
+
+/*
+ * "<name>: adaptive N samples, mean interval .. ms, .. changes,
+ * .. excursions, ..x fewer samples than every min_ms"
+ */
+void adaptive_rate_print(const char *name, const struct adaptive_rate *a);
+
+/* Parses "<min_ms>:<max_ms>", 0 on success. */
+int adaptive_rate_parse(struct adaptive_rate_config *cfg, const char *arg);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Compact binary sensor log.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "binlog.h"
+
+#define BINLOG_CHUNK	(1024 * 1024)
+
+_Static_assert(sizeof(struct binlog_header) == 64, "binlog header layout");
+_Static_assert(sizeof(struct binlog_record) == 16, "binlog record layout");
+
+static int64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int binlog_extend(struct binlog *log)
+{
+	size_t size = log->map_size + BINLOG_CHUNK;
+	void *map;
+	int ret;
+
+	ret = posix_fallocate(log->fd, 0, size);
+
+	/* Not every filesystem supports fallocate, fall back to a sparse file */
+	if (ret && ftruncate(log->fd, size) < 0)
+		return -errno;
+
+	if (log->map)
+		map = mremap(log->map, log->map_size, size, MREMAP_MAYMOVE);
+	else
+		map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			   log->fd, 0);
+
+	if (map == MAP_FAILED)
+		return -errno;
+
+	log->map = map;
+	log->map_size = size;
+
+	return 0;
+}
+
+static void binlog_sync(struct binlog *log, int flags)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t start = log->synced / page * page;
+
+	if (log->offset > start)
+		msync(log->map + start, log->offset - start, flags);
+
+	/* The header holds the record count, keep it in step */
+	if (start)
+		msync(log->map, page, flags);
+
+	log->synced = log->offset;
+}
+
+int binlog_open(struct binlog *log, int fd, int64_t start_ns, long sync_ms)
+{
+	struct binlog_header *hdr;
+	int ret;
+
+	memset(log, 0, sizeof(*log));
+	log->fd = fd;
+	log->sync_ns = (int64_t)sync_ms * 1000000;
+
+	if (ftruncate(fd, 0) < 0)
+		return -errno;
+
+	ret = binlog_extend(log);
+
+	if (ret < 0)
+		return ret;
+
+	hdr = (struct binlog_header *)log->map;
+	memcpy(hdr->magic, BINLOG_MAGIC, sizeof(hdr->magic));
+	hdr->version = BINLOG_VERSION;
+	hdr->record_size = sizeof(struct binlog_record);
+	hdr->start_ns = start_ns;
+	hdr->realtime_ns = clock_ns(CLOCK_REALTIME) -
+			   (clock_ns(CLOCK_MONOTONIC) - start_ns);
+	hdr->records = 0;
+
+	log->offset = sizeof(*hdr);
+	log->last_sync = clock_ns(CLOCK_MONOTONIC);
+	pthread_mutex_init(&log->lock, NULL);
+
+	return 0;
+}
+
+int binlog_append(struct binlog *log, int64_t timestamp, uint32_t channel,
+		  int32_t value)
+{
+	struct binlog_record *rec;
+	int ret = 0;
+
+	pthread_mutex_lock(&log->lock);
+
+	if (log->offset + sizeof(*rec) > log->map_size) {
+		ret = binlog_extend(log);
+
+		if (ret < 0)
+			goto out;
+	}
+
+	rec = (struct binlog_record *)(log->map + log->offset);
+	rec->timestamp = timestamp;
+	rec->channel = channel;
+	rec->value = value;
+	log->offset += sizeof(*rec);
+	((struct binlog_header *)log->map)->records++;
+
+	if (log->sync_ns && timestamp - log->last_sync >= log->sync_ns) {
+		binlog_sync(log, MS_ASYNC);
+		log->last_sync = timestamp;
+	}
+
+out:
+	pthread_mutex_unlock(&log->lock);
+
+	return ret;
+}
+
+void binlog_close(struct binlog *log)
+{
+	if (!log->map)
+		return;
+
+	binlog_sync(log, MS_SYNC);
+	munmap(log->map, log->map_size);
+	ftruncate(log->fd, log->offset);
+	pthread_mutex_destroy(&log->lock);
+	log->map = NULL;
+}
+
+int binlog_map(struct binlog_file *file, const char *path)
+{
+	const struct binlog_header *hdr;
+	struct stat st;
+	uint64_t max;
+	void *map;
+	int fd, ret;
+
+	memset(file, 0, sizeof(*file));
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return ret;
+
+	hdr = map;
+
+	if (memcmp(hdr->magic, BINLOG_MAGIC, sizeof(BINLOG_MAGIC)) ||
+	    hdr->version != BINLOG_VERSION ||
+	    hdr->record_size != sizeof(struct binlog_record)) {
+		munmap(map, st.st_size);
+		return -EINVAL;
+	}
+
+	/* A log that is still being written is longer than its count */
+	max = (st.st_size - sizeof(*hdr)) / sizeof(struct binlog_record);
+
+	file->hdr = hdr;
+	file->rec = (const struct binlog_record *)(hdr + 1);
+	file->count = hdr->records < max ? hdr->records : max;
+	file->size = st.st_size;
+
+	return 0;
+}
+
+void binlog_unmap(struct binlog_file *file)
+{
+	if (file->hdr)
+		munmap((void *)file->hdr, file->size);
+
+	file->hdr = NULL;
+}
@@ -0,0 +1,100 @@
+/*
+ * Compact binary sensor log.
+ *
+ * The file starts with a 64 byte header followed by fixed-size 16 byte
+ * records (monotonic timestamp, channel id, value in milli-units). The
+ * writer appends through a shared mapping of a file that is pre-extended
+ * in large chunks, so logging a sample is a memcpy; dirty pages are pushed
+ * out with msync() at a configurable interval and the file is trimmed to
+ * its real length on close.
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BINLOG_MAGIC	"SENSLOG"
+#define BINLOG_VERSION	1
+
+enum binlog_channel {
+	BINLOG_TEMPERATURE,
+	BINLOG_HUMIDITY,
+	BINLOG_TEMPERATURE_INTERVAL,	/* adaptive mode, value in ms */
+	BINLOG_HUMIDITY_INTERVAL,
+};
+
+/*
+ * Rolling aggregates (htu21d_menu -G) take one record per statistic. The
+ * channel packs the source channel, the statistic and the window length
+ * in seconds; the value is in milli-units, or the sample count.
+ */
+#define BINLOG_AGGREGATE	0x80000000u
+#define BINLOG_AGG_MAX_SECONDS	0x1ffffff
+
+enum binlog_agg_stat {
+	BINLOG_AGG_COUNT,
+	BINLOG_AGG_MIN,
+	BINLOG_AGG_MAX,
+	BINLOG_AGG_MEAN,
+	BINLOG_AGG_STDDEV,
+	BINLOG_AGG_STATS,
+};
+
+#define BINLOG_AGG_CHANNEL(chan, stat, seconds)				\
+	(BINLOG_AGGREGATE | (uint32_t)(chan) << 28 |			\
+	 (uint32_t)(stat) << 25 | (uint32_t)(seconds))
+#define BINLOG_AGG_SOURCE(channel)	((channel) >> 28 & 0x7)
+#define BINLOG_AGG_STAT(channel)	((channel) >> 25 & 0x7)
+#define BINLOG_AGG_SECONDS(channel)	((channel) & BINLOG_AGG_MAX_SECONDS)
+
+struct binlog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	int64_t start_ns;		/* CLOCK_MONOTONIC when logging started */
+	int64_t realtime_ns;		/* CLOCK_REALTIME at the same instant */
+	uint64_t records;		/* records written so far */
+	uint8_t reserved[24];
+};
+
+struct binlog_record {
+	int64_t timestamp;		/* CLOCK_MONOTONIC, ns */
+	uint32_t channel;
+	int32_t value;			/* milli-units */
+};
+
+struct binlog {
+	int fd;
+	unsigned char *map;
+	size_t map_size;
+	size_t offset;			/* next record */
+	size_t synced;			/* everything before this is msync'ed */
+	int64_t sync_ns;
+	int64_t last_sync;
+	pthread_mutex_t lock;
+};
+
+/*
+ * Start a log on fd, which must be open read/write. sync_ms is the msync()
+ * period, 0 leaves write-back to the kernel until close.
+ */
+int binlog_open(struct binlog *log, int fd, int64_t start_ns, long sync_ms);
+int binlog_append(struct binlog *log, int64_t timestamp, uint32_t channel,
+		  int32_t value);
+void binlog_close(struct binlog *log);
+
+/* Read side: maps a complete log file read-only. */
+struct binlog_file {
+	const struct binlog_header *hdr;
+	const struct binlog_record *rec;
+	uint64_t count;
+	size_t size;
+};
+
+int binlog_map(struct binlog_file *file, const char *path);
+void binlog_unmap(struct binlog_file *file);
+
+#endif
@@ -0,0 +1,265 @@
+/*
+ * Batched reads of sysfs channel attributes, pread and io_uring backends.
+ *
+ * The io_uring backend talks to the kernel through the raw syscalls so no
+ * extra library is needed on the target.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "chan_reader.h"
+
+static int uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned int to_submit,
+		       unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+		       NULL, 0);
+}
+
+static void uring_unmap(struct chan_uring *u)
+{
+	if (u->sqes)
+		munmap(u->sqes, u->sqes_size);
+
+	if (u->cq_ring && u->cq_ring != u->sq_ring)
+		munmap(u->cq_ring, u->cq_ring_size);
+
+	if (u->sq_ring)
+		munmap(u->sq_ring, u->sq_ring_size);
+
+	if (u->fd >= 0)
+		close(u->fd);
+
+	memset(u, 0, sizeof(*u));
+	u->fd = -1;
+}
+
+static int uring_init(struct chan_uring *u)
+{
+	struct io_uring_params p;
+	unsigned char *sq, *cq;
+	int ret;
+
+	memset(&p, 0, sizeof(p));
+	u->fd = uring_setup(CHAN_READER_MAX, &p);
+
+	if (u->fd < 0)
+		return -errno;
+
+	u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->cq_ring_size = p.cq_off.cqes +
+			  p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->cq_ring_size > u->sq_ring_size)
+			u->sq_ring_size = u->cq_ring_size;
+		u->cq_ring_size = u->sq_ring_size;
+	}
+
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+
+	if (u->sq_ring == MAP_FAILED) {
+		u->sq_ring = NULL;
+		goto err;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		u->cq_ring = u->sq_ring;
+	} else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE,
+				  MAP_SHARED | MAP_POPULATE, u->fd,
+				  IORING_OFF_CQ_RING);
+
+		if (u->cq_ring == MAP_FAILED) {
+			u->cq_ring = NULL;
+			goto err;
+		}
+	}
+
+	u->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+
+	if (u->sqes == MAP_FAILED) {
+		u->sqes = NULL;
+		goto err;
+	}
+
+	sq = u->sq_ring;
+	cq = u->cq_ring;
+	u->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+	u->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned int *)(sq + p.sq_off.array);
+	u->cq_head = (unsigned int *)(cq + p.cq_off.head);
+	u->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+	u->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	return 0;
+
+err:
+	ret = -errno;
+	uring_unmap(u);
+
+	return ret;
+}
+
+/*
+ * The kernel never writes to the SQEs, so each channel's read request is
+ * prepared once when it is added; a frame only has to publish the indexes
+ * in the SQ array.
+ */
+static void uring_prep(struct chan_reader *r, int i)
+{
+	struct io_uring_sqe *sqe = &r->uring.sqes[i];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = r->fd[i];
+	sqe->addr = (unsigned long)r->buf[i];
+	sqe->len = CHAN_READER_BUF;
+	sqe->off = 0;
+	sqe->user_data = i;
+}
+
+static int uring_read(struct chan_reader *r)
+{
+	struct chan_uring *u = &r->uring;
+	unsigned int tail, head, submit, done = 0;
+	struct io_uring_cqe *cqe;
+	int i, ret;
+
+	tail = *u->sq_tail;
+
+	for (i = 0; i < r->nchan; i++)
+		u->sq_array[(tail + i) & *u->sq_mask] = i;
+
+	__atomic_store_n(u->sq_tail, tail + r->nchan, __ATOMIC_RELEASE);
+	submit = r->nchan;
+
+	while (done < (unsigned int)r->nchan) {
+		head = *u->cq_head;
+
+		/* Submit and wait for the whole frame in one syscall */
+		if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+			ret = uring_enter(u->fd, submit, r->nchan - done,
+					  IORING_ENTER_GETEVENTS);
+			r->syscalls++;
+
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+
+				return -errno;
+			}
+
+			submit -= ret;
+			continue;
+		}
+
+		cqe = &u->cqes[head & *u->cq_mask];
+
+		if (cqe->user_data < (unsigned long long)r->nchan)
+			r->len[cqe->user_data] = cqe->res;
+
+		__atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+		done++;
+	}
+
+	return 0;
+}
+
+int chan_reader_parse_backend(const char *name,
+			      enum chan_reader_backend *backend)
+{
+	if (!strcmp(name, "pread"))
+		*backend = CHAN_READER_PREAD;
+	else if (!strcmp(name, "uring"))
+		*backend = CHAN_READER_URING;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+const char *chan_reader_backend_name(enum chan_reader_backend backend)
+{
+	return backend == CHAN_READER_URING ? "uring" : "pread";
+}
+
+int chan_reader_init(struct chan_reader *r, enum chan_reader_backend backend)
+{
+	memset(r, 0, sizeof(*r));
+	r->backend = backend;
+	r->uring.fd = -1;
+
+	if (backend == CHAN_READER_URING)
+		return uring_init(&r->uring);
+
+	return 0;
+}
+
+int chan_reader_add(struct chan_reader *r, int fd)
+{
+	int i = r->nchan;
+
+	if (i == CHAN_READER_MAX)
+		return -ENOSPC;
+
+	r->fd[i] = fd;
+	r->nchan++;
+
+	if (r->backend == CHAN_READER_URING)
+		uring_prep(r, i);
+
+	return i;
+}
+
+int chan_reader_read(struct chan_reader *r)
+{
+	int i, ret;
+
+	if (r->backend == CHAN_READER_URING) {
+		ret = uring_read(r);
+
+		if (ret < 0)
+			return ret;
+	} else {
+		for (i = 0; i < r->nchan; i++) {
+			r->len[i] = pread(r->fd[i], r->buf[i], CHAN_READER_BUF,
+					  0);
+
+			if (r->len[i] < 0)
+				r->len[i] = -errno;
+		}
+
+		r->syscalls += r->nchan;
+	}
+
+	for (i = 0; i < r->nchan; i++)
+		if (r->len[i] < 0)
+			return r->len[i];
+
+	return 0;
+}
+
+void chan_reader_close(struct chan_reader *r)
+{
+	if (r->backend == CHAN_READER_URING)
+		uring_unmap(&r->uring);
+
+	r->nchan = 0;
+}
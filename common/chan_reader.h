@@ -0,0 +1,70 @@
+/*
+ * Batched reads of sysfs channel attributes.
+ *
+ * Every registered fd is read from offset 0 (no lseek) into its own buffer.
+ * The pread backend issues one pread() per channel; the io_uring backend
+ * queues a read for every channel and submits them all with a single
+ * io_uring_enter(), so a whole frame costs one syscall.
+ */
+
+#ifndef CHAN_READER_H
+#define CHAN_READER_H
+
+#include <stddef.h>
+
+#define CHAN_READER_MAX		16
+#define CHAN_READER_BUF		32
+
+enum chan_reader_backend {
+	CHAN_READER_PREAD,
+	CHAN_READER_URING,
+};
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+struct chan_uring {
+	int fd;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+	unsigned int *sq_tail, *sq_mask, *sq_array;
+	unsigned int *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+
+struct chan_reader {
+	enum chan_reader_backend backend;
+	int nchan;
+	int fd[CHAN_READER_MAX];
+	char buf[CHAN_READER_MAX][CHAN_READER_BUF];
+	int len[CHAN_READER_MAX];	/* bytes read or -errno */
+	unsigned long syscalls;		/* issued so far, for statistics */
+	struct chan_uring uring;
+};
+
+/* "pread" or "uring" */
+int chan_reader_parse_backend(const char *name,
+			      enum chan_reader_backend *backend);
+
+const char *chan_reader_backend_name(enum chan_reader_backend backend);
+
+/*
+ * Returns -errno when the backend is not available (e.g. io_uring disabled
+ * by the kernel), the caller may retry with CHAN_READER_PREAD.
+ */
+int chan_reader_init(struct chan_reader *r, enum chan_reader_backend backend);
+
+/* Returns the channel index (>= 0) or -errno. The fd stays owned by the caller. */
+int chan_reader_add(struct chan_reader *r, int fd);
+
+/*
+ * Read every channel once. Results are in r->buf[i] / r->len[i]; returns 0
+ * or the first per-channel error.
+ */
+int chan_reader_read(struct chan_reader *r);
+
+void chan_reader_close(struct chan_reader *r);
+
+#endif
@@ -0,0 +1,453 @@
+/*
+ * Block-columnar compressed sensor log.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "colog.h"
+
+_Static_assert(sizeof(struct colog_header) == 64, "colog header layout");
+_Static_assert(sizeof(struct colog_channel) == 64, "colog channel layout");
+_Static_assert(sizeof(struct colog_block_header) == 80,
+	       "colog block header layout");
+
+static int64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Small magnitudes of either sign become small unsigned numbers */
+static inline uint64_t zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline size_t put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)v | 0x80;
+		v >>= 7;
+	}
+
+	p[n++] = (uint8_t)v;
+
+	return n;
+}
+
+/* Returns bytes consumed, 0 when the varint runs past end */
+static size_t get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	unsigned int shift = 0;
+	size_t n = 0;
+
+	*v = 0;
+
+	while (p + n < end && shift < 64) {
+		*v |= (uint64_t)(p[n] & 0x7f) << shift;
+
+		if (!(p[n++] & 0x80))
+			return n;
+
+		shift += 7;
+	}
+
+	return 0;
+}
+
+static int write_all(struct colog *log, struct iovec *iov, int cnt)
+{
+	ssize_t ret;
+
+	while (cnt) {
+		ret = writev(log->fd, iov, cnt);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		log->bytes += ret;
+
+		while (cnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			cnt--;
+		}
+
+		if (cnt) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+static int write_block(struct colog *log, struct colog_block_header *hdr,
+		       struct iovec *iov, int cnt)
+{
+	int i, ret;
+
+	hdr->magic = COLOG_BLOCK_MAGIC;
+	hdr->size = 0;
+
+	for (i = 1; i < cnt; i++)
+		hdr->size += iov[i].iov_len;
+
+	iov[0].iov_base = hdr;
+	iov[0].iov_len = sizeof(*hdr);
+
+	pthread_mutex_lock(&log->lock);
+	ret = log->error;
+
+	if (!ret) {
+		ret = write_all(log, iov, cnt);
+		log->error = ret;
+		log->blocks++;
+	}
+
+	pthread_mutex_unlock(&log->lock);
+
+	return ret;
+}
+
+static int flush_series(struct colog *log, int chan)
+{
+	struct colog_series *s = &log->series[chan];
+	struct iovec iov[2 + COLOG_VALUES];
+	struct colog_block_header hdr;
+	unsigned int v;
+	int ret;
+
+	if (!s->count)
+		return 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.type = COLOG_BLOCK_DATA;
+	hdr.channel = chan;
+	hdr.count = s->count;
+	hdr.nvals = s->desc.nvals;
+	hdr.first_ts = s->first_ts;
+	hdr.last_ts = s->prev_ts;
+	memcpy(hdr.min, s->min, sizeof(hdr.min));
+	memcpy(hdr.max, s->max, sizeof(hdr.max));
+
+	iov[1].iov_base = s->ts_col;
+	iov[1].iov_len = s->ts_len;
+
+	for (v = 0; v < s->desc.nvals; v++) {
+		iov[2 + v].iov_base = s->val_col[v];
+		iov[2 + v].iov_len = s->val_len[v];
+	}
+
+	ret = write_block(log, &hdr, iov, 2 + s->desc.nvals);
+
+	if (!ret)
+		s->bytes += sizeof(hdr) + hdr.size;
+
+	s->count = 0;
+	s->ts_len = 0;
+	memset(s->val_len, 0, sizeof(s->val_len));
+
+	return ret;
+}
+
+int colog_open(struct colog *log, int fd, int64_t start_ns)
+{
+	struct colog_header hdr;
+	struct iovec iov;
+	int ret;
+
+	memset(log, 0, sizeof(*log));
+	log->fd = fd;
+
+	if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+		return -errno;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, COLOG_MAGIC, sizeof(hdr.magic));
+	hdr.version = COLOG_VERSION;
+	hdr.block_samples = COLOG_BLOCK_SAMPLES;
+	hdr.start_ns = start_ns;
+	hdr.realtime_ns = clock_ns(CLOCK_REALTIME) -
+			  (clock_ns(CLOCK_MONOTONIC) - start_ns);
+
+	iov.iov_base = &hdr;
+	iov.iov_len = sizeof(hdr);
+	ret = write_all(log, &iov, 1);
+
+	if (ret < 0)
+		return ret;
+
+	pthread_mutex_init(&log->lock, NULL);
+
+	return 0;
+}
+
+int colog_add_channel(struct colog *log, const char *name, const char *unit,
+		      unsigned int nvals, unsigned int digits, int64_t scale)
+{
+	struct colog_block_header hdr;
+	struct colog_series *s;
+	struct iovec iov[2];
+	int chan, ret;
+
+	if (log->nchan >= COLOG_CHANNELS)
+		return -ENOSPC;
+
+	if (!nvals || nvals > COLOG_VALUES)
+		return -EINVAL;
+
+	chan = log->nchan;
+	s = &log->series[chan];
+	memset(s, 0, sizeof(*s));
+	snprintf(s->desc.name, sizeof(s->desc.name), "%s", name);
+	snprintf(s->desc.unit, sizeof(s->desc.unit), "%s", unit);
+	s->desc.nvals = nvals;
+	s->desc.digits = digits;
+	s->desc.scale = scale;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.type = COLOG_BLOCK_CHANNEL;
+	hdr.channel = chan;
+	hdr.nvals = nvals;
+	iov[1].iov_base = &s->desc;
+	iov[1].iov_len = sizeof(s->desc);
+	ret = write_block(log, &hdr, iov, 2);
+
+	if (ret < 0)
+		return ret;
+
+	log->nchan++;
+
+	return chan;
+}
+
+int colog_append(struct colog *log, int chan, int64_t timestamp,
+		 const int64_t *value)
+{
+	struct colog_series *s = &log->series[chan];
+	int64_t delta;
+	unsigned int v;
+
+	if (!s->count) {
+		s->first_ts = timestamp;
+		s->prev_ts = timestamp;
+		s->prev_delta = 0;
+		memset(s->prev, 0, sizeof(s->prev));
+
+		for (v = 0; v < s->desc.nvals; v++)
+			s->min[v] = s->max[v] = value[v];
+	} else {
+		delta = timestamp - s->prev_ts;
+		s->ts_len += put_varint(s->ts_col + s->ts_len,
+					zigzag(delta - s->prev_delta));
+		s->prev_delta = delta;
+		s->prev_ts = timestamp;
+	}
+
+	/* The first value of a block is a delta from 0 */
+	for (v = 0; v < s->desc.nvals; v++) {
+		s->val_len[v] += put_varint(s->val_col[v] + s->val_len[v],
+					    zigzag(value[v] - s->prev[v]));
+		s->prev[v] = value[v];
+
+		if (value[v] < s->min[v])
+			s->min[v] = value[v];
+
+		if (value[v] > s->max[v])
+			s->max[v] = value[v];
+	}
+
+	s->count++;
+	s->samples++;
+
+	if (s->count == COLOG_BLOCK_SAMPLES)
+		return flush_series(log, chan);
+
+	return 0;
+}
+
+int colog_flush(struct colog *log)
+{
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < log->nchan; i++)
+		if (flush_series(log, i) < 0 && !ret)
+			ret = log->error;
+
+	return ret;
+}
+
+int colog_close(struct colog *log)
+{
+	int ret;
+
+	ret = colog_flush(log);
+	pthread_mutex_destroy(&log->lock);
+
+	return ret;
+}
+
+int colog_map(struct colog_file *file, const char *path)
+{
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	memset(file, 0, sizeof(*file));
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	if ((size_t)st.st_size < sizeof(*file->hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return ret;
+
+	file->hdr = map;
+
+	if (memcmp(file->hdr->magic, COLOG_MAGIC, sizeof(COLOG_MAGIC)) ||
+	    file->hdr->version != COLOG_VERSION) {
+		munmap(map, st.st_size);
+		return -EINVAL;
+	}
+
+	file->map = map;
+	file->size = st.st_size;
+	file->offset = sizeof(*file->hdr);
+
+	return 0;
+}
+
+void colog_unmap(struct colog_file *file)
+{
+	if (file->map)
+		munmap((void *)file->map, file->size);
+
+	file->map = NULL;
+}
+
+static int decode_column(const uint8_t **p, const uint8_t *end,
+			 unsigned int count, int64_t *out, size_t stride)
+{
+	int64_t prev = 0;
+	unsigned int i;
+	uint64_t raw;
+	size_t n;
+
+	for (i = 0; i < count; i++) {
+		n = get_varint(*p, end, &raw);
+
+		if (!n)
+			return -EINVAL;
+
+		*p += n;
+		prev += unzigzag(raw);
+		out[i * stride] = prev;
+	}
+
+	return 0;
+}
+
+const struct colog_block_header *
+colog_next_block(struct colog_file *file,
+		 int64_t ts[COLOG_BLOCK_SAMPLES],
+		 int64_t val[COLOG_BLOCK_SAMPLES][COLOG_VALUES])
+{
+	const struct colog_block_header *hdr;
+	const uint8_t *p, *end;
+	int64_t delta = 0;
+	unsigned int i, v;
+	uint64_t raw;
+	size_t n;
+
+	while (file->offset + sizeof(*hdr) <= file->size) {
+		hdr = (const struct colog_block_header *)(file->map +
+							  file->offset);
+
+		if (hdr->magic != COLOG_BLOCK_MAGIC ||
+		    hdr->size > file->size - file->offset - sizeof(*hdr))
+			return NULL;
+
+		p = (const uint8_t *)(hdr + 1);
+		end = p + hdr->size;
+		file->offset += sizeof(*hdr) + hdr->size;
+
+		if (hdr->type == COLOG_BLOCK_CHANNEL) {
+			if (hdr->channel != file->nchan ||
+			    hdr->channel >= COLOG_CHANNELS ||
+			    hdr->size != sizeof(struct colog_channel))
+				return NULL;
+
+			memcpy(&file->chan[file->nchan++], p,
+			       sizeof(struct colog_channel));
+			continue;
+		}
+
+		if (hdr->type != COLOG_BLOCK_DATA ||
+		    hdr->channel >= file->nchan || !hdr->count ||
+		    hdr->count > COLOG_BLOCK_SAMPLES ||
+		    hdr->nvals != file->chan[hdr->channel].nvals ||
+		    hdr->nvals > COLOG_VALUES)
+			return NULL;
+
+		ts[0] = hdr->first_ts;
+
+		for (i = 1; i < hdr->count; i++) {
+			n = get_varint(p, end, &raw);
+
+			if (!n)
+				return NULL;
+
+			p += n;
+			delta += unzigzag(raw);
+			ts[i] = ts[i - 1] + delta;
+		}
+
+		for (v = 0; v < hdr->nvals; v++)
+			if (decode_column(&p, end, hdr->count, &val[0][v],
+					  COLOG_VALUES) < 0)
+				return NULL;
+
+		return hdr;
+	}
+
+	return NULL;
+}
@@ -0,0 +1,140 @@
+/*
+ * Block-columnar compressed sensor log.
+ *
+ * Samples are grouped per channel into blocks of up to COLOG_BLOCK_SAMPLES.
+ * Inside a block every column is stored on its own: the timestamps as
+ * delta-of-delta, each value column as the delta to the previous sample,
+ * all zigzag + LEB128 varint encoded. A regularly sampled, slowly changing
+ * channel therefore costs a couple of bytes per sample instead of a text
+ * line. Every block starts with a fixed header holding the channel, the
+ * first/last timestamp and the per-column min/max, so a reader can skip
+ * blocks by time or range without decoding them.
+ *
+ * Values are fixed point integers: a channel stores raw integers that are
+ * multiplied by scale to get the value with digits decimal places (scale 1
+ * for HTU21D milli-units, the IIO scale in nano-units per count for IMU raw
+ * counts).
+ *
+ * The writer is streaming and uses constant memory: each sample is encoded
+ * straight into its channel's fixed column buffers, and a full block is
+ * written out with one writev(). Each channel has a single writer thread,
+ * different channels may be appended from different threads.
+ */
+
+#ifndef COLOG_H
+#define COLOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define COLOG_MAGIC		"SENSCOL"
+#define COLOG_VERSION		1
+#define COLOG_BLOCK_MAGIC	0x4b4c4243	/* "CBLK" */
+#define COLOG_CHANNELS		8
+#define COLOG_VALUES		3
+#define COLOG_BLOCK_SAMPLES	256
+#define COLOG_NAME_LEN		24
+#define COLOG_UNIT_LEN		16
+#define COLOG_VARINT_MAX	10
+
+enum colog_block_type {
+	COLOG_BLOCK_CHANNEL,	/* payload: struct colog_channel */
+	COLOG_BLOCK_DATA,	/* payload: timestamp column, value columns */
+};
+
+struct colog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t block_samples;
+	int64_t start_ns;		/* CLOCK_MONOTONIC when logging started */
+	int64_t realtime_ns;		/* CLOCK_REALTIME at the same instant */
+	uint8_t reserved[32];
+};
+
+struct colog_channel {
+	char name[COLOG_NAME_LEN];
+	char unit[COLOG_UNIT_LEN];
+	uint32_t nvals;			/* value columns */
+	uint32_t digits;		/* decimal places of raw * scale */
+	int64_t scale;
+	uint8_t reserved[8];
+};
+
+struct colog_block_header {
+	uint32_t magic;
+	uint16_t type;
+	uint16_t channel;
+	uint32_t size;			/* payload bytes after the header */
+	uint16_t count;			/* samples */
+	uint16_t nvals;
+	int64_t first_ts, last_ts;	/* CLOCK_MONOTONIC, ns */
+	int64_t min[COLOG_VALUES];	/* raw, per value column */
+	int64_t max[COLOG_VALUES];
+};
+
+/* One channel's block being built */
+struct colog_series {
+	struct colog_channel desc;
+	unsigned int count;		/* in the current block */
+	uint64_t samples;		/* appended in total */
+	uint64_t bytes;			/* data blocks written */
+	int64_t first_ts, prev_ts, prev_delta;
+	int64_t prev[COLOG_VALUES];
+	int64_t min[COLOG_VALUES], max[COLOG_VALUES];
+	size_t ts_len, val_len[COLOG_VALUES];
+	uint8_t ts_col[COLOG_BLOCK_SAMPLES * COLOG_VARINT_MAX];
+	uint8_t val_col[COLOG_VALUES][COLOG_BLOCK_SAMPLES * COLOG_VARINT_MAX];
+};
+
+struct colog {
+	int fd;
+	unsigned int nchan;
+	pthread_mutex_t lock;		/* serialises block writes */
+	int error;
+	uint64_t bytes, blocks;		/* written, under lock */
+	struct colog_series series[COLOG_CHANNELS];
+};
+
+/* Start a log on fd (truncated). The writer is ~80 KB, don't put it on a stack. */
+int colog_open(struct colog *log, int fd, int64_t start_ns);
+
+/* Returns the channel index or -errno; call before appending to it. */
+int colog_add_channel(struct colog *log, const char *name, const char *unit,
+		      unsigned int nvals, unsigned int digits, int64_t scale);
+
+/* value holds the channel's nvals raw integers. */
+int colog_append(struct colog *log, int chan, int64_t timestamp,
+		 const int64_t *value);
+
+/* Writes out all partial blocks. */
+int colog_flush(struct colog *log);
+
+/* Flushes and stops, the fd stays open. */
+int colog_close(struct colog *log);
+
+/* Read side: maps a log file read-only and walks its blocks. */
+struct colog_file {
+	const struct colog_header *hdr;
+	const uint8_t *map;
+	size_t size;
+	size_t offset;			/* next block */
+	unsigned int nchan;
+	struct colog_channel chan[COLOG_CHANNELS];
+};
+
+int colog_map(struct colog_file *file, const char *path);
+void colog_unmap(struct colog_file *file);
+
+/*
+ * Next data block: decodes its timestamps and values (ts[count],
+ * val[count][COLOG_VALUES]) and returns the header. Channel blocks are
+ * consumed on the way. Returns NULL at the end of the log or at the first
+ * truncated or corrupt block.
+ */
+const struct colog_block_header *
+colog_next_block(struct colog_file *file,
+		 int64_t ts[COLOG_BLOCK_SAMPLES],
+		 int64_t val[COLOG_BLOCK_SAMPLES][COLOG_VALUES]);
+
+#endif
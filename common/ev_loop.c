@@ -0,0 +1,170 @@
+/*
+ * Single-threaded event loop on epoll.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "ev_loop.h"
+
+int ev_loop_init(struct ev_loop *loop)
+{
+	int i;
+
+	memset(loop, 0, sizeof(*loop));
+
+	for (i = 0; i < EV_MAX_SOURCES; i++)
+		loop->src[i].fd = -1;
+
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (loop->epfd < 0)
+		return -errno;
+
+	return 0;
+}
+
+void ev_loop_close(struct ev_loop *loop)
+{
+	int i;
+
+	for (i = 0; i < EV_MAX_SOURCES; i++)
+		if (loop->src[i].fd >= 0)
+			ev_remove(loop, i);
+
+	close(loop->epfd);
+	loop->epfd = -1;
+}
+
+static int add_source(struct ev_loop *loop, int fd, bool is_timer, ev_cb cb,
+		      void *arg)
+{
+	struct epoll_event ev;
+	int id;
+
+	for (id = 0; id < EV_MAX_SOURCES; id++)
+		if (loop->src[id].fd < 0)
+			break;
+
+	if (id == EV_MAX_SOURCES)
+		return -ENOSPC;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u32 = id;
+
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return -errno;
+
+	loop->src[id].fd = fd;
+	loop->src[id].is_timer = is_timer;
+	loop->src[id].cb = cb;
+	loop->src[id].arg = arg;
+
+	return id;
+}
+
+int ev_add_fd(struct ev_loop *loop, int fd, ev_cb cb, void *arg)
+{
+	return add_source(loop, fd, false, cb, arg);
+}
+
+int ev_add_timer(struct ev_loop *loop, long period_ms, ev_cb cb, void *arg)
+{
+	int fd, id, ret;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+	if (fd < 0)
+		return -errno;
+
+	id = add_source(loop, fd, true, cb, arg);
+
+	if (id < 0) {
+		close(fd);
+		return id;
+	}
+
+	ret = ev_timer_set(loop, id, period_ms);
+
+	if (ret < 0) {
+		ev_remove(loop, id);
+		return ret;
+	}
+
+	return id;
+}
+
+int ev_timer_set(struct ev_loop *loop, int id, long period_ms)
+{
+	struct itimerspec its;
+
+	if (id < 0 || id >= EV_MAX_SOURCES || !loop->src[id].is_timer)
+		return -EINVAL;
+
+	its.it_interval.tv_sec = period_ms / 1000;
+	its.it_interval.tv_nsec = period_ms % 1000 * 1000000;
+	its.it_value = its.it_interval;
+
+	if (timerfd_settime(loop->src[id].fd, 0, &its, NULL) < 0)
+		return -errno;
+
+	return 0;
+}
+
+void ev_remove(struct ev_loop *loop, int id)
+{
+	if (id < 0 || id >= EV_MAX_SOURCES || loop->src[id].fd < 0)
+		return;
+
+	epoll_ctl(loop->epfd, EPOLL_CTL_DEL, loop->src[id].fd, NULL);
+
+	if (loop->src[id].is_timer)
+		close(loop->src[id].fd);
+
+	loop->src[id].fd = -1;
+}
+
+int ev_loop_run(struct ev_loop *loop)
+{
+	struct epoll_event events[EV_MAX_SOURCES];
+	struct ev_source *src;
+	uint64_t count;
+	int i, n;
+
+	loop->stop = false;
+
+	while (!loop->stop) {
+		n = epoll_wait(loop->epfd, events, EV_MAX_SOURCES, -1);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		for (i = 0; i < n && !loop->stop; i++) {
+			src = &loop->src[events[i].data.u32];
+
+			/* Removed by an earlier callback in this batch */
+			if (src->fd < 0)
+				continue;
+
+			if (src->is_timer) {
+				if (read(src->fd, &count, sizeof(count)) !=
+				    sizeof(count))
+					continue;
+			} else {
+				count = events[i].events;
+			}
+
+			src->cb(loop, events[i].data.u32, count, src->arg);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,61 @@
+/*
+ * Single-threaded event loop on epoll.
+ *
+ * Every periodic channel is a timerfd and every input (stdin, signals, ...)
+ * is a plain fd registered in the same epoll instance, so any number of
+ * sensors can be sampled from one thread without locks.
+ */
+
+#ifndef EV_LOOP_H
+#define EV_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define EV_MAX_SOURCES	32
+
+struct ev_loop;
+
+/*
+ * For timers count is the number of expirations since the last callback
+ * (more than 1 means periods were overrun), for fds it is the epoll event
+ * mask.
+ */
+typedef void (*ev_cb)(struct ev_loop *loop, int id, uint64_t count,
+		      void *arg);
+
+struct ev_source {
+	int fd;			/* -1 when the slot is free */
+	bool is_timer;
+	ev_cb cb;
+	void *arg;
+};
+
+struct ev_loop {
+	int epfd;
+	bool stop;
+	struct ev_source src[EV_MAX_SOURCES];
+};
+
+int ev_loop_init(struct ev_loop *loop);
+void ev_loop_close(struct ev_loop *loop);
+
+/* Both return the source id (>= 0) or -errno. */
+int ev_add_fd(struct ev_loop *loop, int fd, ev_cb cb, void *arg);
+int ev_add_timer(struct ev_loop *loop, long period_ms, ev_cb cb, void *arg);
+
+/* Re-arm a timer with a new period, 0 disarms it. */
+int ev_timer_set(struct ev_loop *loop, int id, long period_ms);
+
+/* Unregisters a source, timers are also closed. */
+void ev_remove(struct ev_loop *loop, int id);
+
+/* Dispatch events until ev_loop_stop() is called. */
+int ev_loop_run(struct ev_loop *loop);
+
+static inline void ev_loop_stop(struct ev_loop *loop)
+{
+	loop->stop = true;
+}
+
+#endif
@@ -0,0 +1,595 @@
+/*
+ * IIO triggered-buffer capture.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "iio_buffer.h"
+#include "iio_parse.h"
+#include "sysfs.h"
+
+#define IIO_SYSFS_DIR	"/sys/bus/iio/devices"
+#define IIO_DEV_DIR	"/dev"
+#define HRTIMER_DIR	"/sys/kernel/config/iio/triggers/hrtimer"
+
+/* Give a new configfs trigger this long to show up under IIO_SYSFS_DIR */
+#define TRIGGER_WAIT_MS	100
+
+/* snprintf() into a path buffer, -ENAMETOOLONG instead of truncating */
+__attribute__((format(printf, 3, 4)))
+static int format_path(char *path, size_t len, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(path, len, fmt, ap);
+	va_end(ap);
+
+	return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+/* Same through sysfs_path(), for paths that go to the simulated tree */
+static int map_path(char *buf, size_t len, const char *path)
+{
+	int n = sysfs_path(buf, len, path);
+
+	return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+/* Attributes below the device directory, e.g. "buffer/enable" */
+static int dev_read_int(const struct iio_buffer *buf, const char *attr,
+			int *val)
+{
+	char path[PATH_MAX];
+	int ret;
+
+	ret = format_path(path, sizeof(path), "%s/%s", buf->dev_dir, attr);
+
+	return ret < 0 ? ret : sysfs_read_int(path, val);
+}
+
+static int dev_write_int(const struct iio_buffer *buf, const char *attr,
+			 int val)
+{
+	char path[PATH_MAX];
+	int ret;
+
+	ret = format_path(path, sizeof(path), "%s/%s", buf->dev_dir, attr);
+
+	return ret < 0 ? ret : sysfs_write_int(path, val);
+}
+
+static int dev_write_str(const struct iio_buffer *buf, const char *attr,
+			 const char *val)
+{
+	char path[PATH_MAX];
+	int ret;
+
+	ret = format_path(path, sizeof(path), "%s/%s", buf->dev_dir, attr);
+
+	return ret < 0 ? ret : sysfs_write_str(path, val);
+}
+
+static bool chan_wanted(const char *name, const char *const *chans)
+{
+	if (!chans)
+		return true;
+
+	for (; *chans; chans++)
+		if (!strcmp(name, *chans))
+			return true;
+
+	return false;
+}
+
+/*
+ * The _type attribute looks like "le:s16/16>>0", or "be:u12/16X2>>4" for
+ * channels with a repeat count.
+ */
+static int parse_type(struct iio_channel *ch, const char *type)
+{
+	char endian, sign;
+	int ret;
+
+	ch->repeat = 1;
+	ret = sscanf(type, "%ce:%c%u/%uX%u>>%u", &endian, &sign, &ch->bits,
+		     &ch->storage, &ch->repeat, &ch->shift);
+
+	if (ret != 6) {
+		ch->repeat = 1;
+		ret = sscanf(type, "%ce:%c%u/%u>>%u", &endian, &sign,
+			     &ch->bits, &ch->storage, &ch->shift);
+
+		if (ret != 5)
+			return -EINVAL;
+	}
+
+	if (ch->storage == 0 || ch->storage % 8 || ch->storage > 64 ||
+	    ch->bits > ch->storage)
+		return -EINVAL;
+
+	ch->is_be = (endian == 'b');
+	ch->is_signed = (sign == 's' || sign == 'S');
+
+	return 0;
+}
+
+/*
+ * Scale and offset are either per channel (in_accel_x_scale) or shared by
+ * the channel type (in_accel_scale).
+ */
+static int64_t read_chan_attr(const char *dev_dir, const char *chan,
+			      const char *attr, int64_t def)
+{
+	char path[PATH_MAX], shared[IIO_NAME_MAX], val[64];
+	int64_t fixed;
+	char *sep;
+	int len;
+
+	if (format_path(path, sizeof(path), "%s/%s_%s", dev_dir, chan,
+			attr) < 0)
+		return def;
+
+	len = sysfs_read_str(path, val, sizeof(val));
+
+	if (len > 0 && !iio_parse_fixed(val, len, IIO_NANO_DIGITS, &fixed))
+		return fixed;
+
+	if (format_path(shared, sizeof(shared), "%s", chan) < 0)
+		return def;
+
+	sep = strrchr(shared, '_');
+
+	if (sep && sep != strchr(shared, '_')) {
+		*sep = '\0';
+
+		if (format_path(path, sizeof(path), "%s/%s_%s", dev_dir,
+				shared, attr) < 0)
+			return def;
+
+		len = sysfs_read_str(path, val, sizeof(val));
+
+		if (len > 0 &&
+		    !iio_parse_fixed(val, len, IIO_NANO_DIGITS, &fixed))
+			return fixed;
+	}
+
+	return def;
+}
+
+static int cmp_index(const void *a, const void *b)
+{
+	const struct iio_channel *ca = a, *cb = b;
+
+	return ca->index - cb->index;
+}
+
+static int scan_channels(struct iio_buffer *buf, const char *const *chans)
+{
+	char dir_path[PATH_MAX], path[PATH_MAX], type[32];
+	struct iio_channel *ch;
+	struct dirent *ent;
+	size_t len, bytes, largest = 0, offset = 0;
+	DIR *dir;
+	int i, en, ret;
+
+	ret = format_path(dir_path, sizeof(dir_path), "%s/scan_elements",
+			  buf->dev_dir);
+
+	if (ret < 0)
+		return ret;
+
+	dir = opendir(dir_path);
+
+	if (!dir)
+		return -errno;
+
+	buf->nchan = 0;
+
+	while ((ent = readdir(dir))) {
+		len = strlen(ent->d_name);
+
+		/* The name must fit the channel and its longest attribute */
+		if (len < 4 || strcmp(ent->d_name + len - 3, "_en") ||
+		    len >= IIO_NAME_MAX ||
+		    format_path(path, sizeof(path), "%s/%s_index", dir_path,
+				ent->d_name) < 0)
+			continue;
+
+		format_path(path, sizeof(path), "%s/%s", dir_path,
+			    ent->d_name);
+		ent->d_name[len - 3] = '\0';
+		ret = sysfs_write_int(path, chan_wanted(ent->d_name, chans));
+
+		if (ret < 0 && chan_wanted(ent->d_name, chans)) {
+			closedir(dir);
+			return ret;
+		}
+
+		ret = sysfs_read_int(path, &en);
+
+		if (ret < 0 || !en)
+			continue;
+
+		if (buf->nchan == IIO_MAX_CHANNELS) {
+			closedir(dir);
+			return -E2BIG;
+		}
+
+		ch = &buf->chan[buf->nchan];
+		memset(ch, 0, sizeof(*ch));
+		memcpy(ch->name, ent->d_name, len - 2);
+
+		format_path(path, sizeof(path), "%s/%s_index", dir_path,
+			    ch->name);
+		ret = sysfs_read_int(path, &ch->index);
+
+		if (ret < 0) {
+			closedir(dir);
+			return ret;
+		}
+
+		format_path(path, sizeof(path), "%s/%s_type", dir_path,
+			    ch->name);
+		ret = sysfs_read_str(path, type, sizeof(type));
+
+		if (ret < 0 || parse_type(ch, type) < 0) {
+			closedir(dir);
+			return ret < 0 ? ret : -EINVAL;
+		}
+
+		ch->scale = read_chan_attr(buf->dev_dir, ch->name, "scale",
+					   1000000000);
+		ch->offset = read_chan_attr(buf->dev_dir, ch->name, "offset", 0);
+		buf->nchan++;
+	}
+
+	closedir(dir);
+
+	if (!buf->nchan)
+		return -ENODATA;
+
+	/* Same packing rules as iio_compute_scan_bytes() in the kernel */
+	qsort(buf->chan, buf->nchan, sizeof(buf->chan[0]), cmp_index);
+
+	for (i = 0; i < buf->nchan; i++) {
+		bytes = buf->chan[i].storage / 8 * buf->chan[i].repeat;
+
+		if (bytes > largest)
+			largest = bytes;
+
+		offset = (offset + bytes - 1) / bytes * bytes;
+		buf->chan[i].location = offset;
+		offset += bytes;
+	}
+
+	buf->scan_size = (offset + largest - 1) / largest * largest;
+
+	return 0;
+}
+
+int iio_buffer_open(struct iio_buffer *buf, const char *dev_name,
+		    const char *const *chans, unsigned int batch)
+{
+	char path[PATH_MAX];
+	int ret, length;
+
+	memset(buf, 0, sizeof(*buf));
+	buf->fd = -1;
+	buf->batch = batch ? batch : 1;
+
+	if (format_path(buf->dev_name, sizeof(buf->dev_name), "%s",
+			dev_name) < 0 ||
+	    format_path(path, sizeof(path), "%s/%s", IIO_SYSFS_DIR,
+			dev_name) < 0 ||
+	    map_path(buf->dev_dir, sizeof(buf->dev_dir), path) < 0)
+		return -ENAMETOOLONG;
+
+	/* Scan elements can only be changed while the buffer is disabled */
+	ret = dev_write_int(buf, "buffer/enable", 0);
+
+	if (ret < 0)
+		return ret;
+
+	ret = scan_channels(buf, chans);
+
+	if (ret < 0)
+		return ret;
+
+	buf->data = malloc(buf->scan_size * buf->batch);
+
+	if (!buf->data)
+		return -ENOMEM;
+
+	/* Leave room for a few batches in the kernel fifo */
+	if (dev_read_int(buf, "buffer/length", &length) == 0 &&
+	    length < (int)buf->batch * 4)
+		dev_write_int(buf, "buffer/length", buf->batch * 4);
+
+	/* dev_name fits IIO_NAME_MAX, so this can't be truncated */
+	format_path(path, sizeof(path), "%s/%s", IIO_DEV_DIR, dev_name);
+	buf->fd = sysfs_open(path, O_RDONLY);
+
+	if (buf->fd < 0) {
+		ret = buf->fd;
+		free(buf->data);
+		buf->data = NULL;
+
+		return ret;
+	}
+
+	ret = dev_write_int(buf, "buffer/enable", 1);
+
+	if (ret < 0) {
+		close(buf->fd);
+		buf->fd = -1;
+		free(buf->data);
+		buf->data = NULL;
+
+		return ret;
+	}
+
+	return 0;
+}
+
+int iio_buffer_set_watermark(struct iio_buffer *buf, unsigned int frames)
+{
+	int ret, max;
+
+	if (!frames || frames > buf->batch)
+		return -EINVAL;
+
+	ret = dev_write_int(buf, "buffer/enable", 0);
+
+	if (ret < 0)
+		return ret;
+
+	/* The kernel rejects a watermark larger than the buffer length */
+	ret = dev_write_int(buf, "buffer/length", frames * 4);
+
+	if (ret < 0)
+		return ret;
+
+	ret = dev_write_int(buf, "buffer/watermark", frames);
+
+	if (ret < 0)
+		return ret;
+
+	buf->watermark = frames;
+	buf->hwfifo_watermark = 0;
+
+	/*
+	 * Drivers with a hardware FIFO pick up the new watermark through
+	 * hwfifo_set_watermark(). Some expose it read-only, others let it be
+	 * written directly; either way report what the FIFO ended up with.
+	 */
+	if (dev_read_int(buf, "buffer/hwfifo_watermark_max", &max) < 0 ||
+	    max <= 0)
+		max = frames;
+
+	dev_write_int(buf, "buffer/hwfifo_watermark",
+		      (int)frames < max ? (int)frames : max);
+
+	if (dev_read_int(buf, "buffer/hwfifo_watermark", &ret) == 0 &&
+	    ret > 0)
+		buf->hwfifo_watermark = ret;
+
+	return dev_write_int(buf, "buffer/enable", 1);
+}
+
+int iio_buffer_wait(struct iio_buffer *buf, int timeout_ms)
+{
+	struct pollfd pfd = {
+		.fd = buf->fd,
+		.events = POLLIN,
+	};
+	int ret;
+
+	ret = poll(&pfd, 1, timeout_ms);
+
+	if (ret < 0)
+		return -errno;
+
+	if (ret && (pfd.revents & (POLLERR | POLLHUP)))
+		return -EIO;
+
+	return ret;
+}
+
+ssize_t iio_buffer_read(struct iio_buffer *buf)
+{
+	ssize_t ret;
+
+	ret = read(buf->fd, buf->data, buf->scan_size * buf->batch);
+
+	if (ret < 0)
+		return -errno;
+
+	return ret / buf->scan_size;
+}
+
+int iio_buffer_set_trigger(struct iio_buffer *buf, const char *name)
+{
+	int ret;
+
+	ret = dev_write_int(buf, "buffer/enable", 0);
+
+	if (ret < 0)
+		return ret;
+
+	ret = dev_write_str(buf, "trigger/current_trigger", name);
+
+	if (ret < 0)
+		return ret;
+
+	buf->triggered = true;
+
+	/* Older kernels have no such attribute and always use realtime */
+	dev_write_str(buf, "current_timestamp_clock", "monotonic");
+
+	return dev_write_int(buf, "buffer/enable", 1);
+}
+
+void iio_buffer_close(struct iio_buffer *buf)
+{
+	dev_write_int(buf, "buffer/enable", 0);
+
+	if (buf->triggered) {
+		/* An empty write never reaches the driver, "\n" detaches */
+		dev_write_str(buf, "trigger/current_trigger", "\n");
+		buf->triggered = false;
+	}
+
+	if (buf->fd >= 0)
+		close(buf->fd);
+
+	free(buf->data);
+	buf->fd = -1;
+	buf->data = NULL;
+}
+
+const struct iio_channel *iio_buffer_channel(const struct iio_buffer *buf,
+					     const char *name)
+{
+	int i;
+
+	for (i = 0; i < buf->nchan; i++)
+		if (!strcmp(buf->chan[i].name, name))
+			return &buf->chan[i];
+
+	return NULL;
+}
+
+int64_t iio_channel_raw(const struct iio_channel *ch, const void *frame)
+{
+	const unsigned char *p = (const unsigned char *)frame + ch->location;
+	unsigned int i, bytes = ch->storage / 8;
+	uint64_t val = 0;
+
+	if (ch->is_be)
+		for (i = 0; i < bytes; i++)
+			val = (val << 8) | p[i];
+	else
+		for (i = bytes; i > 0; i--)
+			val = (val << 8) | p[i - 1];
+
+	val >>= ch->shift;
+
+	if (ch->bits < 64) {
+		val &= (UINT64_C(1) << ch->bits) - 1;
+
+		if (ch->is_signed && (val & (UINT64_C(1) << (ch->bits - 1))))
+			val |= ~((UINT64_C(1) << ch->bits) - 1);
+	}
+
+	return (int64_t)val;
+}
+
+/* sysfs directory of the trigger called name, 0 or -ENOENT */
+static int find_trigger(const char *name, char *dir_path, size_t len)
+{
+	char dir_name[PATH_MAX], path[PATH_MAX], val[IIO_NAME_MAX];
+	struct dirent *ent;
+	int ret = -ENOENT;
+	DIR *dir;
+
+	if (map_path(dir_name, sizeof(dir_name), IIO_SYSFS_DIR) < 0)
+		return -ENAMETOOLONG;
+
+	dir = opendir(dir_name);
+
+	if (!dir)
+		return -errno;
+
+	while ((ent = readdir(dir))) {
+		if (strncmp(ent->d_name, "trigger", 7))
+			continue;
+
+		if (format_path(path, sizeof(path), "%s/%s/name", dir_name,
+				ent->d_name) < 0 ||
+		    sysfs_read_str(path, val, sizeof(val)) < 0 ||
+		    strcmp(val, name))
+			continue;
+
+		ret = format_path(dir_path, len, "%s/%s", dir_name,
+				  ent->d_name);
+		break;
+	}
+
+	closedir(dir);
+
+	return ret;
+}
+
+int iio_trigger_hrtimer(const char *name, unsigned int freq_hz,
+			bool *created)
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	int ret, waited;
+
+	*created = false;
+	ret = find_trigger(name, dir, sizeof(dir));
+
+	if (ret == -ENOENT) {
+		if (format_path(path, sizeof(path), HRTIMER_DIR "/%s",
+				name) < 0 ||
+		    map_path(dir, sizeof(dir), path) < 0)
+			return -ENAMETOOLONG;
+
+		if (mkdir(dir, 0755) < 0)
+			return -errno;
+
+		*created = true;
+
+		/* The kernel registers it in mkdir(), a simulation may lag */
+		for (waited = 0; waited < TRIGGER_WAIT_MS; waited++) {
+			ret = find_trigger(name, dir, sizeof(dir));
+
+			if (ret != -ENOENT)
+				break;
+
+			usleep(1000);
+		}
+	}
+
+	if (ret < 0) {
+		if (*created)
+			iio_trigger_remove(name);
+
+		*created = false;
+		return ret;
+	}
+
+	ret = format_path(path, sizeof(path), "%s/sampling_frequency", dir);
+
+	if (ret == 0)
+		ret = sysfs_write_int(path, freq_hz);
+
+	if (ret < 0 && *created) {
+		iio_trigger_remove(name);
+		*created = false;
+	}
+
+	return ret;
+}
+
+int iio_trigger_remove(const char *name)
+{
+	char path[PATH_MAX], dir[PATH_MAX];
+
+	if (format_path(path, sizeof(path), HRTIMER_DIR "/%s", name) < 0 ||
+	    map_path(dir, sizeof(dir), path) < 0)
+		return -ENAMETOOLONG;
+
+	return rmdir(dir) < 0 ? -errno : 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * IIO triggered-buffer capture.
+ *
+ * Enables the requested channels under scan_elements/, works out the packed
+ * scan layout from their _index/_type descriptors, turns on buffer/enable
+ * and reads whole batches of binary scan frames from /dev/iio:deviceN with
+ * a single read().
+ *
+ * Devices that share one trigger sample at the same instants. An hrtimer
+ * trigger is created through configfs (iio-trig-hrtimer), and the devices
+ * are attached to it with iio_buffer_set_trigger().
+ */
+
+#ifndef IIO_BUFFER_H
+#define IIO_BUFFER_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define IIO_MAX_CHANNELS	16
+#define IIO_NAME_MAX		64
+
+struct iio_channel {
+	char name[IIO_NAME_MAX];	/* e.g. "in_accel_x" */
+	int index;			/* position in the scan */
+	bool is_signed;
+	bool is_be;
+	unsigned int bits;		/* valid bits */
+	unsigned int storage;		/* storage bits */
+	unsigned int shift;
+	unsigned int repeat;
+	unsigned int location;		/* byte offset inside one frame */
+	int64_t scale;			/* nano-units per count */
+	int64_t offset;			/* counts, scaled by 10^9 */
+};
+
+struct iio_buffer {
+	char dev_name[IIO_NAME_MAX];	/* e.g. "iio:device1" */
+	char dev_dir[PATH_MAX];		/* sysfs directory of the device */
+	int fd;				/* /dev/iio:deviceN */
+	struct iio_channel chan[IIO_MAX_CHANNELS];
+	int nchan;
+	size_t scan_size;		/* bytes per frame */
+	unsigned int batch;		/* frames per read() */
+	unsigned int watermark;		/* frames before poll() wakes us */
+	unsigned int hwfifo_watermark;	/* 0 when the driver doesn't expose it */
+	bool triggered;			/* current_trigger set by us */
+	unsigned char *data;
+};
+
+/*
+ * Set up buffered capture on dev_name. chans is a NULL terminated list of
+ * channel prefixes to enable ("in_accel_x", ...); pass NULL to use every
+ * scan element the device exposes.
+ */
+int iio_buffer_open(struct iio_buffer *buf, const char *dev_name,
+		    const char *const *chans, unsigned int batch);
+
+/*
+ * Program buffer/length and buffer/watermark (and the hardware FIFO
+ * watermark where the driver exposes one) so that poll() only reports the
+ * buffer readable once 'frames' frames are queued. The buffer is briefly
+ * disabled while the attributes are changed. frames must not exceed the
+ * batch size given to iio_buffer_open().
+ */
+int iio_buffer_set_watermark(struct iio_buffer *buf, unsigned int frames);
+
+/*
+ * Block until the watermark is reached. Returns 1 when data is ready, 0 on
+ * timeout and -errno on failure.
+ */
+int iio_buffer_wait(struct iio_buffer *buf, int timeout_ms);
+
+/* Returns the number of frames read into buf->data, or -errno. */
+ssize_t iio_buffer_read(struct iio_buffer *buf);
+
+/*
+ * Attach the device to the trigger named name and switch its in_timestamp
+ * channel to CLOCK_MONOTONIC. The buffer is briefly disabled while doing
+ * so. Timestamps from different devices can then be compared directly.
+ */
+int iio_buffer_set_trigger(struct iio_buffer *buf, const char *name);
+
+/* Detaches the trigger set by iio_buffer_set_trigger() too. */
+void iio_buffer_close(struct iio_buffer *buf);
+
+/*
+ * Look up the trigger called name, or create it as an hrtimer trigger
+ * under configfs when there is none. Either way its sampling_frequency is
+ * set to freq_hz. *created tells whether iio_trigger_remove() should
+ * delete it again.
+ */
+int iio_trigger_hrtimer(const char *name, unsigned int freq_hz,
+			bool *created);
+
+int iio_trigger_remove(const char *name);
+
+/* Channel lookup by prefix, returns NULL when the channel is not enabled. */
+const struct iio_channel *iio_buffer_channel(const struct iio_buffer *buf,
+					     const char *name);
+
+static inline const void *iio_buffer_frame(const struct iio_buffer *buf,
+					   unsigned int i)
+{
+	return buf->data + (size_t)i * buf->scan_size;
+}
+
+/* Raw value of a channel in one frame, shifted, masked and sign extended. */
+int64_t iio_channel_raw(const struct iio_channel *ch, const void *frame);
+
+/* (raw + offset) * scale in nano-units, without floating point. */
+static inline int64_t iio_channel_value(const struct iio_channel *ch,
+					const void *frame)
+{
+	return iio_channel_raw(ch, frame) * ch->scale +
+	       ch->offset * ch->scale / 1000000000;
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * IIO events.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <linux/iio/types.h>
+
+#include "iio_event.h"
+#include "sysfs.h"
+
+#define IIO_SYSFS_DIR	"/sys/bus/iio/devices"
+#define IIO_DEV_DIR	"/dev"
+
+int iio_event_set(const char *dev_name, const char *attr, const char *val)
+{
+	char path[PATH_MAX], mapped[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%s/events/%s", IIO_SYSFS_DIR,
+		 dev_name, attr);
+	sysfs_path(mapped, sizeof(mapped), path);
+
+	return sysfs_write_str(mapped, val);
+}
+
+int iio_event_open(const char *dev_name)
+{
+	char path[PATH_MAX];
+	int fd, event_fd, ret;
+
+	snprintf(path, sizeof(path), "%s/%s", IIO_DEV_DIR, dev_name);
+	fd = sysfs_open(path, O_RDONLY | O_NONBLOCK);
+
+	if (fd < 0)
+		return fd;
+
+	/* The event fd stays valid after the character device is closed */
+	ret = ioctl(fd, IIO_GET_EVENT_FD_IOCTL, &event_fd);
+	ret = ret < 0 ? -errno : event_fd;
+	close(fd);
+
+	return ret;
+}
+
+int iio_event_read(int fd, struct iio_event_data *ev)
+{
+	ssize_t ret;
+
+	do {
+		ret = read(fd, ev, sizeof(*ev));
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0)
+		return -errno;
+
+	return ret == sizeof(*ev) ? 0 : -EIO;
+}
+
+static const char *chan_type_name(unsigned int type)
+{
+	switch (type) {
+	case IIO_ACCEL:
+		return "accel";
+	case IIO_ANGL_VEL:
+		return "anglvel";
+	case IIO_TEMP:
+		return "temp";
+	case IIO_HUMIDITYRELATIVE:
+		return "humidityrelative";
+	default:
+		return "chan";
+	}
+}
+
+static const char *const ev_type_name[] = {
+	[IIO_EV_TYPE_THRESH] = "thresh",
+	[IIO_EV_TYPE_MAG] = "mag",
+	[IIO_EV_TYPE_ROC] = "roc",
+	[IIO_EV_TYPE_THRESH_ADAPTIVE] = "thresh_adaptive",
+	[IIO_EV_TYPE_MAG_ADAPTIVE] = "mag_adaptive",
+	[IIO_EV_TYPE_CHANGE] = "change",
+};
+
+static const char *const ev_dir_name[] = {
+	[IIO_EV_DIR_EITHER] = "either",
+	[IIO_EV_DIR_RISING] = "rising",
+	[IIO_EV_DIR_FALLING] = "falling",
+	[IIO_EV_DIR_NONE] = "none",
+};
+
+int iio_event_describe(char *buf, size_t len, uint64_t id)
+{
+	unsigned int type = IIO_EVENT_CODE_EXTRACT_TYPE(id);
+	unsigned int dir = IIO_EVENT_CODE_EXTRACT_DIR(id);
+	unsigned int mod = IIO_EVENT_CODE_EXTRACT_MODIFIER(id);
+	const char *axis = "";
+
+	if (mod == IIO_MOD_X)
+		axis = " x";
+	else if (mod == IIO_MOD_Y)
+		axis = " y";
+	else if (mod == IIO_MOD_Z)
+		axis = " z";
+
+	return snprintf(buf, len, "%s%s %s %s",
+			chan_type_name(IIO_EVENT_CODE_EXTRACT_CHAN_TYPE(id)),
+			axis,
+			type < sizeof(ev_type_name) / sizeof(ev_type_name[0]) &&
+			ev_type_name[type] ? ev_type_name[type] : "event",
+			dir < sizeof(ev_dir_name) / sizeof(ev_dir_name[0]) &&
+			ev_dir_name[dir] ? ev_dir_name[dir] : "");
+}
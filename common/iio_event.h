@@ -0,0 +1,33 @@
+/*
+ * IIO events.
+ *
+ * Threshold and motion events are configured through the attributes under
+ * the device's events/ directory and delivered as struct iio_event_data
+ * records on an anonymous fd that IIO_GET_EVENT_FD_IOCTL returns for
+ * /dev/iio:deviceN. The fd can be blocked on or watched by epoll, so an
+ * alarm needs no polling of the sample attributes.
+ */
+
+#ifndef IIO_EVENT_H
+#define IIO_EVENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/iio/events.h>
+
+/* Writes events/<attr> of dev_name, -ENOENT when the driver lacks it. */
+int iio_event_set(const char *dev_name, const char *attr, const char *val);
+
+/*
+ * Event fd of dev_name ("iio:device1"), -errno when the driver has no
+ * events or the character device isn't one (-ENOTTY).
+ */
+int iio_event_open(const char *dev_name);
+
+/* Blocks for one event, 0 on success or -errno. */
+int iio_event_read(int fd, struct iio_event_data *ev);
+
+/* "accel x thresh either", returns the snprintf() result. */
+int iio_event_describe(char *buf, size_t len, uint64_t id);
+
+#endif
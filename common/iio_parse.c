@@ -0,0 +1,156 @@
+/*
+ * Allocation-free parsers for IIO sysfs values.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "iio_parse.h"
+
+static const int64_t pow10_tbl[] = {
+	1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+	100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+	1000000000000LL, 10000000000000LL, 100000000000000LL,
+	1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+	1000000000000000000LL,
+};
+
+#define POW10_MAX	(sizeof(pow10_tbl) / sizeof(pow10_tbl[0]) - 1)
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+/* Only whitespace may follow the number, a NUL ends the buffer early */
+static int check_tail(const char *p, const char *end)
+{
+	for (; p < end && *p; p++)
+		if (!is_space(*p))
+			return -EINVAL;
+
+	return 0;
+}
+
+static const char *skip_sign(const char *p, const char *end, bool *neg)
+{
+	while (p < end && is_space(*p))
+		p++;
+
+	*neg = false;
+
+	if (p < end && (*p == '-' || *p == '+'))
+		*neg = (*p++ == '-');
+
+	return p;
+}
+
+int iio_parse_int(const char *buf, size_t len, int32_t *val)
+{
+	const char *p, *end = buf + len;
+	int64_t v = 0;
+	bool neg;
+
+	p = skip_sign(buf, end, &neg);
+
+	if (p == end || !is_digit(*p))
+		return -EINVAL;
+
+	for (; p < end && is_digit(*p); p++) {
+		v = v * 10 + (*p - '0');
+
+		if (v > (int64_t)INT32_MAX + neg)
+			return -ERANGE;
+	}
+
+	if (check_tail(p, end))
+		return -EINVAL;
+
+	*val = neg ? -v : v;
+
+	return 0;
+}
+
+int iio_parse_fixed(const char *buf, size_t len, unsigned int digits,
+		    int64_t *val)
+{
+	const char *p, *end = buf + len;
+	int64_t ip = 0, fp = 0, scale;
+	unsigned int n = 0;
+	bool neg, any = false;
+
+	if (digits > POW10_MAX)
+		return -EINVAL;
+
+	scale = pow10_tbl[digits];
+	p = skip_sign(buf, end, &neg);
+
+	for (; p < end && is_digit(*p); p++) {
+		ip = ip * 10 + (*p - '0');
+		any = true;
+
+		if (ip > INT64_MAX / scale)
+			return -ERANGE;
+	}
+
+	if (p < end && *p == '.') {
+		for (p++; p < end && is_digit(*p); p++, any = true) {
+			if (n < digits) {
+				fp = fp * 10 + (*p - '0');
+				n++;
+			} else if (n == digits) {
+				/* First dropped digit decides the rounding */
+				fp += (*p >= '5');
+				n++;
+			}
+		}
+	}
+
+	if (!any || check_tail(p, end))
+		return -EINVAL;
+
+	if (n < digits)
+		fp *= pow10_tbl[digits - n];
+
+	*val = ip * scale + fp;
+
+	if (neg)
+		*val = -*val;
+
+	return 0;
+}
+
+int iio_format_fixed(char *buf, size_t len, int64_t val, unsigned int digits,
+		     unsigned int out_digits)
+{
+	uint64_t u, div;
+	bool neg = val < 0;
+
+	if (digits > POW10_MAX || out_digits > POW10_MAX)
+		return -EINVAL;
+
+	u = neg ? -(uint64_t)val : (uint64_t)val;
+
+	if (out_digits < digits) {
+		div = pow10_tbl[digits - out_digits];
+		u = (u + div / 2) / div;
+	} else {
+		u *= pow10_tbl[out_digits - digits];
+	}
+
+	if (!out_digits)
+		return snprintf(buf, len, "%s%llu", neg && u ? "-" : "",
+				(unsigned long long)u);
+
+	div = pow10_tbl[out_digits];
+
+	return snprintf(buf, len, "%s%llu.%0*llu", neg && u ? "-" : "",
+			(unsigned long long)(u / div), (int)out_digits,
+			(unsigned long long)(u % div));
+}
@@ -0,0 +1,38 @@
+/*
+ * Allocation-free parsers for IIO sysfs values.
+ *
+ * sysfs attributes are short ASCII strings: plain integers for raw and
+ * _input channels ("-1234\n") and fixed-point numbers for scales and
+ * offsets ("0.000598550" for IIO_VAL_INT_PLUS_NANO, "0.061" for
+ * IIO_VAL_INT_PLUS_MICRO). These helpers decode them straight into scaled
+ * integers without locale lookups or floating point, and work on the
+ * unterminated buffer a read() returns.
+ */
+
+#ifndef IIO_PARSE_H
+#define IIO_PARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IIO_MICRO_DIGITS	6
+#define IIO_NANO_DIGITS		9
+
+/* Decimal integer, optional sign, surrounding whitespace allowed. */
+int iio_parse_int(const char *buf, size_t len, int32_t *val);
+
+/*
+ * Fixed-point number scaled by 10^digits, so "0.000598550" with digits = 9
+ * gives 598550. Extra fractional digits are rounded.
+ */
+int iio_parse_fixed(const char *buf, size_t len, unsigned int digits,
+		    int64_t *val);
+
+/*
+ * Render val / 10^digits with out_digits decimals (rounded or zero padded).
+ * Returns the snprintf() result.
+ */
+int iio_format_fixed(char *buf, size_t len, int64_t val, unsigned int digits,
+		     unsigned int out_digits);
+
+#endif
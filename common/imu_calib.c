@@ -0,0 +1,405 @@
+/*
+ * IMU calibration: gyro bias, accelerometer offset and 3x3 correction.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "imu_calib.h"
+
+#define POSE_COS	0.906		/* cos(25 deg) */
+#define PIVOT_MIN	1e-9
+
+typedef float calib_v4 __attribute__((vector_size(16)));
+typedef int calib_i4 __attribute__((vector_size(16)));
+
+/* Lanes 0-3 pick from a, 4-7 from b */
+#if defined(__clang__)
+#define SHUF(a, b, i, j, k, l)	__builtin_shufflevector(a, b, i, j, k, l)
+#else
+#define SHUF(a, b, i, j, k, l) \
+	__builtin_shuffle(a, b, (calib_i4){ i, j, k, l })
+#endif
+
+void imu_calib_init(struct imu_calib *c)
+{
+	int i;
+
+	memset(c, 0, sizeof(*c));
+
+	for (i = 0; i < 3; i++)
+		c->accel_matrix[i][i] = 1.0f;
+}
+
+void imu_calib_stats_reset(struct imu_calib_stats *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+void imu_calib_stats_add(struct imu_calib_stats *s, const float v[3])
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		s->sum[i] += v[i];
+		s->sumsq[i] += (double)v[i] * v[i];
+	}
+
+	s->n++;
+}
+
+void imu_calib_stats_mean(const struct imu_calib_stats *s, double mean[3])
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+		mean[i] = s->n ? s->sum[i] / s->n : 0.0;
+}
+
+double imu_calib_stats_noise(const struct imu_calib_stats *s)
+{
+	double mean, var, worst = 0.0;
+	int i;
+
+	if (s->n < 2)
+		return 0.0;
+
+	for (i = 0; i < 3; i++) {
+		mean = s->sum[i] / s->n;
+		var = (s->sumsq[i] - s->n * mean * mean) / (s->n - 1);
+
+		if (var > worst)
+			worst = var;
+	}
+
+	return sqrt(worst);
+}
+
+int imu_calib_pose(const double mean[3])
+{
+	double norm = sqrt(mean[0] * mean[0] + mean[1] * mean[1] +
+			   mean[2] * mean[2]);
+	int i, axis = 0;
+
+	for (i = 1; i < 3; i++)
+		if (fabs(mean[i]) > fabs(mean[axis]))
+			axis = i;
+
+	if (norm == 0.0 || fabs(mean[axis]) < POSE_COS * norm)
+		return -1;
+
+	return axis * 2 + (mean[axis] < 0);
+}
+
+/* Solves a x = b in place for 4 unknowns and 3 right-hand sides */
+static int solve4(double a[4][4], double b[4][3])
+{
+	double f, tmp;
+	int i, j, k, p;
+
+	for (i = 0; i < 4; i++) {
+		p = i;
+
+		for (j = i + 1; j < 4; j++)
+			if (fabs(a[j][i]) > fabs(a[p][i]))
+				p = j;
+
+		if (fabs(a[p][i]) < PIVOT_MIN)
+			return -EINVAL;
+
+		for (k = 0; k < 4; k++) {
+			tmp = a[i][k];
+			a[i][k] = a[p][k];
+			a[p][k] = tmp;
+		}
+
+		for (k = 0; k < 3; k++) {
+			tmp = b[i][k];
+			b[i][k] = b[p][k];
+			b[p][k] = tmp;
+		}
+
+		for (j = 0; j < 4; j++) {
+			if (j == i)
+				continue;
+
+			f = a[j][i] / a[i][i];
+
+			for (k = i; k < 4; k++)
+				a[j][k] -= f * a[i][k];
+
+			for (k = 0; k < 3; k++)
+				b[j][k] -= f * b[i][k];
+		}
+	}
+
+	for (i = 0; i < 4; i++)
+		for (k = 0; k < 3; k++)
+			b[i][k] /= a[i][i];
+
+	return 0;
+}
+
+/*
+ * Least squares for ref = m * mean + t over all poses, then offset =
+ * -m^-1 t so that corrected = m * (value - offset).
+ */
+int imu_calib_fit_accel(struct imu_calib *c, const double (*means)[3],
+			const int *poses, unsigned int n, double *rms)
+{
+	double ata[4][4] = { { 0 } }, atb[4][3] = { { 0 } }, x[4], ref[3];
+	double m[3][3], inv[3][3], det, err = 0.0, d;
+	unsigned int i;
+	int j, k;
+
+	if (n < 4)
+		return -EINVAL;
+
+	for (i = 0; i < n; i++) {
+		memcpy(x, means[i], sizeof(means[i]));
+		x[3] = 1.0;
+		memset(ref, 0, sizeof(ref));
+		ref[poses[i] / 2] = poses[i] % 2 ? -IMU_CALIB_GRAVITY :
+						   IMU_CALIB_GRAVITY;
+
+		for (j = 0; j < 4; j++) {
+			for (k = 0; k < 4; k++)
+				ata[j][k] += x[j] * x[k];
+
+			for (k = 0; k < 3; k++)
+				atb[j][k] += x[j] * ref[k];
+		}
+	}
+
+	if (solve4(ata, atb) < 0)
+		return -EINVAL;
+
+	/* atb[j][k] is now m[k][j], atb[3][k] is t[k] */
+	for (j = 0; j < 3; j++)
+		for (k = 0; k < 3; k++)
+			m[k][j] = atb[j][k];
+
+	inv[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	inv[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+	inv[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	inv[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	inv[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+	inv[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	inv[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	inv[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+	inv[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+	det = m[0][0] * inv[0][0] + m[0][1] * inv[1][0] + m[0][2] * inv[2][0];
+
+	if (fabs(det) < PIVOT_MIN)
+		return -EINVAL;
+
+	for (j = 0; j < 3; j++) {
+		c->accel_offset[j] = -(inv[j][0] * atb[3][0] +
+				       inv[j][1] * atb[3][1] +
+				       inv[j][2] * atb[3][2]) / det;
+
+		for (k = 0; k < 3; k++)
+			c->accel_matrix[j][k] = m[j][k];
+	}
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < 3; j++) {
+			d = atb[3][j] - (poses[i] / 2 != j ? 0.0 :
+					 poses[i] % 2 ? -IMU_CALIB_GRAVITY :
+							IMU_CALIB_GRAVITY);
+
+			for (k = 0; k < 3; k++)
+				d += m[j][k] * means[i][k];
+
+			err += d * d;
+		}
+	}
+
+	*rms = sqrt(err / n);
+
+	return 0;
+}
+
+static void print_row(FILE *f, const char *key, const float *v, int n)
+{
+	int i;
+
+	fprintf(f, "%s", key);
+
+	for (i = 0; i < n; i++)
+		fprintf(f, " %.9g", v[i]);
+
+	fprintf(f, "\n");
+}
+
+int imu_calib_save(const struct imu_calib *c, const char *path)
+{
+	char tmp[4096];
+	FILE *f;
+	int ret = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	f = fopen(tmp, "w");
+
+	if (!f)
+		return -errno;
+
+	fprintf(f, "# corrected accel = accel_matrix * (accel - accel_offset)\n"
+		   "# corrected gyro = gyro - gyro_bias\n");
+	print_row(f, "gyro_bias", c->gyro_bias, 3);
+	print_row(f, "accel_offset", c->accel_offset, 3);
+	print_row(f, "accel_matrix", &c->accel_matrix[0][0], 9);
+
+	if (fflush(f) || fsync(fileno(f)) < 0)
+		ret = -errno;
+
+	if (fclose(f) && !ret)
+		ret = -errno;
+
+	if (!ret && rename(tmp, path) < 0)
+		ret = -errno;
+
+	if (ret)
+		unlink(tmp);
+
+	return ret;
+}
+
+int imu_calib_load(struct imu_calib *c, const char *path)
+{
+	char line[512], key[32];
+	float *dst, v[9];
+	int n, want, ret = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+
+	if (!f)
+		return -errno;
+
+	imu_calib_init(c);
+
+	while (!ret && fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+
+		n = sscanf(line, "%31s %f %f %f %f %f %f %f %f %f", key, &v[0],
+			   &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7],
+			   &v[8]) - 1;
+
+		if (!strcmp(key, "gyro_bias")) {
+			dst = c->gyro_bias;
+			want = 3;
+		} else if (!strcmp(key, "accel_offset")) {
+			dst = c->accel_offset;
+			want = 3;
+		} else if (!strcmp(key, "accel_matrix")) {
+			dst = &c->accel_matrix[0][0];
+			want = 9;
+		} else {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (n != want)
+			ret = -EINVAL;
+		else
+			memcpy(dst, v, want * sizeof(float));
+	}
+
+	fclose(f);
+
+	return ret;
+}
+
+void imu_calib_accel(const struct imu_calib *c, struct imu_correction *corr)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		corr->t[i] = 0.0f;
+
+		for (j = 0; j < 3; j++) {
+			corr->m[i][j] = c->accel_matrix[i][j];
+			corr->t[i] -= c->accel_matrix[i][j] *
+				      c->accel_offset[j];
+		}
+	}
+}
+
+void imu_calib_gyro(const struct imu_calib *c, struct imu_correction *corr)
+{
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++)
+			corr->m[i][j] = i == j;
+
+		corr->t[i] = -c->gyro_bias[i];
+	}
+}
+
+static inline calib_v4 load4(const float *p)
+{
+	calib_v4 v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static inline void store4(float *p, calib_v4 v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/*
+ * Four interleaved frames are three vectors (x0 y0 z0 x1, y1 z1 x2 y2,
+ * z2 x3 y3 z3). They are transposed to x, y and z vectors, mapped with
+ * broadcast coefficients and interleaved back.
+ */
+void imu_correct(const struct imu_correction *corr, float (*xyz)[3],
+		 unsigned int n)
+{
+	calib_v4 p0, p1, p2, x, y, z, ox, oy, oz, a, b;
+	const float (*m)[3] = corr->m;
+	float *p = &xyz[0][0], v[3];
+	unsigned int i;
+	int k;
+
+	for (i = 0; i + 4 <= n; i += 4, p += 12) {
+		p0 = load4(p);
+		p1 = load4(p + 4);
+		p2 = load4(p + 8);
+
+		a = SHUF(p0, p1, 0, 3, 6, 0);
+		x = SHUF(a, p2, 0, 1, 2, 5);
+		a = SHUF(p0, p1, 1, 4, 7, 0);
+		y = SHUF(a, p2, 0, 1, 2, 6);
+		a = SHUF(p0, p1, 2, 5, 0, 0);
+		z = SHUF(a, p2, 0, 1, 4, 7);
+
+		ox = x * m[0][0] + y * m[0][1] + z * m[0][2] + corr->t[0];
+		oy = x * m[1][0] + y * m[1][1] + z * m[1][2] + corr->t[1];
+		oz = x * m[2][0] + y * m[2][1] + z * m[2][2] + corr->t[2];
+
+		a = SHUF(ox, oy, 0, 4, 1, 5);
+		store4(p, SHUF(a, oz, 0, 1, 4, 2));
+		a = SHUF(oy, oz, 1, 5, 0, 0);
+		b = SHUF(ox, oy, 2, 6, 0, 0);
+		store4(p + 4, SHUF(a, b, 0, 1, 4, 5));
+		b = SHUF(ox, oy, 3, 7, 0, 0);
+		store4(p + 8, SHUF(oz, b, 2, 4, 5, 3));
+	}
+
+	for (; i < n; i++) {
+		for (k = 0; k < 3; k++)
+			v[k] = m[k][0] * xyz[i][0] + m[k][1] * xyz[i][1] +
+			       m[k][2] * xyz[i][2] + corr->t[k];
+
+		memcpy(xyz[i], v, sizeof(v));
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * IMU calibration: gyro bias, accelerometer offset and 3x3 correction.
+ *
+ * The gyro bias is the mean rate over a window in which the board is kept
+ * still. The accelerometer is modelled as corrected = matrix * (value -
+ * offset), where the matrix takes out scale errors and axis misalignment.
+ * Both are fitted by least squares from the mean readings of at least four
+ * resting poses (normally the six faces up), each of which should read
+ * +-g on one axis and 0 on the others.
+ *
+ * Calibrations are stored as a small text file. For the hot path either
+ * sensor's calibration is reduced to an affine map, out = m * in + t, which
+ * imu_correct() applies to a batch of frames four at a time on 4-lane
+ * float vectors (SSE or NEON without intrinsics).
+ */
+
+#ifndef IMU_CALIB_H
+#define IMU_CALIB_H
+
+#include <stdint.h>
+
+#define IMU_CALIB_POSES		6
+#define IMU_CALIB_GRAVITY	9.80665
+
+struct imu_calib {
+	float gyro_bias[3];		/* rad/s */
+	float accel_offset[3];		/* m/s^2 */
+	float accel_matrix[3][3];
+};
+
+struct imu_correction {
+	float m[3][3];
+	float t[3];
+};
+
+/* Running per-axis mean and spread of a resting window */
+struct imu_calib_stats {
+	uint64_t n;
+	double sum[3], sumsq[3];
+};
+
+/* Identity: no bias, no offset, unit matrix */
+void imu_calib_init(struct imu_calib *c);
+
+void imu_calib_stats_reset(struct imu_calib_stats *s);
+void imu_calib_stats_add(struct imu_calib_stats *s, const float v[3]);
+void imu_calib_stats_mean(const struct imu_calib_stats *s, double mean[3]);
+
+/* Largest per-axis standard deviation, tells whether the board moved */
+double imu_calib_stats_noise(const struct imu_calib_stats *s);
+
+/*
+ * Face a resting accelerometer mean points up: 0..5 for +X, -X, +Y, -Y,
+ * +Z, -Z, or -1 when no axis is within 25 degrees of vertical.
+ */
+int imu_calib_pose(const double mean[3]);
+
+/*
+ * Fits accel_offset and accel_matrix from n pose means and their faces.
+ * *rms is the error left on the corrected poses, m/s^2. Returns -EINVAL
+ * when the poses don't span all three axes.
+ */
+int imu_calib_fit_accel(struct imu_calib *c, const double (*means)[3],
+			const int *poses, unsigned int n, double *rms);
+
+/* 0 or -errno; the file is replaced atomically */
+int imu_calib_save(const struct imu_calib *c, const char *path);
+
+/* 0, -errno, or -EINVAL for a malformed file */
+int imu_calib_load(struct imu_calib *c, const char *path);
+
+void imu_calib_accel(const struct imu_calib *c, struct imu_correction *corr);
+void imu_calib_gyro(const struct imu_calib *c, struct imu_correction *corr);
+
+/* In place, frames in the units the calibration was made in */
+void imu_correct(const struct imu_correction *corr, float (*xyz)[3],
+		 unsigned int n);
+
+#endif
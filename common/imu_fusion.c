@@ -0,0 +1,300 @@
+/*
+ * Accelerometer + gyroscope attitude estimation.
+ *
+ * Quaternions are kept in a 4-lane float vector so the products, the
+ * gradient and the integration step compile to SIMD instructions (SSE or
+ * NEON) without intrinsics.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#include "imu_fusion.h"
+
+#define COMP_TAU	0.5f
+#define MADGWICK_BETA	0.1f
+#define MAHONY_KP	1.0f
+#define MAHONY_KI	0.05f
+
+static inline imu_quat quat_mul(imu_quat a, imu_quat b)
+{
+	return a[0] * b +
+	       a[1] * (imu_quat){ -b[1], b[0], -b[3], b[2] } +
+	       a[2] * (imu_quat){ -b[2], b[3], b[0], -b[1] } +
+	       a[3] * (imu_quat){ -b[3], -b[2], b[1], b[0] };
+}
+
+static inline float quat_dot(imu_quat a, imu_quat b)
+{
+	imu_quat p = a * b;
+
+	return p[0] + p[1] + p[2] + p[3];
+}
+
+static inline imu_quat quat_normalize(imu_quat q)
+{
+	float n = quat_dot(q, q);
+
+	if (n <= 0.0f)
+		return (imu_quat){ 1.0f, 0.0f, 0.0f, 0.0f };
+
+	return q * (1.0f / sqrtf(n));
+}
+
+/* q' = 0.5 * q (x) (0, w) */
+static inline imu_quat quat_rate(imu_quat q, float wx, float wy, float wz)
+{
+	return 0.5f * quat_mul(q, (imu_quat){ 0.0f, wx, wy, wz });
+}
+
+static imu_quat quat_from_euler(float roll, float pitch, float yaw)
+{
+	float cr = cosf(roll / 2), sr = sinf(roll / 2);
+	float cp = cosf(pitch / 2), sp = sinf(pitch / 2);
+	float cy = cosf(yaw / 2), sy = sinf(yaw / 2);
+
+	return (imu_quat){
+		cr * cp * cy + sr * sp * sy,
+		sr * cp * cy - cr * sp * sy,
+		cr * sp * cy + sr * cp * sy,
+		cr * cp * sy - sr * sp * cy,
+	};
+}
+
+static void quat_to_euler(imu_quat q, float *roll, float *pitch, float *yaw)
+{
+	float sinp = 2.0f * (q[0] * q[2] - q[3] * q[1]);
+
+	if (sinp > 1.0f)
+		sinp = 1.0f;
+	else if (sinp < -1.0f)
+		sinp = -1.0f;
+
+	*roll = atan2f(2.0f * (q[0] * q[1] + q[2] * q[3]),
+		       1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]));
+	*pitch = asinf(sinp);
+	*yaw = atan2f(2.0f * (q[0] * q[3] + q[1] * q[2]),
+		      1.0f - 2.0f * (q[2] * q[2] + q[3] * q[3]));
+}
+
+static void accel_tilt(const float a[3], float *roll, float *pitch)
+{
+	*roll = atan2f(a[1], a[2]);
+	*pitch = atan2f(-a[0], sqrtf(a[1] * a[1] + a[2] * a[2]));
+}
+
+static float wrap_pi(float angle)
+{
+	if (angle > (float)M_PI)
+		angle -= 2.0f * (float)M_PI;
+	else if (angle < -(float)M_PI)
+		angle += 2.0f * (float)M_PI;
+
+	return angle;
+}
+
+static void complementary_step(struct imu_fusion *f, const float g[3],
+			       const float a[3], float dt)
+{
+	float alpha = f->tau / (f->tau + dt);
+	float roll, pitch, yaw, roll_acc, pitch_acc;
+
+	f->q = quat_normalize(f->q + quat_rate(f->q, g[0], g[1], g[2]) * dt);
+
+	if (!a)
+		return;
+
+	quat_to_euler(f->q, &roll, &pitch, &yaw);
+	accel_tilt(a, &roll_acc, &pitch_acc);
+	roll += (1.0f - alpha) * wrap_pi(roll_acc - roll);
+	pitch += (1.0f - alpha) * (pitch_acc - pitch);
+	f->q = quat_from_euler(roll, pitch, yaw);
+}
+
+static void madgwick_step(struct imu_fusion *f, const float g[3],
+			  const float a[3], float dt)
+{
+	imu_quat q = f->q, qdot, s;
+	float f1, f2, f3, n;
+
+	qdot = quat_rate(q, g[0], g[1], g[2]);
+
+	if (a) {
+		/* Objective function: estimated minus measured gravity */
+		f1 = 2.0f * (q[1] * q[3] - q[0] * q[2]) - a[0];
+		f2 = 2.0f * (q[0] * q[1] + q[2] * q[3]) - a[1];
+		f3 = 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]) - a[2];
+
+		/* Gradient J^T f */
+		s = f1 * (imu_quat){ -2 * q[2], 2 * q[3], -2 * q[0], 2 * q[1] } +
+		    f2 * (imu_quat){ 2 * q[1], 2 * q[0], 2 * q[3], 2 * q[2] } +
+		    f3 * (imu_quat){ 0.0f, -4 * q[1], -4 * q[2], 0.0f };
+		n = quat_dot(s, s);
+
+		if (n > 0.0f)
+			qdot -= f->beta * s * (1.0f / sqrtf(n));
+	}
+
+	f->q = quat_normalize(q + qdot * dt);
+}
+
+static void mahony_step(struct imu_fusion *f, const float g[3],
+			const float a[3], float dt)
+{
+	imu_quat q = f->q;
+	float v[3], e[3], w[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		w[i] = g[i];
+
+	if (a) {
+		/* Gravity direction predicted by q */
+		v[0] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+		v[1] = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+		v[2] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+		e[0] = a[1] * v[2] - a[2] * v[1];
+		e[1] = a[2] * v[0] - a[0] * v[2];
+		e[2] = a[0] * v[1] - a[1] * v[0];
+
+		for (i = 0; i < 3; i++) {
+			f->integral[i] += f->ki * e[i] * dt;
+			w[i] += f->kp * e[i] + f->integral[i];
+		}
+	}
+
+	f->q = quat_normalize(q + quat_rate(q, w[0], w[1], w[2]) * dt);
+}
+
+/* Returns 0 when no accelerometer sample has been posted yet */
+static int read_accel(struct imu_fusion *f, float a[3])
+{
+	unsigned int seq;
+	float n;
+
+	do {
+		seq = atomic_load_explicit(&f->accel_seq, memory_order_acquire);
+
+		if (!seq)
+			return 0;
+
+		memcpy(a, f->accel, sizeof(f->accel));
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+		 seq != atomic_load_explicit(&f->accel_seq,
+					     memory_order_relaxed));
+
+	n = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+
+	if (n <= 0.0f)
+		return 0;
+
+	a[0] /= n;
+	a[1] /= n;
+	a[2] /= n;
+
+	return 1;
+}
+
+static void publish(struct imu_fusion *f, int64_t timestamp)
+{
+	unsigned int seq;
+
+	seq = atomic_load_explicit(&f->seq, memory_order_relaxed);
+	atomic_store_explicit(&f->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(f->att.q, &f->q, sizeof(f->att.q));
+	quat_to_euler(f->q, &f->att.roll, &f->att.pitch, &f->att.yaw);
+	f->att.timestamp = timestamp;
+	f->att.updates = f->updates;
+
+	atomic_store_explicit(&f->seq, seq + 2, memory_order_release);
+}
+
+int imu_fusion_parse_algo(const char *name, enum imu_fusion_algo *algo)
+{
+	if (!strcmp(name, "complementary"))
+		*algo = IMU_FUSION_COMPLEMENTARY;
+	else if (!strcmp(name, "madgwick"))
+		*algo = IMU_FUSION_MADGWICK;
+	else if (!strcmp(name, "mahony"))
+		*algo = IMU_FUSION_MAHONY;
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+void imu_fusion_init(struct imu_fusion *f, enum imu_fusion_algo algo)
+{
+	memset(f, 0, sizeof(*f));
+	f->algo = algo;
+	f->q = (imu_quat){ 1.0f, 0.0f, 0.0f, 0.0f };
+	f->tau = COMP_TAU;
+	f->beta = MADGWICK_BETA;
+	f->kp = MAHONY_KP;
+	f->ki = MAHONY_KI;
+	atomic_init(&f->accel_seq, 0);
+	atomic_init(&f->seq, 0);
+	memcpy(f->att.q, &f->q, sizeof(f->att.q));
+}
+
+void imu_fusion_set_accel(struct imu_fusion *f, const float accel[3])
+{
+	unsigned int seq;
+
+	/* Odd while the sample is being written, 0 means none posted yet */
+	seq = atomic_load_explicit(&f->accel_seq, memory_order_relaxed);
+	atomic_store_explicit(&f->accel_seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy(f->accel, accel, sizeof(f->accel));
+	atomic_store_explicit(&f->accel_seq, seq + 2, memory_order_release);
+}
+
+void imu_fusion_update(struct imu_fusion *f, const float (*gyro)[3],
+		       unsigned int n, float dt, int64_t timestamp)
+{
+	float a[3], roll, pitch;
+	const float *accel;
+	unsigned int i;
+
+	accel = read_accel(f, a) ? a : NULL;
+
+	/* Start from the measured tilt instead of converging from level */
+	if (!f->updates && accel) {
+		accel_tilt(accel, &roll, &pitch);
+		f->q = quat_from_euler(roll, pitch, 0.0f);
+	}
+
+	for (i = 0; i < n; i++) {
+		switch (f->algo) {
+		case IMU_FUSION_COMPLEMENTARY:
+			complementary_step(f, gyro[i], accel, dt);
+			break;
+		case IMU_FUSION_MADGWICK:
+			madgwick_step(f, gyro[i], accel, dt);
+			break;
+		case IMU_FUSION_MAHONY:
+			mahony_step(f, gyro[i], accel, dt);
+			break;
+		}
+	}
+
+	f->updates += n;
+	publish(f, timestamp);
+}
+
+void imu_fusion_get(struct imu_fusion *f, struct imu_attitude *att)
+{
+	unsigned int seq;
+
+	do {
+		seq = atomic_load_explicit(&f->seq, memory_order_acquire);
+		memcpy(att, &f->att, sizeof(*att));
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+		 seq != atomic_load_explicit(&f->seq, memory_order_relaxed));
+}
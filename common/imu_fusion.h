@@ -0,0 +1,82 @@
+/*
+ * Accelerometer + gyroscope attitude estimation.
+ *
+ * The gyroscope stream drives the filter at its full output data rate; the
+ * accelerometer thread only posts its latest (batch averaged) gravity
+ * vector, which the filter uses as the tilt reference. Three filters are
+ * available:
+ *
+ *  - complementary: gyro integration blended towards the accelerometer
+ *    roll/pitch with a time constant
+ *  - madgwick: gradient descent correction (IMU variant)
+ *  - mahony: PI correction of the gyro rate from the gravity error
+ *
+ * Without a magnetometer yaw is only integrated from the gyro and drifts.
+ *
+ * The latest attitude is published through a sequence counter, so readers
+ * on any thread get a consistent snapshot without locks and never block
+ * the update.
+ */
+
+#ifndef IMU_FUSION_H
+#define IMU_FUSION_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define IMU_FUSION_CACHE_LINE	64
+
+typedef float imu_quat __attribute__((vector_size(16)));	/* w, x, y, z */
+
+enum imu_fusion_algo {
+	IMU_FUSION_COMPLEMENTARY,
+	IMU_FUSION_MADGWICK,
+	IMU_FUSION_MAHONY,
+};
+
+struct imu_attitude {
+	float q[4];			/* w, x, y, z */
+	float roll, pitch, yaw;		/* rad */
+	int64_t timestamp;		/* of the last gyro sample, ns */
+	uint64_t updates;		/* gyro samples integrated */
+};
+
+struct imu_fusion {
+	/* Owned by the thread calling imu_fusion_update() */
+	enum imu_fusion_algo algo;
+	imu_quat q;
+	float tau;			/* complementary time constant, s */
+	float beta;			/* Madgwick gain */
+	float kp, ki;			/* Mahony gains */
+	float integral[3];
+	uint64_t updates;
+
+	/* Latest accelerometer sample */
+	alignas(IMU_FUSION_CACHE_LINE) atomic_uint accel_seq;
+	float accel[3];
+
+	/* Published attitude */
+	alignas(IMU_FUSION_CACHE_LINE) atomic_uint seq;
+	struct imu_attitude att;
+};
+
+/* "complementary", "madgwick" or "mahony" */
+int imu_fusion_parse_algo(const char *name, enum imu_fusion_algo *algo);
+
+void imu_fusion_init(struct imu_fusion *f, enum imu_fusion_algo algo);
+
+/* Any thread; units don't matter, only the direction is used. */
+void imu_fusion_set_accel(struct imu_fusion *f, const float accel[3]);
+
+/*
+ * Integrate n gyro samples (rad/s) spaced dt seconds apart and publish the
+ * result. timestamp belongs to the last sample. Single thread only.
+ */
+void imu_fusion_update(struct imu_fusion *f, const float (*gyro)[3],
+		       unsigned int n, float dt, int64_t timestamp);
+
+/* Any thread, lock-free snapshot of the latest attitude. */
+void imu_fusion_get(struct imu_fusion *f, struct imu_attitude *att);
+
+#endif
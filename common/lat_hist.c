@@ -0,0 +1,117 @@
+/*
+ * Single-writer latency histograms.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "lat_hist.h"
+
+#define CALIBRATE_NS	10000000
+
+/* ns per lat_clock() tick */
+static double tick_ns = 1.0;
+
+static uint64_t monotonic(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void lat_clock_init(void)
+{
+	uint64_t t0, c0, t1, c1;
+
+	t0 = monotonic();
+	c0 = lat_clock();
+
+	do {
+		t1 = monotonic();
+	} while (t1 - t0 < CALIBRATE_NS);
+
+	c1 = lat_clock();
+
+	if (c1 > c0)
+		tick_ns = (double)(t1 - t0) / (c1 - c0);
+}
+
+uint64_t lat_ticks_to_ns(uint64_t ticks)
+{
+	return ticks * tick_ns + 0.5;
+}
+
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src)
+{
+	uint64_t max = __atomic_load_n(&src->max, __ATOMIC_RELAXED);
+	unsigned int i;
+
+	dst->samples += __atomic_load_n(&src->samples, __ATOMIC_RELAXED);
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		dst->count[i] += __atomic_load_n(&src->count[i],
+						 __ATOMIC_RELAXED);
+
+	if (max > dst->max)
+		dst->max = max;
+}
+
+uint64_t lat_hist_total(const struct lat_hist *h)
+{
+	uint64_t total = 0;
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++)
+		total += h->count[i];
+
+	return total;
+}
+
+/* Upper bound of a bucket */
+static uint64_t bucket_limit(unsigned int idx)
+{
+	unsigned int shift;
+
+	if (idx < (1 << LAT_SUB_BITS))
+		return idx;
+
+	shift = (idx >> LAT_SUB_BITS) - 1;
+
+	return ((uint64_t)((idx & ((1 << LAT_SUB_BITS) - 1)) |
+			   (1 << LAT_SUB_BITS)) + 1) << shift;
+}
+
+uint64_t lat_hist_percentile(const struct lat_hist *h, double pct)
+{
+	uint64_t seen = 0, want = lat_hist_total(h) * pct / 100.0;
+	unsigned int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		seen += h->count[i];
+
+		if (seen > want)
+			return bucket_limit(i) < h->max ? bucket_limit(i) :
+							  h->max;
+	}
+
+	return 0;
+}
+
+void lat_hist_print(const char *name, const struct lat_hist *h)
+{
+	uint64_t total = lat_hist_total(h);
+
+	if (h->samples > total)
+		printf("%s: %llu samples, %llu timed", name,
+		       (unsigned long long)h->samples,
+		       (unsigned long long)total);
+	else
+		printf("%s: %llu samples", name, (unsigned long long)total);
+
+	printf(", p50 %llu ns, p99 %llu ns, max %llu ns\n",
+	       (unsigned long long)lat_ticks_to_ns(lat_hist_percentile(h, 50)),
+	       (unsigned long long)lat_ticks_to_ns(lat_hist_percentile(h, 99)),
+	       (unsigned long long)lat_ticks_to_ns(h->max));
+}
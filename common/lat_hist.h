@@ -0,0 +1,132 @@
+/*
+ * Single-writer latency histograms.
+ *
+ * Buckets are log-linear, 4 linear sub-buckets per power of two, so any
+ * value is recorded within 25%. Every histogram has exactly one writer that
+ * updates it with relaxed plain stores, no locked read-modify-write, while
+ * other threads may merge a snapshot at any time. A snapshot can miss the
+ * sample being recorded, which does not matter for statistics.
+ *
+ * Per-sample timestamps come from lat_clock(), the raw cycle counter where
+ * the CPU has one (TSC on x86, CNTVCT_EL0 on arm64) and CLOCK_MONOTONIC
+ * elsewhere. Ticks are only converted to ns when reporting, so timing a
+ * stage costs one counter read and one bucket update.
+ *
+ * A counter read alone is 20 ns or more where it traps to a hypervisor, so
+ * a sample started with lat_hist_start() is only timed once every
+ * LAT_SAMPLE_EVERY samples. The others skip the clock and are only
+ * counted, which keeps the average cost per sample within a few ns.
+ */
+
+#ifndef LAT_HIST_H
+#define LAT_HIST_H
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LAT_SUB_BITS	2
+#define LAT_BUCKETS	256
+#define LAT_SAMPLE_EVERY	4	/* one sample in N is timed */
+
+struct lat_hist {
+	alignas(64) uint64_t count[LAT_BUCKETS];
+	uint64_t max;
+	uint64_t samples;		/* lat_hist_stage() calls, timed or not */
+	unsigned int seq;		/* lat_hist_start() calls */
+};
+
+static inline uint64_t lat_clock(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+
+	__asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+
+	return ticks;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline unsigned int lat_hist_bucket(uint64_t v)
+{
+	unsigned int msb, idx;
+
+	if (v < (1 << LAT_SUB_BITS))
+		return v;
+
+	msb = 63 - __builtin_clzll(v);
+	idx = ((msb - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+	      ((v >> (msb - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1));
+
+	return idx < LAT_BUCKETS ? idx : LAT_BUCKETS - 1;
+}
+
+/* Only ever called by the histogram's owner */
+static inline void lat_hist_record(struct lat_hist *h, uint64_t v)
+{
+	uint64_t *slot = &h->count[lat_hist_bucket(v)];
+
+	__atomic_store_n(slot, __atomic_load_n(slot, __ATOMIC_RELAXED) + 1,
+			 __ATOMIC_RELAXED);
+
+	if (v > h->max)
+		__atomic_store_n(&h->max, v, __ATOMIC_RELAXED);
+}
+
+/*
+ * Start of a sample, on the histogram of its first stage. Returns the
+ * clock for the samples that are timed and 0 for the others.
+ */
+static inline uint64_t lat_hist_start(struct lat_hist *h)
+{
+	return h->seq++ % LAT_SAMPLE_EVERY ? 0 : lat_clock();
+}
+
+/*
+ * Records now - *start and moves *start to now, for back to back stages.
+ * A stage of an untimed sample (*start == 0) is only counted.
+ */
+static inline void lat_hist_stage(struct lat_hist *h, uint64_t *start)
+{
+	uint64_t now;
+
+	__atomic_store_n(&h->samples,
+			 __atomic_load_n(&h->samples, __ATOMIC_RELAXED) + 1,
+			 __ATOMIC_RELAXED);
+
+	if (!*start)
+		return;
+
+	now = lat_clock();
+	lat_hist_record(h, now - *start);
+	*start = now;
+}
+
+/* Measures the lat_clock() rate, call once before converting ticks. */
+void lat_clock_init(void);
+
+uint64_t lat_ticks_to_ns(uint64_t ticks);
+
+/* Adds a snapshot of src to dst, safe while src is being written. */
+void lat_hist_merge(struct lat_hist *dst, const struct lat_hist *src);
+
+uint64_t lat_hist_total(const struct lat_hist *h);
+
+/* Upper bound of the bucket holding the pct-th percentile, at most max. */
+uint64_t lat_hist_percentile(const struct lat_hist *h, double pct);
+
+/*
+ * "<name>: N samples, p50 .. ns, p99 .. ns, max .. ns" for tick values,
+ * with the number of timed samples when only some were.
+ */
+void lat_hist_print(const char *name, const struct lat_hist *h);
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * Sparse time index for sensor logs.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log_index.h"
+
+_Static_assert(sizeof(struct log_index_header) == 64, "index header layout");
+_Static_assert(sizeof(struct log_index_entry) == 16, "index entry layout");
+
+static int64_t clock_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *data, size_t len)
+{
+	const char *buf = data;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static void flush_entries(struct log_index *idx)
+{
+	int ret;
+
+	if (!idx->len)
+		return;
+
+	ret = write_all(idx->fd, idx->buf, idx->len * sizeof(idx->buf[0]));
+
+	if (ret < 0 && !idx->error)
+		idx->error = ret;
+
+	idx->len = 0;
+}
+
+int log_index_open(struct log_index *idx, const char *path, int64_t start_ns,
+		   unsigned int stride)
+{
+	struct log_index_header hdr;
+	int ret;
+
+	memset(idx, 0, sizeof(*idx));
+	idx->stride = stride ? stride : LOG_INDEX_STRIDE;
+	idx->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (idx->fd < 0)
+		return -errno;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, LOG_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = LOG_INDEX_VERSION;
+	hdr.stride = idx->stride;
+	hdr.start_ns = start_ns;
+	hdr.realtime_ns = clock_ns(CLOCK_REALTIME) -
+			  (clock_ns(CLOCK_MONOTONIC) - start_ns);
+
+	ret = write_all(idx->fd, &hdr, sizeof(hdr));
+
+	if (ret < 0) {
+		close(idx->fd);
+		idx->fd = -1;
+	}
+
+	return ret;
+}
+
+void log_index_add(struct log_index *idx, int64_t timestamp, uint64_t offset)
+{
+	if (idx->records++ % idx->stride)
+		return;
+
+	idx->buf[idx->len].timestamp = timestamp;
+	idx->buf[idx->len].offset = offset;
+
+	if (++idx->len == LOG_INDEX_BUFFER)
+		flush_entries(idx);
+}
+
+int log_index_close(struct log_index *idx)
+{
+	if (idx->fd < 0)
+		return idx->error;
+
+	flush_entries(idx);
+	close(idx->fd);
+	idx->fd = -1;
+
+	return idx->error;
+}
+
+int log_index_path(char *buf, size_t len, const char *log_path)
+{
+	return snprintf(buf, len, "%s.idx", log_path);
+}
+
+int log_index_map(struct log_index_file *file, const char *path)
+{
+	const struct log_index_header *hdr;
+	struct stat st;
+	void *map;
+	int fd, ret;
+
+	memset(file, 0, sizeof(*file));
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	if ((size_t)st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return -EINVAL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return ret;
+
+	hdr = map;
+
+	if (memcmp(hdr->magic, LOG_INDEX_MAGIC, sizeof(LOG_INDEX_MAGIC)) ||
+	    hdr->version != LOG_INDEX_VERSION) {
+		munmap(map, st.st_size);
+		return -EINVAL;
+	}
+
+	file->hdr = hdr;
+	file->entry = (const struct log_index_entry *)(hdr + 1);
+	file->count = (st.st_size - sizeof(*hdr)) /
+		      sizeof(struct log_index_entry);
+	file->size = st.st_size;
+
+	return 0;
+}
+
+void log_index_unmap(struct log_index_file *file)
+{
+	if (file->hdr)
+		munmap((void *)file->hdr, file->size);
+
+	file->hdr = NULL;
+}
+
+uint64_t log_index_lookup(const struct log_index_file *file,
+			  int64_t timestamp)
+{
+	size_t lo = 0, hi = file->count, mid;
+
+	/* First entry at or after timestamp */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (file->entry[mid].timestamp < timestamp)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo ? file->entry[lo - 1].offset : 0;
+}
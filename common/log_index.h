@@ -0,0 +1,81 @@
+/*
+ * Sparse time index for sensor logs.
+ *
+ * The logger appends a (timestamp, file offset) entry for every stride-th
+ * record to a small side file, normally "<log>.idx". A reader maps the
+ * index, binary-searches it for the start of a time range and seeks the
+ * log straight to that offset, so a query touches only the records in its
+ * range however long the log is. The index is advisory: entries the
+ * logger never flushed just mean a longer scan from the last one.
+ */
+
+#ifndef LOG_INDEX_H
+#define LOG_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_INDEX_MAGIC		"SENSIDX"
+#define LOG_INDEX_VERSION	1
+#define LOG_INDEX_STRIDE	64
+#define LOG_INDEX_BUFFER	64	/* entries buffered per write() */
+
+struct log_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t stride;		/* records per entry */
+	int64_t start_ns;		/* CLOCK_MONOTONIC when logging started */
+	int64_t realtime_ns;		/* CLOCK_REALTIME at the same instant */
+	uint8_t reserved[32];
+};
+
+struct log_index_entry {
+	int64_t timestamp;		/* CLOCK_MONOTONIC, ns */
+	uint64_t offset;		/* of the record in the log */
+};
+
+struct log_index {
+	int fd;
+	unsigned int stride;
+	uint64_t records;
+	unsigned int len;
+	int error;
+	struct log_index_entry buf[LOG_INDEX_BUFFER];
+};
+
+/* Creates (truncates) the index file, stride 0 means LOG_INDEX_STRIDE. */
+int log_index_open(struct log_index *idx, const char *path, int64_t start_ns,
+		   unsigned int stride);
+
+/*
+ * Counts one record written at offset. Not thread safe, the caller
+ * serializes it with the log append that assigns the offset.
+ */
+void log_index_add(struct log_index *idx, int64_t timestamp, uint64_t offset);
+
+/* Flushes buffered entries and closes the file, returns the first error. */
+int log_index_close(struct log_index *idx);
+
+/* "<log>.idx" */
+int log_index_path(char *buf, size_t len, const char *log_path);
+
+/* Read side */
+struct log_index_file {
+	const struct log_index_header *hdr;
+	const struct log_index_entry *entry;
+	size_t count;
+	size_t size;
+};
+
+int log_index_map(struct log_index_file *file, const char *path);
+void log_index_unmap(struct log_index_file *file);
+
+/*
+ * Offset of the last indexed record stamped before timestamp, 0 when there
+ * is none. Threads sharing a log can queue records slightly out of
+ * timestamp order, so callers look up the start of a range minus a slack.
+ */
+uint64_t log_index_lookup(const struct log_index_file *file,
+			  int64_t timestamp);
+
+#endif
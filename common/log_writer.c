@@ -0,0 +1,329 @@
+/*
+ * Asynchronous group-commit log writer.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log_writer.h"
+
+#define DEFAULT_FLUSH_MS	100
+#define DEFAULT_BUFFER_SIZE	(64 * 1024)
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void ns_to_timespec(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+void log_writer_default_config(struct log_writer_config *cfg)
+{
+	cfg->policy = LOG_SYNC_NONE;
+	cfg->sync_ms = 0;
+	cfg->sync_records = 0;
+	cfg->flush_ms = DEFAULT_FLUSH_MS;
+	cfg->buffer_size = DEFAULT_BUFFER_SIZE;
+	cfg->index = NULL;
+}
+
+int log_writer_parse_policy(struct log_writer_config *cfg, const char *arg)
+{
+	long val;
+
+	if (!strcmp(arg, "none")) {
+		cfg->policy = LOG_SYNC_NONE;
+		return 0;
+	}
+
+	if (sscanf(arg, "ms:%ld", &val) == 1 && val > 0) {
+		cfg->policy = LOG_SYNC_INTERVAL;
+		cfg->sync_ms = val;
+
+		/* Don't let data sit queued longer than the sync period */
+		if (cfg->flush_ms > val)
+			cfg->flush_ms = val;
+
+		return 0;
+	}
+
+	if (sscanf(arg, "records:%ld", &val) == 1 && val > 0) {
+		cfg->policy = LOG_SYNC_RECORDS;
+		cfg->sync_records = val;
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(fd, buf, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -errno;
+		}
+
+		buf += ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static bool commit_due(const struct log_writer *w)
+{
+	if (w->stop || w->len >= w->cfg.buffer_size / 2)
+		return true;
+
+	return w->cfg.policy == LOG_SYNC_RECORDS &&
+	       w->unsynced + w->pending >= w->cfg.sync_records;
+}
+
+static bool sync_due(const struct log_writer *w, int64_t last_sync)
+{
+	switch (w->cfg.policy) {
+	case LOG_SYNC_INTERVAL:
+		return w->unsynced &&
+		       now_ns() - last_sync >= w->cfg.sync_ms * 1000000LL;
+	case LOG_SYNC_RECORDS:
+		return w->unsynced >= w->cfg.sync_records;
+	default:
+		return false;
+	}
+}
+
+/*
+ * fdatasync() with the lock dropped. A failure is kept in w->error like a
+ * failed write, so the next log_writer_enqueue() reports it, and is not
+ * counted as a sync.
+ */
+static void sync_log(struct log_writer *w, int64_t *last_sync)
+{
+	int ret;
+
+	pthread_mutex_unlock(&w->lock);
+	ret = fdatasync(w->fd) < 0 ? -errno : 0;
+	pthread_mutex_lock(&w->lock);
+
+	*last_sync = now_ns();
+	w->unsynced = 0;
+
+	if (ret < 0) {
+		if (!w->error)
+			w->error = ret;
+	} else {
+		w->syncs++;
+	}
+}
+
+static void *writer_thread(void *arg)
+{
+	struct log_writer *w = arg;
+	int64_t last_sync = now_ns();
+	struct timespec deadline;
+	unsigned long records;
+	size_t len;
+	char *buf;
+	int ret;
+
+	pthread_mutex_lock(&w->lock);
+
+	for (;;) {
+		ns_to_timespec(now_ns() + w->cfg.flush_ms * 1000000LL,
+			       &deadline);
+
+		while (!commit_due(w))
+			if (pthread_cond_timedwait(&w->wake, &w->lock,
+						   &deadline) == ETIMEDOUT)
+				break;
+
+		if (!w->len) {
+			if (w->stop)
+				break;
+
+			/* Idle, but an interval sync may still be owed */
+			if (sync_due(w, last_sync))
+				sync_log(w, &last_sync);
+
+			continue;
+		}
+
+		buf = w->buf[w->active];
+		len = w->len;
+		records = w->pending;
+		w->active ^= 1;
+		w->len = 0;
+		w->pending = 0;
+		pthread_cond_broadcast(&w->space);
+		pthread_mutex_unlock(&w->lock);
+
+		ret = write_all(w->fd, buf, len);
+
+		pthread_mutex_lock(&w->lock);
+
+		if (ret < 0 && !w->error)
+			w->error = ret;
+
+		w->bytes += len;
+		w->commits++;
+		w->unsynced += records;
+
+		if (sync_due(w, last_sync))
+			sync_log(w, &last_sync);
+	}
+
+	if (w->cfg.policy != LOG_SYNC_NONE && w->unsynced)
+		sync_log(w, &last_sync);
+
+	pthread_mutex_unlock(&w->lock);
+
+	return NULL;
+}
+
+int log_writer_open(struct log_writer *w, int fd,
+		    const struct log_writer_config *cfg)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	memset(w, 0, sizeof(*w));
+	w->fd = fd;
+	w->cfg = *cfg;
+
+	if (w->cfg.flush_ms <= 0)
+		w->cfg.flush_ms = DEFAULT_FLUSH_MS;
+
+	if (!w->cfg.buffer_size)
+		w->cfg.buffer_size = DEFAULT_BUFFER_SIZE;
+
+	w->buf[0] = malloc(w->cfg.buffer_size);
+	w->buf[1] = malloc(w->cfg.buffer_size);
+
+	if (!w->buf[0] || !w->buf[1]) {
+		free(w->buf[0]);
+		free(w->buf[1]);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&w->wake, &attr);
+	pthread_cond_init(&w->space, NULL);
+	pthread_condattr_destroy(&attr);
+	w->start_ns = now_ns();
+
+	ret = pthread_create(&w->thread, NULL, writer_thread, w);
+
+	if (ret) {
+		free(w->buf[0]);
+		free(w->buf[1]);
+		return -ret;
+	}
+
+	return 0;
+}
+
+int log_writer_enqueue(struct log_writer *w, int64_t timestamp,
+		       const void *data, size_t len)
+{
+	int64_t start = now_ns();
+	int ret;
+
+	if (len > w->cfg.buffer_size)
+		return -EMSGSIZE;
+
+	pthread_mutex_lock(&w->lock);
+
+	while (w->len + len > w->cfg.buffer_size && !w->stop) {
+		pthread_cond_signal(&w->wake);
+		pthread_cond_wait(&w->space, &w->lock);
+	}
+
+	if (w->stop) {
+		pthread_mutex_unlock(&w->lock);
+		return -EPIPE;
+	}
+
+	memcpy(w->buf[w->active] + w->len, data, len);
+
+	if (w->cfg.index)
+		log_index_add(w->cfg.index, timestamp, w->queued);
+
+	w->queued += len;
+	w->len += len;
+	w->pending++;
+	w->records++;
+
+	/* Wake the writer only when a commit is due, not for every record */
+	if (commit_due(w))
+		pthread_cond_signal(&w->wake);
+
+	lat_hist_record(&w->lat, now_ns() - start);
+	ret = w->error;
+	pthread_mutex_unlock(&w->lock);
+
+	return ret;
+}
+
+static void fill_stats(const struct log_writer *w,
+		       struct log_writer_stats *st)
+{
+	st->bytes = w->bytes;
+	st->records = w->records;
+	st->commits = w->commits;
+	st->syncs = w->syncs;
+	st->seconds = (now_ns() - w->start_ns) / 1e9;
+	st->enqueue_p50_ns = lat_hist_percentile(&w->lat, 50);
+	st->enqueue_p99_ns = lat_hist_percentile(&w->lat, 99);
+	st->enqueue_max_ns = w->lat.max;
+}
+
+void log_writer_get_stats(struct log_writer *w, struct log_writer_stats *st)
+{
+	pthread_mutex_lock(&w->lock);
+	fill_stats(w, st);
+	pthread_mutex_unlock(&w->lock);
+}
+
+void log_writer_close(struct log_writer *w, struct log_writer_stats *st)
+{
+	pthread_mutex_lock(&w->lock);
+	w->stop = true;
+	pthread_cond_signal(&w->wake);
+	pthread_cond_broadcast(&w->space);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+
+	/* The writer is gone, the final counters need no lock */
+	if (st)
+		fill_stats(w, st);
+
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->wake);
+	pthread_cond_destroy(&w->space);
+	free(w->buf[0]);
+	free(w->buf[1]);
+	w->buf[0] = NULL;
+	w->buf[1] = NULL;
+}
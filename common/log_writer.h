@@ -0,0 +1,98 @@
+/*
+ * Asynchronous group-commit log writer.
+ *
+ * Any number of producer threads hand over complete records, which are
+ * copied into the active half of a double buffer under a short lock. A
+ * dedicated writer thread swaps the halves and pushes everything queued
+ * since the previous commit out with one write(), so producers never wait
+ * for the filesystem unless the buffer is completely full.
+ *
+ * Durability is selectable: leave write-back to the kernel, fdatasync()
+ * every N milliseconds, or fdatasync() every N records.
+ *
+ * With an index in the config every record's timestamp and file offset
+ * are passed to log_index_add() in queue order (log_index.h).
+ */
+
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lat_hist.h"
+#include "log_index.h"
+
+enum log_sync_policy {
+	LOG_SYNC_NONE,
+	LOG_SYNC_INTERVAL,	/* fdatasync every sync_ms */
+	LOG_SYNC_RECORDS,	/* fdatasync every sync_records */
+};
+
+struct log_writer_config {
+	enum log_sync_policy policy;
+	long sync_ms;
+	unsigned long sync_records;
+	long flush_ms;		/* upper bound on how long data sits queued */
+	size_t buffer_size;	/* size of each buffer half */
+	struct log_index *index;	/* NULL = no index */
+};
+
+struct log_writer_stats {
+	uint64_t bytes;
+	uint64_t records;
+	uint64_t commits;	/* write() calls */
+	uint64_t syncs;		/* fdatasync() calls that succeeded */
+	double seconds;
+	uint64_t enqueue_p50_ns;
+	uint64_t enqueue_p99_ns;
+	uint64_t enqueue_max_ns;
+};
+
+struct log_writer {
+	int fd;
+	struct log_writer_config cfg;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* producers -> writer */
+	pthread_cond_t space;		/* writer -> blocked producers */
+	char *buf[2];
+	size_t len;			/* bytes queued in buf[active] */
+	int active;
+	unsigned long pending;		/* records in buf[active] */
+	unsigned long unsynced;		/* records written since last sync */
+	bool stop;
+	int error;
+	uint64_t queued;		/* file offset of the next record */
+
+	/* Statistics, protected by lock */
+	int64_t start_ns;
+	uint64_t bytes, records, commits, syncs;
+	struct lat_hist lat;		/* enqueue latency, ns */
+};
+
+/* Parses "none", "ms:<N>" or "records:<N>" into cfg. */
+int log_writer_parse_policy(struct log_writer_config *cfg, const char *arg);
+
+void log_writer_default_config(struct log_writer_config *cfg);
+int log_writer_open(struct log_writer *w, int fd,
+		    const struct log_writer_config *cfg);
+
+/*
+ * Queue one record taken at timestamp (CLOCK_MONOTONIC ns, only used for
+ * the index). Blocks only while both buffer halves are full.
+ */
+int log_writer_enqueue(struct log_writer *w, int64_t timestamp,
+		       const void *data, size_t len);
+
+void log_writer_get_stats(struct log_writer *w, struct log_writer_stats *st);
+
+/*
+ * Commits everything still queued, applies the final sync and stops. The
+ * final statistics go to st unless it is NULL.
+ */
+void log_writer_close(struct log_writer *w, struct log_writer_stats *st);
+
+#endif
@@ -0,0 +1,150 @@
+/*
+ * Drift-free periodic scheduling on CLOCK_MONOTONIC.
+ */
+
+#include <errno.h>
+#include <time.h>
+
+#include "periodic.h"
+
+static void ns_to_timespec(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000;
+	ts->tv_nsec = ns % 1000000000;
+}
+
+void periodic_start(struct periodic *p, long period_ms)
+{
+	p->period_ms = period_ms > 0 ? period_ms : 1;
+	p->cycles = 0;
+	p->missed = 0;
+	p->overruns = 0;
+	ns_to_timespec(monotonic_ns() + (int64_t)p->period_ms * 1000000,
+		       &p->next);
+}
+
+void periodic_set_period(struct periodic *p, long period_ms)
+{
+	p->period_ms = period_ms > 0 ? period_ms : 1;
+	ns_to_timespec(monotonic_ns() + (int64_t)p->period_ms * 1000000,
+		       &p->next);
+}
+
+/*
+ * Late: run this cycle right away and move the deadline to the next grid
+ * point still in the future. Returns the periods skipped.
+ */
+static int catch_up(struct periodic *p, int64_t now)
+{
+	int64_t period = (int64_t)p->period_ms * 1000000;
+	int64_t next = timespec_to_ns(&p->next);
+	int skipped;
+
+	skipped = (now - next) / period + 1;
+	p->missed++;
+	p->overruns += skipped - 1;
+	ns_to_timespec(next + skipped * period, &p->next);
+
+	return skipped;
+}
+
+static void advance(struct periodic *p)
+{
+	ns_to_timespec(timespec_to_ns(&p->next) +
+		       (int64_t)p->period_ms * 1000000, &p->next);
+}
+
+int periodic_wait(struct periodic *p)
+{
+	int64_t now = monotonic_ns();
+	int ret;
+
+	p->cycles++;
+
+	if (now >= timespec_to_ns(&p->next))
+		return catch_up(p, now);
+
+	do {
+		ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->next,
+				      NULL);
+	} while (ret == EINTR);
+
+	advance(p);
+
+	return 0;
+}
+
+int periodic_wake_init(struct periodic_wake *w)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	w->pending = false;
+	ret = pthread_condattr_init(&attr);
+
+	if (ret)
+		return -ret;
+
+	ret = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+	if (!ret)
+		ret = pthread_cond_init(&w->cond, &attr);
+
+	pthread_condattr_destroy(&attr);
+
+	if (ret)
+		return -ret;
+
+	ret = pthread_mutex_init(&w->lock, NULL);
+
+	if (ret) {
+		pthread_cond_destroy(&w->cond);
+		return -ret;
+	}
+
+	return 0;
+}
+
+void periodic_wake_destroy(struct periodic_wake *w)
+{
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->lock);
+}
+
+void periodic_wake_up(struct periodic_wake *w)
+{
+	pthread_mutex_lock(&w->lock);
+	w->pending = true;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int periodic_wait_wake(struct periodic *p, struct periodic_wake *w)
+{
+	int64_t now = monotonic_ns();
+	bool late = now >= timespec_to_ns(&p->next);
+	bool woken;
+	int ret = 0;
+
+	pthread_mutex_lock(&w->lock);
+
+	while (!late && !w->pending && ret == 0)
+		ret = pthread_cond_timedwait(&w->cond, &w->lock, &p->next);
+
+	woken = w->pending;
+	w->pending = false;
+	pthread_mutex_unlock(&w->lock);
+
+	/* The deadline stays, the caller decides what the wakeup changes */
+	if (woken)
+		return -EINTR;
+
+	p->cycles++;
+
+	if (late)
+		return catch_up(p, now);
+
+	advance(p);
+
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Drift-free periodic scheduling on CLOCK_MONOTONIC.
+ *
+ * Deadlines are absolute and advance by exactly one period each cycle, so
+ * the time spent reading and logging a sample does not push the next one
+ * back. A cycle that starts after its deadline counts as a missed deadline;
+ * whole periods that are skipped to get back on the grid count as overruns.
+ *
+ * periodic_wait_wake() sleeps on a condition variable bound to
+ * CLOCK_MONOTONIC instead, so another thread can cut the sleep short with
+ * periodic_wake_up() to apply a new period or stop right away.
+ */
+
+#ifndef PERIODIC_H
+#define PERIODIC_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+struct periodic {
+	struct timespec next;		/* next absolute deadline */
+	long period_ms;
+	unsigned long cycles;
+	unsigned long missed;		/* deadlines we arrived late for */
+	unsigned long overruns;		/* whole periods skipped */
+};
+
+struct periodic_wake {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		/* timed on CLOCK_MONOTONIC */
+	bool pending;
+};
+
+static inline int64_t timespec_to_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static inline int64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return timespec_to_ns(&ts);
+}
+
+/* First deadline is one period from now. */
+void periodic_start(struct periodic *p, long period_ms);
+
+/* Change the period, the next deadline is one new period from now. */
+void periodic_set_period(struct periodic *p, long period_ms);
+
+/*
+ * Sleep until the next deadline. Returns 0 when the deadline was met, or
+ * the number of periods that were skipped (at least 1) when it was missed.
+ */
+int periodic_wait(struct periodic *p);
+
+int periodic_wake_init(struct periodic_wake *w);
+void periodic_wake_destroy(struct periodic_wake *w);
+
+/* Any thread: ends the current or next periodic_wait_wake() early. */
+void periodic_wake_up(struct periodic_wake *w);
+
+/*
+ * periodic_wait() that returns -EINTR as soon as w is woken, leaving the
+ * deadline in place so the caller can check what changed and wait again.
+ */
+int periodic_wait_wake(struct periodic *p, struct periodic_wake *w);
+
+#endif
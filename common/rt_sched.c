@@ -0,0 +1,172 @@
+/*
+ * Opt-in real-time scheduling for sampler threads.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <malloc.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "rt_sched.h"
+
+int rt_parse(struct rt_config *cfg, const char *arg)
+{
+	char *end;
+	long val;
+
+	val = strtol(arg, &end, 10);
+
+	if (end == arg || val < sched_get_priority_min(SCHED_FIFO) ||
+	    val > sched_get_priority_max(SCHED_FIFO))
+		return -EINVAL;
+
+	cfg->priority = val;
+	cfg->cpu = -1;
+
+	if (*end == '\0')
+		return 0;
+
+	if (*end != ':')
+		return -EINVAL;
+
+	arg = end + 1;
+	val = strtol(arg, &end, 10);
+
+	if (end == arg || *end != '\0' || val < 0 || val >= CPU_SETSIZE)
+		return -EINVAL;
+
+	cfg->cpu = val;
+
+	return 0;
+}
+
+int rt_lock_memory(void)
+{
+	/* Freed heap stays mapped, and so locked, for the next malloc() */
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+		return -errno;
+
+	return 0;
+}
+
+int rt_thread_attr(pthread_attr_t *attr)
+{
+	int ret;
+
+	ret = pthread_attr_init(attr);
+
+	if (ret)
+		return -ret;
+
+	ret = pthread_attr_setstacksize(attr, RT_STACK_SIZE);
+
+	if (ret) {
+		pthread_attr_destroy(attr);
+		return -ret;
+	}
+
+	return 0;
+}
+
+static __attribute__((noinline)) void prefault_stack(void)
+{
+	volatile char stack[RT_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+int rt_enter(const struct rt_config *cfg)
+{
+	struct sched_param param = { .sched_priority = cfg->priority };
+	cpu_set_t set;
+	int ret = 0, err;
+
+	if (cfg->cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cfg->cpu, &set);
+		ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	prefault_stack();
+	err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+	return -(ret ? ret : err);
+}
+
+void rt_jitter_init(struct rt_jitter *j, long period_ms)
+{
+	memset(j, 0, sizeof(*j));
+	j->target = (int64_t)period_ms * 1000000;
+}
+
+void rt_jitter_record(struct rt_jitter *j, int64_t timestamp)
+{
+	int64_t period = timestamp - j->last;
+	double delta;
+	uint64_t n;
+
+	j->last = timestamp;
+
+	if (j->samples++ == 0)
+		return;
+
+	n = j->samples - 1;
+
+	if (n == 1 || period - j->target < j->min)
+		j->min = period - j->target;
+
+	if (n == 1 || period - j->target > j->max)
+		j->max = period - j->target;
+
+	delta = period - j->mean;
+	j->mean += delta / n;
+	j->m2 += delta * (period - j->mean);
+}
+
+void rt_faults_begin(struct rt_jitter *j)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+		j->minflt = -ru.ru_minflt;
+		j->majflt = -ru.ru_majflt;
+	}
+}
+
+void rt_faults_end(struct rt_jitter *j)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+		j->minflt += ru.ru_minflt;
+		j->majflt += ru.ru_majflt;
+	}
+}
+
+void rt_jitter_print(const char *name, const struct rt_jitter *j)
+{
+	uint64_t n = j->samples ? j->samples - 1 : 0;
+
+	if (n < 2) {
+		printf("%s: not enough periods\n", name);
+		return;
+	}
+
+	printf("%s: %llu periods, target %.3f ms, mean %.3f ms, stddev %.1f us, "
+	       "min %+.1f us, max %+.1f us, page faults %ld minor %ld major\n",
+	       name, (unsigned long long)n, j->target / 1e6, j->mean / 1e6,
+	       sqrt(j->m2 / (n - 1)) / 1e3, j->min / 1e3, j->max / 1e3,
+	       j->minflt, j->majflt);
+}
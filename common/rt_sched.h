@@ -0,0 +1,63 @@
+/*
+ * Opt-in real-time scheduling for sampler threads.
+ *
+ * rt_lock_memory() locks every current and future page of the process and
+ * keeps malloc from handing memory back to the kernel, so buffers stay
+ * resident. rt_enter() then moves the calling thread to SCHED_FIFO, pins it
+ * to one CPU if asked and touches RT_PREFAULT bytes of its stack, after
+ * which a steady loop takes no page faults. Without CAP_SYS_NICE and
+ * CAP_IPC_LOCK (or matching rlimits) both return -errno and the caller can
+ * carry on with normal scheduling.
+ *
+ * struct rt_jitter shows whether it helps: the spacing between samples
+ * against the target period, and the page faults the loop took.
+ */
+
+#ifndef RT_SCHED_H
+#define RT_SCHED_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define RT_STACK_SIZE	(256 * 1024)	/* per thread, all of it locked */
+#define RT_PREFAULT	(64 * 1024)
+
+struct rt_config {
+	int priority;			/* SCHED_FIFO 1..99, 0 when off */
+	int cpu;			/* -1: any CPU */
+};
+
+struct rt_jitter {
+	int64_t target;			/* ns */
+	int64_t last;			/* previous sample, ns */
+	uint64_t samples;
+	int64_t min, max;		/* period - target, ns */
+	double mean, m2;		/* of the period, running (Welford) */
+	long minflt, majflt;		/* between rt_faults_begin and _end */
+};
+
+/* Parses "<priority>[:<cpu>]", 0 or -EINVAL. */
+int rt_parse(struct rt_config *cfg, const char *arg);
+
+/* mlockall(MCL_CURRENT | MCL_FUTURE), 0 or -errno. */
+int rt_lock_memory(void);
+
+/* Small stacks for threads created while memory is locked. */
+int rt_thread_attr(pthread_attr_t *attr);
+
+/* Applies cfg to the calling thread, the first error as -errno. */
+int rt_enter(const struct rt_config *cfg);
+
+void rt_jitter_init(struct rt_jitter *j, long period_ms);
+
+/* Called by the loop's thread once per sample */
+void rt_jitter_record(struct rt_jitter *j, int64_t timestamp);
+
+/* Page faults of the calling thread between the two calls */
+void rt_faults_begin(struct rt_jitter *j);
+void rt_faults_end(struct rt_jitter *j);
+
+/* "<name>: N periods, target .. ms, mean .., stddev .., min .., max .." */
+void rt_jitter_print(const char *name, const struct rt_jitter *j);
+
+#endif
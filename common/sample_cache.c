@@ -0,0 +1,66 @@
+/*
+ * Latest-value cache for on-demand reads.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "sample_cache.h"
+
+void sample_cache_init(struct sample_cache *c, long max_age_ms)
+{
+	unsigned int i;
+
+	memset(c, 0, sizeof(*c));
+	c->max_age_ns = (int64_t)max_age_ms * 1000000;
+
+	for (i = 0; i < SAMPLE_CACHE_CHANNELS; i++)
+		atomic_init(&c->entry[i].seq, 0);
+
+	atomic_init(&c->hits, 0);
+	atomic_init(&c->misses, 0);
+}
+
+void sample_cache_put(struct sample_cache *c, unsigned int chan,
+		      int64_t timestamp, int32_t value)
+{
+	struct sample_cache_entry *e = &c->entry[chan];
+	unsigned int seq;
+
+	seq = atomic_load_explicit(&e->seq, memory_order_relaxed);
+	atomic_store_explicit(&e->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	e->timestamp = timestamp;
+	e->value = value;
+	atomic_store_explicit(&e->seq, seq + 2, memory_order_release);
+}
+
+int sample_cache_get(struct sample_cache *c, unsigned int chan, int64_t now,
+		     int32_t *value, int64_t *timestamp)
+{
+	struct sample_cache_entry *e = &c->entry[chan];
+	unsigned int seq;
+	int64_t ts;
+	int32_t val;
+
+	do {
+		seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+		ts = e->timestamp;
+		val = e->value;
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+		 seq != atomic_load_explicit(&e->seq, memory_order_relaxed));
+
+	if (!seq || now - ts > c->max_age_ns) {
+		atomic_fetch_add_explicit(&c->misses, 1, memory_order_relaxed);
+		return -ENODATA;
+	}
+
+	atomic_fetch_add_explicit(&c->hits, 1, memory_order_relaxed);
+	*value = val;
+
+	if (timestamp)
+		*timestamp = ts;
+
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Latest-value cache for on-demand reads.
+ *
+ * The sampling threads put every decoded sample here; an on-demand read
+ * (e.g. a menu "read now") takes the cached value when it is younger than
+ * max_age and only goes to the sensor on a miss, so it adds no bus
+ * transaction while logging is running. Each channel is a seqlock with a
+ * single writer, the reader never blocks it.
+ */
+
+#ifndef SAMPLE_CACHE_H
+#define SAMPLE_CACHE_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define SAMPLE_CACHE_CHANNELS	4
+#define SAMPLE_CACHE_CACHE_LINE	64
+
+struct sample_cache_entry {
+	alignas(SAMPLE_CACHE_CACHE_LINE) atomic_uint seq;	/* 0: empty */
+	int64_t timestamp;		/* CLOCK_MONOTONIC, ns */
+	int32_t value;
+};
+
+struct sample_cache {
+	int64_t max_age_ns;
+	struct sample_cache_entry entry[SAMPLE_CACHE_CHANNELS];
+
+	/* Reader side statistics */
+	atomic_ulong hits, misses;
+};
+
+void sample_cache_init(struct sample_cache *c, long max_age_ms);
+
+/* One writer per channel. */
+void sample_cache_put(struct sample_cache *c, unsigned int chan,
+		      int64_t timestamp, int32_t value);
+
+/*
+ * Latest value of chan if it was sampled at most max_age before now.
+ * Returns 0 on a hit, -ENODATA on a miss (empty or too old).
+ */
+int sample_cache_get(struct sample_cache *c, unsigned int chan, int64_t now,
+		     int32_t *value, int64_t *timestamp);
+
+#endif
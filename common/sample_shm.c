@@ -0,0 +1,234 @@
+/*
+ * Latest-sample publication through POSIX shared memory.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sample_shm.h"
+
+/* Each retry means the publisher finished two updates during one copy */
+#define READ_RETRIES	16
+
+static int map_segment(struct sample_shm *shm, const char *name, int fd,
+		       int prot)
+{
+	void *map;
+
+	map = mmap(NULL, sizeof(*shm->seg), prot, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED)
+		return -errno;
+
+	shm->seg = map;
+	snprintf(shm->name, sizeof(shm->name), "%s", name);
+
+	return 0;
+}
+
+int sample_shm_create(struct sample_shm *shm, const char *name)
+{
+	struct sample_shm_header *hdr;
+	int fd, ret;
+
+	memset(shm, 0, sizeof(*shm));
+
+	/* The full name is kept so close unlinks this segment and no other */
+	if (strlen(name) >= sizeof(shm->name))
+		return -ENAMETOOLONG;
+
+	/* A fresh segment, never truncate one readers may have mapped */
+	shm_unlink(name);
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+	if (fd < 0)
+		return -errno;
+
+	if (ftruncate(fd, sizeof(*shm->seg)) < 0) {
+		ret = -errno;
+		close(fd);
+		shm_unlink(name);
+		return ret;
+	}
+
+	ret = map_segment(shm, name, fd, PROT_READ | PROT_WRITE);
+	close(fd);
+
+	if (ret < 0) {
+		shm_unlink(name);
+		return ret;
+	}
+
+	shm->owner = 1;
+	hdr = &shm->seg->hdr;
+	hdr->version = SAMPLE_SHM_VERSION;
+	hdr->pid = getpid();
+	atomic_init(&hdr->nchan, 0);
+
+	/* Readers treat the segment as valid once the magic is there */
+	atomic_thread_fence(memory_order_release);
+	memcpy(hdr->magic, SAMPLE_SHM_MAGIC, sizeof(hdr->magic));
+
+	return 0;
+}
+
+int sample_shm_add(struct sample_shm *shm, const char *name, const char *unit,
+		   unsigned int nvals, unsigned int digits)
+{
+	struct sample_shm_channel *chan;
+	unsigned int idx;
+
+	idx = atomic_load_explicit(&shm->seg->hdr.nchan, memory_order_relaxed);
+
+	if (idx >= SAMPLE_SHM_CHANNELS)
+		return -ENOSPC;
+
+	if (!nvals || nvals > SAMPLE_SHM_VALUES)
+		return -EINVAL;
+
+	chan = &shm->seg->chan[idx];
+	snprintf(chan->name, sizeof(chan->name), "%s", name);
+	snprintf(chan->unit, sizeof(chan->unit), "%s", unit);
+	chan->nvals = nvals;
+	chan->digits = digits;
+	atomic_init(&chan->seq, 0);
+
+	atomic_store_explicit(&shm->seg->hdr.nchan, idx + 1,
+			      memory_order_release);
+
+	return idx;
+}
+
+/*
+ * seq odd: slot 0 is being written, readers use slot 1. seq even: slot 1
+ * is being written (or idle), readers use slot 0.
+ */
+void sample_shm_publish(struct sample_shm *shm, int idx, int64_t timestamp,
+			const int64_t *value)
+{
+	struct sample_shm_channel *chan = &shm->seg->chan[idx];
+	struct sample_shm_value val;
+	unsigned int seq;
+
+	memset(&val, 0, sizeof(val));
+	val.timestamp = timestamp;
+	memcpy(val.value, value, chan->nvals * sizeof(*value));
+
+	seq = atomic_load_explicit(&chan->seq, memory_order_relaxed);
+	val.count = seq / 2 + 1;
+
+	/*
+	 * Each seq store is fenced on both sides: the previous slot write
+	 * must be visible before seq moves readers onto it, and the next slot
+	 * write must not become visible before seq moved them away.
+	 */
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&chan->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	chan->slot[0] = val;
+
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&chan->seq, seq + 2, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	chan->slot[1] = val;
+}
+
+int sample_shm_open(struct sample_shm *shm, const char *name)
+{
+	const struct sample_shm_header *hdr;
+	struct stat st;
+	int fd, ret;
+
+	memset(shm, 0, sizeof(*shm));
+	fd = shm_open(name, O_RDONLY, 0);
+
+	if (fd < 0)
+		return -errno;
+
+	/* The publisher may not have sized it yet */
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*shm->seg)) {
+		close(fd);
+		return -EAGAIN;
+	}
+
+	ret = map_segment(shm, name, fd, PROT_READ);
+	close(fd);
+
+	if (ret < 0)
+		return ret;
+
+	hdr = &shm->seg->hdr;
+
+	if (memcmp(hdr->magic, SAMPLE_SHM_MAGIC, sizeof(hdr->magic))) {
+		sample_shm_close(shm);
+		return -EAGAIN;
+	}
+
+	atomic_thread_fence(memory_order_acquire);
+
+	if (hdr->version != SAMPLE_SHM_VERSION) {
+		sample_shm_close(shm);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int sample_shm_find(const struct sample_shm *shm, const char *name)
+{
+	unsigned int i, n = sample_shm_channels(shm);
+
+	for (i = 0; i < n; i++)
+		if (!strncmp(shm->seg->chan[i].name, name,
+			     SAMPLE_SHM_NAME_LEN))
+			return i;
+
+	return -ENOENT;
+}
+
+int sample_shm_read(const struct sample_shm *shm, int idx,
+		    struct sample_shm_value *val)
+{
+	const struct sample_shm_channel *chan;
+	unsigned int seq, tries;
+
+	if (idx < 0 || (unsigned int)idx >= sample_shm_channels(shm))
+		return -EINVAL;
+
+	chan = &shm->seg->chan[idx];
+
+	for (tries = 0; tries < READ_RETRIES; tries++) {
+		seq = atomic_load_explicit(&chan->seq, memory_order_acquire);
+
+		/* Slot 1 holds nothing until the first update completed */
+		if (seq < 2)
+			return -ENODATA;
+
+		*val = chan->slot[seq & 1];
+		atomic_thread_fence(memory_order_acquire);
+
+		if (seq == atomic_load_explicit(&chan->seq,
+						memory_order_relaxed))
+			return 0;
+	}
+
+	return -EAGAIN;
+}
+
+void sample_shm_close(struct sample_shm *shm)
+{
+	if (!shm->seg)
+		return;
+
+	munmap(shm->seg, sizeof(*shm->seg));
+
+	if (shm->owner)
+		shm_unlink(shm->name);
+
+	shm->seg = NULL;
+}
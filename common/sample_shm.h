@@ -0,0 +1,110 @@
+/*
+ * Latest-sample publication through POSIX shared memory.
+ *
+ * One sampler process creates a named segment (shm_open()) and publishes
+ * the newest timestamped sample of each of its channels; any number of
+ * other processes map the segment read-only and pick the values up with
+ * plain loads, so reading costs no syscall and the sensor bus is touched
+ * only once per sampling period, however many consumers there are.
+ *
+ * Every channel is a seqlock with two copies of the sample (a latch): the
+ * writer fills the copy readers are not being pointed at, so a reader never
+ * waits for a write in progress, or for a publisher that died in the middle
+ * of one. The next seq step already hands the copy a reader was sent to
+ * back to the writer, so a reader retries whenever seq changed while it
+ * was copying, and gives up with -EAGAIN after a bounded number of tries.
+ *
+ * Values are fixed point integers with channel->digits decimal places,
+ * e.g. 3 for HTU21D milli-units or 9 for IMU nano-units (see iio_parse.h).
+ */
+
+#ifndef SAMPLE_SHM_H
+#define SAMPLE_SHM_H
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SAMPLE_SHM_MAGIC	"SENSSHM"
+#define SAMPLE_SHM_VERSION	1
+#define SAMPLE_SHM_CHANNELS	8
+#define SAMPLE_SHM_VALUES	3
+#define SAMPLE_SHM_NAME_LEN	24
+#define SAMPLE_SHM_UNIT_LEN	16
+#define SAMPLE_SHM_PATH_LEN	256	/* NAME_MAX + 1 */
+#define SAMPLE_SHM_CACHE_LINE	64
+
+struct sample_shm_value {
+	int64_t timestamp;			/* CLOCK_MONOTONIC, ns */
+	uint64_t count;				/* samples published so far */
+	int64_t value[SAMPLE_SHM_VALUES];	/* fixed point */
+};
+
+struct sample_shm_channel {
+	/* Set once before the channel is made visible */
+	char name[SAMPLE_SHM_NAME_LEN];
+	char unit[SAMPLE_SHM_UNIT_LEN];
+	uint32_t nvals;
+	uint32_t digits;
+
+	/* Written by the publisher, seq counts half updates */
+	alignas(SAMPLE_SHM_CACHE_LINE) atomic_uint seq;
+	struct sample_shm_value slot[2];
+};
+
+struct sample_shm_header {
+	char magic[8];
+	uint32_t version;
+	int32_t pid;				/* publisher */
+	atomic_uint nchan;
+};
+
+struct sample_shm_segment {
+	struct sample_shm_header hdr;
+	struct sample_shm_channel chan[SAMPLE_SHM_CHANNELS];
+};
+
+struct sample_shm {
+	struct sample_shm_segment *seg;
+	char name[SAMPLE_SHM_PATH_LEN];		/* segment, for shm_unlink() */
+	int owner;				/* unlinks on close */
+};
+
+/*
+ * Publisher side. name is a POSIX shm name such as "/htu21d"; an existing
+ * segment with that name is replaced, readers still mapping it keep the
+ * old (now frozen) copy until they reopen.
+ */
+int sample_shm_create(struct sample_shm *shm, const char *name);
+
+/* Returns the channel index or -errno. Call before publishing. */
+int sample_shm_add(struct sample_shm *shm, const char *name, const char *unit,
+		   unsigned int nvals, unsigned int digits);
+
+/* Single writer per channel; value holds the channel's nvals values. */
+void sample_shm_publish(struct sample_shm *shm, int idx, int64_t timestamp,
+			const int64_t *value);
+
+/* Reader side, -EAGAIN while the publisher is still setting up. */
+int sample_shm_open(struct sample_shm *shm, const char *name);
+
+/* Channel index by name, or -ENOENT. */
+int sample_shm_find(const struct sample_shm *shm, const char *name);
+
+static inline unsigned int sample_shm_channels(const struct sample_shm *shm)
+{
+	return atomic_load_explicit(&shm->seg->hdr.nchan, memory_order_acquire);
+}
+
+/*
+ * Copies the newest sample of channel idx, wait-free and without syscalls.
+ * Returns 0, -ENODATA before the first sample or -EAGAIN if the publisher
+ * kept overtaking the copy.
+ */
+int sample_shm_read(const struct sample_shm *shm, int idx,
+		    struct sample_shm_value *val);
+
+void sample_shm_close(struct sample_shm *shm);
+
+#endif
@@ -0,0 +1,162 @@
+/*
+ * Discovery of the supported IIO sensors.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sensor_discover.h"
+#include "sysfs.h"
+
+#define IIO_SYSFS_DIR	"/sys/bus/iio/devices"
+
+static const struct sensor_type sensor_types[] = {
+	{
+		.driver = "htu21",
+		.label = "HTU21D",
+		.nchan = 2,
+		.chan = {
+			{ "in_temp_input", "temperature", "celsius" },
+			{ "in_humidityrelative_input", "humidity", "RH" },
+		},
+		.digits = 3,
+	},
+	{
+		.driver = "lsm6dsv16x_accel",
+		.label = "LSM6DSV16X accel",
+		.nchan = 3,
+		.chan = {
+			{ "in_accel_x_raw", "x", "m/s^2" },
+			{ "in_accel_y_raw", "y", "m/s^2" },
+			{ "in_accel_z_raw", "z", "m/s^2" },
+		},
+		.scale = "in_accel_scale",
+		.digits = 9,
+	},
+	{
+		.driver = "lsm6dsv16x_gyro",
+		.label = "LSM6DSV16X gyro",
+		.nchan = 3,
+		.chan = {
+			{ "in_anglvel_x_raw", "x", "rad/s" },
+			{ "in_anglvel_y_raw", "y", "rad/s" },
+			{ "in_anglvel_z_raw", "z", "rad/s" },
+		},
+		.scale = "in_anglvel_scale",
+		.digits = 9,
+	},
+};
+
+static const struct sensor_type *find_type(const char *driver)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(sensor_types) / sizeof(sensor_types[0]); i++)
+		if (!strcmp(driver, sensor_types[i].driver))
+			return &sensor_types[i];
+
+	return NULL;
+}
+
+/*
+ * An I2C client directory is named "<bus>-<4 digit hex address>", the
+ * innermost one on the resolved path is the device's.
+ */
+static void find_bus(struct sensor_device *dev)
+{
+	char real[PATH_MAX], *p, *end;
+	unsigned int addr;
+	long bus;
+
+	dev->bus = -1;
+	dev->addr = 0;
+
+	if (!realpath(dev->dir, real))
+		return;
+
+	while ((p = strrchr(real, '/'))) {
+		*p++ = '\0';
+		bus = strtol(p, &end, 10);
+
+		if (end != p && *end == '-' && strlen(end + 1) == 4 &&
+		    sscanf(end + 1, "%4x", &addr) == 1) {
+			dev->bus = bus;
+			dev->addr = addr;
+			return;
+		}
+	}
+}
+
+static int dev_cmp(const void *a, const void *b)
+{
+	const struct sensor_device *x = a, *y = b;
+	size_t lx = strlen(x->dev_name), ly = strlen(y->dev_name);
+
+	if (x->bus != y->bus)
+		return x->bus < y->bus ? -1 : 1;
+
+	/* iio:device2 before iio:device10 */
+	if (lx != ly)
+		return lx < ly ? -1 : 1;
+
+	return strcmp(x->dev_name, y->dev_name);
+}
+
+int sensor_discover(struct sensor_device *dev, unsigned int max)
+{
+	char dir_path[PATH_MAX], path[PATH_MAX], name[SENSOR_NAME_MAX];
+	const struct sensor_type *type;
+	struct dirent *ent;
+	unsigned int n = 0;
+	DIR *dir;
+	int len;
+
+	len = sysfs_path(dir_path, sizeof(dir_path), IIO_SYSFS_DIR);
+
+	if (len < 0 || (size_t)len >= sizeof(dir_path))
+		return -ENAMETOOLONG;
+
+	dir = opendir(dir_path);
+
+	if (!dir)
+		return -errno;
+
+	while ((ent = readdir(dir)) && n < max) {
+		if (strncmp(ent->d_name, "iio:device", 10))
+			continue;
+
+		/* Skip entries whose name or paths would be truncated */
+		if (strlen(ent->d_name) >= sizeof(dev[n].dev_name))
+			continue;
+
+		len = snprintf(dev[n].dir, sizeof(dev[n].dir), "%s/%s",
+			       dir_path, ent->d_name);
+
+		if (len < 0 || (size_t)len >= sizeof(dev[n].dir))
+			continue;
+
+		len = snprintf(path, sizeof(path), "%s/name", dev[n].dir);
+
+		if (len < 0 || (size_t)len >= sizeof(path) ||
+		    sysfs_read_str(path, name, sizeof(name)) <= 0)
+			continue;
+
+		type = find_type(name);
+
+		if (!type)
+			continue;
+
+		dev[n].type = type;
+		strcpy(dev[n].dev_name, ent->d_name);
+		find_bus(&dev[n]);
+		n++;
+	}
+
+	closedir(dir);
+	qsort(dev, n, sizeof(*dev), dev_cmp);
+
+	return n;
+}
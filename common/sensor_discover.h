@@ -0,0 +1,50 @@
+/*
+ * Discovery of the supported IIO sensors.
+ *
+ * Every /sys/bus/iio/devices/iio:deviceN whose name attribute matches a
+ * known driver becomes one sensor_device with its polled channels. The
+ * I2C bus and address come from the "<bus>-<addr>" client directory the
+ * device symlink resolves through, so callers can keep transactions on
+ * one bus in one thread; devices that are not on I2C (or a tree without
+ * the symlinks) get bus -1.
+ */
+
+#ifndef SENSOR_DISCOVER_H
+#define SENSOR_DISCOVER_H
+
+#include <limits.h>
+
+#define SENSOR_MAX_DEVICES	32
+#define SENSOR_MAX_CHANNELS	3
+#define SENSOR_NAME_MAX		32
+
+struct sensor_chan_type {
+	const char *attr;		/* "in_temp_input" */
+	const char *name;
+	const char *unit;
+};
+
+struct sensor_type {
+	const char *driver;		/* IIO name attribute */
+	const char *label;
+	unsigned int nchan;
+	struct sensor_chan_type chan[SENSOR_MAX_CHANNELS];
+	const char *scale;		/* NULL: values are already scaled */
+	unsigned int digits;		/* decimal places of a value */
+};
+
+struct sensor_device {
+	const struct sensor_type *type;
+	char dev_name[SENSOR_NAME_MAX];	/* "iio:device2" */
+	char dir[PATH_MAX];		/* already mapped by sysfs_path() */
+	int bus;			/* I2C adapter, -1 unknown */
+	unsigned int addr;		/* I2C address */
+};
+
+/*
+ * Fills up to max devices sorted by bus, then device name. Returns the
+ * number found or -errno when the IIO directory can't be read.
+ */
+int sensor_discover(struct sensor_device *dev, unsigned int max);
+
+#endif
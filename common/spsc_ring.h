@@ -0,0 +1,101 @@
+/*
+ * Lock-free single-producer/single-consumer ring of fixed-size elements.
+ *
+ * The producer only writes head and the consumer only writes tail; each
+ * index lives on its own cache line together with the side's cached copy
+ * of the other index, so in the common case push and pop touch no shared
+ * cache line other than the slot itself. Capacity is rounded up to a power
+ * of two. push() never blocks: when the ring is full it fails and the
+ * caller decides whether to drop or retry.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE	64
+
+struct spsc_ring {
+	alignas(CACHE_LINE) atomic_size_t head;	/* producer */
+	size_t tail_cache;
+	alignas(CACHE_LINE) atomic_size_t tail;	/* consumer */
+	size_t head_cache;
+	alignas(CACHE_LINE) size_t mask;
+	size_t elem_size;
+	unsigned char *slots;
+};
+
+static inline int spsc_ring_init(struct spsc_ring *r, size_t capacity,
+				 size_t elem_size)
+{
+	size_t size = 1;
+
+	while (size < capacity)
+		size <<= 1;
+
+	memset(r, 0, sizeof(*r));
+	r->slots = aligned_alloc(CACHE_LINE, (size * elem_size + CACHE_LINE - 1)
+				 / CACHE_LINE * CACHE_LINE);
+
+	if (!r->slots)
+		return -ENOMEM;
+
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	r->mask = size - 1;
+	r->elem_size = elem_size;
+
+	return 0;
+}
+
+static inline void spsc_ring_free(struct spsc_ring *r)
+{
+	free(r->slots);
+	r->slots = NULL;
+}
+
+/* Producer side. Returns false when the ring is full. */
+static inline bool spsc_ring_push(struct spsc_ring *r, const void *elem)
+{
+	size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+	if (head - r->tail_cache > r->mask) {
+		r->tail_cache = atomic_load_explicit(&r->tail,
+						     memory_order_acquire);
+
+		if (head - r->tail_cache > r->mask)
+			return false;
+	}
+
+	memcpy(r->slots + (head & r->mask) * r->elem_size, elem, r->elem_size);
+	atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+	return true;
+}
+
+/* Consumer side. Returns false when the ring is empty. */
+static inline bool spsc_ring_pop(struct spsc_ring *r, void *elem)
+{
+	size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+	if (tail == r->head_cache) {
+		r->head_cache = atomic_load_explicit(&r->head,
+						     memory_order_acquire);
+
+		if (tail == r->head_cache)
+			return false;
+	}
+
+	memcpy(elem, r->slots + (tail & r->mask) * r->elem_size, r->elem_size);
+	atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Small helpers to read and write sysfs attributes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "iio_parse.h"
+#include "sysfs.h"
+
+#define SYSFS_ROOT_ENV	"SENSOR_SYSFS_ROOT"
+#define DEV_ROOT_ENV	"SENSOR_DEV_ROOT"
+
+int sysfs_path(char *buf, size_t len, const char *path)
+{
+	const char *root;
+
+	if (!strncmp(path, "/dev/", 5)) {
+		root = getenv(DEV_ROOT_ENV);
+
+		if (root && *root)
+			return snprintf(buf, len, "%s%s", root, path + 4);
+	}
+
+	root = getenv(SYSFS_ROOT_ENV);
+
+	if (!root)
+		root = "";
+
+	return snprintf(buf, len, "%s%s", root, path);
+}
+
+int sysfs_open(const char *path, int flags)
+{
+	char real[PATH_MAX];
+	int fd;
+
+	if (sysfs_path(real, sizeof(real), path) >= (int)sizeof(real))
+		return -ENAMETOOLONG;
+
+	fd = open(real, flags);
+
+	return fd < 0 ? -errno : fd;
+}
+
+int sysfs_read_str(const char *path, char *buf, size_t len)
+{
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	ret = read(fd, buf, len - 1);
+
+	if (ret < 0) {
+		ret = -errno;
+		close(fd);
+
+		return ret;
+	}
+
+	close(fd);
+
+	while (ret > 0 && (buf[ret - 1] == '\n' || buf[ret - 1] == ' '))
+		ret--;
+
+	buf[ret] = '\0';
+
+	return ret;
+}
+
+int sysfs_read_int(const char *path, int *val)
+{
+	char buf[32];
+	int32_t v;
+	int ret;
+
+	ret = sysfs_read_str(path, buf, sizeof(buf));
+
+	if (ret < 0)
+		return ret;
+
+	ret = iio_parse_int(buf, ret, &v);
+
+	if (ret < 0)
+		return ret;
+
+	*val = v;
+
+	return 0;
+}
+
+int sysfs_write_str(const char *path, const char *val)
+{
+	int fd, ret;
+
+	/* O_TRUNC like a shell redirect, so plain files can stand in for sysfs */
+	fd = open(path, O_WRONLY | O_TRUNC);
+
+	if (fd < 0)
+		return -errno;
+
+	ret = write(fd, val, strlen(val));
+
+	if (ret < 0) {
+		ret = -errno;
+		close(fd);
+
+		return ret;
+	}
+
+	close(fd);
+
+	return 0;
+}
+
+int sysfs_write_int(const char *path, int val)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%d", val);
+
+	return sysfs_write_str(path, buf);
+}
@@ -0,0 +1,31 @@
+/*
+ * Small helpers to read and write sysfs attributes.
+ *
+ * All helpers return 0 (or the number of bytes read) on success and a
+ * negative errno value on failure, so callers can tell a missing attribute
+ * (-ENOENT) from a real I/O error.
+ */
+
+#ifndef SYSFS_H
+#define SYSFS_H
+
+#include <stddef.h>
+
+/*
+ * Programs never open /sys or /dev paths directly but map them through
+ * sysfs_path() first, so they can run against a simulated device tree:
+ * $SENSOR_SYSFS_ROOT is prepended to every other absolute path and
+ * $SENSOR_DEV_ROOT replaces the /dev prefix. Unset means the real tree.
+ * Returns the snprintf() result.
+ */
+int sysfs_path(char *buf, size_t len, const char *path);
+
+/* open() on the mapped path, -errno on failure. */
+int sysfs_open(const char *path, int flags);
+
+int sysfs_read_str(const char *path, char *buf, size_t len);
+int sysfs_read_int(const char *path, int *val);
+int sysfs_write_str(const char *path, const char *val);
+int sysfs_write_int(const char *path, int val);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * Userspace threshold alarms with hysteresis.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "iio_parse.h"
+#include "threshold.h"
+
+enum threshold_event threshold_update(struct threshold *t, int64_t value)
+{
+	bool past;
+
+	if (!t->active) {
+		past = t->dir == THRESHOLD_ABOVE ? value > t->level :
+						   value < t->level;
+
+		if (!past)
+			return THRESHOLD_NONE;
+
+		t->active = true;
+		t->raised++;
+
+		return THRESHOLD_RAISED;
+	}
+
+	past = t->dir == THRESHOLD_ABOVE ? value > t->level - t->hysteresis :
+					   value < t->level + t->hysteresis;
+
+	if (past)
+		return THRESHOLD_NONE;
+
+	t->active = false;
+
+	return THRESHOLD_CLEARED;
+}
+
+int threshold_parse(struct threshold *t, const char *arg,
+		    unsigned int digits)
+{
+	const char *sep;
+	int ret;
+
+	memset(t, 0, sizeof(*t));
+
+	if (*arg == '>')
+		t->dir = THRESHOLD_ABOVE;
+	else if (*arg == '<')
+		t->dir = THRESHOLD_BELOW;
+	else
+		return -EINVAL;
+
+	arg++;
+	sep = strchr(arg, ':');
+	ret = iio_parse_fixed(arg, sep ? (size_t)(sep - arg) : strlen(arg),
+			      digits, &t->level);
+
+	if (ret < 0 || !sep)
+		return ret;
+
+	ret = iio_parse_fixed(sep + 1, strlen(sep + 1), digits,
+			      &t->hysteresis);
+
+	return ret < 0 || t->hysteresis < 0 ? -EINVAL : 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * Userspace threshold alarms with hysteresis.
+ *
+ * For sensors whose driver has no IIO events the threshold is evaluated
+ * inline on the sample stream, so an alarm is raised by the sample that
+ * crosses the level and costs no extra reads: its latency is bounded by
+ * the sampling interval. An alarm clears only once the value is back
+ * past the level by the hysteresis, so noise around the level doesn't
+ * make it flap.
+ */
+
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum threshold_dir {
+	THRESHOLD_ABOVE,
+	THRESHOLD_BELOW,
+};
+
+enum threshold_event {
+	THRESHOLD_NONE,
+	THRESHOLD_RAISED,
+	THRESHOLD_CLEARED,
+};
+
+struct threshold {
+	enum threshold_dir dir;
+	int64_t level;			/* same units as the samples */
+	int64_t hysteresis;
+	bool active;
+	uint64_t raised;		/* times raised */
+};
+
+enum threshold_event threshold_update(struct threshold *t, int64_t value);
+
+/*
+ * Parses "<op><level>[:<hysteresis>]" where op is '>' or '<', e.g.
+ * ">30.5:0.5"; values are scaled by 10^digits. 0 on success.
+ */
+int threshold_parse(struct threshold *t, const char *arg,
+		    unsigned int digits);
+
+#endif
@@ -0,0 +1,428 @@
+/*
+ * Streaming vibration analysis of accelerometer frames.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vibration.h"
+
+#define DEFAULT_PEAKS	3
+#define MAG_FLOOR	1e-30f
+#define PEAK_FLOOR	1e-3f	/* of the RMS, below is leakage and rounding */
+
+typedef float vib_v4 __attribute__((vector_size(16)));
+
+static inline vib_v4 load4(const float *p)
+{
+	vib_v4 v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+static inline void store4(float *p, vib_v4 v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static float *alloc_floats(size_t n)
+{
+	/* aligned_alloc wants a multiple of the alignment */
+	return aligned_alloc(16, (n * sizeof(float) + 15) & ~(size_t)15);
+}
+
+static unsigned int log2u(unsigned int n)
+{
+	unsigned int bits = 0;
+
+	while ((1u << bits) < n)
+		bits++;
+
+	return bits;
+}
+
+/* Half-size of the first radix-4 pass: 1, or 2 after a radix-2 pass */
+static unsigned int first_quarter(unsigned int n)
+{
+	return log2u(n) % 2 ? 2 : 1;
+}
+
+/*
+ * Per pass, for m sub-DFTs combined into 4m: w1 = e^(-2 pi i k / 4m) and
+ * w2 = w1^2 for k < m, stored as four arrays of m floats (re1, im1, re2,
+ * im2) so the vector loop loads them directly.
+ */
+static void make_twiddles(struct vib *v)
+{
+	unsigned int n = v->cfg.size, m, k;
+	float *tw = v->tw;
+	double a;
+
+	for (m = first_quarter(n); 4 * m <= n; m *= 4) {
+		for (k = 0; k < m; k++) {
+			a = -2.0 * M_PI * k / (4.0 * m);
+			tw[k] = cos(a);
+			tw[m + k] = sin(a);
+			tw[2 * m + k] = cos(2 * a);
+			tw[3 * m + k] = sin(2 * a);
+		}
+
+		tw += 4 * m;
+	}
+}
+
+static void radix2_pass(float *re, float *im, unsigned int n)
+{
+	float a, b;
+	unsigned int i;
+
+	for (i = 0; i < n; i += 2) {
+		a = re[i];
+		b = re[i + 1];
+		re[i] = a + b;
+		re[i + 1] = a - b;
+		a = im[i];
+		b = im[i + 1];
+		im[i] = a + b;
+		im[i + 1] = a - b;
+	}
+}
+
+/*
+ * Four size-m sub-DFTs A, B, C, D become one of size 4m:
+ *   E0,1 = A +- w2 B    F0,1 = C +- w2 D
+ *   X[k], X[k + 2m] = E0 +- w1 F0
+ *   X[k + m], X[k + 3m] = E1 +- (-i) w1 F1
+ */
+#define RADIX4_BUTTERFLY(T, LD, ST)					\
+do {									\
+	T ar = LD(r0), ai = LD(i0), br = LD(r0 + m), bi = LD(i0 + m);	\
+	T cr = LD(r0 + 2 * m), ci = LD(i0 + 2 * m);			\
+	T dr = LD(r0 + 3 * m), di = LD(i0 + 3 * m);			\
+	T c1 = LD(tw + k), s1 = LD(tw + m + k);				\
+	T c2 = LD(tw + 2 * m + k), s2 = LD(tw + 3 * m + k);		\
+	T tr, ti, e0r, e0i, e1r, e1i, f0r, f0i, f1r, f1i;		\
+									\
+	tr = br * c2 - bi * s2;						\
+	ti = br * s2 + bi * c2;						\
+	e0r = ar + tr;							\
+	e0i = ai + ti;							\
+	e1r = ar - tr;							\
+	e1i = ai - ti;							\
+	tr = dr * c2 - di * s2;						\
+	ti = dr * s2 + di * c2;						\
+	f0r = cr + tr;							\
+	f0i = ci + ti;							\
+	f1r = cr - tr;							\
+	f1i = ci - ti;							\
+	tr = f0r * c1 - f0i * s1;					\
+	ti = f0r * s1 + f0i * c1;					\
+	ST(r0, e0r + tr);						\
+	ST(i0, e0i + ti);						\
+	ST(r0 + 2 * m, e0r - tr);					\
+	ST(i0 + 2 * m, e0i - ti);					\
+	/* (-i)(x + iy) = y - ix */					\
+	tr = f1r * c1 - f1i * s1;					\
+	ti = f1r * s1 + f1i * c1;					\
+	ST(r0 + m, e1r + ti);						\
+	ST(i0 + m, e1i - tr);						\
+	ST(r0 + 3 * m, e1r - ti);					\
+	ST(i0 + 3 * m, e1i + tr);					\
+} while (0)
+
+#define LOAD1(p)	(*(p))
+#define STORE1(p, x)	(*(p) = (x))
+
+static void radix4_pass(float *re, float *im, unsigned int n, unsigned int m,
+			const float *tw)
+{
+	unsigned int b, k;
+	float *r0, *i0;
+
+	for (b = 0; b < n; b += 4 * m) {
+		if (m % 4 == 0) {
+			for (k = 0; k < m; k += 4) {
+				r0 = re + b + k;
+				i0 = im + b + k;
+				RADIX4_BUTTERFLY(vib_v4, load4, store4);
+			}
+		} else {
+			for (k = 0; k < m; k++) {
+				r0 = re + b + k;
+				i0 = im + b + k;
+				RADIX4_BUTTERFLY(float, LOAD1, STORE1);
+			}
+		}
+	}
+}
+
+void vib_fft(const struct vib *v, float *re, float *im)
+{
+	unsigned int n = v->cfg.size, i, j, m;
+	const float *tw = v->tw;
+	float t;
+
+	for (i = 0; i < n; i++) {
+		j = v->rev[i];
+
+		if (i < j) {
+			t = re[i];
+			re[i] = re[j];
+			re[j] = t;
+			t = im[i];
+			im[i] = im[j];
+			im[j] = t;
+		}
+	}
+
+	m = first_quarter(n);
+
+	if (m == 2)
+		radix2_pass(re, im, n);
+
+	for (; 4 * m <= n; m *= 4) {
+		radix4_pass(re, im, n, m, tw);
+		tw += 4 * m;
+	}
+}
+
+int vib_init(struct vib *v, const struct vib_config *cfg)
+{
+	unsigned int n = cfg->size, bits, i, j, a;
+	double sum = 0;
+
+	if (n < VIB_MIN_SIZE || n > VIB_MAX_SIZE || (n & (n - 1)) ||
+	    !cfg->hop || cfg->hop > n || cfg->peaks > VIB_MAX_PEAKS)
+		return -EINVAL;
+
+	memset(v, 0, sizeof(*v));
+	v->cfg = *cfg;
+	bits = log2u(n);
+
+	for (a = 0; a < 3; a++) {
+		v->hist[a] = alloc_floats(n);
+		v->mag[a] = alloc_floats(n / 2 + 1);
+	}
+
+	for (a = 0; a < 2; a++) {
+		v->re[a] = alloc_floats(n);
+		v->im[a] = alloc_floats(n);
+	}
+
+	v->hann = alloc_floats(n);
+	v->tw = alloc_floats(2 * n);
+	v->rev = malloc(n * sizeof(*v->rev));
+
+	if (!v->hist[0] || !v->hist[1] || !v->hist[2] || !v->mag[0] ||
+	    !v->mag[1] || !v->mag[2] || !v->re[0] || !v->im[0] ||
+	    !v->re[1] || !v->im[1] || !v->hann || !v->tw || !v->rev) {
+		vib_free(v);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < n; i++) {
+		v->hann[i] = 0.5 - 0.5 * cos(2 * M_PI * i / n);
+		sum += v->hann[i];
+
+		for (j = 0, a = 0; a < bits; a++)
+			j |= ((i >> a) & 1) << (bits - 1 - a);
+
+		v->rev[i] = j;
+	}
+
+	/* A sine of amplitude A peaks at A * sum(w) / 2 */
+	v->amp_scale = 2.0 / sum;
+	make_twiddles(v);
+
+	return 0;
+}
+
+void vib_free(struct vib *v)
+{
+	unsigned int a;
+
+	for (a = 0; a < 3; a++) {
+		free(v->hist[a]);
+		free(v->mag[a]);
+	}
+
+	for (a = 0; a < 2; a++) {
+		free(v->re[a]);
+		free(v->im[a]);
+	}
+
+	free(v->hann);
+	free(v->tw);
+	free(v->rev);
+	memset(v, 0, sizeof(*v));
+}
+
+void vib_set_rate(struct vib *v, float rate_hz)
+{
+	v->rate_hz = rate_hz;
+}
+
+/* Mean removed, Hann windowed copy of one axis; fills RMS and crest */
+static void window_axis(struct vib *v, unsigned int a, float *out,
+			struct vib_axis *s)
+{
+	unsigned int n = v->cfg.size, i;
+	const float *x = v->hist[a];
+	float mean = 0, sq = 0, peak = 0, d;
+
+	for (i = 0; i < n; i++)
+		mean += x[i];
+
+	mean /= n;
+
+	for (i = 0; i < n; i++) {
+		d = x[i] - mean;
+		sq += d * d;
+
+		if (fabsf(d) > peak)
+			peak = fabsf(d);
+
+		out[i] = d * v->hann[i];
+	}
+
+	s->rms = sqrtf(sq / n);
+	s->peak = peak;
+	s->crest = s->rms > 0 ? peak / s->rms : 0;
+}
+
+/*
+ * Z = FFT(x + iy): X[k] = (Z[k] + conj Z[n-k]) / 2 and
+ * Y[k] = (Z[k] - conj Z[n-k]) / 2i, only the magnitudes are kept.
+ */
+static void split_spectra(struct vib *v)
+{
+	unsigned int n = v->cfg.size, k, j;
+	const float *re = v->re[0], *im = v->im[0];
+	float sr, si, dr, di;
+
+	for (k = 0; k <= n / 2; k++) {
+		j = (n - k) & (n - 1);
+		sr = re[k] + re[j];
+		si = im[k] - im[j];
+		dr = re[k] - re[j];
+		di = im[k] + im[j];
+		v->mag[0][k] = 0.5f * sqrtf(sr * sr + si * si);
+		v->mag[1][k] = 0.5f * sqrtf(di * di + dr * dr);
+		v->mag[2][k] = sqrtf(v->re[1][k] * v->re[1][k] +
+				     v->im[1][k] * v->im[1][k]);
+	}
+}
+
+/* Local maxima, largest first, refined by a parabola through log |X| */
+static void find_peaks(struct vib *v, const float *mag, struct vib_axis *s)
+{
+	unsigned int n = v->cfg.size, k, i, want = v->cfg.peaks;
+	float a, b, c, p, den, bin_hz, floor = s->rms * PEAK_FLOOR;
+	struct vib_peak pk;
+
+	bin_hz = v->rate_hz > 0 ? v->rate_hz / n : 1.0f;
+	s->npeaks = 0;
+
+	if (!want)
+		return;
+
+	for (k = 1; k < n / 2; k++) {
+		if (!(mag[k] > mag[k - 1] && mag[k] >= mag[k + 1]))
+			continue;
+
+		if (mag[k] * v->amp_scale <= floor ||
+		    (s->npeaks == want &&
+		     mag[k] * v->amp_scale <= s->top[want - 1].amp))
+			continue;
+
+		a = logf(mag[k - 1] + MAG_FLOOR);
+		b = logf(mag[k] + MAG_FLOOR);
+		c = logf(mag[k + 1] + MAG_FLOOR);
+		den = a - 2 * b + c;
+		p = den < 0 ? 0.5f * (a - c) / den : 0;
+		pk.freq = (k + p) * bin_hz;
+		pk.amp = expf(b - 0.25f * (a - c) * p) * v->amp_scale;
+
+		if (s->npeaks < want)
+			s->npeaks++;
+
+		for (i = s->npeaks - 1; i > 0 && s->top[i - 1].amp < pk.amp; i--)
+			s->top[i] = s->top[i - 1];
+
+		s->top[i] = pk;
+	}
+}
+
+static void analyze(struct vib *v, int64_t timestamp, vib_fn fn, void *arg)
+{
+	struct vib_summary s;
+	unsigned int a;
+
+	s.window = v->windows++;
+	s.timestamp = timestamp;
+	s.rate_hz = v->rate_hz;
+
+	window_axis(v, 0, v->re[0], &s.axis[0]);
+	window_axis(v, 1, v->im[0], &s.axis[1]);
+	window_axis(v, 2, v->re[1], &s.axis[2]);
+	memset(v->im[1], 0, v->cfg.size * sizeof(float));
+	vib_fft(v, v->re[0], v->im[0]);
+	vib_fft(v, v->re[1], v->im[1]);
+	split_spectra(v);
+
+	for (a = 0; a < 3; a++)
+		find_peaks(v, v->mag[a], &s.axis[a]);
+
+	fn(&s, arg);
+}
+
+void vib_push(struct vib *v, const float (*frames)[3], unsigned int n,
+	      int64_t timestamp, vib_fn fn, void *arg)
+{
+	unsigned int size = v->cfg.size, keep = size - v->cfg.hop, i, a;
+	int64_t period = v->rate_hz > 0 ? 1e9f / v->rate_hz : 0;
+
+	for (i = 0; i < n; i++) {
+		for (a = 0; a < 3; a++)
+			v->hist[a][v->fill] = frames[i][a];
+
+		if (++v->fill < size)
+			continue;
+
+		analyze(v, timestamp - (int64_t)(n - 1 - i) * period, fn, arg);
+
+		/* Slide by hop, the overlap stays for the next window */
+		for (a = 0; a < 3; a++)
+			memmove(v->hist[a], v->hist[a] + v->cfg.hop,
+				keep * sizeof(float));
+
+		v->fill = keep;
+	}
+}
+
+int vib_parse(struct vib_config *cfg, const char *arg)
+{
+	unsigned int size, hop = 0, peaks = DEFAULT_PEAKS;
+	char end;
+	int ret;
+
+	ret = sscanf(arg, "%u:%u:%u%c", &size, &hop, &peaks, &end);
+
+	if (ret < 1 || ret > 3)
+		return -EINVAL;
+
+	cfg->size = size;
+	cfg->hop = ret > 1 ? hop : size / 2;
+	cfg->peaks = peaks;
+
+	if (size < VIB_MIN_SIZE || size > VIB_MAX_SIZE || (size & (size - 1)) ||
+	    !cfg->hop || cfg->hop > size || peaks > VIB_MAX_PEAKS)
+		return -EINVAL;
+
+	return 0;
+}
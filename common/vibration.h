@@ -0,0 +1,90 @@
+/*
+ * Streaming vibration analysis of accelerometer frames.
+ *
+ * Frames are collected into windows of size frames that overlap by
+ * size - hop. Every full window is reduced to a summary per axis: RMS and
+ * crest factor (peak / RMS) of the signal with its mean (gravity) removed,
+ * and the largest peaks of its Hann windowed amplitude spectrum. Peaks
+ * under 0.1% of the RMS are not reported.
+ *
+ * X and Y share one complex FFT (x + iy, separated afterwards) and Z takes
+ * a second one, so a window costs two size-point FFTs. The FFT is an
+ * iterative radix-4 (radix-2^2) decimation in time over split real and
+ * imaginary arrays, with one radix-2 pass first when log2(size) is odd.
+ * The butterflies run on 4-lane float vectors, which compile to SSE or
+ * NEON without intrinsics.
+ */
+
+#ifndef VIBRATION_H
+#define VIBRATION_H
+
+#include <stdint.h>
+
+#define VIB_MIN_SIZE	16
+#define VIB_MAX_SIZE	65536
+#define VIB_MAX_PEAKS	8
+
+struct vib_config {
+	unsigned int size;		/* frames per window, power of two */
+	unsigned int hop;		/* frames between windows */
+	unsigned int peaks;		/* spectral peaks reported per axis */
+};
+
+struct vib_peak {
+	float freq;			/* Hz, or bins while the rate is 0 */
+	float amp;			/* amplitude, same units as the input */
+};
+
+struct vib_axis {
+	float rms;
+	float peak;			/* largest |x - mean| */
+	float crest;			/* peak / rms */
+	unsigned int npeaks;
+	struct vib_peak top[VIB_MAX_PEAKS];	/* by amplitude, largest first */
+};
+
+struct vib_summary {
+	uint64_t window;
+	int64_t timestamp;		/* of the window's last frame, ns */
+	float rate_hz;
+	struct vib_axis axis[3];
+};
+
+typedef void (*vib_fn)(const struct vib_summary *s, void *arg);
+
+struct vib {
+	struct vib_config cfg;
+	float rate_hz;
+	unsigned int fill;		/* frames in hist */
+	float *hist[3];			/* last size frames per axis */
+	float *hann;
+	float *re[2], *im[2];		/* FFT work: x + iy, z */
+	float *mag[3];			/* size / 2 + 1 bins */
+	float *tw;			/* twiddles of every radix-4 pass */
+	uint32_t *rev;			/* bit reversal permutation */
+	float amp_scale;		/* |X| -> single-sided amplitude */
+	uint64_t windows;
+};
+
+/* Allocates the buffers and tables, 0 or -errno. */
+int vib_init(struct vib *v, const struct vib_config *cfg);
+
+void vib_free(struct vib *v);
+
+/* Output data rate used for the peak frequencies and window timestamps. */
+void vib_set_rate(struct vib *v, float rate_hz);
+
+/*
+ * Appends n frames, the last one taken at timestamp, and calls fn for
+ * every window they complete.
+ */
+void vib_push(struct vib *v, const float (*frames)[3], unsigned int n,
+	      int64_t timestamp, vib_fn fn, void *arg);
+
+/* In-place forward FFT of size points, exposed for the benchmark. */
+void vib_fft(const struct vib *v, float *re, float *im);
+
+/* Parses "<size>[:<hop>[:<peaks>]]", hop defaults to size / 2. */
+int vib_parse(struct vib_config *cfg, const char *arg);
+
+#endif
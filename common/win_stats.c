@@ -0,0 +1,332 @@
+/*
+ * Rolling-window statistics over tumbling and sliding windows.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "win_stats.h"
+
+#define NS_PER_SEC	1000000000LL
+
+static const struct {
+	char suffix;
+	int64_t ns;
+} units[] = {
+	{ 'd', 86400 * NS_PER_SEC },
+	{ 'h', 3600 * NS_PER_SEC },
+	{ 'm', 60 * NS_PER_SEC },
+	{ 's', NS_PER_SEC },
+};
+
+static int parse_duration(const char *s, const char **end, int64_t *ns)
+{
+	char *p;
+	long val;
+	size_t i;
+
+	val = strtol(s, &p, 10);
+
+	if (p == s || val <= 0)
+		return -EINVAL;
+
+	*ns = val * NS_PER_SEC;
+
+	for (i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+		if (*p == units[i].suffix) {
+			*ns = val * units[i].ns;
+			p++;
+			break;
+		}
+	}
+
+	*end = p;
+
+	return 0;
+}
+
+int win_stats_parse(struct win_spec *specs, unsigned int max,
+		    const char *arg)
+{
+	struct win_spec *w;
+	unsigned int n = 0;
+	const char *p = arg;
+
+	while (*p) {
+		if (n == max)
+			return -EINVAL;
+
+		w = &specs[n];
+
+		if (parse_duration(p, &p, &w->length) < 0)
+			return -EINVAL;
+
+		w->hop = w->length;
+
+		if (*p == '/' && parse_duration(p + 1, &p, &w->hop) < 0)
+			return -EINVAL;
+
+		if (w->length % w->hop ||
+		    w->length / w->hop > WIN_STATS_MAX_PANES)
+			return -EINVAL;
+
+		n++;
+
+		if (*p == ',')
+			p++;
+		else if (*p)
+			return -EINVAL;
+	}
+
+	return n ? (int)n : -EINVAL;
+}
+
+static int format_duration(char *buf, int len, int64_t ns)
+{
+	size_t i;
+
+	for (i = 0; i < sizeof(units) / sizeof(units[0]) - 1; i++)
+		if (ns % units[i].ns == 0)
+			break;
+
+	return snprintf(buf, len, "%lld%c", (long long)(ns / units[i].ns),
+			units[i].suffix);
+}
+
+void win_stats_format(char *buf, int len, const struct win_spec *spec)
+{
+	int n;
+
+	n = format_duration(buf, len, spec->length);
+
+	if (spec->hop != spec->length && n > 0 && n + 1 < len) {
+		buf[n] = '/';
+		format_duration(buf + n + 1, len - n - 1, spec->hop);
+	}
+}
+
+int win_stats_init(struct win_stats *w, const struct win_spec *spec)
+{
+	memset(w, 0, sizeof(*w));
+	w->spec = *spec;
+	w->npanes = spec->length / spec->hop;
+	w->pane = calloc(w->npanes, sizeof(*w->pane));
+	w->min.seq = calloc(w->npanes, sizeof(*w->min.seq));
+	w->max.seq = calloc(w->npanes, sizeof(*w->max.seq));
+
+	if (!w->pane || !w->min.seq || !w->max.seq) {
+		win_stats_free(w);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+void win_stats_free(struct win_stats *w)
+{
+	free(w->pane);
+	free(w->min.seq);
+	free(w->max.seq);
+	w->pane = NULL;
+	w->min.seq = NULL;
+	w->max.seq = NULL;
+}
+
+void win_stats_reset(struct win_stats *w, int64_t origin)
+{
+	memset(&w->open, 0, sizeof(w->open));
+	memset(&w->total, 0, sizeof(w->total));
+	memset(w->pane, 0, w->npanes * sizeof(*w->pane));
+	w->closed = 0;
+	w->min.len = 0;
+	w->max.len = 0;
+	w->next = origin + w->spec.hop;
+	w->emitted = 0;
+}
+
+static void acc_add(struct win_acc *a, int32_t x)
+{
+	double d = x - a->mean;
+
+	if (a->n == 0 || x < a->min)
+		a->min = x;
+
+	if (a->n == 0 || x > a->max)
+		a->max = x;
+
+	a->n++;
+	a->mean += d / a->n;
+	a->m2 += d * (x - a->mean);
+}
+
+/* Chan et al. pairwise update; min and max are kept by the deques */
+static void acc_merge(struct win_acc *t, const struct win_acc *p)
+{
+	uint64_t n = t->n + p->n;
+	double d = p->mean - t->mean;
+
+	if (!p->n)
+		return;
+
+	t->mean += d * p->n / n;
+	t->m2 += p->m2 + d * d * t->n * p->n / n;
+	t->n = n;
+}
+
+/* Takes p back out of t, the inverse of acc_merge() */
+static void acc_unmerge(struct win_acc *t, const struct win_acc *p)
+{
+	uint64_t n;
+	double mean, d;
+
+	if (!p->n)
+		return;
+
+	if (p->n >= t->n) {
+		memset(t, 0, sizeof(*t));
+		return;
+	}
+
+	n = t->n - p->n;
+	mean = (t->mean * t->n - p->mean * p->n) / n;
+	d = p->mean - mean;
+	t->m2 -= p->m2 + d * d * p->n * n / t->n;
+	t->mean = mean;
+	t->n = n;
+
+	if (t->m2 < 0)
+		t->m2 = 0;
+}
+
+static const struct win_acc *pane_at(const struct win_stats *w,
+				     uint64_t seq)
+{
+	return &w->pane[seq % w->npanes];
+}
+
+static uint64_t dq_front(const struct win_deque *q)
+{
+	return q->seq[q->head];
+}
+
+static uint64_t dq_back(const struct win_stats *w, const struct win_deque *q)
+{
+	return q->seq[(q->head + q->len - 1) % w->npanes];
+}
+
+static void dq_push(const struct win_stats *w, struct win_deque *q,
+		    uint64_t seq)
+{
+	q->seq[(q->head + q->len) % w->npanes] = seq;
+	q->len++;
+}
+
+/* Drops panes that left the window from the front */
+static void dq_expire(const struct win_stats *w, struct win_deque *q,
+		      uint64_t oldest)
+{
+	while (q->len && dq_front(q) < oldest) {
+		q->head = (q->head + 1) % w->npanes;
+		q->len--;
+	}
+}
+
+static void emit(const struct win_stats *w, int64_t end, win_stats_fn fn,
+		 void *arg)
+{
+	struct win_result r;
+
+	r.spec = &w->spec;
+	r.end = end;
+	r.n = w->total.n;
+	r.min = pane_at(w, dq_front(&w->min))->min;
+	r.max = pane_at(w, dq_front(&w->max))->max;
+	r.mean = w->total.mean;
+	r.stddev = r.n > 1 ? sqrt(w->total.m2 / (r.n - 1)) : 0.0;
+	fn(&r, arg);
+}
+
+/* Closes the open pane as seq w->closed and emits the window ending at end */
+static void close_pane(struct win_stats *w, int64_t end, win_stats_fn fn,
+		       void *arg)
+{
+	uint64_t seq = w->closed, i;
+	struct win_acc *slot = &w->pane[seq % w->npanes];
+
+	if (seq >= w->npanes)
+		acc_unmerge(&w->total, slot);
+
+	*slot = w->open;
+	acc_merge(&w->total, slot);
+	memset(&w->open, 0, sizeof(w->open));
+	w->closed++;
+
+	if (seq + 1 >= w->npanes) {
+		dq_expire(w, &w->min, seq + 1 - w->npanes);
+		dq_expire(w, &w->max, seq + 1 - w->npanes);
+	}
+
+	if (slot->n) {
+		while (w->min.len && pane_at(w, dq_back(w, &w->min))->min >=
+				     slot->min)
+			w->min.len--;
+
+		while (w->max.len && pane_at(w, dq_back(w, &w->max))->max <=
+				     slot->max)
+			w->max.len--;
+
+		dq_push(w, &w->min, seq);
+		dq_push(w, &w->max, seq);
+	}
+
+	/* Once per turn of the ring, amortised O(1) */
+	if (seq % w->npanes == w->npanes - 1) {
+		memset(&w->total, 0, sizeof(w->total));
+
+		for (i = 0; i < w->npanes; i++)
+			acc_merge(&w->total, &w->pane[i]);
+	}
+
+	if (w->total.n) {
+		emit(w, end, fn, arg);
+		w->emitted++;
+	}
+}
+
+/* Passes every boundary at or before timestamp */
+static void advance(struct win_stats *w, int64_t timestamp, win_stats_fn fn,
+		    void *arg)
+{
+	unsigned int i;
+
+	/* After npanes empty panes the window is empty, skip the rest */
+	for (i = 0; timestamp >= w->next && i <= w->npanes; i++) {
+		close_pane(w, w->next, fn, arg);
+		w->next += w->spec.hop;
+	}
+
+	if (timestamp >= w->next)
+		w->next += ((timestamp - w->next) / w->spec.hop + 1) *
+			   w->spec.hop;
+}
+
+void win_stats_push(struct win_stats *w, int64_t timestamp, int32_t value,
+		    win_stats_fn fn, void *arg)
+{
+	if (timestamp >= w->next)
+		advance(w, timestamp, fn, arg);
+
+	acc_add(&w->open, value);
+}
+
+void win_stats_flush(struct win_stats *w, int64_t timestamp,
+		     win_stats_fn fn, void *arg)
+{
+	advance(w, timestamp, fn, arg);
+
+	if (w->open.n)
+		close_pane(w, timestamp, fn, arg);
+}
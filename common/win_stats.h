@@ -0,0 +1,97 @@
+/*
+ * Rolling-window statistics: count, min, max, mean and standard deviation
+ * of one channel over tumbling or sliding windows.
+ *
+ * A window of length L that moves by hop H (H == L: tumbling) is kept as
+ * a ring of L / H panes. A sample only updates the open pane (Welford),
+ * which is O(1). When a hop boundary passes the pane is closed, merged
+ * into the window totals (Chan et al.) and the pane leaving the window is
+ * taken out again by the inverse merge; min and max come from monotonic
+ * deques of panes. Every boundary emits one result through a callback.
+ * The totals are rebuilt from the panes each time the ring wraps, so
+ * rounding from the inverse merges cannot build up.
+ *
+ * Memory is allocated once by win_stats_init() and depends on L / H only,
+ * not on the sample rate. Boundaries are multiples of H after the origin
+ * given to win_stats_reset(), so windows of the same hop line up.
+ */
+
+#ifndef WIN_STATS_H
+#define WIN_STATS_H
+
+#include <stdint.h>
+
+#define WIN_STATS_MAX		8	/* windows per channel */
+#define WIN_STATS_MAX_PANES	4096
+
+struct win_spec {
+	int64_t length;			/* ns */
+	int64_t hop;			/* ns, divides length */
+};
+
+/* Welford accumulator */
+struct win_acc {
+	uint64_t n;
+	double mean, m2;
+	int32_t min, max;
+};
+
+struct win_result {
+	const struct win_spec *spec;
+	int64_t end;			/* window end, ns after the origin */
+	uint64_t n;
+	int32_t min, max;
+	double mean, stddev;		/* sample standard deviation */
+};
+
+typedef void (*win_stats_fn)(const struct win_result *r, void *arg);
+
+/* Monotonic deque of pane sequence numbers, npanes entries at most */
+struct win_deque {
+	uint64_t *seq;
+	unsigned int head, len;
+};
+
+struct win_stats {
+	struct win_spec spec;
+	unsigned int npanes;
+	struct win_acc open;		/* pane being filled */
+	struct win_acc total;		/* closed panes inside the window */
+	struct win_acc *pane;		/* ring, pane seq at seq % npanes */
+	uint64_t closed;		/* panes closed since the reset */
+	struct win_deque min, max;	/* increasing min, decreasing max */
+	int64_t next;			/* end of the open pane */
+	uint64_t emitted;
+};
+
+/*
+ * Parses a comma separated list of "<length>[/<hop>]" with s, m, h or d
+ * suffixes, e.g. "1m,1h,1d,1h/1m". Returns the number of windows or
+ * -EINVAL.
+ */
+int win_stats_parse(struct win_spec *specs, unsigned int max,
+		    const char *arg);
+
+/* "1h/1m" or "1d", the shortest unit that is exact */
+void win_stats_format(char *buf, int len, const struct win_spec *spec);
+
+/* Allocates the pane ring and deques, 0 or -errno. */
+int win_stats_init(struct win_stats *w, const struct win_spec *spec);
+
+void win_stats_free(struct win_stats *w);
+
+/* Empties the window; boundaries fall on origin + k * hop */
+void win_stats_reset(struct win_stats *w, int64_t origin);
+
+/*
+ * Adds a sample. Results are emitted, before the sample is counted, for
+ * every boundary at or before timestamp whose window holds samples.
+ */
+void win_stats_push(struct win_stats *w, int64_t timestamp, int32_t value,
+		    win_stats_fn fn, void *arg);
+
+/* Ends the open pane at timestamp and emits the partial window */
+void win_stats_flush(struct win_stats *w, int64_t timestamp,
+		     win_stats_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * Converter for binary HTU21D logs.
+ *
+ * Renders a log written by "htu21d_menu -b" in the same text format the
+ * menu application writes by default:
+ *
+ *   [12.004] Temperature: 23.456000 celsius
+ *   [12.004] Humidity: 45.678000 RH
+ *
+ * Rolling aggregates come out one statistic per line:
+ *
+ *   [3600.000] Temperature 3600 s mean: 23.412000 celsius
+ *
+ * Usage: htu21d_logcat <binary log> [text file]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../../common/binlog.h"
+
+#define DIVESER 1000
+
+static const char *const agg_source[2][2] = {
+	{ "Temperature", "celsius" }, { "Humidity", "RH" },
+};
+
+static const char *const agg_stat[BINLOG_AGG_STATS] = {
+	"count", "min", "max", "mean", "stddev"
+};
+
+static void print_aggregate(FILE *fptr, const struct binlog_record *rec)
+{
+	unsigned int src = BINLOG_AGG_SOURCE(rec->channel);
+	unsigned int stat = BINLOG_AGG_STAT(rec->channel);
+
+	if (src > BINLOG_HUMIDITY || stat >= BINLOG_AGG_STATS) {
+		fprintf(fptr, "Channel %u: %d\n", rec->channel, rec->value);
+		return;
+	}
+
+	fprintf(fptr, "%s %u s %s: ", agg_source[src][0],
+		BINLOG_AGG_SECONDS(rec->channel), agg_stat[stat]);
+
+	if (stat == BINLOG_AGG_COUNT)
+		fprintf(fptr, "%d\n", rec->value);
+	else
+		fprintf(fptr, "%lf %s\n", (double)rec->value / DIVESER,
+			agg_source[src][1]);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct binlog_record *rec;
+	struct binlog_file file;
+	FILE *fptr = stdout;
+	int64_t t;
+	uint64_t i;
+	int ret;
+
+	if (argc < 2 || argc > 3) {
+		printf("Usage: %s <binary log> [text file]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	ret = binlog_map(&file, argv[1]);
+
+	if (ret < 0) {
+		printf("Failed to open binary log %s: %s\n", argv[1],
+		       strerror(-ret));
+		return ret;
+	}
+
+	if (argc == 3) {
+		fptr = fopen(argv[2], "w");
+
+		if (!fptr) {
+			printf("Failed to create %s\n", argv[2]);
+			binlog_unmap(&file);
+			return -errno;
+		}
+	}
+
+	for (i = 0; i < file.count; i++) {
+		rec = &file.rec[i];
+		t = rec->timestamp - file.hdr->start_ns;
+
+		fprintf(fptr, "[%lld.%03lld] ", (long long)(t / 1000000000),
+			(long long)(t / 1000000 % 1000));
+
+		if (rec->channel & BINLOG_AGGREGATE) {
+			print_aggregate(fptr, rec);
+			continue;
+		}
+
+		switch (rec->channel) {
+		case BINLOG_TEMPERATURE:
+			fprintf(fptr, "Temperature: %lf celsius\n",
+				(double)rec->value / DIVESER);
+			break;
+		case BINLOG_HUMIDITY:
+			fprintf(fptr, "Humidity: %lf RH\n",
+				(double)rec->value / DIVESER);
+			break;
+		case BINLOG_TEMPERATURE_INTERVAL:
+			fprintf(fptr, "Temperature interval: %d ms\n",
+				rec->value);
+			break;
+		case BINLOG_HUMIDITY_INTERVAL:
+			fprintf(fptr, "Humidity interval: %d ms\n", rec->value);
+			break;
+		default:
+			fprintf(fptr, "Channel %u: %d\n", rec->channel,
+				rec->value);
+		}
+	}
+
+	if (fptr != stdout)
+		fclose(fptr);
+
+	binlog_unmap(&file);
+
+	return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * Time-range queries over HTU21D logs.
+ *
+ * Works on the text log of htu21d_menu, using its "<log>.idx" sparse
+ * index to start reading right before the range, and on binary logs
+ * (htu21d_menu -b), whose fixed-size records are binary-searched
+ * directly; the format is detected from the file. Only the records of the
+ * range are decoded and the scan stops as soon as it is past its end.
+ *
+ * Times are seconds since the start of the log ("3600.5") or local wall
+ * clock time ("2024-05-14 02:00[:00]"):
+ *
+ *   htu21d_query -c humidity -f "2024-05-14 02:00" -t "2024-05-14 03:00" log
+ *   htu21d_query -a -B 600 log        # min/max/mean per 10 minutes
+ *
+ * Usage: htu21d_query [-c temperature|humidity] [-f from] [-t to]
+ *                     [-a] [-B bucket_seconds] [-v] <log>
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../common/binlog.h"
+#include "../../common/iio_parse.h"
+#include "../../common/log_index.h"
+
+#define MILLI_DIGITS	3
+#define PRINT_DIGITS	3
+#define CHANNELS	2
+#define PATH_LEN	256
+#define NSEC		1000000000LL
+
+/*
+ * The two sampling threads take their timestamp before reading the sensor
+ * and queue the line afterwards, so neighbouring records can be out of
+ * order by a read time (up to 50 ms for an HTU21D conversion). Start and
+ * stop the scan this much outside the range.
+ */
+#define SLACK_NS	(NSEC / 10)
+
+static const char *const chan_name[CHANNELS] = { "Temperature", "Humidity" };
+static const char *const chan_unit[CHANNELS] = { "celsius", "RH" };
+
+struct bucket {
+	int64_t index;
+	uint64_t count;
+	int64_t sum, min, max;
+};
+
+struct query {
+	int64_t from, to;		/* ns since the start of the log */
+	int64_t bucket_ns;		/* 0: one bucket for the whole range */
+	int chan;			/* -1: all */
+	bool aggregate;
+	FILE *out;
+	struct bucket agg[CHANNELS];
+	uint64_t scanned, matched;
+};
+
+static void print_time(FILE *out, int64_t t)
+{
+	fprintf(out, "[%lld.%03lld]", (long long)(t / NSEC),
+		(long long)(t / 1000000 % 1000));
+}
+
+static void print_bucket(struct query *q, unsigned int chan)
+{
+	struct bucket *b = &q->agg[chan];
+	char min[32], max[32], mean[32];
+	int64_t start;
+
+	if (!b->count)
+		return;
+
+	start = q->bucket_ns ? q->from + b->index * q->bucket_ns : q->from;
+
+	iio_format_fixed(min, sizeof(min), b->min, MILLI_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(max, sizeof(max), b->max, MILLI_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(mean, sizeof(mean), b->sum / (int64_t)b->count,
+			 MILLI_DIGITS, PRINT_DIGITS);
+	print_time(q->out, start < 0 ? 0 : start);
+	fprintf(q->out, " %s: %llu samples, min %s, max %s, mean %s %s\n",
+		chan_name[chan], (unsigned long long)b->count, min, max, mean,
+		chan_unit[chan]);
+	b->count = 0;
+}
+
+static void aggregate(struct query *q, unsigned int chan, int64_t t,
+		      int64_t value)
+{
+	struct bucket *b = &q->agg[chan];
+	int64_t index = q->bucket_ns ? (t - q->from) / q->bucket_ns : 0;
+
+	if (b->count && index != b->index)
+		print_bucket(q, chan);
+
+	if (!b->count) {
+		b->index = index;
+		b->sum = 0;
+		b->min = value;
+		b->max = value;
+	}
+
+	b->count++;
+	b->sum += value;
+
+	if (value < b->min)
+		b->min = value;
+
+	if (value > b->max)
+		b->max = value;
+}
+
+/* "[12.004] Temperature: 23.456000 celsius" */
+static int parse_time(const char *p, const char *end, int64_t *t)
+{
+	int64_t sec = 0, ms = 0;
+	int digits = 0;
+
+	if (p == end || *p++ != '[')
+		return -EINVAL;
+
+	while (p < end && *p >= '0' && *p <= '9')
+		sec = sec * 10 + (*p++ - '0');
+
+	if (p == end || *p++ != '.')
+		return -EINVAL;
+
+	while (p < end && *p >= '0' && *p <= '9' && digits++ < 3)
+		ms = ms * 10 + (*p++ - '0');
+
+	if (digits != 3 || p == end || *p != ']')
+		return -EINVAL;
+
+	*t = sec * NSEC + ms * 1000000;
+
+	return 0;
+}
+
+static int parse_channel(const char *p, const char *end, const char **value)
+{
+	unsigned int i;
+	size_t len;
+
+	p = memchr(p, ' ', end - p);
+
+	if (!p)
+		return -EINVAL;
+
+	p++;
+
+	for (i = 0; i < CHANNELS; i++) {
+		len = strlen(chan_name[i]);
+
+		if ((size_t)(end - p) > len + 1 && p[len] == ':' &&
+		    !memcmp(p, chan_name[i], len)) {
+			*value = p + len + 2;
+			return i;
+		}
+	}
+
+	return -EINVAL;
+}
+
+static void text_record(struct query *q, const char *line, const char *end,
+			int64_t t)
+{
+	const char *value, *sep;
+	int64_t val;
+	int chan;
+
+	chan = parse_channel(line, end, &value);
+
+	if (chan < 0 || (q->chan >= 0 && chan != q->chan))
+		return;
+
+	q->matched++;
+
+	if (!q->aggregate) {
+		fwrite(line, 1, end - line + 1, q->out);
+		return;
+	}
+
+	sep = memchr(value, ' ', end - value);
+
+	if (iio_parse_fixed(value, (sep ? sep : end) - value, MILLI_DIGITS,
+			    &val) == 0)
+		aggregate(q, chan, t, val);
+}
+
+static int map_file(const char *path, const char **map, size_t *size)
+{
+	struct stat st;
+	int fd, ret;
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &st) < 0) {
+		ret = -errno;
+		close(fd);
+		return ret;
+	}
+
+	*size = st.st_size;
+	*map = NULL;
+
+	if (!st.st_size) {
+		close(fd);
+		return 0;
+	}
+
+	*map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	ret = -errno;
+	close(fd);
+
+	if (*map == MAP_FAILED)
+		return ret;
+
+	return 0;
+}
+
+static int query_text(struct query *q, const char *path,
+		      const struct log_index_file *idx)
+{
+	const char *map, *p, *end, *nl;
+	uint64_t offset = 0;
+	size_t size = 0;
+	int64_t t;
+	int ret;
+
+	ret = map_file(path, &map, &size);
+
+	if (ret < 0)
+		return ret;
+
+	if (idx->hdr)
+		offset = log_index_lookup(idx, idx->hdr->start_ns + q->from -
+					  SLACK_NS);
+
+	/* An index entry can be ahead of a log that is still being written */
+	if (offset > size)
+		offset = 0;
+
+	madvise((void *)map, size, MADV_SEQUENTIAL);
+	end = map + size;
+
+	for (p = map + offset; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+
+		if (!nl)
+			break;
+
+		q->scanned++;
+
+		if (parse_time(p, nl, &t) < 0)
+			continue;
+
+		if (t >= q->to && t - q->to >= SLACK_NS)
+			break;
+
+		if (t >= q->from && t < q->to)
+			text_record(q, p, nl, t);
+	}
+
+	if (map)
+		munmap((void *)map, size);
+
+	return 0;
+}
+
+static int query_binary(struct query *q, const struct binlog_file *file)
+{
+	const struct binlog_record *rec;
+	uint64_t lo = 0, hi = file->count, mid;
+	char value[32];
+	int64_t t;
+
+	/* First record in the slack before the range */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+
+		if (file->rec[mid].timestamp - file->hdr->start_ns <
+		    q->from - SLACK_NS)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < file->count; lo++) {
+		rec = &file->rec[lo];
+		t = rec->timestamp - file->hdr->start_ns;
+		q->scanned++;
+
+		if (t >= q->to && t - q->to >= SLACK_NS)
+			break;
+
+		if (t < q->from || t >= q->to || rec->channel >= CHANNELS ||
+		    (q->chan >= 0 && rec->channel != (unsigned int)q->chan))
+			continue;
+
+		q->matched++;
+
+		if (q->aggregate) {
+			aggregate(q, rec->channel, t, rec->value);
+			continue;
+		}
+
+		iio_format_fixed(value, sizeof(value), rec->value,
+				 MILLI_DIGITS, 6);
+		print_time(q->out, t);
+		fprintf(q->out, " %s: %s %s\n", chan_name[rec->channel],
+			value, chan_unit[rec->channel]);
+	}
+
+	return 0;
+}
+
+/*
+ * Seconds since the start of the log, or local wall clock time converted
+ * with the log's CLOCK_REALTIME reference (0 if it has none).
+ */
+static int parse_when(const char *arg, int64_t realtime_ns, int64_t *t)
+{
+	struct tm tm;
+	const char *end;
+	int64_t val;
+
+	if (strchr(arg, '-') != arg && strchr(arg, '-')) {
+		if (!realtime_ns)
+			return -ENOENT;
+
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(arg, "%Y-%m-%d %H:%M:%S", &tm);
+
+		if (!end || *end) {
+			memset(&tm, 0, sizeof(tm));
+			end = strptime(arg, "%Y-%m-%d %H:%M", &tm);
+		}
+
+		if (!end || *end)
+			return -EINVAL;
+
+		tm.tm_isdst = -1;
+		*t = (int64_t)mktime(&tm) * NSEC - realtime_ns;
+
+		return 0;
+	}
+
+	if (iio_parse_fixed(arg, strlen(arg), 9, &val) < 0)
+		return -EINVAL;
+
+	*t = val;
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *from = NULL, *to = NULL, *path;
+	char idx_path[PATH_LEN];
+	struct log_index_file idx;
+	struct binlog_file bin;
+	int64_t realtime_ns = 0;
+	struct query q;
+	bool binary = false, verbose = false;
+	unsigned int i;
+	int opt, ret;
+
+	memset(&q, 0, sizeof(q));
+	q.to = INT64_MAX;
+	q.chan = -1;
+	q.out = stdout;
+
+	while ((opt = getopt(argc, argv, "c:f:t:aB:v")) != -1) {
+		switch (opt) {
+		case 'c':
+			for (i = 0; i < CHANNELS; i++)
+				if (!strcasecmp(optarg, chan_name[i]))
+					q.chan = i;
+
+			if (q.chan < 0) {
+				printf("Unknown channel %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'f':
+			from = optarg;
+			break;
+		case 't':
+			to = optarg;
+			break;
+		case 'a':
+			q.aggregate = true;
+			break;
+		case 'B':
+			q.bucket_ns = atof(optarg) * NSEC;
+			q.aggregate = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			goto usage;
+		}
+	}
+
+	if (optind != argc - 1)
+		goto usage;
+
+	path = argv[optind];
+	memset(&idx, 0, sizeof(idx));
+
+	ret = binlog_map(&bin, path);
+
+	if (ret == 0) {
+		binary = true;
+		realtime_ns = bin.hdr->realtime_ns;
+	} else if (ret != -EINVAL) {
+		printf("Failed to open %s: %s\n", path, strerror(-ret));
+		return ret;
+	} else {
+		log_index_path(idx_path, sizeof(idx_path), path);
+		ret = log_index_map(&idx, idx_path);
+
+		if (ret == 0)
+			realtime_ns = idx.hdr->realtime_ns;
+		else if (verbose)
+			fprintf(stderr, "No index %s (%s), scanning the whole "
+				"log\n", idx_path, strerror(-ret));
+	}
+
+	ret = 0;
+
+	if (from)
+		ret = parse_when(from, realtime_ns, &q.from);
+
+	if (!ret && to)
+		ret = parse_when(to, realtime_ns, &q.to);
+
+	if (ret < 0) {
+		printf(ret == -ENOENT ? "Wall clock times need the log's "
+		       "index\n" : "Invalid time, use seconds or "
+		       "\"YYYY-MM-DD HH:MM[:SS]\"\n");
+		goto out;
+	}
+
+	if (binary)
+		ret = query_binary(&q, &bin);
+	else
+		ret = query_text(&q, path, &idx);
+
+	if (ret < 0) {
+		printf("Failed to read %s: %s\n", path, strerror(-ret));
+		goto out;
+	}
+
+	for (i = 0; i < CHANNELS; i++)
+		print_bucket(&q, i);
+
+	if (verbose)
+		fprintf(stderr, "%llu records scanned, %llu matched\n",
+			(unsigned long long)q.scanned,
+			(unsigned long long)q.matched);
+
+out:
+	if (binary)
+		binlog_unmap(&bin);
+	else
+		log_index_unmap(&idx);
+
+	return ret;
+
+usage:
+	printf("Usage: %s [-c temperature|humidity] [-f from] [-t to] [-a] "
+	       "[-B bucket_seconds] [-v] <log>\n", argv[0]);
+	return -EINVAL;
+}
@@ -5,42 +5,622 @@
  * Features:
  * - Read temperature and humidity via sysfs
  * - Multithreaded data logging
- * - User-configurable logging interval
+ * - User-configurable logging interval in milliseconds, scheduled on
+ *   absolute CLOCK_MONOTONIC deadlines so the period does not drift
+ * - Missed deadline and overrun counters per channel
+ * - The samplers wait on a CLOCK_MONOTONIC condition variable, so a new
+ *   interval applies and stopping completes in milliseconds even when the
+ *   interval is long; the time to stop is printed
  * - Automatic log file creation
+ * - Text log lines are committed by a dedicated writer thread in large
+ *   write() calls; durability is selectable with -s (none, fdatasync every
+ *   N ms or every N records)
+ * - Optional compact binary log (-b): 16 byte records appended through an
+ *   mmap'ed, pre-extended file; htu21d_logcat renders it as text
+ * - Optional columnar compressed log (-c): per-channel blocks with
+ *   delta-of-delta timestamps and delta values, a few bytes per sample;
+ *   colog_cat renders it as text
+ * - Optional adaptive sampling (-A min:max, -D deltas): each channel's
+ *   interval follows its slope and noise between min and max ms, the
+ *   effective interval is logged whenever it changes
+ * - Optional threshold alarms (-T): the HTU21D driver has no IIO events, so
+ *   each threshold is checked with hysteresis by the channel's sampler on
+ *   every sample and reported as soon as it is crossed
+ * - Text logs get a sparse time index "<log>.idx" (an entry every -i N
+ *   records) so htu21d_query can jump straight to a time range
+ * - Optional single-threaded event-loop engine (-E): every channel is a
+ *   timerfd in one epoll instance together with stdin and shutdown signals,
+ *   so no logger threads or mutexes are needed
+ * - Per-stage latency histograms (read, decode, sink) for every sampling
+ *   thread, merged and printed from the menu or on SIGUSR1
+ * - Optional publisher mode (-p /name): the newest timestamped sample of
+ *   each channel is also published in a POSIX shared-memory segment that
+ *   any number of other processes read without syscalls (sample_shm.h)
+ * - Optional rolling statistics (-G): count, min, max, mean and standard
+ *   deviation of each channel over tumbling and sliding windows (e.g. a
+ *   minute, an hour and a day), updated in O(1) per sample and written to
+ *   the log as compact aggregate records whenever a window ends; -N then
+ *   leaves the raw samples out of the log
+ * - "Read data" is served from the latest sample of the logging threads
+ *   when it is younger than the max age (-a ms); only a miss reads the
+ *   sensor, with pread() so the loggers' file offset is left alone
  */
 
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
+#include "../../common/adaptive_rate.h"
+#include "../../common/binlog.h"
+#include "../../common/colog.h"
+#include "../../common/ev_loop.h"
+#include "../../common/iio_parse.h"
+#include "../../common/lat_hist.h"
+#include "../../common/log_index.h"
+#include "../../common/log_writer.h"
+#include "../../common/periodic.h"
+#include "../../common/sample_cache.h"
+#include "../../common/sample_shm.h"
+#include "../../common/sysfs.h"
+#include "../../common/threshold.h"
+#include "../../common/win_stats.h"
+
 #define MAX	50
-#define COUNT	5
-#define DIVESER 1000
+#define COUNT	15
+#define MILLI_DIGITS	3
+#define PRINT_DIGITS	6
+#define DEFAULT_INTERVAL_MS	1000
+#define DEFAULT_MAX_AGE_MS	2000
+#define BINLOG_SYNC_MS		1000
+#define LINE_MAX		128
+#define PATH_LEN		256
+#define DEFAULT_TEMP_DELTA	200	/* milli-celsius */
+#define DEFAULT_HUM_DELTA	1000	/* milli-RH */
+#define MAX_ALARMS		4
+#define NS_PER_SEC		1000000000LL
 
-pthread_mutex_t mutex;
 pthread_mutex_t mutex_temp_interval;
 pthread_mutex_t mutex_hum_interval;
 pthread_mutex_t mutex_temp_fptr;
 pthread_mutex_t mutex_hum_fptr;
 
+/* Sample stages timed by the latency histograms */
+enum stage {
+	STAGE_READ,		/* sysfs read() */
+	STAGE_DECODE,		/* text to fixed point */
+	STAGE_SINK,		/* format + queue for the log */
+	STAGES,
+};
+
+static const char *const stage_name[STAGES] = { "read", "decode", "sink" };
+
 struct thread_data {
 	FILE *fptr;
 	int fd;
-	int interval;
+	int interval;		/* milliseconds */
+	int shm_chan;			/* -1 when not publishing */
+	struct lat_hist lat[STAGES];	/* written by the sampling thread only */
+	struct adaptive_rate rate;	/* adaptive mode only */
+	struct periodic_wake wake;	/* interval change or stop */
 } temperature, humidity;
 
+/* Latest sample per channel, indexed by binlog channel id */
+static struct sample_cache cache;
+
+/* Publisher mode (-p): latest samples for other processes */
+static struct sample_shm shm;
+
+static void publish(int chan, int64_t timestamp, int32_t value)
+{
+	int64_t val = value;
+
+	if (chan >= 0)
+		sample_shm_publish(&shm, chan, timestamp, &val);
+}
+
+/* Monotonic time at which logging to the current file started */
+static int64_t log_start_ns;
+
+/* Binary log mode (-b): fixed-size records appended through mmap */
+static bool binary_log;
+static struct binlog binlog;
+
+/* Adaptive sampling (-A): interval bounds and delta by binlog channel id */
+static bool adaptive;
+static struct adaptive_rate_config adapt_cfg[2] = {
+	[BINLOG_TEMPERATURE] = { .delta = DEFAULT_TEMP_DELTA },
+	[BINLOG_HUMIDITY] = { .delta = DEFAULT_HUM_DELTA },
+};
+
+/* Threshold alarms (-T), each only touched by its channel's sampler */
+struct alarm {
+	uint32_t id;			/* binlog channel */
+	struct threshold th;
+};
+
+static struct alarm alarms[MAX_ALARMS];
+static int nalarms;
+
+/* Columnar log mode (-c): compressed blocks, channel index by binlog id */
+static bool columnar_log;
+static struct colog colog;
+static int colog_chan[4];
+
+static int colog_start(int fd)
+{
+	int ret;
+
+	ret = colog_open(&colog, fd, log_start_ns);
+
+	if (ret < 0)
+		return ret;
+
+	colog_chan[BINLOG_TEMPERATURE] = colog_add_channel(&colog,
+							   "Temperature",
+							   "celsius", 1,
+							   MILLI_DIGITS, 1);
+	colog_chan[BINLOG_HUMIDITY] = colog_add_channel(&colog, "Humidity",
+							"RH", 1, MILLI_DIGITS,
+							1);
+
+	if (colog_chan[BINLOG_TEMPERATURE] < 0)
+		return colog_chan[BINLOG_TEMPERATURE];
+
+	if (colog_chan[BINLOG_HUMIDITY] < 0)
+		return colog_chan[BINLOG_HUMIDITY];
+
+	if (!adaptive)
+		return 0;
+
+	colog_chan[BINLOG_TEMPERATURE_INTERVAL] =
+		colog_add_channel(&colog, "Temperature interval", "ms", 1, 0,
+				  1);
+	colog_chan[BINLOG_HUMIDITY_INTERVAL] =
+		colog_add_channel(&colog, "Humidity interval", "ms", 1, 0, 1);
+
+	if (colog_chan[BINLOG_TEMPERATURE_INTERVAL] < 0)
+		return colog_chan[BINLOG_TEMPERATURE_INTERVAL];
+
+	return colog_chan[BINLOG_HUMIDITY_INTERVAL] < 0 ?
+	       colog_chan[BINLOG_HUMIDITY_INTERVAL] : 0;
+}
+
+static void colog_sample(uint32_t id, int64_t timestamp, int32_t value)
+{
+	int64_t val = value;
+
+	colog_append(&colog, colog_chan[id], timestamp, &val);
+}
+
+/*
+ * Text lines go through the group-commit writer, the sampling threads only
+ * format the line and queue it. Durability is chosen with -s.
+ */
+static struct log_writer log_writer;
+static struct log_writer_config log_writer_cfg;
+
+/* Every index_stride-th text line is indexed, 0 disables the index */
+static struct log_index log_index;
+static unsigned int index_stride = LOG_INDEX_STRIDE;
+
+static int start_text_log(const char *file_name, int fd)
+{
+	char path[PATH_LEN];
+	int ret;
+
+	log_writer_cfg.index = NULL;
+
+	if (index_stride) {
+		log_index_path(path, sizeof(path), file_name);
+		ret = log_index_open(&log_index, path, log_start_ns,
+				     index_stride);
+
+		if (ret < 0) {
+			printf("Failed to create index %s: %s\n", path,
+			       strerror(-ret));
+			return ret;
+		}
+
+		log_writer_cfg.index = &log_index;
+	}
+
+	ret = log_writer_open(&log_writer, fd, &log_writer_cfg);
+
+	if (ret < 0 && log_writer_cfg.index)
+		log_index_close(&log_index);
+
+	return ret;
+}
+
+static const char *const chan_name[2] = { "Temperature", "Humidity" };
+static const char *const chan_unit[2] = { "celsius", "RH" };
+
+/* Runs right after decode, so an alarm never waits for the log sink */
+static void check_alarms(uint32_t id, int64_t timestamp, int32_t value)
+{
+	char level[MAX], str[MAX];
+	enum threshold_event ev;
+	struct alarm *a;
+	int i;
+
+	for (i = 0; i < nalarms; i++) {
+		a = &alarms[i];
+
+		if (a->id != id)
+			continue;
+
+		ev = threshold_update(&a->th, value);
+
+		if (ev == THRESHOLD_NONE)
+			continue;
+
+		iio_format_fixed(level, MAX, a->th.level, MILLI_DIGITS,
+				 MILLI_DIGITS);
+		iio_format_fixed(str, MAX, value, MILLI_DIGITS, MILLI_DIGITS);
+		printf("\n[%lld.%03lld] Alarm %s: %s %s %s %s (%s)\n",
+		       (long long)(timestamp / 1000000000),
+		       (long long)(timestamp / 1000000 % 1000),
+		       ev == THRESHOLD_RAISED ? "raised" : "cleared",
+		       chan_name[id],
+		       a->th.dir == THRESHOLD_ABOVE ? "above" : "below",
+		       level, chan_unit[id], str);
+		fflush(stdout);
+	}
+}
+
+/*
+ * Rolling statistics (-G), windows by binlog channel id. Each channel's
+ * windows are only touched by its sampler, the panes are allocated once.
+ */
+static struct win_spec agg_spec[WIN_STATS_MAX];
+static struct win_stats agg[2][WIN_STATS_MAX];
+static int nagg;
+static bool raw_off;		/* -N: aggregates only */
+
+static int agg_init(const char *arg)
+{
+	int i, j, ret;
+
+	nagg = win_stats_parse(agg_spec, WIN_STATS_MAX, arg);
+
+	if (nagg < 0)
+		return nagg;
+
+	/* A binary aggregate record is told apart by its window length */
+	for (i = 0; i < nagg; i++) {
+		if (agg_spec[i].length % NS_PER_SEC ||
+		    agg_spec[i].length / NS_PER_SEC > BINLOG_AGG_MAX_SECONDS)
+			return -EINVAL;
+
+		for (j = 0; j < i; j++)
+			if (agg_spec[j].length == agg_spec[i].length)
+				return -EINVAL;
+	}
+
+	for (i = 0; i < 2; i++) {
+		for (j = 0; j < nagg; j++) {
+			ret = win_stats_init(&agg[i][j], &agg_spec[j]);
+
+			if (ret < 0)
+				return ret;
+		}
+	}
+
+	return 0;
+}
+
+/* Windows line up with the start of the log */
+static void agg_reset(uint32_t id)
+{
+	int i;
+
+	for (i = 0; i < nagg; i++)
+		win_stats_reset(&agg[id][i], 0);
+}
+
+static void log_aggregate(const struct win_result *r, void *arg)
+{
+	uint32_t id = *(const uint32_t *)arg;
+	uint32_t seconds = r->spec->length / NS_PER_SEC;
+	char name[MAX], min[MAX], max[MAX], mean[MAX], sd[MAX];
+	char line[2 * LINE_MAX];	/* six values, longer than a sample */
+	int64_t timestamp = log_start_ns + r->end;
+	int32_t stat[BINLOG_AGG_STATS] = {
+		r->n, r->min, r->max, llround(r->mean), llround(r->stddev)
+	};
+	int len, i;
+
+	if (binary_log) {
+		for (i = 0; i < BINLOG_AGG_STATS; i++)
+			binlog_append(&binlog, timestamp,
+				      BINLOG_AGG_CHANNEL(id, i, seconds),
+				      stat[i]);
+		return;
+	}
+
+	win_stats_format(name, sizeof(name), r->spec);
+	iio_format_fixed(min, MAX, r->min, MILLI_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(max, MAX, r->max, MILLI_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(mean, MAX, stat[BINLOG_AGG_MEAN], MILLI_DIGITS,
+			 PRINT_DIGITS);
+	iio_format_fixed(sd, MAX, stat[BINLOG_AGG_STDDEV], MILLI_DIGITS,
+			 PRINT_DIGITS);
+	len = snprintf(line, sizeof(line),
+		       "[%lld.%03lld] %s %s: n %llu, min %s, max %s, "
+		       "mean %s, stddev %s %s\n",
+		       (long long)(r->end / 1000000000),
+		       (long long)(r->end / 1000000 % 1000), chan_name[id],
+		       name, (unsigned long long)r->n, min, max, mean, sd,
+		       chan_unit[id]);
+	log_writer_enqueue(&log_writer, timestamp, line, len);
+}
+
+static const uint32_t agg_id[2] = { BINLOG_TEMPERATURE, BINLOG_HUMIDITY };
+
+/* Emits the partly filled windows when logging stops */
+static void agg_flush(uint32_t id, int64_t timestamp)
+{
+	int i;
+
+	for (i = 0; i < nagg; i++)
+		win_stats_flush(&agg[id][i], timestamp, log_aggregate,
+				(void *)&agg_id[id]);
+}
+
+/* Updates the windows and writes the sample to whichever log is open */
+static void log_sample(uint32_t id, int64_t timestamp, int32_t value)
+{
+	char line[LINE_MAX], str[MAX];
+	int len, i;
+
+	for (i = 0; i < nagg; i++)
+		win_stats_push(&agg[id][i], timestamp, value, log_aggregate,
+			       (void *)&agg_id[id]);
+
+	if (raw_off)
+		return;
+
+	if (binary_log) {
+		binlog_append(&binlog, log_start_ns + timestamp, id, value);
+	} else if (columnar_log) {
+		colog_sample(id, log_start_ns + timestamp, value);
+	} else {
+		iio_format_fixed(str, MAX, value, MILLI_DIGITS, PRINT_DIGITS);
+		len = snprintf(line, sizeof(line), "[%lld.%03lld] %s: %s %s\n",
+			       (long long)(timestamp / 1000000000),
+			       (long long)(timestamp / 1000000 % 1000),
+			       chan_name[id], str, chan_unit[id]);
+		log_writer_enqueue(&log_writer, log_start_ns + timestamp,
+				   line, len);
+	}
+}
+
+/* Records an adaptive interval change in whichever log is open */
+static void log_interval(uint32_t id, int64_t timestamp, long interval_ms)
+{
+	char line[LINE_MAX];
+	int len;
+
+	if (binary_log) {
+		binlog_append(&binlog, log_start_ns + timestamp,
+			      BINLOG_TEMPERATURE_INTERVAL + id, interval_ms);
+	} else if (columnar_log) {
+		colog_sample(BINLOG_TEMPERATURE_INTERVAL + id,
+			     log_start_ns + timestamp, interval_ms);
+	} else {
+		len = snprintf(line, sizeof(line),
+			       "[%lld.%03lld] %s interval: %ld ms\n",
+			       (long long)(timestamp / 1000000000),
+			       (long long)(timestamp / 1000000 % 1000),
+			       chan_name[id], interval_ms);
+		log_writer_enqueue(&log_writer, log_start_ns + timestamp,
+				   line, len);
+	}
+}
+
+/* Feeds a sample to the channel's rate controller, returns the interval */
+static long adapt_interval(struct adaptive_rate *rate, uint32_t id,
+			   int64_t timestamp, int32_t value, long interval_ms)
+{
+	long next;
+
+	next = adaptive_rate_next(rate, timestamp, value, interval_ms);
+
+	if (next != interval_ms)
+		log_interval(id, timestamp, next);
+
+	return next;
+}
+
+static FILE *open_log(const char *file_name)
+{
+	FILE *fptr;
+	int ret;
+
+	fptr = fopen(file_name, binary_log ? "w+" : "w");
+
+	if (!fptr)
+		return NULL;
+
+	if (binary_log)
+		ret = binlog_open(&binlog, fileno(fptr), log_start_ns,
+				  BINLOG_SYNC_MS);
+	else if (columnar_log)
+		ret = colog_start(fileno(fptr));
+	else
+		ret = start_text_log(file_name, fileno(fptr));
+
+	if (ret < 0) {
+		printf("Failed to start log writer\n");
+		fclose(fptr);
+
+		return NULL;
+	}
+
+	return fptr;
+}
+
+static void close_log(FILE *fptr)
+{
+	struct log_writer_stats st;
+	uint64_t samples = 0;
+	unsigned int i;
+
+	if (binary_log) {
+		binlog_close(&binlog);
+	} else if (columnar_log) {
+		colog_close(&colog);
+
+		for (i = 0; i < colog.nchan; i++)
+			samples += colog.series[i].samples;
+
+		printf("Log: %llu samples, %llu bytes in %llu blocks, "
+		       "%.2f bytes/sample\n", (unsigned long long)samples,
+		       (unsigned long long)colog.bytes,
+		       (unsigned long long)colog.blocks,
+		       samples ? (double)colog.bytes / samples : 0.0);
+	} else {
+		log_writer_close(&log_writer, &st);
+
+		if (log_writer_cfg.index &&
+		    log_index_close(&log_index) < 0)
+			printf("Failed to write log index\n");
+
+		printf("Log: %llu records, %llu bytes in %llu writes, "
+		       "%llu syncs, %.0f bytes/s\n",
+		       (unsigned long long)st.records,
+		       (unsigned long long)st.bytes,
+		       (unsigned long long)st.commits,
+		       (unsigned long long)st.syncs,
+		       st.seconds > 0 ? st.bytes / st.seconds : 0.0);
+		printf("Enqueue latency: p50 %llu ns, p99 %llu ns, "
+		       "max %llu ns\n",
+		       (unsigned long long)st.enqueue_p50_ns,
+		       (unsigned long long)st.enqueue_p99_ns,
+		       (unsigned long long)st.enqueue_max_ns);
+	}
+
+	fclose(fptr);
+}
+
+/* Picks up an interval change from the menu without holding the lock */
+static void update_period(struct periodic *period, int *interval,
+			  const int *new_interval, pthread_mutex_t *lock)
+{
+	int value;
+
+	pthread_mutex_lock(lock);
+	value = *new_interval;
+	pthread_mutex_unlock(lock);
+
+	if (value != *interval) {
+		*interval = value;
+		periodic_set_period(period, value);
+	}
+}
+
+/*
+ * Sleeps until the next sample. The menu wakes the thread to apply a new
+ * interval at once or to stop; returns false when logging was turned off.
+ */
+static bool wait_next(struct thread_data *data, struct periodic *period,
+		      int *interval, pthread_mutex_t *lock)
+{
+	update_period(period, interval, &data->interval, lock);
+
+	while (periodic_wait_wake(period, &data->wake) < 0) {
+		if (!data->fptr)
+			return false;
+
+		update_period(period, interval, &data->interval, lock);
+	}
+
+	return true;
+}
+
+static void adapt_period(struct periodic *period, struct adaptive_rate *rate,
+			 uint32_t id, int64_t timestamp, int32_t value)
+{
+	long next;
+
+	next = adapt_interval(rate, id, timestamp, value, period->period_ms);
+
+	if (next != period->period_ms)
+		periodic_set_period(period, next);
+}
+
+static void print_period_stats(const char *name, const struct periodic *period)
+{
+	printf("%s: %lu samples, %lu missed deadlines, %lu overruns\n", name,
+	       period->cycles, period->missed, period->overruns);
+}
+
+/* Merges the temperature and humidity histograms stage by stage */
+static void print_latency(const struct lat_hist *temp,
+			  const struct lat_hist *hum)
+{
+	struct lat_hist all;
+	char name[MAX];
+	int i;
+
+	printf("\nPer-stage latency\n");
+
+	for (i = 0; i < STAGES; i++) {
+		memset(&all, 0, sizeof(all));
+		lat_hist_merge(&all, &temp[i]);
+		lat_hist_merge(&all, &hum[i]);
+		snprintf(name, sizeof(name), "%-6s", stage_name[i]);
+		lat_hist_print(name, &all);
+	}
+
+	fflush(stdout);
+}
+
+/* SIGUSR1 is blocked everywhere, this thread picks it up */
+static void *stats_thread_fun(void *arg)
+{
+	sigset_t *mask = arg;
+	int sig;
+
+	while (sigwait(mask, &sig) == 0)
+		print_latency(temperature.lat, humidity.lat);
+
+	return NULL;
+}
+
 void *temp_thread_fun(void *arg)
 {
-	int ret, interval = 0;
+	int ret, interval;
 	struct thread_data *temp_data= (struct thread_data *)arg;
-	double temperature;
-	char temp_str[MAX], interval_str[MAX], data[MAX];
+	struct periodic period;
+	int64_t timestamp;
+	int32_t temperature;
+	char data[MAX];
+	uint64_t start;
+
+	pthread_mutex_lock(&mutex_temp_interval);
+	interval = temp_data->interval;
+	pthread_mutex_unlock(&mutex_temp_interval);
+
+	periodic_start(&period, interval);
+	agg_reset(BINLOG_TEMPERATURE);
+
+	if (adaptive)
+		adaptive_rate_init(&temp_data->rate, &adapt_cfg[BINLOG_TEMPERATURE]);
 
 	while (temp_data->fptr) {
+		timestamp = monotonic_ns() - log_start_ns;
+		start = lat_hist_start(&temp_data->lat[STAGE_READ]);
 		ret = read(temp_data->fd, data, COUNT);
+		lat_hist_stage(&temp_data->lat[STAGE_READ], &start);
 
 		if (ret == -1) {
 			printf("Failed to read temperature data\n");
@@ -48,41 +628,66 @@ void *temp_thread_fun(void *arg)
 			return NULL;
 		}
 
-		temperature = atof(data) / DIVESER;
-
-		sprintf(interval_str, "%d", interval);
-		sprintf(temp_str, "%lf", temperature);
-		pthread_mutex_lock(&mutex_temp_fptr);
-		pthread_mutex_lock(&mutex);
-		fputs("[", temp_data->fptr);
-		fputs(interval_str, temp_data->fptr);
-		fputs("] Temperature: ", temp_data->fptr);
-		fputs(temp_str, temp_data->fptr);
-		fputs(" celsius\n", temp_data->fptr);
-		fflush(temp_data->fptr);
-		pthread_mutex_unlock(&mutex);
-		pthread_mutex_unlock(&mutex_temp_fptr);
-
-		pthread_mutex_lock(&mutex_temp_interval);
-		sleep(temp_data->interval);
-		interval += temp_data->interval;
-		pthread_mutex_unlock(&mutex_temp_interval);
+		if (iio_parse_int(data, ret, &temperature) < 0) {
+			printf("Invalid temperature data\n");
+		} else {
+			lat_hist_stage(&temp_data->lat[STAGE_DECODE], &start);
+			check_alarms(BINLOG_TEMPERATURE, timestamp, temperature);
+			publish(temp_data->shm_chan, log_start_ns + timestamp,
+				temperature);
+			sample_cache_put(&cache, BINLOG_TEMPERATURE,
+					 log_start_ns + timestamp, temperature);
+
+			log_sample(BINLOG_TEMPERATURE, timestamp, temperature);
+			lat_hist_stage(&temp_data->lat[STAGE_SINK], &start);
+
+			if (adaptive)
+				adapt_period(&period, &temp_data->rate,
+					     BINLOG_TEMPERATURE, timestamp, temperature);
+		}
+
+		if (!wait_next(temp_data, &period, &interval,
+			       &mutex_temp_interval))
+			break;
 
 		lseek(temp_data->fd, 0, SEEK_SET);
 	}
 
+	agg_flush(BINLOG_TEMPERATURE, monotonic_ns() - log_start_ns);
 	printf("Exit from temperature thread\n");
+	print_period_stats("Temperature", &period);
+
+	if (adaptive)
+		adaptive_rate_print("Temperature", &temp_data->rate);
+
+	return NULL;
 }
 
 void *humidity_thread_fun(void *arg)
 {
-	int ret, interval = 0;
+	int ret, interval;
 	struct thread_data *hum_data= (struct thread_data *)arg;
-	double humidity;
-	char hum_str[MAX], interval_str[MAX], data[MAX];
+	struct periodic period;
+	int64_t timestamp;
+	int32_t humidity;
+	char data[MAX];
+	uint64_t start;
+
+	pthread_mutex_lock(&mutex_hum_interval);
+	interval = hum_data->interval;
+	pthread_mutex_unlock(&mutex_hum_interval);
+
+	periodic_start(&period, interval);
+	agg_reset(BINLOG_HUMIDITY);
+
+	if (adaptive)
+		adaptive_rate_init(&hum_data->rate, &adapt_cfg[BINLOG_HUMIDITY]);
 
 	while (hum_data->fptr) {
+		timestamp = monotonic_ns() - log_start_ns;
+		start = lat_hist_start(&hum_data->lat[STAGE_READ]);
 		ret = read(hum_data->fd, data, COUNT);
+		lat_hist_stage(&hum_data->lat[STAGE_READ], &start);
 
 		if (ret == -1) {
 			printf("Failed to read humidity data\n");
@@ -90,52 +695,720 @@ void *humidity_thread_fun(void *arg)
 			return NULL;
 		}
 
-		humidity = atof(data) / DIVESER;
-
-		sprintf(hum_str, "%lf", humidity);
-		sprintf(interval_str, "%d", interval);
-
-		pthread_mutex_lock(&mutex_hum_fptr);
-		pthread_mutex_lock(&mutex);
-		fputs("[", hum_data->fptr);
-		fputs(interval_str, hum_data->fptr);
-		fputs("] Humidity: ", hum_data->fptr);
-		fputs(hum_str, hum_data->fptr);
-		fflush(hum_data->fptr);
-		fputs(" RH\n", hum_data->fptr);
-		fflush(hum_data->fptr);
-		pthread_mutex_unlock(&mutex);
-		pthread_mutex_unlock(&mutex_hum_fptr);
+		if (iio_parse_int(data, ret, &humidity) < 0) {
+			printf("Invalid humidity data\n");
+		} else {
+			lat_hist_stage(&hum_data->lat[STAGE_DECODE], &start);
+			check_alarms(BINLOG_HUMIDITY, timestamp, humidity);
+			publish(hum_data->shm_chan, log_start_ns + timestamp,
+				humidity);
+			sample_cache_put(&cache, BINLOG_HUMIDITY,
+					 log_start_ns + timestamp, humidity);
+
+			log_sample(BINLOG_HUMIDITY, timestamp, humidity);
+			lat_hist_stage(&hum_data->lat[STAGE_SINK], &start);
+
+			if (adaptive)
+				adapt_period(&period, &hum_data->rate,
+					     BINLOG_HUMIDITY, timestamp, humidity);
+		}
 
-		pthread_mutex_lock(&mutex_hum_interval);
-		sleep(hum_data->interval);
-		interval += hum_data->interval;
-		pthread_mutex_unlock(&mutex_hum_interval);
+		if (!wait_next(hum_data, &period, &interval,
+			       &mutex_hum_interval))
+			break;
 
 		lseek(hum_data->fd, 0, SEEK_SET);
 	}
 
+	agg_flush(BINLOG_HUMIDITY, monotonic_ns() - log_start_ns);
 	printf("Exit from humidity thread\n");
+	print_period_stats("Humidity", &period);
+
+	if (adaptive)
+		adaptive_rate_print("Humidity", &hum_data->rate);
+
+	return NULL;
 }
 
-int main(void)
+/*
+ * Event-loop engine. The menu is driven line by line from stdin through a
+ * small state machine instead of nested blocking scanf() calls, so that
+ * sampling keeps running while the user types.
+ */
+enum menu_state {
+	MENU_MAIN,
+	MENU_READ,
+	MENU_INTERVAL_CHANNEL,
+	MENU_INTERVAL_VALUE,
+	MENU_FILE,
+	MENU_FILE_NAME,
+};
+
+struct ev_channel {
+	uint32_t id;
+	const char *name;
+	const char *unit;
+	int fd;
+	int interval;		/* milliseconds */
+	int timer;
+	int shm_chan;
+	unsigned long samples, missed, overruns;
+	struct lat_hist lat[STAGES];
+	struct adaptive_rate rate;
+};
+
+static struct ev_app {
+	struct ev_loop loop;
+	struct ev_channel chan[2];
+	FILE *fptr;
+	enum menu_state state;
+	int selected;
+	char line[MAX];
+	size_t len;
+} app;
+
+static void print_menu(void)
+{
+	printf("\nEnter your choice\n");
+	printf("1 -> Read data\n");
+	printf("2 -> Change intervals for readings\n");
+	printf("3 -> Enable/disable option to logging data on file\n");
+	printf("4 -> Exit from application\n");
+	printf("5 -> Show per-stage latency\n\n");
+	fflush(stdout);
+}
+
+/*
+ * On-demand read: the logger's latest sample when it is fresh enough,
+ * otherwise one synchronous pread(). Returns -EIO when the attribute could
+ * not be read and another negative value for invalid data.
+ */
+static int read_cached(uint32_t id, int fd, int32_t *value)
+{
+	char data[MAX];
+	int ret;
+
+	if (sample_cache_get(&cache, id, monotonic_ns(), value, NULL) == 0)
+		return 0;
+
+	ret = pread(fd, data, COUNT, 0);
+
+	if (ret == -1)
+		return -EIO;
+
+	return iio_parse_int(data, ret, value);
+}
+
+static void print_cache_stats(void)
+{
+	printf("Read cache: %lu hits, %lu misses\n",
+	       atomic_load(&cache.hits), atomic_load(&cache.misses));
+}
+
+static void ev_sample(struct ev_loop *loop, int id, uint64_t count, void *arg)
+{
+	struct ev_channel *chan = arg;
+	char data[MAX];
+	int64_t timestamp;
+	uint64_t start;
+	int32_t value;
+	int ret;
+	long next;
+
+	(void)id;
+
+	chan->samples++;
+
+	if (count > 1) {
+		chan->missed++;
+		chan->overruns += count - 1;
+	}
+
+	timestamp = monotonic_ns() - log_start_ns;
+	start = lat_hist_start(&chan->lat[STAGE_READ]);
+	ret = pread(chan->fd, data, COUNT, 0);
+	lat_hist_stage(&chan->lat[STAGE_READ], &start);
+
+	if (ret == -1 || iio_parse_int(data, ret, &value) < 0) {
+		printf("Failed to read %s data\n", chan->name);
+		ev_loop_stop(loop);
+		return;
+	}
+
+	lat_hist_stage(&chan->lat[STAGE_DECODE], &start);
+	check_alarms(chan->id, timestamp, value);
+	publish(chan->shm_chan, log_start_ns + timestamp, value);
+	sample_cache_put(&cache, chan->id, log_start_ns + timestamp, value);
+
+	log_sample(chan->id, timestamp, value);
+	lat_hist_stage(&chan->lat[STAGE_SINK], &start);
+
+	if (!adaptive)
+		return;
+
+	next = adapt_interval(&chan->rate, chan->id, timestamp, value,
+			      chan->interval);
+
+	if (next != chan->interval) {
+		chan->interval = next;
+		ev_timer_set(loop, chan->timer, next);
+	}
+}
+
+static void ev_adaptive_init(void)
+{
+	int i;
+
+	for (i = 0; adaptive && i < 2; i++)
+		adaptive_rate_init(&app.chan[i].rate,
+				   &adapt_cfg[app.chan[i].id]);
+}
+
+static void ev_print_adaptive(void)
+{
+	int i;
+
+	for (i = 0; adaptive && i < 2; i++)
+		adaptive_rate_print(app.chan[i].name, &app.chan[i].rate);
+}
+
+static void ev_logging(bool enable)
+{
+	int64_t now = monotonic_ns() - log_start_ns;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (enable)
+			agg_reset(app.chan[i].id);
+		else
+			agg_flush(app.chan[i].id, now);
+	}
+
+	if (enable)
+		ev_adaptive_init();
+
+	for (i = 0; i < 2; i++)
+		ev_timer_set(&app.loop, app.chan[i].timer,
+			     enable ? app.chan[i].interval : 0);
+
+	if (!enable)
+		ev_print_adaptive();
+}
+
+static void ev_menu_line(struct ev_loop *loop, const char *line)
+{
+	struct ev_channel *chan;
+	char str[MAX];
+	int32_t value;
+	int choice, ret;
+
+	if (app.state == MENU_FILE_NAME) {
+		log_start_ns = monotonic_ns();
+		app.fptr = open_log(line);
+
+		if (!app.fptr)
+			printf("Failed to open %s\n", line);
+		else
+			ev_logging(true);
+
+		app.state = MENU_MAIN;
+		print_menu();
+		return;
+	}
+
+	if (sscanf(line, "%d", &choice) != 1) {
+		printf("\nInvalid option\n");
+		ev_loop_stop(loop);
+		return;
+	}
+
+	switch (app.state) {
+	case MENU_MAIN:
+		switch (choice) {
+		case 1:
+			printf("\n1 -> For temperature\n");
+			printf("2 -> For humidity\n");
+			app.state = MENU_READ;
+			break;
+		case 2:
+			printf("\n1 -> Change temperature interval\n");
+			printf("2 -> Change humidity interval\n");
+			app.state = MENU_INTERVAL_CHANNEL;
+			break;
+		case 3:
+			printf("\n1 -> Enable option for write data on file\n");
+			printf("2 -> Disable to write data on file\n");
+			app.state = MENU_FILE;
+			break;
+		case 4:
+			ev_loop_stop(loop);
+			return;
+		case 5:
+			print_latency(app.chan[0].lat, app.chan[1].lat);
+			print_cache_stats();
+			print_menu();
+			break;
+		default:
+			printf("\nInvalid option\n");
+			print_menu();
+		}
+		fflush(stdout);
+		return;
+	case MENU_READ:
+		if (choice < 1 || choice > 2) {
+			printf("\nInvalid option\n");
+			break;
+		}
+
+		chan = &app.chan[choice - 1];
+		ret = read_cached(chan->id, chan->fd, &value);
+
+		if (ret == -EIO) {
+			printf("Failed to read %s data\n", chan->name);
+			ev_loop_stop(loop);
+			return;
+		}
+
+		if (ret < 0) {
+			printf("\nInvalid %s data\n", chan->name);
+			break;
+		}
+
+		iio_format_fixed(str, MAX, value, MILLI_DIGITS, PRINT_DIGITS);
+		printf("\n%s: %s %s\n", chan->name, str, chan->unit);
+		break;
+	case MENU_INTERVAL_CHANNEL:
+		if (choice < 1 || choice > 2) {
+			printf("\nInvalid choice\n");
+			break;
+		}
+
+		if (!app.fptr) {
+			printf("\nFirst enable the write data on file\n");
+			break;
+		}
+
+		app.selected = choice - 1;
+		app.state = MENU_INTERVAL_VALUE;
+		printf("\nEnter new interval value in milliseconds\n");
+		fflush(stdout);
+		return;
+	case MENU_INTERVAL_VALUE:
+		if (choice <= 0) {
+			printf("\nInvalid value\n");
+			break;
+		}
+
+		chan = &app.chan[app.selected];
+		chan->interval = choice;
+
+		if (app.fptr)
+			ev_timer_set(loop, chan->timer, chan->interval);
+		break;
+	case MENU_FILE:
+		if (choice == 1) {
+			if (app.fptr) {
+				printf("\nIt's already enabled\n");
+				break;
+			}
+
+			app.state = MENU_FILE_NAME;
+			printf("\nEnter file name\n");
+			fflush(stdout);
+			return;
+		} else if (choice == 2) {
+			if (!app.fptr) {
+				printf("\nIt's already disabled\n");
+				break;
+			}
+
+			ev_logging(false);
+			close_log(app.fptr);
+			app.fptr = NULL;
+		} else {
+			printf("\nInvalid option\n");
+		}
+		break;
+	default:
+		break;
+	}
+
+	app.state = MENU_MAIN;
+	print_menu();
+}
+
+static void ev_stdin(struct ev_loop *loop, int id, uint64_t events, void *arg)
+{
+	char *nl;
+	ssize_t ret;
+
+	(void)id;
+	(void)events;
+	(void)arg;
+
+	ret = read(STDIN_FILENO, app.line + app.len,
+		   sizeof(app.line) - 1 - app.len);
+
+	if (ret <= 0) {
+		ev_loop_stop(loop);
+		return;
+	}
+
+	app.len += ret;
+	app.line[app.len] = '\0';
+
+	while ((nl = strchr(app.line, '\n')) && !loop->stop) {
+		*nl = '\0';
+
+		if (nl != app.line)
+			ev_menu_line(loop, app.line);
+
+		app.len -= nl + 1 - app.line;
+		memmove(app.line, nl + 1, app.len + 1);
+	}
+
+	/* Drop a line that doesn't fit instead of spinning on it */
+	if (app.len == sizeof(app.line) - 1)
+		app.len = 0;
+}
+
+static void ev_signal(struct ev_loop *loop, int id, uint64_t events, void *arg)
+{
+	struct signalfd_siginfo info;
+	int fd = *(int *)arg;
+
+	(void)id;
+	(void)events;
+
+	if (read(fd, &info, sizeof(info)) != sizeof(info))
+		return;
+
+	if (info.ssi_signo == SIGUSR1) {
+		print_latency(app.chan[0].lat, app.chan[1].lat);
+		return;
+	}
+
+	printf("\nReceived signal %u\n", info.ssi_signo);
+	ev_loop_stop(loop);
+}
+
+static int event_main(int fd_temperature, int fd_humidity, FILE *fptr)
+{
+	sigset_t mask;
+	int i, ret, sfd;
+
+	app.fptr = fptr;
+	app.state = MENU_MAIN;
+	app.chan[0] = (struct ev_channel){
+		.id = BINLOG_TEMPERATURE, .name = "Temperature",
+		.unit = "celsius", .fd = fd_temperature,
+		.interval = DEFAULT_INTERVAL_MS, .timer = -1,
+		.shm_chan = temperature.shm_chan,
+	};
+	app.chan[1] = (struct ev_channel){
+		.id = BINLOG_HUMIDITY, .name = "Humidity", .unit = "RH",
+		.fd = fd_humidity, .interval = DEFAULT_INTERVAL_MS,
+		.timer = -1, .shm_chan = humidity.shm_chan,
+	};
+	ev_adaptive_init();
+
+	for (i = 0; i < 2; i++)
+		agg_reset(app.chan[i].id);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+	if (sfd < 0) {
+		ret = -errno;
+		printf("Failed to create signal fd: %s\n", strerror(-ret));
+		goto close_fds;
+	}
+
+	ret = ev_loop_init(&app.loop);
+
+	if (ret < 0) {
+		printf("Failed to create event loop\n");
+		goto out;
+	}
+
+	for (i = 0; i < 2; i++) {
+		app.chan[i].timer = ev_add_timer(&app.loop,
+						 fptr ? app.chan[i].interval : 0,
+						 ev_sample, &app.chan[i]);
+
+		if (app.chan[i].timer < 0) {
+			ret = app.chan[i].timer;
+			printf("Failed to create %s timer\n", app.chan[i].name);
+			goto out;
+		}
+	}
+
+	if (ev_add_fd(&app.loop, STDIN_FILENO, ev_stdin, NULL) < 0 ||
+	    ev_add_fd(&app.loop, sfd, ev_signal, &sfd) < 0) {
+		ret = -EINVAL;
+		printf("Failed to watch stdin\n");
+		goto out;
+	}
+
+	print_menu();
+	ret = ev_loop_run(&app.loop);
+
+	for (i = 0; i < 2; i++)
+		printf("%s: %lu samples, %lu missed deadlines, %lu overruns\n",
+		       app.chan[i].name, app.chan[i].samples,
+		       app.chan[i].missed, app.chan[i].overruns);
+
+	print_cache_stats();
+
+	if (app.fptr) {
+		for (i = 0; i < 2; i++)
+			agg_flush(app.chan[i].id,
+				  monotonic_ns() - log_start_ns);
+
+		ev_print_adaptive();
+	}
+
+out:
+	ev_loop_close(&app.loop);
+	close(sfd);
+close_fds:
+	close(fd_temperature);
+	close(fd_humidity);
+
+	if (app.fptr)
+		close_log(app.fptr);
+
+	return ret;
+}
+
+/* "<temperature>:<humidity>" in celsius and RH, e.g. "0.2:1" */
+static int parse_deltas(const char *arg)
+{
+	const char *sep = strchr(arg, ':');
+	int64_t temp, hum;
+
+	if (!sep || iio_parse_fixed(arg, sep - arg, MILLI_DIGITS, &temp) < 0 ||
+	    iio_parse_fixed(sep + 1, strlen(sep + 1), MILLI_DIGITS, &hum) < 0 ||
+	    temp <= 0 || hum <= 0)
+		return -EINVAL;
+
+	adapt_cfg[BINLOG_TEMPERATURE].delta = temp;
+	adapt_cfg[BINLOG_HUMIDITY].delta = hum;
+
+	return 0;
+}
+
+/* "temp>30:0.5" or "hum<20", levels in celsius and RH */
+static int parse_alarm(const char *arg)
+{
+	struct alarm *a = &alarms[nalarms];
+	int ret;
+
+	if (nalarms == MAX_ALARMS)
+		return -ENOSPC;
+
+	if (!strncmp(arg, "temp", 4)) {
+		a->id = BINLOG_TEMPERATURE;
+		arg += 4;
+	} else if (!strncmp(arg, "hum", 3)) {
+		a->id = BINLOG_HUMIDITY;
+		arg += 3;
+	} else {
+		return -EINVAL;
+	}
+
+	ret = threshold_parse(&a->th, arg, MILLI_DIGITS);
+
+	if (ret < 0)
+		return ret;
+
+	nalarms++;
+
+	return 0;
+}
+
+static void publish_close(void)
+{
+	sample_shm_close(&shm);
+}
+
+static int publish_open(const char *name)
+{
+	int ret;
+
+	ret = sample_shm_create(&shm, name);
+
+	if (ret < 0)
+		return ret;
+
+	temperature.shm_chan = sample_shm_add(&shm, "temperature", "celsius",
+					      1, MILLI_DIGITS);
+	humidity.shm_chan = sample_shm_add(&shm, "humidity", "RH", 1,
+					   MILLI_DIGITS);
+
+	/* main() has many exit paths, remove the segment on every one */
+	atexit(publish_close);
+
+	return 0;
+}
+
+/*
+ * Turns logging off. Both samplers are woken out of their wait, so this
+ * takes milliseconds whatever the interval; the time is printed.
+ */
+static void stop_threads(pthread_t temp_thread, pthread_t humidity_thread)
+{
+	int64_t start = monotonic_ns();
+
+	pthread_mutex_lock(&mutex_temp_fptr);
+	temperature.fptr = NULL;
+	pthread_mutex_unlock(&mutex_temp_fptr);
+	periodic_wake_up(&temperature.wake);
+
+	pthread_mutex_lock(&mutex_hum_fptr);
+	humidity.fptr = NULL;
+	pthread_mutex_unlock(&mutex_hum_fptr);
+	periodic_wake_up(&humidity.wake);
+
+	pthread_join(temp_thread, NULL);
+	pthread_join(humidity_thread, NULL);
+
+	printf("Logging stopped in %.3f ms\n",
+	       (monotonic_ns() - start) / 1e6);
+}
+
+int main(int argc, char *argv[])
 {
 	int fd_temperature, fd_humidity, ret, choice, data_choice, interval_choice, interval, file_choice;
 	char file_name[MAX], data[MAX];
-	double temperature_value, humidity_value;
+	int32_t temperature_value, humidity_value;
 	FILE *fptr = NULL;
-	pthread_t temp_thread, humidity_thread;
+	pthread_t temp_thread, humidity_thread, stats_thread;
+	bool event_loop = false;
+	long max_age = DEFAULT_MAX_AGE_MS;
+	const char *shm_name = NULL;
+	sigset_t stats_mask;
+	int opt;
+
+	log_writer_default_config(&log_writer_cfg);
+	lat_clock_init();
+
+	while ((opt = getopt(argc, argv, "EbcNs:p:a:i:A:D:T:G:")) != -1) {
+		switch (opt) {
+		case 'E':
+			event_loop = true;
+			break;
+		case 'b':
+			binary_log = true;
+			columnar_log = false;
+			break;
+		case 'c':
+			columnar_log = true;
+			binary_log = false;
+			break;
+		case 's':
+			if (log_writer_parse_policy(&log_writer_cfg,
+						    optarg) < 0) {
+				printf("Invalid sync policy %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'p':
+			shm_name = optarg;
+			break;
+		case 'i':
+			index_stride = atoi(optarg);
+			break;
+		case 'A':
+			if (adaptive_rate_parse(&adapt_cfg[0], optarg) < 0) {
+				printf("Invalid adaptive range %s\n", optarg);
+				return -EINVAL;
+			}
 
-	fd_temperature = open("/sys/bus/i2c/devices/0-0040/iio:device0/in_temp_input",
-			      O_RDONLY);
+			adapt_cfg[1].min_ms = adapt_cfg[0].min_ms;
+			adapt_cfg[1].max_ms = adapt_cfg[0].max_ms;
+			adaptive = true;
+			break;
+		case 'D':
+			if (parse_deltas(optarg) < 0) {
+				printf("Invalid deltas %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'T':
+			if (parse_alarm(optarg) < 0) {
+				printf("Invalid alarm %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'G':
+			if (agg_init(optarg) < 0) {
+				printf("Invalid windows %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'N':
+			raw_off = true;
+			break;
+		case 'a':
+			max_age = atol(optarg);
+
+			if (max_age < 0) {
+				printf("Invalid max age %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		default:
+			printf("Usage: %s [-E] [-b|-c] [-s none|ms:<N>|records:<N>] "
+			       "[-p /shm_name] [-a max_age_ms] "
+			       "[-i index_records] [-A min_ms:max_ms] "
+			       "[-D temp_delta:hum_delta] "
+			       "[-T temp|hum<op><level>[:<hysteresis>]] "
+			       "[-G windows [-N]]\n", argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (raw_off && !nagg) {
+		printf("-N needs rolling statistics (-G)\n");
+		return -EINVAL;
+	}
+
+	/* A columnar channel holds at most COLOG_VALUES values per sample */
+	if (nagg && columnar_log) {
+		printf("Rolling statistics need a text or binary log\n");
+		return -EINVAL;
+	}
+
+	/*
+	 * SIGUSR1 prints the latency statistics. Block it before the log
+	 * writer or any sampler starts so every thread inherits the mask.
+	 */
+	sigemptyset(&stats_mask);
+	sigaddset(&stats_mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &stats_mask, NULL);
+
+	/* -a 0 turns the cache off, every read goes to the sensor */
+	sample_cache_init(&cache, max_age);
+
+	/* The event loop reads stdin itself, stdio must not buffer ahead */
+	if (event_loop)
+		setvbuf(stdin, NULL, _IONBF, 0);
+
+	fd_temperature = sysfs_open("/sys/bus/i2c/devices/0-0040/iio:device0/in_temp_input",
+				    O_RDONLY);
 
 	if (fd_temperature < 0) {
 		printf("Failed to get temperature file descriptor\n");
 		return -EAGAIN;
 	}
 
-	fd_humidity = open("/sys/bus/i2c/devices/0-0040/iio:device0/"
-			   "in_humidityrelative_input", O_RDONLY);
+	fd_humidity = sysfs_open("/sys/bus/i2c/devices/0-0040/iio:device0/"
+				 "in_humidityrelative_input", O_RDONLY);
 
 	if (fd_humidity < 0) {
 		printf("Failed to get humidity file descriptor\n");
@@ -144,16 +1417,44 @@ int main(void)
 	}
 
 	temperature.fd = fd_temperature;
-	temperature.interval = 1;
+	temperature.interval = DEFAULT_INTERVAL_MS;
+	temperature.shm_chan = -1;
 	humidity.fd = fd_humidity;
-	humidity.interval = 1;
+	humidity.interval = DEFAULT_INTERVAL_MS;
+	humidity.shm_chan = -1;
+
+	if (shm_name) {
+		ret = publish_open(shm_name);
+
+		if (ret < 0) {
+			printf("Failed to publish samples in %s: %s\n",
+			       shm_name, strerror(-ret));
+			close(fd_temperature);
+			close(fd_humidity);
+
+			return ret;
+		}
+	}
 
-	pthread_mutex_init(&mutex, NULL);
 	pthread_mutex_init(&mutex_temp_interval, NULL);
 	pthread_mutex_init(&mutex_hum_interval, NULL);
 	pthread_mutex_init(&mutex_temp_fptr, NULL);
 	pthread_mutex_init(&mutex_hum_fptr, NULL);
 
+	ret = periodic_wake_init(&temperature.wake);
+
+	if (ret == 0)
+		ret = periodic_wake_init(&humidity.wake);
+
+	if (ret < 0) {
+		printf("Failed to create the sampler wakeups: %s\n",
+		       strerror(-ret));
+		close(fd_temperature);
+		close(fd_humidity);
+
+		return ret;
+	}
+
 	printf("\nApplication for the read temperature and humidity\n");
 
 	printf("Enter file name where the the application data save\n");
@@ -167,17 +1468,26 @@ int main(void)
 		return ret;
 	}
 
-	fptr = fopen(file_name, "w");
+	log_start_ns = monotonic_ns();
+	fptr = open_log(file_name);
+
+	if (event_loop)
+		return event_main(fd_temperature, fd_humidity, fptr);
+
 	temperature.fptr = fptr;
 	humidity.fptr = fptr;
 
+	if (pthread_create(&stats_thread, NULL, stats_thread_fun,
+			   &stats_mask) == 0)
+		pthread_detach(stats_thread);
+
 	ret = pthread_create(&temp_thread, NULL, temp_thread_fun, &temperature);
 
 	if (ret < 0) {
 		printf("Failed to create temperature thread\n");
 		close(fd_temperature);
 		close(fd_humidity);
-		fclose(fptr);
+		close_log(fptr);
 
 		return ret;
 	}
@@ -188,7 +1498,7 @@ int main(void)
 		printf("Failed to create temperature thread\n");
 		close(fd_temperature);
 		close(fd_humidity);
-		fclose(fptr);
+		close_log(fptr);
 
 		return ret;
 	}
@@ -198,28 +1508,20 @@ int main(void)
 		printf("1 -> Read data\n");
 		printf("2 -> Change intervals for readings\n");
 		printf("3 -> Enable/disable option to logging data on file\n");
-		printf("4 -> Exit from application\n\n");
+		printf("4 -> Exit from application\n");
+		printf("5 -> Show per-stage latency\n\n");
 		ret = scanf("%d", &choice);
 
 		if (ret <= 0) {
 			printf("Invalid option\n");
 
-			pthread_mutex_lock(&mutex_temp_fptr);
-			temperature.fptr = NULL;
-			pthread_mutex_unlock(&mutex_temp_fptr);
-
-			pthread_mutex_lock(&mutex_hum_fptr);
-			humidity.fptr = NULL;
-			pthread_mutex_unlock(&mutex_hum_fptr);
-
-			pthread_join(temp_thread, NULL);
-			pthread_join(humidity_thread, NULL);
+			stop_threads(temp_thread, humidity_thread);
 
 			close(fd_temperature);
 			close(fd_humidity);
 
 			if (fptr)
-				fclose(fptr);
+				close_log(fptr);
 
 			return ret;
 		}
@@ -233,88 +1535,73 @@ int main(void)
 			if (ret <= 0) {
 				printf("\nInvalid option\n");
 
-				pthread_mutex_lock(&mutex_temp_fptr);
-				temperature.fptr = NULL;
-				pthread_mutex_unlock(&mutex_temp_fptr);
-
-				pthread_mutex_lock(&mutex_hum_fptr);
-				humidity.fptr = NULL;
-				pthread_mutex_unlock(&mutex_hum_fptr);
-
-				pthread_join(temp_thread, NULL);
-				pthread_join(humidity_thread, NULL);
+				stop_threads(temp_thread, humidity_thread);
 
 				close(fd_temperature);
 				close(fd_humidity);
 
 				if (fptr)
-					fclose(fptr);
+					close_log(fptr);
 
 				return ret;
 			}
 
 			switch (data_choice) {
 			case 1:
-				lseek(fd_temperature, 0, SEEK_SET);
-				ret = read(fd_temperature, data, COUNT);
-
-				if (ret == -1) {
-					printf("Failed to read humidity data\n");
-
-					pthread_mutex_lock(&mutex_temp_fptr);
-					temperature.fptr = NULL;
-					pthread_mutex_unlock(&mutex_temp_fptr);
+				ret = read_cached(BINLOG_TEMPERATURE, fd_temperature,
+						  &temperature_value);
 
-					pthread_mutex_lock(&mutex_hum_fptr);
-					humidity.fptr = NULL;
-					pthread_mutex_unlock(&mutex_hum_fptr);
+				if (ret == -EIO) {
+					printf("Failed to read temperature data\n");
 
-					pthread_join(temp_thread, NULL);
-					pthread_join(humidity_thread, NULL);
+					stop_threads(temp_thread,
+						     humidity_thread);
 
 					close(fd_temperature);
 					close(fd_humidity);
 
 					if (fptr)
-						fclose(fptr);
+						close_log(fptr);
 
 					return ret;
 				}
 
-				temperature_value = atof(data) / DIVESER;
+				if (ret < 0) {
+					printf("\nInvalid temperature data\n");
+					break;
+				}
 
-				printf("\nTemperature: %lf celsius\n", temperature_value);
+				iio_format_fixed(data, MAX, temperature_value,
+						 MILLI_DIGITS, PRINT_DIGITS);
+				printf("\nTemperature: %s celsius\n", data);
 				break;
 			case 2:
-				lseek(fd_humidity, 0, SEEK_SET);
-				ret = read(fd_humidity, data, COUNT);
+				ret = read_cached(BINLOG_HUMIDITY, fd_humidity,
+						  &humidity_value);
 
-				if (ret == -1) {
+				if (ret == -EIO) {
 					printf("Failed to read humidity data\n");
 
-					pthread_mutex_lock(&mutex_temp_fptr);
-					temperature.fptr = NULL;
-					pthread_mutex_unlock(&mutex_temp_fptr);
-
-					pthread_mutex_lock(&mutex_hum_fptr);
-					humidity.fptr = NULL;
-					pthread_mutex_unlock(&mutex_hum_fptr);
-
-					pthread_join(temp_thread, NULL);
-					pthread_join(humidity_thread, NULL);
+					stop_threads(temp_thread,
+						     humidity_thread);
 
 					close(fd_temperature);
 					close(fd_humidity);
 
 					if (fptr)
-						fclose(fptr);
+						close_log(fptr);
 
 					return ret;
 				}
 
-				humidity_value = atof(data) / DIVESER;
+				if (ret < 0) {
+					printf("\nInvalid humidity data\n");
+					break;
+				}
 
-				printf("\nHumidity: %lf RH\n", humidity_value);
+				iio_format_fixed(data, MAX, humidity_value,
+						 MILLI_DIGITS, PRINT_DIGITS);
+				printf("\nHumidity: %s RH\n", data);
 				break;
 			default:
 				printf("\nInvalid option\n");
@@ -328,22 +1615,13 @@ int main(void)
 			if (ret <= 0) {
 				printf("\nInvalid option\n");
 
-				pthread_mutex_lock(&mutex_temp_fptr);
-				temperature.fptr = NULL;
-				pthread_mutex_unlock(&mutex_temp_fptr);
-
-				pthread_mutex_lock(&mutex_hum_fptr);
-				humidity.fptr = NULL;
-				pthread_mutex_unlock(&mutex_hum_fptr);
-
-				pthread_join(temp_thread, NULL);
-				pthread_join(humidity_thread, NULL);
+				stop_threads(temp_thread, humidity_thread);
 
 				close(fd_temperature);
 				close(fd_humidity);
 
 				if (fptr)
-					fclose(fptr);
+					close_log(fptr);
 
 				return ret;
 			}
@@ -354,33 +1632,32 @@ int main(void)
 					printf("\nFirst enable the write data "
 					       "on file\n");
 				} else {
-					printf("\nEnter new interval value\n");
+					printf("\nEnter new interval value in "
+					       "milliseconds\n");
 					ret = scanf("%d", &interval);
 
 					if (ret <= 0) {
 						printf("\nInvalid value\n");
 
-						pthread_mutex_lock(&mutex_temp_fptr);
-						temperature.fptr = NULL;
-						pthread_mutex_unlock(&mutex_temp_fptr);
-
-						pthread_mutex_lock(&mutex_hum_fptr);
-						humidity.fptr = NULL;
-						pthread_mutex_unlock(&mutex_hum_fptr);
-
-						pthread_join(temp_thread, NULL);
-						pthread_join(humidity_thread, NULL);
+						stop_threads(temp_thread,
+							     humidity_thread);
 
 						close(fd_temperature);
 						close(fd_humidity);
-						fclose(fptr);
+						close_log(fptr);
 
 						return ret;
 					}
 
+					if (interval <= 0) {
+						printf("\nInvalid value\n");
+						break;
+					}
+
 					pthread_mutex_lock(&mutex_temp_interval);
 					temperature.interval = interval;
 					pthread_mutex_unlock(&mutex_temp_interval);
+					periodic_wake_up(&temperature.wake);
 				}
 				break;
 			case 2:
@@ -388,33 +1665,32 @@ int main(void)
 					printf("\nFirst enable the write data "
 					       "on file\n");
 				} else {
-					printf("\nEnter new interval value\n");
+					printf("\nEnter new interval value in "
+					       "milliseconds\n");
 					ret = scanf("%d", &interval);
 
 					if (ret <= 0) {
 						printf("\nInvalid value\n");
 
-						pthread_mutex_lock(&mutex_temp_fptr);
-						temperature.fptr = NULL;
-						pthread_mutex_unlock(&mutex_temp_fptr);
-
-						pthread_mutex_lock(&mutex_hum_fptr);
-						humidity.fptr = NULL;
-						pthread_mutex_unlock(&mutex_hum_fptr);
-
-						pthread_join(temp_thread, NULL);
-						pthread_join(humidity_thread, NULL);
+						stop_threads(temp_thread,
+							     humidity_thread);
 
 						close(fd_temperature);
 						close(fd_humidity);
-						fclose(fptr);
+						close_log(fptr);
 
 						return ret;
 					}
 
+					if (interval <= 0) {
+						printf("\nInvalid value\n");
+						break;
+					}
+
 					pthread_mutex_lock(&mutex_hum_interval);
 					humidity.interval = interval;
 					pthread_mutex_unlock(&mutex_hum_interval);
+					periodic_wake_up(&humidity.wake);
 				}
 				break;
 			default:
@@ -429,22 +1705,13 @@ int main(void)
 			if (ret <= 0) {
 				printf("\nInvalid option\n");
 
-				pthread_mutex_lock(&mutex_temp_fptr);
-				temperature.fptr = NULL;
-				pthread_mutex_unlock(&mutex_temp_fptr);
-
-				pthread_mutex_lock(&mutex_hum_fptr);
-				humidity.fptr = NULL;
-				pthread_mutex_unlock(&mutex_hum_fptr);
-
-				pthread_join(temp_thread, NULL);
-				pthread_join(humidity_thread, NULL);
+				stop_threads(temp_thread, humidity_thread);
 
 				close(fd_temperature);
 				close(fd_humidity);
 
 				if (fptr)
-					fclose(fptr);
+					close_log(fptr);
 
 				return ret;
 			}
@@ -465,7 +1732,8 @@ int main(void)
 						return ret;
 					}
 
-					fptr = fopen(file_name, "w");
+					log_start_ns = monotonic_ns();
+					fptr = open_log(file_name);
 
 					pthread_mutex_lock(&mutex_temp_fptr);
 					temperature.fptr = fptr;
@@ -483,7 +1751,7 @@ int main(void)
 						printf("Failed to create temperature thread\n");
 						close(fd_temperature);
 						close(fd_humidity);
-						fclose(fptr);
+						close_log(fptr);
 
 						return ret;
 					}
@@ -494,7 +1762,7 @@ int main(void)
 						printf("Failed to create temperature thread\n");
 						close(fd_temperature);
 						close(fd_humidity);
-						fclose(fptr);
+						close_log(fptr);
 
 						return ret;
 					}
@@ -504,17 +1772,9 @@ int main(void)
 				if (!fptr) {
 					printf("\nIt's already disabled\n");
 				} else {
-					pthread_mutex_lock(&mutex_temp_fptr);
-					temperature.fptr = NULL;
-					pthread_mutex_unlock(&mutex_temp_fptr);
-
-					pthread_mutex_lock(&mutex_hum_fptr);
-					humidity.fptr = NULL;
-					pthread_mutex_unlock(&mutex_hum_fptr);
-
-					pthread_join(temp_thread, NULL);
-					pthread_join(humidity_thread, NULL);
-					fclose(fptr);
+					stop_threads(temp_thread,
+						     humidity_thread);
+					close_log(fptr);
 					fptr = NULL;
 				}
 				break;
@@ -523,24 +1783,21 @@ int main(void)
 			}
 			break;
 		case 4:
-			pthread_mutex_lock(&mutex_temp_fptr);
-			temperature.fptr = NULL;
-			pthread_mutex_unlock(&mutex_temp_fptr);
-
-			pthread_mutex_lock(&mutex_hum_fptr);
-			humidity.fptr = NULL;
-			pthread_mutex_unlock(&mutex_hum_fptr);
-
-			pthread_join(temp_thread, NULL);
-			pthread_join(humidity_thread, NULL);
+			stop_threads(temp_thread, humidity_thread);
 
 			close(fd_temperature);
 			close(fd_humidity);
 
 			if (fptr)
-				fclose(fptr);
+				close_log(fptr);
+
+			print_cache_stats();
 
 			return 0;
+		case 5:
+			print_latency(temperature.lat, humidity.lat);
+			print_cache_stats();
+			break;
 		default:
 			printf("\nInvalid option\n");
 		}
@@ -6,29 +6,32 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <unistd.h>
 
+#include "../../common/iio_parse.h"
+#include "../../common/sysfs.h"
+
 #define MAX	50
-#define COUNT	5
-#define DIVESER 1000
+#define COUNT	15
+#define MILLI_DIGITS	3
+#define PRINT_DIGITS	6
 
 int main(void)
 {
 	int fd_temperature, fd_humidity, ret;
-	char data[MAX];
-	double temperature_value, humidity_value;
+	char data[MAX], value[MAX];
+	int32_t temperature_value, humidity_value;
 
-	fd_temperature = open("/sys/bus/i2c/devices/0-0040/iio:device0/in_temp_input",
-			      O_RDONLY);
+	fd_temperature = sysfs_open("/sys/bus/i2c/devices/0-0040/iio:device0/in_temp_input",
+				    O_RDONLY);
 
 	if (fd_temperature < 0) {
 		printf("Failed to get temperature file descriptor\n");
 		return -EAGAIN;
 	}
 
-	fd_humidity = open("/sys/bus/i2c/devices/0-0040/iio:device0/"
-			   "in_humidityrelative_input", O_RDONLY);
+	fd_humidity = sysfs_open("/sys/bus/i2c/devices/0-0040/iio:device0/"
+				 "in_humidityrelative_input", O_RDONLY);
 
 	if (fd_humidity < 0) {
 		printf("Failed to get humidity file descriptor\n");
@@ -46,9 +49,19 @@ int main(void)
 		return ret;
 	}
 
-	temperature_value = atof(data) / DIVESER;
+	ret = iio_parse_int(data, ret, &temperature_value);
+
+	if (ret < 0) {
+		printf("Invalid temperature data\n");
+		close(fd_temperature);
+		close(fd_humidity);
+
+		return ret;
+	}
 
-	printf("\nTemperature: %lf celsius\n", temperature_value);
+	iio_format_fixed(value, MAX, temperature_value, MILLI_DIGITS,
+			 PRINT_DIGITS);
+	printf("\nTemperature: %s celsius\n", value);
 
 	ret = read(fd_humidity, data, COUNT);
 
@@ -60,9 +73,18 @@ int main(void)
 		return ret;
 	}
 
-	humidity_value = atof(data) / DIVESER;
+	ret = iio_parse_int(data, ret, &humidity_value);
+
+	if (ret < 0) {
+		printf("Invalid humidity data\n");
+		close(fd_temperature);
+		close(fd_humidity);
+
+		return ret;
+	}
 
-	printf("\nHumidity: %lf RH\n", humidity_value);
+	iio_format_fixed(value, MAX, humidity_value, MILLI_DIGITS, PRINT_DIGITS);
+	printf("\nHumidity: %s RH\n", value);
 	close(fd_temperature);
 	close(fd_humidity);
 
@@ -0,0 +1,1000 @@
+/*
+ * Buffered IMU Reader
+ *
+ * - Streams accelerometer and gyroscope data through the IIO buffer
+ *   interface instead of polling the per-axis sysfs attributes
+ * - Enables the X, Y and Z channels under scan_elements, turns on
+ *   buffer/enable and reads packed binary frames from /dev/iio:deviceN
+ * - One read() returns a whole batch of frames, decoded according to the
+ *   _type descriptor of each channel
+ * - Optional FIFO watermark batching (-w): the thread sleeps in poll()
+ *   until N frames are queued and drains them with one read(), reporting
+ *   wakeups and CPU time per sample so N can be tuned for power
+ * - Optional attitude estimation (-f complementary|madgwick|mahony): every
+ *   gyro frame is fed to the fusion filter, the accelerometer thread posts
+ *   its batch averaged gravity vector, and roll/pitch/yaw are read back
+ *   lock-free for printing
+ * - Optional publisher mode (-p /name): the newest frame of every batch is
+ *   published in a POSIX shared-memory segment for other processes
+ *   (sample_shm.h)
+ * - Optional full rate log (-l file): every frame is stored as raw counts
+ *   in a columnar compressed log (colog.h), a few bytes per frame;
+ *   colog_cat renders it as text
+ * - Optional vibration analysis (-V size[:hop[:peaks]]): accelerometer
+ *   frames go through overlapping Hann windowed FFTs (vibration.h) and
+ *   every window is printed as per-axis RMS, crest factor and its largest
+ *   spectral peaks instead of raw values
+ * - Optional synchronized mode (-S rate[:trigger]): both devices are put
+ *   on one IIO hrtimer trigger (created through configfs when missing) so
+ *   they sample at the same instants, in_timestamp is enabled on
+ *   CLOCK_MONOTONIC and a pairing thread matches accel and gyro frames by
+ *   timestamp into 6-axis records carrying their skew, printed with the
+ *   skew statistics
+ * - Optional calibration (-c file from imu_calibrate): every batch is
+ *   corrected in place (gyroscope bias, accelerometer offset and
+ *   scale/misalignment matrix) four frames per vector operation before it
+ *   reaches fusion, vibration analysis, pairing, printing and publishing;
+ *   the log keeps the raw counts
+ * - Prints the frame rate and the latest values once per second
+ * - Runs continuously until user presses any key to exit
+ *
+ * Usage: imu_buffered [-a accel_device] [-g gyro_device] [-n frames]
+ *                     [-w watermark] [-f filter] [-p /shm_name]
+ *                     [-l log_file] [-V size[:hop[:peaks]]]
+ *                     [-S rate[:trigger]] [-c calib_file]
+ *
+ * This is a generic Linux I2C user-space application.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/colog.h"
+#include "../common/iio_buffer.h"
+#include "../common/iio_parse.h"
+#include "../common/imu_calib.h"
+#include "../common/imu_fusion.h"
+#include "../common/periodic.h"
+#include "../common/sample_shm.h"
+#include "../common/spsc_ring.h"
+#include "../common/sysfs.h"
+#include "../common/vibration.h"
+
+#define BATCH		64
+#define MAX_FRAMES	4096		/* -n and -w */
+#define POLL_TIMEOUT	500
+#define PRINT_DIGITS	6
+#define ACCEL_DEVICE	"iio:device1"
+#define GYRO_DEVICE	"iio:device0"
+#define RAD_TO_DEG	57.29577951
+#define SYNC_TRIGGER	"imu_sync"
+#define SYNC_FRAMES	1024		/* per device ring */
+#define SYNC_IDLE_US	1000
+
+static pthread_mutex_t thread_mux;
+
+struct capture_data {
+	struct iio_buffer buf;
+	const char *label;
+	const char *unit;
+	const struct iio_channel *x, *y, *z;
+	bool thread_stop;
+	struct imu_fusion *fusion;	/* NULL when fusion is off */
+	bool is_gyro;
+	float (*samples)[3];		/* one batch in float SI units */
+	const struct imu_correction *corr;	/* NULL when uncalibrated */
+	float dt;			/* sample period, 0 = measure it */
+	int64_t last_ns;
+	struct sample_shm *shm;		/* NULL when not publishing */
+	int shm_chan;
+	struct colog *log;		/* NULL when not logging */
+	int log_chan;
+	int64_t period_ns;		/* 0 = measure it */
+	int64_t log_last_ns;
+	struct vib *vib;		/* NULL when not analyzing */
+	int64_t vib_last_ns;
+	int64_t start_ns;
+	const struct iio_channel *ts;	/* in_timestamp, NULL when off */
+	struct spsc_ring *sync;		/* to the pairing thread */
+	unsigned long sync_dropped;	/* sync ring full */
+};
+
+/* One frame of either device on its way to the pairing thread */
+struct stamped_frame {
+	int64_t timestamp;		/* CLOCK_MONOTONIC, ns */
+	int64_t val[3];			/* nano-units */
+};
+
+/* An accel and a gyro frame taken on the same trigger tick */
+struct imu_record {
+	int64_t timestamp;		/* accelerometer's */
+	int64_t skew;			/* gyro - accel timestamp, ns */
+	int64_t accel[3];		/* nano m/s^2 */
+	int64_t gyro[3];		/* nano rad/s */
+};
+
+struct sync_data {
+	struct spsc_ring accel, gyro;
+	int64_t tolerance;		/* half a trigger period */
+	bool thread_stop;
+	/* Pairing thread only, restarted every second */
+	uint64_t pairs;
+	uint64_t unpaired[2];		/* accel, gyro without a partner */
+	int64_t skew_sum, skew_max;	/* absolute skews, ns */
+};
+
+static const char *const accel_chans[] = {
+	"in_accel_x", "in_accel_y", "in_accel_z", NULL
+};
+
+static const char *const gyro_chans[] = {
+	"in_anglvel_x", "in_anglvel_y", "in_anglvel_z", NULL
+};
+
+static const char *const accel_sync_chans[] = {
+	"in_accel_x", "in_accel_y", "in_accel_z", "in_timestamp", NULL
+};
+
+static const char *const gyro_sync_chans[] = {
+	"in_anglvel_x", "in_anglvel_y", "in_anglvel_z", "in_timestamp", NULL
+};
+
+static double now_sec(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * One batch in float SI units, calibrated when a calibration is loaded,
+ * for the fusion and vibration stages
+ */
+static void scale_batch(struct capture_data *ptr, unsigned int n)
+{
+	const void *frame;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		frame = iio_buffer_frame(&ptr->buf, i);
+		ptr->samples[i][0] = iio_channel_value(ptr->x, frame) * 1e-9f;
+		ptr->samples[i][1] = iio_channel_value(ptr->y, frame) * 1e-9f;
+		ptr->samples[i][2] = iio_channel_value(ptr->z, frame) * 1e-9f;
+	}
+
+	if (ptr->corr)
+		imu_correct(ptr->corr, ptr->samples, n);
+}
+
+/* Frame i of the batch in nano-units, corrected when calibrated */
+static void batch_value(const struct capture_data *ptr, unsigned int i,
+			int64_t val[3])
+{
+	const void *frame;
+	int k;
+
+	if (ptr->corr) {
+		for (k = 0; k < 3; k++)
+			val[k] = (int64_t)(ptr->samples[i][k] * 1e9);
+		return;
+	}
+
+	frame = iio_buffer_frame(&ptr->buf, i);
+	val[0] = iio_channel_value(ptr->x, frame);
+	val[1] = iio_channel_value(ptr->y, frame);
+	val[2] = iio_channel_value(ptr->z, frame);
+}
+
+/*
+ * Gyro frames drive the filter; accelerometer frames only update the
+ * gravity reference, averaged over the batch to reject vibration.
+ */
+static void fuse_batch(struct capture_data *ptr, unsigned int n)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f }, dt;
+	int64_t now = monotonic_ns();
+	unsigned int i;
+
+	if (!ptr->is_gyro) {
+		for (i = 0; i < n; i++) {
+			mean[0] += ptr->samples[i][0];
+			mean[1] += ptr->samples[i][1];
+			mean[2] += ptr->samples[i][2];
+		}
+
+		mean[0] /= n;
+		mean[1] /= n;
+		mean[2] /= n;
+		imu_fusion_set_accel(ptr->fusion, mean);
+		return;
+	}
+
+	dt = ptr->dt;
+
+	if (!dt && ptr->last_ns)
+		dt = (now - ptr->last_ns) * 1e-9f / n;
+
+	ptr->last_ns = now;
+
+	if (dt > 0)
+		imu_fusion_update(ptr->fusion, ptr->samples, n, dt, now);
+}
+
+/*
+ * Without in_timestamp the buffer carries no timestamps, so the frames of
+ * a batch are spread back from the read time by the sample period.
+ */
+static void log_batch(struct capture_data *ptr, unsigned int n)
+{
+	int64_t now = monotonic_ns(), period = ptr->period_ns;
+	const void *frame;
+	int64_t val[3];
+	unsigned int i;
+
+	if (!period && ptr->log_last_ns)
+		period = (now - ptr->log_last_ns) / n;
+
+	ptr->log_last_ns = now;
+
+	for (i = 0; i < n; i++) {
+		frame = iio_buffer_frame(&ptr->buf, i);
+		val[0] = iio_channel_raw(ptr->x, frame);
+		val[1] = iio_channel_raw(ptr->y, frame);
+		val[2] = iio_channel_raw(ptr->z, frame);
+		colog_append(ptr->log, ptr->log_chan,
+			     ptr->ts ? iio_channel_raw(ptr->ts, frame) :
+			     now - (int64_t)(n - 1 - i) * period, val);
+	}
+}
+
+static void sync_batch(struct capture_data *ptr, unsigned int n)
+{
+	struct stamped_frame f;
+	const void *frame;
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		frame = iio_buffer_frame(&ptr->buf, i);
+		f.timestamp = iio_channel_raw(ptr->ts, frame);
+		batch_value(ptr, i, f.val);
+
+		if (!spsc_ring_push(ptr->sync, &f))
+			ptr->sync_dropped++;
+	}
+}
+
+static void print_window(const struct vib_summary *s, void *arg)
+{
+	const struct capture_data *ptr = arg;
+	int64_t t = s->timestamp - ptr->start_ns;
+	const char axis[3] = { 'X', 'Y', 'Z' };
+	const struct vib_axis *a;
+	unsigned int i, p;
+
+	pthread_mutex_lock(&thread_mux);
+	printf("\n[%lld.%03lld] Vibration window %llu, %u frames at %.1f Hz\n",
+	       (long long)(t / 1000000000), (long long)(t / 1000000 % 1000),
+	       (unsigned long long)s->window, ptr->vib->cfg.size, s->rate_hz);
+
+	for (i = 0; i < 3; i++) {
+		a = &s->axis[i];
+		printf("%c: rms %.4f %s, crest %.2f", axis[i], a->rms,
+		       ptr->unit, a->crest);
+
+		for (p = 0; p < a->npeaks; p++)
+			printf("%s %.1f Hz %.4f", p ? "," : ", peaks",
+			       a->top[p].freq, a->top[p].amp);
+
+		printf("\n");
+	}
+	pthread_mutex_unlock(&thread_mux);
+}
+
+/*
+ * Summaries are printed from the capture thread as windows complete. The
+ * rate comes from sampling_frequency, or from the batch timing without it.
+ */
+static void analyze_batch(struct capture_data *ptr, unsigned int n)
+{
+	int64_t now = monotonic_ns();
+
+	if (!ptr->dt && ptr->vib_last_ns && now > ptr->vib_last_ns)
+		vib_set_rate(ptr->vib, n * 1e9f / (now - ptr->vib_last_ns));
+
+	ptr->vib_last_ns = now;
+	vib_push(ptr->vib, (const float (*)[3])ptr->samples, n, now,
+		 print_window, ptr);
+}
+
+void *capture_thread(void *arg)
+{
+	struct capture_data *ptr = (struct capture_data *)arg;
+	unsigned long frames = 0, reads = 0, wakeups = 0;
+	double start, now, cpu_start, cpu;
+	int64_t last[3] = { 0, 0, 0 };
+	char xs[32], ys[32], zs[32];
+	struct imu_attitude att;
+	ssize_t ret;
+
+	start = now_sec(CLOCK_MONOTONIC);
+	cpu_start = now_sec(CLOCK_THREAD_CPUTIME_ID);
+
+	while (!ptr->thread_stop) {
+		if (ptr->buf.watermark) {
+			ret = iio_buffer_wait(&ptr->buf, POLL_TIMEOUT);
+
+			if (ret < 0) {
+				if (ret == -EINTR)
+					continue;
+
+				printf("\nFailed to poll %s buffer: %s\n",
+				       ptr->label, strerror(-ret));
+				return NULL;
+			}
+
+			if (!ret)
+				continue;
+
+			wakeups++;
+		}
+
+		ret = iio_buffer_read(&ptr->buf);
+
+		if (ret < 0) {
+			if (ret == -EAGAIN || ret == -EINTR)
+				continue;
+
+			printf("\nFailed to read %s buffer: %s\n", ptr->label,
+			       strerror(-ret));
+			return NULL;
+		}
+
+		if (!ret)
+			continue;
+
+		frames += ret;
+		reads++;
+
+		if (ptr->samples)
+			scale_batch(ptr, ret);
+
+		if (ptr->fusion)
+			fuse_batch(ptr, ret);
+
+		if (ptr->vib)
+			analyze_batch(ptr, ret);
+
+		if (ptr->log)
+			log_batch(ptr, ret);
+
+		if (ptr->sync)
+			sync_batch(ptr, ret);
+
+		batch_value(ptr, ret - 1, last);
+
+		if (ptr->shm)
+			sample_shm_publish(ptr->shm, ptr->shm_chan,
+					   monotonic_ns(), last);
+
+		now = now_sec(CLOCK_MONOTONIC);
+
+		if (now - start < 1.0)
+			continue;
+
+		cpu = now_sec(CLOCK_THREAD_CPUTIME_ID);
+
+		pthread_mutex_lock(&thread_mux);
+		printf("\n%s: %.1f frames/s, %.1f frames/read\n", ptr->label,
+		       frames / (now - start), (double)frames / reads);
+
+		if (ptr->buf.watermark)
+			printf("%.1f wakeups/s, %.1f frames/wakeup, "
+			       "%.0f ns CPU/sample\n", wakeups / (now - start),
+			       wakeups ? (double)frames / wakeups : 0.0,
+			       (cpu - cpu_start) * 1e9 / frames);
+
+		/* The window summaries replace the raw values */
+		if (ptr->vib) {
+			printf("%.0f ns CPU/frame\n",
+			       (cpu - cpu_start) * 1e9 / frames);
+		} else {
+			iio_format_fixed(xs, sizeof(xs), last[0],
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			iio_format_fixed(ys, sizeof(ys), last[1],
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			iio_format_fixed(zs, sizeof(zs), last[2],
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("X = %s %s, Y = %s %s, Z = %s %s\n", xs,
+			       ptr->unit, ys, ptr->unit, zs, ptr->unit);
+		}
+
+		if (ptr->fusion && ptr->is_gyro) {
+			imu_fusion_get(ptr->fusion, &att);
+			printf("Roll = %.2f deg, Pitch = %.2f deg, "
+			       "Yaw = %.2f deg\n", att.roll * RAD_TO_DEG,
+			       att.pitch * RAD_TO_DEG, att.yaw * RAD_TO_DEG);
+		}
+		pthread_mutex_unlock(&thread_mux);
+
+		frames = 0;
+		reads = 0;
+		wakeups = 0;
+		start = now;
+		cpu_start = cpu;
+	}
+
+	return NULL;
+}
+
+static void print_record(const struct sync_data *sync,
+			 const struct imu_record *r, int64_t elapsed)
+{
+	char val[6][32];
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		iio_format_fixed(val[i], sizeof(val[i]), r->accel[i],
+				 IIO_NANO_DIGITS, PRINT_DIGITS);
+		iio_format_fixed(val[3 + i], sizeof(val[3 + i]), r->gyro[i],
+				 IIO_NANO_DIGITS, PRINT_DIGITS);
+	}
+
+	pthread_mutex_lock(&thread_mux);
+	printf("\nSynchronized: %.1f records/s, skew mean %.1f us, "
+	       "max %.1f us, unpaired accel %llu gyro %llu\n",
+	       sync->pairs * 1e9 / elapsed,
+	       sync->pairs ? sync->skew_sum / 1e3 / sync->pairs : 0.0,
+	       sync->skew_max / 1e3, (unsigned long long)sync->unpaired[0],
+	       (unsigned long long)sync->unpaired[1]);
+	printf("Accel %s %s %s m/s^2, Gyro %s %s %s rad/s, skew %lld ns\n",
+	       val[0], val[1], val[2], val[3], val[4], val[5],
+	       (long long)r->skew);
+	pthread_mutex_unlock(&thread_mux);
+}
+
+/*
+ * Pairs the two streams by timestamp. Frames of one trigger tick are less
+ * than half a period apart; when two frames are further apart the older
+ * one has no partner (dropped, or taken before the other device joined
+ * the trigger) and is skipped.
+ */
+void *sync_thread(void *arg)
+{
+	struct sync_data *sync = arg;
+	int64_t skew, start = monotonic_ns(), now;
+	bool have_a = false, have_g = false;
+	struct stamped_frame a, g;
+	struct imu_record rec;
+
+	while (!__atomic_load_n(&sync->thread_stop, __ATOMIC_ACQUIRE)) {
+		if (!have_a)
+			have_a = spsc_ring_pop(&sync->accel, &a);
+
+		if (!have_g)
+			have_g = spsc_ring_pop(&sync->gyro, &g);
+
+		if (!have_a || !have_g) {
+			usleep(SYNC_IDLE_US);
+			continue;
+		}
+
+		skew = g.timestamp - a.timestamp;
+
+		if (skew > sync->tolerance) {
+			sync->unpaired[0]++;
+			have_a = false;
+			continue;
+		}
+
+		if (skew < -sync->tolerance) {
+			sync->unpaired[1]++;
+			have_g = false;
+			continue;
+		}
+
+		rec.timestamp = a.timestamp;
+		rec.skew = skew;
+		memcpy(rec.accel, a.val, sizeof(rec.accel));
+		memcpy(rec.gyro, g.val, sizeof(rec.gyro));
+		have_a = false;
+		have_g = false;
+
+		skew = skew < 0 ? -skew : skew;
+		sync->skew_sum += skew;
+
+		if (skew > sync->skew_max)
+			sync->skew_max = skew;
+
+		sync->pairs++;
+		now = monotonic_ns();
+
+		if (now - start < 1000000000)
+			continue;
+
+		print_record(sync, &rec, now - start);
+		sync->pairs = 0;
+		sync->unpaired[0] = 0;
+		sync->unpaired[1] = 0;
+		sync->skew_sum = 0;
+		sync->skew_max = 0;
+		start = now;
+	}
+
+	return NULL;
+}
+
+/*
+ * Sample period from the channel's (or the device's) sampling_frequency,
+ * 0 when the driver doesn't expose it.
+ */
+static float sample_period(const struct iio_buffer *buf, const char *chan)
+{
+	char path[PATH_MAX], type[IIO_NAME_MAX], val[32];
+	int64_t freq;
+	int len = 0;
+
+	/* "in_anglvel_x" -> "in_anglvel" */
+	snprintf(type, sizeof(type), "%.*s", (int)(strrchr(chan, '_') - chan),
+		 chan);
+
+	/* A path that doesn't fit counts as a missing attribute */
+	if (snprintf(path, sizeof(path), "%s/%s_sampling_frequency",
+		     buf->dev_dir, type) < (int)sizeof(path))
+		len = sysfs_read_str(path, val, sizeof(val));
+
+	if (len <= 0 &&
+	    snprintf(path, sizeof(path), "%s/sampling_frequency",
+		     buf->dev_dir) < (int)sizeof(path))
+		len = sysfs_read_str(path, val, sizeof(val));
+
+	if (len <= 0 || iio_parse_fixed(val, len, IIO_MICRO_DIGITS, &freq) < 0 ||
+	    freq <= 0)
+		return 0;
+
+	return 1e6f / freq;
+}
+
+/* trigger is NULL for free running capture */
+static int capture_open(struct capture_data *data, const char *dev_name,
+			const char *const *chans, unsigned int batch,
+			unsigned int watermark, const char *trigger)
+{
+	int ret;
+
+	if (watermark > batch)
+		batch = watermark;
+
+	ret = iio_buffer_open(&data->buf, dev_name, chans, batch);
+
+	if (ret < 0) {
+		printf("Failed to set up %s buffer on %s: %s\n", data->label,
+		       dev_name, strerror(-ret));
+		return ret;
+	}
+
+	data->x = iio_buffer_channel(&data->buf, chans[0]);
+	data->y = iio_buffer_channel(&data->buf, chans[1]);
+	data->z = iio_buffer_channel(&data->buf, chans[2]);
+
+	if (!data->x || !data->y || !data->z) {
+		printf("%s channels missing in %s scan elements\n",
+		       data->label, dev_name);
+		iio_buffer_close(&data->buf);
+		return -ENODEV;
+	}
+
+	if (watermark) {
+		ret = iio_buffer_set_watermark(&data->buf, watermark);
+
+		if (ret < 0) {
+			printf("Failed to set %s watermark on %s: %s\n",
+			       data->label, dev_name, strerror(-ret));
+			iio_buffer_close(&data->buf);
+			return ret;
+		}
+	}
+
+	if (trigger) {
+		data->ts = iio_buffer_channel(&data->buf, "in_timestamp");
+		ret = data->ts ? iio_buffer_set_trigger(&data->buf, trigger) :
+				 -ENODEV;
+
+		if (ret < 0) {
+			printf("Failed to attach %s on %s to trigger %s: %s\n",
+			       data->label, dev_name, trigger, strerror(-ret));
+			iio_buffer_close(&data->buf);
+			return ret;
+		}
+	}
+
+	if (data->fusion || data->vib || data->corr) {
+		data->samples = malloc(data->buf.batch * sizeof(*data->samples));
+
+		if (!data->samples) {
+			iio_buffer_close(&data->buf);
+			return -ENOMEM;
+		}
+
+		data->dt = sample_period(&data->buf, chans[0]);
+	}
+
+	if (data->vib && data->dt > 0)
+		vib_set_rate(data->vib, 1.0f / data->dt);
+
+	if (data->log) {
+		data->period_ns = sample_period(&data->buf, chans[0]) * 1e9f;
+		data->log_chan = colog_add_channel(data->log, data->label,
+						   data->unit, 3,
+						   IIO_NANO_DIGITS,
+						   data->x->scale);
+
+		if (data->log_chan < 0) {
+			iio_buffer_close(&data->buf);
+			free(data->samples);
+			return data->log_chan;
+		}
+	}
+
+	printf("%s: %s, %zu bytes per frame, %u frames per read\n",
+	       data->label, dev_name, data->buf.scan_size, data->buf.batch);
+
+	if (watermark)
+		printf("%s: watermark %u frames, hardware FIFO watermark %u\n",
+		       data->label, data->buf.watermark,
+		       data->buf.hwfifo_watermark);
+
+	return 0;
+}
+
+/* A frame count for -n or -w, 1 to MAX_FRAMES */
+static int parse_frames(const char *arg, unsigned int *frames)
+{
+	unsigned long val;
+	char *end;
+
+	if (!isdigit((unsigned char)*arg))
+		return -EINVAL;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+
+	if (errno || *end || !val || val > MAX_FRAMES)
+		return -EINVAL;
+
+	*frames = val;
+
+	return 0;
+}
+
+static void print_usage(const char *name)
+{
+	printf("Usage: %s [-a accel_device] [-g gyro_device] "
+	       "[-n frames] [-w watermark] "
+	       "[-f complementary|madgwick|mahony] "
+	       "[-p /shm_name] [-l log_file] "
+	       "[-V size[:hop[:peaks]]] "
+	       "[-S rate[:trigger]] [-c calib_file]\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *accel_dev = ACCEL_DEVICE, *gyro_dev = GYRO_DEVICE;
+	struct capture_data accel_data, gyro_data;
+	pthread_t acceleration, angle_level;
+	unsigned int batch = BATCH, watermark = 0;
+	enum imu_fusion_algo algo;
+	struct imu_fusion fusion;
+	struct sample_shm shm;
+	const char *shm_name = NULL, *log_name = NULL;
+	struct colog log;
+	struct vib_config vib_cfg;
+	struct vib vib;
+	uint64_t frames;
+	int log_fd = -1;
+	bool fuse = false, analyze = false;
+	const char *trigger = NULL;
+	bool trigger_created = false;
+	unsigned long sync_hz = 0;
+	struct sync_data sync;
+	pthread_t sync_tid;
+	struct imu_correction accel_corr, gyro_corr;
+	struct imu_calib calib;
+	bool calibrated = false;
+	char *end;
+	int opt, ret, choice;
+
+	memset(&sync, 0, sizeof(sync));
+
+	while ((opt = getopt(argc, argv, "a:g:n:w:f:p:l:V:S:c:")) != -1) {
+		switch (opt) {
+		case 'a':
+			accel_dev = optarg;
+			break;
+		case 'g':
+			gyro_dev = optarg;
+			break;
+		case 'n':
+			if (parse_frames(optarg, &batch) < 0) {
+				printf("Invalid frames per read: %s, 1 to %d\n",
+				       optarg, MAX_FRAMES);
+				print_usage(argv[0]);
+				return -EINVAL;
+			}
+			break;
+		case 'w':
+			if (parse_frames(optarg, &watermark) < 0) {
+				printf("Invalid watermark: %s, 1 to %d\n", optarg,
+				       MAX_FRAMES);
+				print_usage(argv[0]);
+				return -EINVAL;
+			}
+			break;
+		case 'f':
+			if (imu_fusion_parse_algo(optarg, &algo) < 0) {
+				printf("Invalid fusion filter: %s\n", optarg);
+				return -EINVAL;
+			}
+
+			fuse = true;
+			break;
+		case 'p':
+			shm_name = optarg;
+			break;
+		case 'l':
+			log_name = optarg;
+			break;
+		case 'V':
+			if (vib_parse(&vib_cfg, optarg) < 0) {
+				printf("Invalid vibration window: %s\n", optarg);
+				return -EINVAL;
+			}
+
+			analyze = true;
+			break;
+		case 'S':
+			sync_hz = strtoul(optarg, &end, 10);
+			trigger = *end == ':' ? end + 1 : SYNC_TRIGGER;
+
+			if (!sync_hz || (*end && *end != ':') || !*trigger) {
+				printf("Invalid synchronized mode: %s\n",
+				       optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'c':
+			ret = imu_calib_load(&calib, optarg);
+
+			if (ret < 0) {
+				printf("Failed to load calibration %s: %s\n",
+				       optarg, strerror(-ret));
+				return ret;
+			}
+
+			imu_calib_accel(&calib, &accel_corr);
+			imu_calib_gyro(&calib, &gyro_corr);
+			calibrated = true;
+			break;
+		default:
+			print_usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	printf("\nApplication to stream the accleration and angular velocity "
+	       "through the IIO buffer, Press Any key to stop the application "
+	       "execution\n");
+
+	memset(&accel_data, 0, sizeof(accel_data));
+	memset(&gyro_data, 0, sizeof(gyro_data));
+	accel_data.label = "Acceleration";
+	accel_data.unit = "m/s^2";
+	gyro_data.label = "Angular velocity";
+	gyro_data.unit = "rad/s";
+	gyro_data.is_gyro = true;
+	accel_data.start_ns = monotonic_ns();
+
+	if (calibrated) {
+		accel_data.corr = &accel_corr;
+		gyro_data.corr = &gyro_corr;
+	}
+
+	if (fuse) {
+		imu_fusion_init(&fusion, algo);
+		accel_data.fusion = &fusion;
+		gyro_data.fusion = &fusion;
+	}
+
+	if (analyze) {
+		ret = vib_init(&vib, &vib_cfg);
+
+		if (ret < 0) {
+			printf("Failed to set up vibration analysis: %s\n",
+			       strerror(-ret));
+			return ret;
+		}
+
+		accel_data.vib = &vib;
+	}
+
+	if (shm_name) {
+		ret = sample_shm_create(&shm, shm_name);
+
+		if (ret < 0) {
+			printf("Failed to publish samples in %s: %s\n",
+			       shm_name, strerror(-ret));
+
+			if (analyze)
+				vib_free(&vib);
+
+			return ret;
+		}
+
+		accel_data.shm = &shm;
+		accel_data.shm_chan = sample_shm_add(&shm, "accel", "m/s^2", 3,
+						     IIO_NANO_DIGITS);
+		gyro_data.shm = &shm;
+		gyro_data.shm_chan = sample_shm_add(&shm, "anglvel", "rad/s", 3,
+						    IIO_NANO_DIGITS);
+	}
+
+	if (log_name) {
+		log_fd = open(log_name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+		ret = log_fd < 0 ? -errno : colog_open(&log, log_fd,
+						       monotonic_ns());
+
+		if (ret < 0) {
+			printf("Failed to create log %s: %s\n", log_name,
+			       strerror(-ret));
+
+			if (log_fd >= 0)
+				close(log_fd);
+
+			if (shm_name)
+				sample_shm_close(&shm);
+
+			if (analyze)
+				vib_free(&vib);
+
+			return ret;
+		}
+
+		accel_data.log = &log;
+		gyro_data.log = &log;
+	}
+
+	if (trigger) {
+		ret = spsc_ring_init(&sync.accel, SYNC_FRAMES,
+				     sizeof(struct stamped_frame));
+
+		if (!ret)
+			ret = spsc_ring_init(&sync.gyro, SYNC_FRAMES,
+					     sizeof(struct stamped_frame));
+
+		if (!ret)
+			ret = iio_trigger_hrtimer(trigger, sync_hz,
+						  &trigger_created);
+
+		if (ret < 0) {
+			printf("Failed to set up trigger %s: %s\n", trigger,
+			       strerror(-ret));
+			goto close_outputs;
+		}
+
+		sync.tolerance = 500000000 / sync_hz;
+		accel_data.sync = &sync.accel;
+		gyro_data.sync = &sync.gyro;
+		printf("Trigger %s: %lu Hz%s\n", trigger, sync_hz,
+		       trigger_created ? ", created" : "");
+	}
+
+	ret = capture_open(&accel_data, accel_dev,
+			   trigger ? accel_sync_chans : accel_chans, batch,
+			   watermark, trigger);
+
+	if (ret < 0)
+		goto close_outputs;
+
+	ret = capture_open(&gyro_data, gyro_dev,
+			   trigger ? gyro_sync_chans : gyro_chans, batch,
+			   watermark, trigger);
+
+	if (ret < 0) {
+		iio_buffer_close(&accel_data.buf);
+		free(accel_data.samples);
+		goto close_outputs;
+	}
+
+	pthread_mutex_init(&thread_mux, NULL);
+
+	if (trigger) {
+		ret = pthread_create(&sync_tid, NULL, sync_thread, &sync);
+
+		if (ret) {
+			printf("Failed to create pairing thread\n");
+			ret = -ret;
+			goto close_capture;
+		}
+	}
+
+	ret = pthread_create(&acceleration, NULL, capture_thread, &accel_data);
+
+	if (ret) {
+		printf("Failed to create acceleration thread\n");
+		ret = -ret;
+		goto stop_sync;
+	}
+
+	ret = pthread_create(&angle_level, NULL, capture_thread, &gyro_data);
+
+	if (ret) {
+		printf("Failed to create angle thread\n");
+		accel_data.thread_stop = true;
+		pthread_join(acceleration, NULL);
+		ret = -ret;
+		goto stop_sync;
+	}
+
+	scanf("%d", &choice);
+
+	accel_data.thread_stop = true;
+	gyro_data.thread_stop = true;
+	pthread_join(acceleration, NULL);
+	pthread_join(angle_level, NULL);
+
+stop_sync:
+	if (trigger) {
+		__atomic_store_n(&sync.thread_stop, true, __ATOMIC_RELEASE);
+		pthread_join(sync_tid, NULL);
+
+		if (accel_data.sync_dropped || gyro_data.sync_dropped)
+			printf("Pairing fell behind: %lu accel and %lu gyro "
+			       "frames dropped\n", accel_data.sync_dropped,
+			       gyro_data.sync_dropped);
+	}
+
+close_capture:
+	iio_buffer_close(&accel_data.buf);
+	iio_buffer_close(&gyro_data.buf);
+	free(accel_data.samples);
+	free(gyro_data.samples);
+
+	if (!ret)
+		printf("\nExit from application\n");
+
+close_outputs:
+	if (trigger) {
+		if (trigger_created)
+			iio_trigger_remove(trigger);
+
+		spsc_ring_free(&sync.accel);
+		spsc_ring_free(&sync.gyro);
+	}
+
+	if (log_name) {
+		colog_close(&log);
+		frames = log.series[0].samples + log.series[1].samples;
+		printf("Log: %llu frames, %llu bytes, %.2f bytes/frame\n",
+		       (unsigned long long)frames,
+		       (unsigned long long)log.bytes,
+		       frames ? (double)log.bytes / frames : 0.0);
+		close(log_fd);
+	}
+
+	if (shm_name)
+		sample_shm_close(&shm);
+
+	if (analyze)
+		vib_free(&vib);
+
+	return ret;
+}
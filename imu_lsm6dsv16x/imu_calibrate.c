@@ -0,0 +1,381 @@
+/*
+ * IMU Calibration
+ *
+ * - Estimates the gyroscope bias from a window in which the board rests
+ *   still, rejecting the window when the readings spread too much
+ * - Walks the user through six resting poses, one face of the board up
+ *   each time; the face is detected from the accelerometer mean, tilted
+ *   and repeated poses are refused
+ * - Fits the accelerometer offset and 3x3 scale/misalignment matrix by
+ *   least squares (imu_calib.h), prints the residual and the result and
+ *   saves it where imu_menu, imu_continuous and imu_buffered load it
+ *   with -c
+ *
+ * Usage: imu_calibrate -o calib_file [-s seconds] [-r rate]
+ *                      [-a accel_device] [-g gyro_device]
+ *
+ * This is a generic Linux I2C user-space application.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/chan_reader.h"
+#include "../common/iio_parse.h"
+#include "../common/imu_calib.h"
+#include "../common/periodic.h"
+#include "../common/sysfs.h"
+
+#define MAX 15
+#define SECONDS		5
+#define RATE_HZ		100
+#define ACCEL_DEVICE	"iio:device1"
+#define GYRO_DEVICE	"iio:device0"
+#define GYRO_STILL	0.02		/* rad/s, largest stddev at rest */
+#define ACCEL_STILL	0.2		/* m/s^2 */
+
+struct sensor {
+	int fd[3], fd_scale;
+	struct chan_reader reader;
+	int64_t scale;			/* nano-units per count */
+};
+
+static const char *const pose_name[IMU_CALIB_POSES] = {
+	"+X", "-X", "+Y", "-Y", "+Z", "-Z"
+};
+
+static void sensor_close(struct sensor *s)
+{
+	int i;
+
+	chan_reader_close(&s->reader);
+
+	for (i = 0; i < 3; i++)
+		if (s->fd[i] >= 0)
+			close(s->fd[i]);
+
+	if (s->fd_scale >= 0)
+		close(s->fd_scale);
+}
+
+static int sensor_open(struct sensor *s, const char *dev, const char *type)
+{
+	const char axis[3] = { 'x', 'y', 'z' };
+	char path[256], buf[MAX];
+	int i, ret;
+
+	s->fd_scale = -1;
+
+	for (i = 0; i < 3; i++)
+		s->fd[i] = -1;
+
+	ret = chan_reader_init(&s->reader, CHAN_READER_PREAD);
+
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 3; i++) {
+		snprintf(path, sizeof(path),
+			 "/sys/bus/iio/devices/%s/in_%s_%c_raw", dev, type,
+			 axis[i]);
+		s->fd[i] = sysfs_open(path, O_RDONLY);
+
+		if (s->fd[i] < 0) {
+			ret = -ENOENT;
+			goto err;
+		}
+
+		chan_reader_add(&s->reader, s->fd[i]);
+	}
+
+	snprintf(path, sizeof(path), "/sys/bus/iio/devices/%s/in_%s_scale",
+		 dev, type);
+	s->fd_scale = sysfs_open(path, O_RDONLY);
+
+	if (s->fd_scale < 0) {
+		ret = -ENOENT;
+		goto err;
+	}
+
+	ret = read(s->fd_scale, buf, MAX);
+
+	if (ret < 0 ||
+	    iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, &s->scale) < 0) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	return 0;
+err:
+	sensor_close(s);
+
+	return ret;
+}
+
+/* One frame in float SI units */
+static int sensor_read(struct sensor *s, float v[3])
+{
+	int32_t raw;
+	int i, ret;
+
+	ret = chan_reader_read(&s->reader);
+
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 3; i++) {
+		ret = iio_parse_int(s->reader.buf[i], s->reader.len[i], &raw);
+
+		if (ret < 0)
+			return ret;
+
+		v[i] = raw * s->scale * 1e-9f;
+	}
+
+	return 0;
+}
+
+/* Averages both sensors over seconds at rate frames/s */
+static int capture(struct sensor *accel, struct sensor *gyro,
+		   unsigned int seconds, unsigned int rate,
+		   struct imu_calib_stats *a, struct imu_calib_stats *g)
+{
+	unsigned int i, n = seconds * rate;
+	struct periodic p;
+	float v[3];
+	int ret;
+
+	imu_calib_stats_reset(a);
+	imu_calib_stats_reset(g);
+	periodic_start(&p, 1000 / rate);
+
+	for (i = 0; i < n; i++) {
+		ret = sensor_read(accel, v);
+
+		if (ret < 0)
+			return ret;
+
+		imu_calib_stats_add(a, v);
+		ret = sensor_read(gyro, v);
+
+		if (ret < 0)
+			return ret;
+
+		imu_calib_stats_add(g, v);
+		periodic_wait(&p);
+	}
+
+	return 0;
+}
+
+/* false on end of input */
+static bool wait_enter(void)
+{
+	char line[64];
+
+	return fgets(line, sizeof(line), stdin) != NULL;
+}
+
+static int calibrate_gyro(struct sensor *accel, struct sensor *gyro,
+			  unsigned int seconds, unsigned int rate,
+			  struct imu_calib *c)
+{
+	struct imu_calib_stats a, g;
+	double mean[3], noise;
+	int i, ret;
+
+	while (1) {
+		printf("\nPut the board down on any face, keep it still and "
+		       "press Enter\n");
+
+		if (!wait_enter())
+			return -EINTR;
+
+		printf("Measuring gyroscope bias for %u s...\n", seconds);
+		ret = capture(accel, gyro, seconds, rate, &a, &g);
+
+		if (ret < 0) {
+			printf("Failed to read the sensors: %s\n",
+			       strerror(-ret));
+			return ret;
+		}
+
+		noise = imu_calib_stats_noise(&g);
+
+		if (noise <= GYRO_STILL)
+			break;
+
+		printf("The board moved (gyroscope noise %.4f rad/s), "
+		       "try again\n", noise);
+	}
+
+	imu_calib_stats_mean(&g, mean);
+
+	for (i = 0; i < 3; i++)
+		c->gyro_bias[i] = mean[i];
+
+	printf("Gyroscope bias: %.6f %.6f %.6f rad/s, noise %.4f rad/s\n",
+	       mean[0], mean[1], mean[2], noise);
+
+	return 0;
+}
+
+static int calibrate_accel(struct sensor *accel, struct sensor *gyro,
+			   unsigned int seconds, unsigned int rate,
+			   struct imu_calib *c)
+{
+	double means[IMU_CALIB_POSES][3], noise, rms;
+	int poses[IMU_CALIB_POSES], pose, ret;
+	bool done[IMU_CALIB_POSES] = { false };
+	struct imu_calib_stats a, g;
+	unsigned int n = 0;
+
+	while (n < IMU_CALIB_POSES) {
+		printf("\nTurn the board so that a new face points up (%u of "
+		       "%d done), keep it still and press Enter\n", n,
+		       IMU_CALIB_POSES);
+
+		if (!wait_enter())
+			return -EINTR;
+
+		ret = capture(accel, gyro, seconds, rate, &a, &g);
+
+		if (ret < 0) {
+			printf("Failed to read the sensors: %s\n",
+			       strerror(-ret));
+			return ret;
+		}
+
+		noise = imu_calib_stats_noise(&a);
+
+		if (noise > ACCEL_STILL) {
+			printf("The board moved (accelerometer noise %.3f "
+			       "m/s^2), try again\n", noise);
+			continue;
+		}
+
+		imu_calib_stats_mean(&a, means[n]);
+		pose = imu_calib_pose(means[n]);
+
+		if (pose < 0) {
+			printf("No face points up (%.3f %.3f %.3f m/s^2), "
+			       "lay the board flat\n", means[n][0],
+			       means[n][1], means[n][2]);
+			continue;
+		}
+
+		if (done[pose]) {
+			printf("Face %s is already done\n", pose_name[pose]);
+			continue;
+		}
+
+		printf("Face %s: %.4f %.4f %.4f m/s^2\n", pose_name[pose],
+		       means[n][0], means[n][1], means[n][2]);
+		done[pose] = true;
+		poses[n++] = pose;
+	}
+
+	ret = imu_calib_fit_accel(c, (const double (*)[3])means, poses, n,
+				  &rms);
+
+	if (ret < 0) {
+		printf("The poses don't span all three axes\n");
+		return ret;
+	}
+
+	printf("\nAccelerometer fit: residual %.4f m/s^2\n", rms);
+	printf("Offset: %.4f %.4f %.4f m/s^2\n", c->accel_offset[0],
+	       c->accel_offset[1], c->accel_offset[2]);
+	printf("Matrix: %.5f %.5f %.5f\n        %.5f %.5f %.5f\n"
+	       "        %.5f %.5f %.5f\n", c->accel_matrix[0][0],
+	       c->accel_matrix[0][1], c->accel_matrix[0][2],
+	       c->accel_matrix[1][0], c->accel_matrix[1][1],
+	       c->accel_matrix[1][2], c->accel_matrix[2][0],
+	       c->accel_matrix[2][1], c->accel_matrix[2][2]);
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	printf("Usage: %s -o calib_file [-s seconds] [-r rate] "
+	       "[-a accel_device] [-g gyro_device]\n", prog);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out = NULL, *accel_dev = ACCEL_DEVICE;
+	const char *gyro_dev = GYRO_DEVICE;
+	unsigned int seconds = SECONDS, rate = RATE_HZ;
+	struct sensor accel, gyro;
+	struct imu_calib c;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "o:s:r:a:g:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out = optarg;
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'a':
+			accel_dev = optarg;
+			break;
+		case 'g':
+			gyro_dev = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (!out || !seconds || !rate || rate > 1000) {
+		usage(argv[0]);
+		return -EINVAL;
+	}
+
+	ret = sensor_open(&accel, accel_dev, "accel");
+
+	if (ret < 0) {
+		printf("Failed to open accelerometer %s\n", accel_dev);
+		return ret;
+	}
+
+	ret = sensor_open(&gyro, gyro_dev, "anglvel");
+
+	if (ret < 0) {
+		printf("Failed to open gyroscope %s\n", gyro_dev);
+		sensor_close(&accel);
+		return ret;
+	}
+
+	imu_calib_init(&c);
+	ret = calibrate_gyro(&accel, &gyro, seconds, rate, &c);
+
+	if (!ret)
+		ret = calibrate_accel(&accel, &gyro, seconds, rate, &c);
+
+	if (!ret) {
+		ret = imu_calib_save(&c, out);
+
+		if (ret < 0)
+			printf("Failed to save %s: %s\n", out, strerror(-ret));
+		else
+			printf("Saved to %s\n", out);
+	}
+
+	sensor_close(&gyro);
+	sensor_close(&accel);
+
+	return ret;
+}
@@ -1,10 +1,36 @@
 /*
  * Continuous IMU Reader with Threads
  *
- * - Reads accelerometer and angle values every 10 seconds
- * - Uses two threads: one for reading sensor, one for printing data
- * - Prevents print mixing using mutex lock
+ * - Reads accelerometer and angle values every 10 seconds (-i ms); the
+ *   samplers sleep on a CLOCK_MONOTONIC condition variable, so exit takes
+ *   milliseconds instead of up to an interval (the time is printed)
+ * - Optional real-time mode (-R priority[:cpu]): memory is locked, the
+ *   samplers run SCHED_FIFO, optionally pinned to one CPU, with prefaulted
+ *   stacks. Every run ends with a jitter report (spacing of the samples
+ *   against the interval, page faults taken by the sampling loop)
+ * - Sampler threads only read the sensor; they hand timestamped frames to
+ *   a printer thread through lock-free single-producer/single-consumer
+ *   rings, so a slow terminal cannot delay acquisition
+ * - Only the printer thread writes to stdout, so prints never mix
  * - Runs continuously until user presses any key to exit
+ * - Optional single-threaded event-loop engine (-E): accelerometer and
+ *   gyroscope are timerfds in one epoll instance together with stdin, so no
+ *   threads or mutex are needed
+ * - Each sensor's x, y and z attributes are read as one batch with pread at
+ *   offset 0 (no lseek), or with -r uring as three io_uring reads submitted
+ *   by a single io_uring_enter()
+ * - Per-stage latency histograms (read, decode, sink, and the printer's
+ *   printf) merged across sensors and printed on SIGUSR1 and at exit
+ * - Optional publisher mode (-p /name): every frame is also published in a
+ *   POSIX shared-memory segment for other processes (sample_shm.h)
+ * - Optional motion alarm (-W level[:hysteresis] in m/s^2): programs the
+ *   accelerometer's wake-up threshold event and blocks on the IIO event
+ *   fd, so motion is reported as it happens; without driver support the
+ *   same test (change between two frames) runs on every sample instead.
+ *   Alarms and events are queued to the printer like frames
+ * - Optional calibration (-c file from imu_calibrate): the gyroscope bias
+ *   is removed and the accelerometer offset and scale/misalignment matrix
+ *   are applied to every frame as it is decoded
  *
  * This is a generic Linux I2C user-space application.
  */
@@ -12,25 +38,479 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <unistd.h>
 
+#include "../common/chan_reader.h"
+#include "../common/ev_loop.h"
+#include "../common/iio_event.h"
+#include "../common/iio_parse.h"
+#include "../common/imu_calib.h"
+#include "../common/lat_hist.h"
+#include "../common/periodic.h"
+#include "../common/rt_sched.h"
+#include "../common/sample_shm.h"
+#include "../common/spsc_ring.h"
+#include "../common/sysfs.h"
+#include "../common/threshold.h"
+
 #define MAX 15
+#define PRINT_DIGITS	6
+#define INTERVAL_MS	10000
+
+#define RING_FRAMES	64
+#define MOTION_RECORDS	16
+#define SINK_IDLE_US	10000
+
+#define ACCEL_DEV	"iio:device1"
+
+enum imu_sensor {
+	SENSOR_ACCEL,
+	SENSOR_ANGLE,
+};
+
+/* Sample stages timed by the latency histograms */
+enum stage {
+	STAGE_READ,		/* batched x, y, z read */
+	STAGE_DECODE,		/* parse and scale */
+	STAGE_SINK,		/* ring push, or printf in the event loop */
+	STAGES,
+};
+
+static const char *const stage_name[STAGES] = { "read", "decode", "sink" };
 
-static pthread_mutex_t thread_mux;
+/* Fixed-size record handed from a sampler thread to the printer thread */
+struct imu_frame {
+	int64_t timestamp;	/* CLOCK_MONOTONIC, ns */
+	int64_t x, y, z;	/* nano-units (m/s^2 or rad/s) */
+};
+
+/*
+ * Motion alarm (-W): the wake-up event when the driver has one, otherwise
+ * a slope threshold per axis on consecutive frames, which is what the
+ * wake-up logic itself compares against.
+ */
+struct motion {
+	int fd;				/* IIO event fd, -1 in userspace mode */
+	struct threshold axis[3];	/* nano m/s^2 */
+	int64_t prev[3];
+	bool primed;
+	int64_t start;
+	struct spsc_ring ring;		/* motion_record, to the printer */
+	unsigned long dropped;
+	int stop_fd;			/* eventfd that ends motion_thread */
+	pthread_t thread;
+	bool running;
+};
+
+/* An alarm from the userspace check or an event from the driver */
+struct motion_record {
+	int64_t timestamp;		/* CLOCK_MONOTONIC, ns */
+	bool event;
+	uint64_t id;			/* IIO event id */
+	int axis;			/* userspace alarm: axis, change, level */
+	bool raised;
+	int64_t change, level;		/* nano m/s^2 */
+};
+
+static const char *const motion_en[3] = {
+	"in_accel_x_thresh_either_en",
+	"in_accel_y_thresh_either_en",
+	"in_accel_z_thresh_either_en",
+};
 
 struct thread_data {
 	int fd_x, fd_y, fd_z, fd_scale;
+	struct motion *motion;		/* userspace motion checks, or NULL */
+	const struct imu_correction *corr;	/* NULL when uncalibrated */
+	struct chan_reader reader;	/* x, y and z in one batch */
 	bool thread_stop;
+	struct periodic_wake wake;	/* ends the wait on exit */
+	struct spsc_ring ring;
+	unsigned long dropped;
+	int shm_chan;			/* -1 when not publishing */
+	const struct rt_config *rt;	/* NULL: normal scheduling */
+	int rt_error;			/* rt_enter() result, read at exit */
+	struct rt_jitter jitter;	/* sampling thread only, read at exit */
+	struct lat_hist lat[STAGES];	/* written by the sampling thread only */
 };
 
+struct sink_data {
+	struct thread_data *accel, *angl;
+	struct motion *motion;		/* NULL without -W */
+	int64_t start;
+	bool thread_stop;
+	struct lat_hist print_lat;	/* written by the printer only */
+};
+
+/* Publisher mode (-p): latest frames for other processes */
+static struct sample_shm shm;
+
+static long interval_ms = INTERVAL_MS;
+
+static void publish_frame(const struct thread_data *ptr,
+			  const struct imu_frame *frame)
+{
+	int64_t val[3] = { frame->x, frame->y, frame->z };
+
+	if (ptr->shm_chan >= 0)
+		sample_shm_publish(&shm, ptr->shm_chan, frame->timestamp, val);
+}
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Sampler threads never print: a frame that doesn't fit because the printer
+ * is behind is counted and dropped, so a slow terminal can't stall
+ * acquisition.
+ */
+static void push_frame(struct thread_data *ptr, const struct imu_frame *frame)
+{
+	if (!spsc_ring_push(&ptr->ring, frame))
+		ptr->dropped++;
+}
+
+/* Calibrations are in float SI units, frames in nano-units */
+static void correct_frame(const struct imu_correction *corr,
+			  int64_t *const axis[3])
+{
+	float v[1][3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		v[0][i] = *axis[i] * 1e-9f;
+
+	imu_correct(corr, v, 1);
+
+	for (i = 0; i < 3; i++)
+		*axis[i] = (int64_t)(v[0][i] * 1e9);
+}
+
+/*
+ * One batched read of x, y and z, scaled to nano-units and corrected when
+ * calibrated. Times the read and decode stages; *start is left at the end
+ * of decode for the caller's sink.
+ */
+static int read_frame(struct thread_data *ptr, int64_t scale,
+		      struct imu_frame *frame, uint64_t *start)
+{
+	int64_t *const axis[3] = { &frame->x, &frame->y, &frame->z };
+	int32_t raw;
+	int i, ret;
+
+	*start = lat_hist_start(&ptr->lat[STAGE_READ]);
+	ret = chan_reader_read(&ptr->reader);
+	lat_hist_stage(&ptr->lat[STAGE_READ], start);
+
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 3; i++) {
+		ret = iio_parse_int(ptr->reader.buf[i], ptr->reader.len[i],
+				    &raw);
+
+		if (ret < 0)
+			return ret;
+
+		*axis[i] = raw * scale;
+	}
+
+	if (ptr->corr)
+		correct_frame(ptr->corr, axis);
+
+	lat_hist_stage(&ptr->lat[STAGE_DECODE], start);
+
+	return 0;
+}
+
+/* Like frames, alarms are dropped rather than wait for the printer */
+static void push_motion(struct motion *m, const struct motion_record *rec)
+{
+	if (!spsc_ring_push(&m->ring, rec))
+		m->dropped++;
+}
+
+static void check_motion(struct motion *m, const struct imu_frame *frame)
+{
+	const int64_t value[3] = { frame->x, frame->y, frame->z };
+	struct motion_record rec = { .timestamp = frame->timestamp };
+	enum threshold_event ev;
+	int i;
+
+	for (i = 0; m->primed && i < 3; i++) {
+		ev = threshold_update(&m->axis[i], llabs(value[i] - m->prev[i]));
+
+		if (ev == THRESHOLD_NONE)
+			continue;
+
+		rec.axis = i;
+		rec.raised = ev == THRESHOLD_RAISED;
+		rec.change = value[i] - m->prev[i];
+		rec.level = m->axis[i].level;
+		push_motion(m, &rec);
+	}
+
+	for (i = 0; i < 3; i++)
+		m->prev[i] = value[i];
+
+	m->primed = true;
+}
+
+static void print_motion(const struct motion *m,
+			 const struct motion_record *rec)
+{
+	const char axis[3] = { 'X', 'Y', 'Z' };
+	int64_t t = rec->timestamp - m->start;
+	char level[32], text[64];
+
+	printf("\n[%lld.%03lld] ", (long long)(t / 1000000000),
+	       (long long)(t / 1000000 % 1000));
+
+	if (rec->event) {
+		iio_event_describe(text, sizeof(text), rec->id);
+		printf("Motion event: %s\n", text);
+		return;
+	}
+
+	iio_format_fixed(level, sizeof(level), rec->level, IIO_NANO_DIGITS,
+			 PRINT_DIGITS);
+	iio_format_fixed(text, sizeof(text), rec->change, IIO_NANO_DIGITS,
+			 PRINT_DIGITS);
+	printf("Motion alarm %s: %c acceleration changed by %s m/s^2 "
+	       "(level %s)\n", rec->raised ? "raised" : "cleared",
+	       axis[rec->axis], text, level);
+}
+
+/* Prints the queued alarms and events, returns how many */
+static int drain_motion(struct motion *m)
+{
+	struct motion_record rec;
+	int n = 0;
+
+	while (spsc_ring_pop(&m->ring, &rec)) {
+		print_motion(m, &rec);
+		n++;
+	}
+
+	return n;
+}
+
+/* Reads one event from the event fd and queues it */
+static int read_motion_event(struct motion *m)
+{
+	struct motion_record rec = { .event = true };
+	struct iio_event_data ev;
+	int ret;
+
+	ret = iio_event_read(m->fd, &ev);
+
+	if (ret < 0)
+		return ret;
+
+	rec.timestamp = now_ns();
+	rec.id = ev.id;
+	push_motion(m, &rec);
+
+	return 0;
+}
+
+/* Sleeps in poll() until the sensor reports motion or motion_stop() */
+static void *motion_thread(void *arg)
+{
+	struct motion *m = arg;
+	struct pollfd pfd[2] = {
+		{ .fd = m->fd, .events = POLLIN },
+		{ .fd = m->stop_fd, .events = POLLIN },
+	};
+
+	for (;;) {
+		if (poll(pfd, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+
+			break;
+		}
+
+		if (pfd[1].revents || (pfd[0].revents & ~POLLIN))
+			break;
+
+		if (pfd[0].revents && read_motion_event(m) < 0)
+			break;
+	}
+
+	return NULL;
+}
+
+static int motion_start(struct motion *m, const pthread_attr_t *attr)
+{
+	int ret;
+
+	m->stop_fd = eventfd(0, EFD_CLOEXEC);
+
+	if (m->stop_fd < 0)
+		return -errno;
+
+	ret = pthread_create(&m->thread, attr, motion_thread, m);
+
+	if (ret) {
+		close(m->stop_fd);
+		m->stop_fd = -1;
+		return -ret;
+	}
+
+	m->running = true;
+
+	return 0;
+}
+
+/* Wakes and joins motion_thread, so the event fd can be closed safely */
+static void motion_stop(struct motion *m)
+{
+	uint64_t one = 1;
+
+	if (!m->running)
+		return;
+
+	/* poll() is a cancellation point, the fallback if the write fails */
+	if (write(m->stop_fd, &one, sizeof(one)) != sizeof(one))
+		pthread_cancel(m->thread);
+
+	pthread_join(m->thread, NULL);
+
+	close(m->stop_fd);
+	m->stop_fd = -1;
+	m->running = false;
+}
+
+/*
+ * The event value is in raw counts like the channels it watches. Returns
+ * -errno and leaves m->fd at -1 when the driver can't do it.
+ */
+static int motion_open(struct motion *m, int64_t scale)
+{
+	char val[32];
+	int64_t raw;
+	int i, ret;
+
+	raw = scale > 0 ? m->axis[0].level / scale : 0;
+	snprintf(val, sizeof(val), "%lld", (long long)(raw > 0 ? raw : 1));
+	ret = iio_event_set(ACCEL_DEV, "in_accel_thresh_either_value", val);
+
+	for (i = 0; ret == 0 && i < 3; i++)
+		ret = iio_event_set(ACCEL_DEV, motion_en[i], "1");
+
+	if (ret == 0)
+		ret = iio_event_open(ACCEL_DEV);
+
+	if (ret < 0) {
+		for (i = 0; i < 3; i++)
+			iio_event_set(ACCEL_DEV, motion_en[i], "0");
+
+		return ret;
+	}
+
+	m->fd = ret;
+
+	return 0;
+}
+
+static void motion_close(struct motion *m)
+{
+	int i;
+
+	motion_stop(m);
+
+	if (m->fd < 0)
+		return;
+
+	for (i = 0; i < 3; i++)
+		iio_event_set(ACCEL_DEV, motion_en[i], "0");
+
+	close(m->fd);
+	m->fd = -1;
+}
+
+/* Merges both sensors stage by stage; print may be NULL */
+static void print_latency(const struct thread_data *accel,
+			  const struct thread_data *angl,
+			  const struct lat_hist *print)
+{
+	struct lat_hist all;
+	char name[32];
+	int i;
+
+	printf("\nPer-stage latency\n");
+
+	for (i = 0; i < STAGES; i++) {
+		memset(&all, 0, sizeof(all));
+		lat_hist_merge(&all, &accel->lat[i]);
+		lat_hist_merge(&all, &angl->lat[i]);
+		snprintf(name, sizeof(name), "%-6s", stage_name[i]);
+		lat_hist_print(name, &all);
+	}
+
+	if (print) {
+		memset(&all, 0, sizeof(all));
+		lat_hist_merge(&all, print);
+		lat_hist_print("print ", &all);
+	}
+
+	fflush(stdout);
+}
+
+static void print_jitter(const struct thread_data *accel,
+			 const struct thread_data *angl)
+{
+	if (accel->rt_error < 0)
+		printf("\nReal-time setup of acceleration failed: %s\n",
+		       strerror(-accel->rt_error));
+
+	if (angl->rt_error < 0)
+		printf("\nReal-time setup of angle failed: %s\n",
+		       strerror(-angl->rt_error));
+
+	printf("\nSample spacing\n");
+	rt_jitter_print("acceleration", &accel->jitter);
+	rt_jitter_print("angle       ", &angl->jitter);
+	fflush(stdout);
+}
+
+/*
+ * Real-time setup and jitter accounting, on the sampling thread. Only the
+ * printer writes to stdout, a failed setup is reported with the jitter.
+ */
+static void sampler_start(struct thread_data *ptr)
+{
+	if (ptr->rt)
+		ptr->rt_error = rt_enter(ptr->rt);
+
+	rt_jitter_init(&ptr->jitter, interval_ms);
+	rt_faults_begin(&ptr->jitter);
+}
+
 void *accel_thread(void *arg)
 {
 	struct thread_data *ptr = (struct thread_data *)arg;
+	struct periodic period;
+	struct imu_frame frame;
 	char buf[MAX];
-	double scale, x_accel, y_accel, z_accel;
+	uint64_t start;
+	int64_t scale;
 	int ret;
 
 	ret = read(ptr->fd_scale, buf, MAX);
@@ -45,32 +525,26 @@ void *accel_thread(void *arg)
 		return NULL;
 	}
 
-	scale = atof(buf);
-
-	while (!ptr->thread_stop) {
-		pthread_mutex_lock(&thread_mux);
-		lseek(ptr->fd_x, 0, SEEK_SET);
-		ret = read(ptr->fd_x, buf, MAX);
-
-		if (ret == -1) {
-			printf("\nFailed to read x accleration value\n");
-			close(ptr->fd_x);
-			close(ptr->fd_y);
-			close(ptr->fd_z);
-			close(ptr->fd_scale);
-
-			return NULL;
-		}
+	if (iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, &scale) < 0) {
+		printf("\nInvalid scale value\n");
+		close(ptr->fd_x);
+		close(ptr->fd_y);
+		close(ptr->fd_z);
+		close(ptr->fd_scale);
 
-		x_accel = atof(buf);
+		return NULL;
+	}
 
-		printf("\nX acceleration = %lf m/s^2\n", x_accel*scale);
+	sampler_start(ptr);
+	periodic_start(&period, interval_ms);
 
-		lseek(ptr->fd_y, 0, SEEK_SET);
-		ret = read(ptr->fd_y, buf, MAX);
+	while (!ptr->thread_stop) {
+		frame.timestamp = now_ns();
+		rt_jitter_record(&ptr->jitter, frame.timestamp);
+		ret = read_frame(ptr, scale, &frame, &start);
 
-		if (ret == -1) {
-			printf("\nFailed to read x accleration value\n");
+		if (ret < 0) {
+			printf("\nFailed to read acceleration values\n");
 			close(ptr->fd_x);
 			close(ptr->fd_y);
 			close(ptr->fd_z);
@@ -79,36 +553,30 @@ void *accel_thread(void *arg)
 			return NULL;
 		}
 
-		y_accel = atof(buf);
+		if (ptr->motion)
+			check_motion(ptr->motion, &frame);
 
-		printf("Y acceleration = %lf m/s^2\n", y_accel*scale);
+		publish_frame(ptr, &frame);
+		push_frame(ptr, &frame);
+		lat_hist_stage(&ptr->lat[STAGE_SINK], &start);
 
-		lseek(ptr->fd_z, 0, SEEK_SET);
-		ret = read(ptr->fd_z, buf, MAX);
-
-		if (ret == -1) {
-			printf("\nFailed to read x accleration value\n");
-			close(ptr->fd_x);
-			close(ptr->fd_y);
-			close(ptr->fd_z);
-			close(ptr->fd_scale);
-
-			return NULL;
-		}
+		if (periodic_wait_wake(&period, &ptr->wake) < 0)
+			break;
+	}
 
-		z_accel = atof(buf);
+	rt_faults_end(&ptr->jitter);
 
-		printf("Z acceleration = %lf m/s^2\n", z_accel*scale);
-		pthread_mutex_unlock(&thread_mux);
-		sleep(10);
-	}
+	return NULL;
 }
 
 void *angle_thread(void *arg)
 {
 	struct thread_data *ptr = (struct thread_data *)arg;
+	struct periodic period;
+	struct imu_frame frame;
 	char buf[MAX];
-	double scale, x_angl, y_angl, z_angl;
+	uint64_t start;
+	int64_t scale;
 	int ret;
 
 	ret = read(ptr->fd_scale, buf, MAX);
@@ -123,15 +591,26 @@ void *angle_thread(void *arg)
 		return NULL;
 	}
 
-	scale = atof(buf);
+	if (iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, &scale) < 0) {
+		printf("\nInvalid scale value\n");
+		close(ptr->fd_x);
+		close(ptr->fd_y);
+		close(ptr->fd_z);
+		close(ptr->fd_scale);
+
+		return NULL;
+	}
+
+	sampler_start(ptr);
+	periodic_start(&period, interval_ms);
 
 	while (!ptr->thread_stop) {
-		pthread_mutex_lock(&thread_mux);
-		lseek(ptr->fd_x, 0, SEEK_SET);
-		ret = read(ptr->fd_x, buf, MAX);
+		frame.timestamp = now_ns();
+		rt_jitter_record(&ptr->jitter, frame.timestamp);
+		ret = read_frame(ptr, scale, &frame, &start);
 
-		if (ret == -1) {
-			printf("\nFailed to read x angle value\n");
+		if (ret < 0) {
+			printf("\nFailed to read angle values\n");
 			close(ptr->fd_x);
 			close(ptr->fd_y);
 			close(ptr->fd_z);
@@ -140,59 +619,436 @@ void *angle_thread(void *arg)
 			return NULL;
 		}
 
-		x_angl = atof(buf);
+		publish_frame(ptr, &frame);
+		push_frame(ptr, &frame);
+		lat_hist_stage(&ptr->lat[STAGE_SINK], &start);
 
-		printf("\nX angle level = %lf dps\n", x_angl*scale);
+		if (periodic_wait_wake(&period, &ptr->wake) < 0)
+			break;
+	}
 
-		lseek(ptr->fd_y, 0, SEEK_SET);
-		ret = read(ptr->fd_y, buf, MAX);
+	rt_faults_end(&ptr->jitter);
 
-		if (ret == -1) {
-			printf("\nFailed to read x angle value\n");
-			close(ptr->fd_x);
-			close(ptr->fd_y);
-			close(ptr->fd_z);
-			close(ptr->fd_scale);
+	return NULL;
+}
 
-			return NULL;
+static void print_frame(const struct sink_data *sink, enum imu_sensor sensor,
+			const struct imu_frame *frame)
+{
+	int64_t t = frame->timestamp - sink->start;
+	char x[32], y[32], z[32];
+
+	printf("\n[%lld.%03lld]\n", (long long)(t / 1000000000),
+	       (long long)(t / 1000000 % 1000));
+
+	iio_format_fixed(x, sizeof(x), frame->x, IIO_NANO_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(y, sizeof(y), frame->y, IIO_NANO_DIGITS, PRINT_DIGITS);
+	iio_format_fixed(z, sizeof(z), frame->z, IIO_NANO_DIGITS, PRINT_DIGITS);
+
+	if (sensor == SENSOR_ACCEL) {
+		printf("X acceleration = %s m/s^2\n", x);
+		printf("Y acceleration = %s m/s^2\n", y);
+		printf("Z acceleration = %s m/s^2\n", z);
+	} else {
+		printf("X angle level = %s rad/s\n", x);
+		printf("Y angle level = %s rad/s\n", y);
+		printf("Z angle level = %s rad/s\n", z);
+	}
+}
+
+/* Only thread that writes to stdout, drains both rings in time order */
+void *sink_thread(void *arg)
+{
+	struct sink_data *sink = (struct sink_data *)arg;
+	struct imu_frame accel, angl;
+	bool have_accel = false, have_angl = false, stop;
+	uint64_t start;
+
+	for (;;) {
+		stop = __atomic_load_n(&sink->thread_stop, __ATOMIC_ACQUIRE);
+
+		/* Alarms go out as soon as they are queued */
+		if (sink->motion && drain_motion(sink->motion))
+			continue;
+
+		if (!have_accel)
+			have_accel = spsc_ring_pop(&sink->accel->ring, &accel);
+
+		if (!have_angl)
+			have_angl = spsc_ring_pop(&sink->angl->ring, &angl);
+
+		start = lat_clock();
+
+		if (have_accel && (!have_angl ||
+				   accel.timestamp <= angl.timestamp)) {
+			print_frame(sink, SENSOR_ACCEL, &accel);
+			lat_hist_stage(&sink->print_lat, &start);
+			have_accel = false;
+		} else if (have_angl) {
+			print_frame(sink, SENSOR_ANGLE, &angl);
+			lat_hist_stage(&sink->print_lat, &start);
+			have_angl = false;
+		} else if (stop) {
+			break;
+		} else {
+			fflush(stdout);
+			usleep(SINK_IDLE_US);
 		}
+	}
 
-		y_angl = atof(buf);
+	if (sink->accel->dropped || sink->angl->dropped)
+		printf("\nDropped frames: %lu acceleration, %lu angle level\n",
+		       sink->accel->dropped, sink->angl->dropped);
 
-		printf("Y angle level = %lf dps\n", y_angl*scale);
+	if (sink->motion && sink->motion->dropped)
+		printf("\nDropped motion alarms: %lu\n",
+		       sink->motion->dropped);
 
-		lseek(ptr->fd_z, 0, SEEK_SET);
-		ret = read(ptr->fd_z, buf, MAX);
+	return NULL;
+}
 
-		if (ret == -1) {
-			printf("\nFailed to read x angle value\n");
-			close(ptr->fd_x);
-			close(ptr->fd_y);
-			close(ptr->fd_z);
-			close(ptr->fd_scale);
+/*
+ * Event-loop engine: both sensors are sampled from the main thread when
+ * their timerfd expires, any input on stdin stops the loop.
+ */
+struct ev_sensor {
+	struct thread_data *data;
+	const char *name;
+	const char *unit;
+	int64_t scale;		/* nano-units per count */
+};
 
-			return NULL;
+static int read_scale(int fd, int64_t *scale)
+{
+	char buf[MAX];
+	int ret;
+
+	ret = pread(fd, buf, MAX, 0);
+
+	if (ret == -1)
+		return -errno;
+
+	return iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, scale);
+}
+
+static void ev_sample(struct ev_loop *loop, int id, uint64_t count, void *arg)
+{
+	struct ev_sensor *sensor = arg;
+	const char axis[3] = { 'X', 'Y', 'Z' };
+	struct imu_frame frame;
+	int64_t value[3];
+	uint64_t start;
+	char text[32];
+	int i;
+
+	(void)id;
+	(void)count;
+
+	frame.timestamp = now_ns();
+	rt_jitter_record(&sensor->data->jitter, frame.timestamp);
+
+	if (read_frame(sensor->data, sensor->scale, &frame, &start) < 0) {
+		printf("\nFailed to read %s values\n", sensor->name);
+		ev_loop_stop(loop);
+		return;
+	}
+
+	if (sensor->data->motion) {
+		check_motion(sensor->data->motion, &frame);
+		drain_motion(sensor->data->motion);
+	}
+
+	publish_frame(sensor->data, &frame);
+	value[0] = frame.x;
+	value[1] = frame.y;
+	value[2] = frame.z;
+	printf("\n");
+
+	for (i = 0; i < 3; i++) {
+		iio_format_fixed(text, sizeof(text), value[i], IIO_NANO_DIGITS,
+				 PRINT_DIGITS);
+		printf("%c %s = %s %s\n", axis[i], sensor->name, text,
+		       sensor->unit);
+	}
+
+	lat_hist_stage(&sensor->data->lat[STAGE_SINK], &start);
+}
+
+static void ev_stdin(struct ev_loop *loop, int id, uint64_t events, void *arg)
+{
+	(void)id;
+	(void)events;
+	(void)arg;
+
+	ev_loop_stop(loop);
+}
+
+static void ev_motion(struct ev_loop *loop, int id, uint64_t events, void *arg)
+{
+	struct motion *m = arg;
+
+	(void)loop;
+	(void)id;
+	(void)events;
+
+	if (read_motion_event(m) == 0)
+		drain_motion(m);
+}
+
+static void ev_signal(struct ev_loop *loop, int id, uint64_t events, void *arg)
+{
+	struct ev_sensor *sensors = arg;
+	struct signalfd_siginfo info;
+
+	(void)events;
+
+	if (read(loop->src[id].fd, &info, sizeof(info)) == sizeof(info))
+		print_latency(sensors[0].data, sensors[1].data, NULL);
+}
+
+static int event_main(struct thread_data *accel_data,
+		      struct thread_data *angl_data, struct motion *motion)
+{
+	struct ev_sensor sensors[2] = {
+		{ accel_data, "acceleration", "m/s^2", 0 },
+		{ angl_data, "angle level", "rad/s", 0 },
+	};
+	struct ev_loop loop;
+	sigset_t mask;
+	int i, ret, sfd;
+
+	for (i = 0; i < 2; i++) {
+		ret = read_scale(sensors[i].data->fd_scale, &sensors[i].scale);
+
+		if (ret < 0) {
+			printf("\nFailed to read %s scale value\n",
+			       sensors[i].name);
+			return ret;
 		}
+	}
 
-		z_angl = atof(buf);
+	ret = ev_loop_init(&loop);
 
-		printf("Z angle level = %lf dps\n", z_angl*scale);
-		pthread_mutex_unlock(&thread_mux);
-		sleep(10);
+	if (ret < 0) {
+		printf("Failed to create event loop\n");
+		return ret;
 	}
+
+	/*
+	 * One thread does all the sampling: its real-time setup and page
+	 * faults are counted on the accelerometer
+	 */
+	sampler_start(accel_data);
+	rt_jitter_init(&angl_data->jitter, interval_ms);
+
+	for (i = 0; i < 2; i++) {
+		ret = ev_add_timer(&loop, interval_ms, ev_sample, &sensors[i]);
+
+		if (ret < 0) {
+			printf("Failed to create %s timer\n", sensors[i].name);
+			ev_loop_close(&loop);
+			return ret;
+		}
+
+		/* Take the first sample right away like the threads do */
+		ev_sample(&loop, ret, 1, &sensors[i]);
+	}
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+	if (sfd >= 0 && ev_add_fd(&loop, sfd, ev_signal, sensors) < 0)
+		printf("Failed to watch SIGUSR1\n");
+
+	if (motion && motion->fd >= 0 &&
+	    ev_add_fd(&loop, motion->fd, ev_motion, motion) < 0)
+		printf("Failed to watch motion events\n");
+
+	ret = ev_add_fd(&loop, STDIN_FILENO, ev_stdin, NULL);
+
+	if (ret >= 0)
+		ret = ev_loop_run(&loop);
+
+	rt_faults_end(&accel_data->jitter);
+	print_latency(accel_data, angl_data, NULL);
+	print_jitter(accel_data, angl_data);
+	ev_loop_close(&loop);
+
+	if (sfd >= 0)
+		close(sfd);
+
+	return ret;
+}
+
+struct stats_data {
+	sigset_t mask;
+	struct sink_data *sink;
+};
+
+/* SIGUSR1 is blocked everywhere, this thread picks it up */
+static void *stats_thread(void *arg)
+{
+	struct stats_data *stats = arg;
+	int sig;
+
+	while (sigwait(&stats->mask, &sig) == 0)
+		print_latency(stats->sink->accel, stats->sink->angl,
+			      &stats->sink->print_lat);
+
+	return NULL;
+}
+
+static void publish_close(void)
+{
+	sample_shm_close(&shm);
 }
 
-int main(void)
+static int publish_open(const char *name, struct thread_data *accel_data,
+			struct thread_data *angl_data)
+{
+	int ret;
+
+	ret = sample_shm_create(&shm, name);
+
+	if (ret < 0)
+		return ret;
+
+	accel_data->shm_chan = sample_shm_add(&shm, "accel", "m/s^2", 3,
+					      IIO_NANO_DIGITS);
+	angl_data->shm_chan = sample_shm_add(&shm, "anglvel", "rad/s", 3,
+					     IIO_NANO_DIGITS);
+
+	/* main() has many exit paths, remove the segment on every one */
+	atexit(publish_close);
+
+	return 0;
+}
+
+/* Falls back to pread when the kernel refuses io_uring */
+static int reader_open(struct thread_data *data,
+		       enum chan_reader_backend backend)
+{
+	int ret;
+
+	ret = chan_reader_init(&data->reader, backend);
+
+	if (ret < 0 && backend == CHAN_READER_URING) {
+		printf("io_uring unavailable (%d), using pread\n", ret);
+		ret = chan_reader_init(&data->reader, CHAN_READER_PREAD);
+	}
+
+	if (ret < 0)
+		return ret;
+
+	chan_reader_add(&data->reader, data->fd_x);
+	chan_reader_add(&data->reader, data->fd_y);
+	chan_reader_add(&data->reader, data->fd_z);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
 {
 	int fd_x_accel, fd_y_accel, fd_z_accel, fd_accel_scale, fd_x_angl, fd_y_angl, fd_z_angl, fd_angl_scale, ret, choice;
-	pthread_t acceleration, angle_level;
+	pthread_t acceleration, angle_level, printer, stats_tid;
 	struct thread_data angl_data, accel_data; 
+	struct sink_data sink;
+	struct stats_data stats;
+	enum chan_reader_backend backend = CHAN_READER_PREAD;
+	bool event_loop = false;
+	const char *shm_name = NULL;
+	struct motion motion = { .fd = -1, .stop_fd = -1 }, *wake = NULL;
+	struct rt_config rt = { 0, -1 };
+	pthread_attr_t attr, *pattr = NULL;
+	const char *calib_file = NULL;
+	struct imu_correction accel_corr, angl_corr;
+	struct imu_calib calib;
+	char arg[32];
+	int64_t scale, stop;
+	int opt;
+
+	lat_clock_init();
+
+	while ((opt = getopt(argc, argv, "Er:p:W:R:i:c:")) != -1) {
+		switch (opt) {
+		case 'E':
+			event_loop = true;
+			break;
+		case 'r':
+			if (chan_reader_parse_backend(optarg, &backend) < 0) {
+				printf("Invalid reader backend: %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'p':
+			shm_name = optarg;
+			break;
+		case 'W':
+			snprintf(arg, sizeof(arg), ">%s", optarg);
+
+			if (threshold_parse(&motion.axis[0], arg,
+					    IIO_NANO_DIGITS) < 0) {
+				printf("Invalid motion level: %s\n", optarg);
+				return -EINVAL;
+			}
+
+			motion.axis[1] = motion.axis[0];
+			motion.axis[2] = motion.axis[0];
+			wake = &motion;
+			break;
+		case 'R':
+			if (rt_parse(&rt, optarg) < 0) {
+				printf("Invalid real-time setting: %s\n",
+				       optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'i':
+			interval_ms = atol(optarg);
+
+			if (interval_ms <= 0) {
+				printf("Invalid interval: %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'c':
+			calib_file = optarg;
+			ret = imu_calib_load(&calib, calib_file);
+
+			if (ret < 0) {
+				printf("Failed to load calibration %s: %s\n",
+				       calib_file, strerror(-ret));
+				return ret;
+			}
+
+			imu_calib_accel(&calib, &accel_corr);
+			imu_calib_gyro(&calib, &angl_corr);
+			break;
+		default:
+			printf("Usage: %s [-E] [-r pread|uring] [-p /shm_name] "
+			       "[-W level[:hysteresis]] [-R priority[:cpu]] "
+			       "[-i interval_ms] [-c calib_file]\n", argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (rt.priority) {
+		ret = rt_lock_memory();
+
+		if (ret < 0)
+			printf("Failed to lock memory: %s\n", strerror(-ret));
+
+		if (rt_thread_attr(&attr) == 0)
+			pattr = &attr;
+	}
 
 	printf("\nApplication to countinuosly print the accleration and angle "
 	       "level, Press Any key to stop the application execution\n");
 
-	fd_x_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_x_raw",
-			  O_RDONLY);
+	fd_x_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_x_raw",
+				O_RDONLY);
 
 	if (fd_x_accel < 0) {
 		printf("Failed to open file descriptor of x acceleration file\n");
@@ -200,8 +1056,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_y_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_y_raw",
-			  O_RDONLY);
+	fd_y_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_y_raw",
+				O_RDONLY);
 
 	if (fd_y_accel < 0) {
 		printf("Failed to open file descriptor of y acceleration file\n");
@@ -210,8 +1066,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_z_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_z_raw",
-			  O_RDONLY);
+	fd_z_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_z_raw",
+				O_RDONLY);
 
 	if (fd_z_accel < 0) {
 		printf("Failed to open file descriptor of z acceleration file\n");
@@ -221,8 +1077,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_accel_scale = open("/sys/bus/iio/devices/iio:device1/in_accel_scale",
-			      O_RDONLY);
+	fd_accel_scale = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_scale",
+				    O_RDONLY);
 
 	if (fd_accel_scale < 0) {
 		printf("Failed to open file descriptor of scale acceleration file\n");
@@ -233,7 +1089,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_x_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_x_raw", O_RDONLY);
+	fd_x_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_x_raw", O_RDONLY);
 
 	if (fd_x_angl < 0) {
 		printf("Failed to open file descriptor of x angle level file\n");
@@ -245,7 +1101,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_y_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_y_raw", O_RDONLY);
+	fd_y_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_y_raw", O_RDONLY);
 
 	if (fd_y_angl < 0) {
 		printf("Failed to open file descriptor of y angle level file\n");
@@ -258,7 +1114,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_z_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_z_raw", O_RDONLY);
+	fd_z_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_z_raw", O_RDONLY);
 
 	if (fd_z_angl < 0) {
 		printf("Failed to open file descriptor of z angle level file\n");
@@ -272,7 +1128,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_angl_scale = open("/sys/bus/iio/devices/iio:device0/in_anglvel_scale", O_RDONLY);
+	fd_angl_scale = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_scale", O_RDONLY);
 
 	if (fd_angl_scale < 0) {
 		printf("Failed to open file descriptor of z angle level file\n");
@@ -287,23 +1143,48 @@ int main(void)
 		return -ENOENT;
 	}
 
-	pthread_mutex_init(&thread_mux, NULL);
-
 	accel_data.fd_x = fd_x_accel;
 	accel_data.fd_y = fd_y_accel;
 	accel_data.fd_z = fd_z_accel;
 	accel_data.fd_scale = fd_accel_scale;
 	accel_data.thread_stop = false;
+	memset(accel_data.lat, 0, sizeof(accel_data.lat));
 	angl_data.fd_x = fd_x_angl;
 	angl_data.fd_y = fd_y_angl;
 	angl_data.fd_z = fd_z_angl;
 	angl_data.fd_scale = fd_angl_scale;
 	angl_data.thread_stop = false;
+	memset(angl_data.lat, 0, sizeof(angl_data.lat));
+	accel_data.shm_chan = -1;
+	angl_data.shm_chan = -1;
+	accel_data.motion = NULL;
+	angl_data.motion = NULL;
+	accel_data.corr = calib_file ? &accel_corr : NULL;
+	angl_data.corr = calib_file ? &angl_corr : NULL;
+	accel_data.rt = rt.priority ? &rt : NULL;
+	angl_data.rt = accel_data.rt;
+	accel_data.rt_error = 0;
+	angl_data.rt_error = 0;
+
+	if (shm_name &&
+	    (ret = publish_open(shm_name, &accel_data, &angl_data)) < 0) {
+		printf("Failed to publish samples in %s: %s\n", shm_name,
+		       strerror(-ret));
+		close(fd_x_accel);
+		close(fd_y_accel);
+		close(fd_z_accel);
+		close(fd_accel_scale);
+		close(fd_x_angl);
+		close(fd_y_angl);
+		close(fd_z_angl);
+		close(fd_angl_scale);
 
-	ret = pthread_create(&acceleration, NULL, accel_thread, &accel_data);
+		return ret;
+	}
 
-	if (ret < 0) {
-		printf("Failed to create acceleration thread\n");
+	if (reader_open(&accel_data, backend) < 0 ||
+	    reader_open(&angl_data, backend) < 0) {
+		printf("Failed to set up channel readers\n");
 		close(fd_x_accel);
 		close(fd_y_accel);
 		close(fd_z_accel);
@@ -313,13 +1194,44 @@ int main(void)
 		close(fd_z_angl);
 		close(fd_angl_scale);
 
-		return ret;
+		return -ENOMEM;
+	}
+
+	if (wake && spsc_ring_init(&wake->ring, MOTION_RECORDS,
+				   sizeof(struct motion_record)) < 0) {
+		printf("Failed to allocate the motion alarm ring\n");
+		close(fd_x_accel);
+		close(fd_y_accel);
+		close(fd_z_accel);
+		close(fd_accel_scale);
+		close(fd_x_angl);
+		close(fd_y_angl);
+		close(fd_z_angl);
+		close(fd_angl_scale);
+
+		return -ENOMEM;
 	}
 
-	ret = pthread_create(&angle_level, NULL, angle_thread, &angl_data);
+	if (wake) {
+		wake->start = now_ns();
+		ret = read_scale(fd_accel_scale, &scale);
 
-	if (ret < 0) {
-		printf("Failed to create angle thread\n");
+		if (ret == 0)
+			ret = motion_open(wake, scale);
+
+		if (ret < 0) {
+			printf("No accelerometer wake-up event (%s), checking "
+			       "motion on every sample\n", strerror(-ret));
+			accel_data.motion = wake;
+		}
+	}
+
+	if (event_loop) {
+		ret = event_main(&accel_data, &angl_data, wake);
+		motion_close(&motion);
+		spsc_ring_free(&motion.ring);
+		chan_reader_close(&accel_data.reader);
+		chan_reader_close(&angl_data.reader);
 		close(fd_x_accel);
 		close(fd_y_accel);
 		close(fd_z_accel);
@@ -328,18 +1240,105 @@ int main(void)
 		close(fd_y_angl);
 		close(fd_z_angl);
 		close(fd_angl_scale);
+		printf("\nExit from application\n");
 
 		return ret;
 	}
 
+	accel_data.dropped = 0;
+	angl_data.dropped = 0;
+
+	if (spsc_ring_init(&accel_data.ring, RING_FRAMES,
+			   sizeof(struct imu_frame)) < 0 ||
+	    spsc_ring_init(&angl_data.ring, RING_FRAMES,
+			   sizeof(struct imu_frame)) < 0 ||
+	    periodic_wake_init(&accel_data.wake) < 0 ||
+	    periodic_wake_init(&angl_data.wake) < 0) {
+		printf("Failed to allocate frame rings\n");
+		close(fd_x_accel);
+		close(fd_y_accel);
+		close(fd_z_accel);
+		close(fd_accel_scale);
+		close(fd_x_angl);
+		close(fd_y_angl);
+		close(fd_z_angl);
+		close(fd_angl_scale);
+
+		return -ENOMEM;
+	}
+
+	sink.accel = &accel_data;
+	sink.angl = &angl_data;
+	sink.motion = wake;
+	sink.start = now_ns();
+	sink.thread_stop = false;
+	memset(&sink.print_lat, 0, sizeof(sink.print_lat));
+
+	/* Blocked before any thread starts so they all inherit the mask */
+	stats.sink = &sink;
+	sigemptyset(&stats.mask);
+	sigaddset(&stats.mask, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &stats.mask, NULL);
+
+	if (pthread_create(&stats_tid, pattr, stats_thread, &stats) == 0)
+		pthread_detach(stats_tid);
+
+	if (motion.fd >= 0 && (ret = motion_start(&motion, pattr)) < 0)
+		printf("Failed to start the motion event thread: %s\n",
+		       strerror(-ret));
+
+	ret = pthread_create(&printer, pattr, sink_thread, &sink);
+
+	if (ret) {
+		printf("Failed to create printer thread\n");
+		ret = -ret;
+		goto free_rings;
+	}
+
+	ret = pthread_create(&acceleration, pattr, accel_thread, &accel_data);
+
+	if (ret) {
+		printf("Failed to create acceleration thread\n");
+		ret = -ret;
+		goto stop_printer;
+	}
+
+	ret = pthread_create(&angle_level, pattr, angle_thread, &angl_data);
+
+	if (ret) {
+		printf("Failed to create angle thread\n");
+		ret = -ret;
+		goto stop_accel;
+	}
+
+	if (pattr)
+		pthread_attr_destroy(pattr);
+
 	scanf("%d", &choice);
 
 	switch (choice) {
 		default:
+			stop = now_ns();
 			accel_data.thread_stop = true;
 			angl_data.thread_stop = true;
+			periodic_wake_up(&accel_data.wake);
+			periodic_wake_up(&angl_data.wake);
 			pthread_join(acceleration, NULL);
 			pthread_join(angle_level, NULL);
+			printf("Samplers stopped in %.3f ms\n",
+			       (now_ns() - stop) / 1e6);
+			motion_stop(&motion);
+			__atomic_store_n(&sink.thread_stop, true,
+					 __ATOMIC_RELEASE);
+			pthread_join(printer, NULL);
+			print_latency(&accel_data, &angl_data, &sink.print_lat);
+			print_jitter(&accel_data, &angl_data);
+			spsc_ring_free(&accel_data.ring);
+			motion_close(&motion);
+			spsc_ring_free(&motion.ring);
+			spsc_ring_free(&angl_data.ring);
+			chan_reader_close(&accel_data.reader);
+			chan_reader_close(&angl_data.reader);
 			close(fd_x_accel);
 			close(fd_y_accel);
 			close(fd_z_accel);
@@ -353,4 +1352,34 @@ int main(void)
 	printf("\nExit from application\n");
 
 	return 0;
+
+stop_accel:
+	accel_data.thread_stop = true;
+	periodic_wake_up(&accel_data.wake);
+	pthread_join(acceleration, NULL);
+stop_printer:
+	motion_stop(&motion);
+	__atomic_store_n(&sink.thread_stop, true, __ATOMIC_RELEASE);
+	pthread_join(printer, NULL);
+free_rings:
+	if (pattr)
+		pthread_attr_destroy(pattr);
+
+	motion_close(&motion);
+	spsc_ring_free(&motion.ring);
+	spsc_ring_free(&accel_data.ring);
+	spsc_ring_free(&angl_data.ring);
+	chan_reader_close(&accel_data.reader);
+	chan_reader_close(&angl_data.reader);
+	publish_close();
+	close(fd_x_accel);
+	close(fd_y_accel);
+	close(fd_z_accel);
+	close(fd_accel_scale);
+	close(fd_x_angl);
+	close(fd_y_angl);
+	close(fd_z_angl);
+	close(fd_angl_scale);
+
+	return ret;
 }
@@ -5,28 +5,89 @@
  * - User can choose what data to read from menu
  * - Prints values on console
  * - User can exit the application at any time
+ * - Optional calibration (-c file from imu_calibrate): the value shown is
+ *   corrected, which takes all three axes of the sensor, so each choice
+ *   then reads x, y and z
  *
  * This is a generic Linux I2C user-space application.
  */
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "../common/iio_parse.h"
+#include "../common/imu_calib.h"
+#include "../common/sysfs.h"
+
 #define MAX 15
+#define PRINT_DIGITS	6
 
-int main(void)
+/* Reads x, y and z and returns the calibrated value of one axis */
+static int correct_axis(const int fd[3], int64_t scale,
+			const struct imu_correction *corr, int axis,
+			int64_t *val)
 {
-	int fd_x_accel, fd_y_accel, fd_z_accel, fd_accel_scale, fd_x_angl, fd_y_angl, fd_z_angl, fd_angl_scale, choice, ret;
 	char buf[MAX];
-	double scale, x_accel, y_accel, z_accel, x_angl, y_angl, z_angl, angl_scale;
+	float v[1][3];
+	int32_t raw;
+	int i, ret;
+
+	for (i = 0; i < 3; i++) {
+		ret = pread(fd[i], buf, MAX, 0);
+
+		if (ret < 0)
+			return -errno;
+
+		if (iio_parse_int(buf, ret, &raw) < 0)
+			return -EINVAL;
+
+		v[0][i] = raw * scale * 1e-9f;
+	}
+
+	imu_correct(corr, v, 1);
+	*val = (int64_t)(v[0][axis] * 1e9);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int fd_x_accel, fd_y_accel, fd_z_accel, fd_accel_scale, fd_x_angl, fd_y_angl, fd_z_angl, fd_angl_scale, choice, ret;
+	char buf[MAX], value[32];
+	int64_t scale, angl_scale;	/* nano-units per count */
+	int64_t val;
+	int32_t raw;
+	struct imu_correction accel_corr, angl_corr;
+	struct imu_calib calib;
+	bool calibrated = false;
+	int accel_fd[3], angl_fd[3];
+
+	if (argc == 3 && !strcmp(argv[1], "-c")) {
+		ret = imu_calib_load(&calib, argv[2]);
+
+		if (ret < 0) {
+			printf("Failed to load calibration %s: %s\n", argv[2],
+			       strerror(-ret));
+			return ret;
+		}
+
+		imu_calib_accel(&calib, &accel_corr);
+		imu_calib_gyro(&calib, &angl_corr);
+		calibrated = true;
+	} else if (argc != 1) {
+		printf("Usage: %s [-c calib_file]\n", argv[0]);
+		return -EINVAL;
+	}
 
 	printf("Accelerometer application\n\n");
 
-	fd_x_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_x_raw",
-			  O_RDONLY);
+	fd_x_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_x_raw",
+				O_RDONLY);
 
 	if (fd_x_accel < 0) {
 		printf("Failed to open file descriptor of x acceleration file\n");
@@ -34,8 +95,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_y_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_y_raw",
-			  O_RDONLY);
+	fd_y_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_y_raw",
+				O_RDONLY);
 
 	if (fd_y_accel < 0) {
 		printf("Failed to open file descriptor of y acceleration file\n");
@@ -44,8 +105,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_z_accel = open("/sys/bus/iio/devices/iio:device1/in_accel_z_raw",
-			  O_RDONLY);
+	fd_z_accel = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_z_raw",
+				O_RDONLY);
 
 	if (fd_z_accel < 0) {
 		printf("Failed to open file descriptor of z acceleration file\n");
@@ -55,8 +116,8 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_accel_scale = open("/sys/bus/iio/devices/iio:device1/in_accel_scale",
-			      O_RDONLY);
+	fd_accel_scale = sysfs_open("/sys/bus/iio/devices/iio:device1/in_accel_scale",
+				    O_RDONLY);
 
 	if (fd_accel_scale < 0) {
 		printf("Failed to open file descriptor of scale acceleration file\n");
@@ -67,7 +128,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_x_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_x_raw", O_RDONLY);
+	fd_x_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_x_raw", O_RDONLY);
 
 	if (fd_x_angl < 0) {
 		printf("Failed to open file descriptor of x angle level file\n");
@@ -79,7 +140,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_y_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_y_raw", O_RDONLY);
+	fd_y_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_y_raw", O_RDONLY);
 
 	if (fd_y_angl < 0) {
 		printf("Failed to open file descriptor of y angle level file\n");
@@ -92,7 +153,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_z_angl = open("/sys/bus/iio/devices/iio:device0/in_anglvel_z_raw", O_RDONLY);
+	fd_z_angl = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_z_raw", O_RDONLY);
 
 	if (fd_z_angl < 0) {
 		printf("Failed to open file descriptor of z angle level file\n");
@@ -106,7 +167,7 @@ int main(void)
 		return -ENOENT;
 	}
 
-	fd_angl_scale = open("/sys/bus/iio/devices/iio:device0/in_anglvel_scale", O_RDONLY);
+	fd_angl_scale = sysfs_open("/sys/bus/iio/devices/iio:device0/in_anglvel_scale", O_RDONLY);
 
 	if (fd_angl_scale < 0) {
 		printf("Failed to open file descriptor of z angle level file\n");
@@ -136,9 +197,24 @@ int main(void)
 
 		return ret;
 	}
-	scale = atof(buf);
 
-	printf("\nScale = %lf\n", scale);
+	if (iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, &scale) < 0) {
+		printf("\nInvalid acceleration scale value\n");
+		close(fd_x_accel);
+		close(fd_y_accel);
+		close(fd_z_accel);
+		close(fd_accel_scale);
+		close(fd_x_angl);
+		close(fd_y_angl);
+		close(fd_z_angl);
+		close(fd_angl_scale);
+
+		return -EINVAL;
+	}
+
+	iio_format_fixed(value, sizeof(value), scale, IIO_NANO_DIGITS,
+			 IIO_NANO_DIGITS);
+	printf("\nScale = %s\n", value);
 
 	ret = read(fd_angl_scale, buf, MAX);
 
@@ -155,9 +231,31 @@ int main(void)
 
 		return ret;
 	}
-	angl_scale = atof(buf);
 
-	printf("\nScale = %lf\n", angl_scale);
+	if (iio_parse_fixed(buf, ret, IIO_NANO_DIGITS, &angl_scale) < 0) {
+		printf("\nInvalid angle scale value\n");
+		close(fd_x_accel);
+		close(fd_y_accel);
+		close(fd_z_accel);
+		close(fd_accel_scale);
+		close(fd_x_angl);
+		close(fd_y_angl);
+		close(fd_z_angl);
+		close(fd_angl_scale);
+
+		return -EINVAL;
+	}
+
+	iio_format_fixed(value, sizeof(value), angl_scale, IIO_NANO_DIGITS,
+			 IIO_NANO_DIGITS);
+	printf("\nScale = %s\n", value);
+
+	accel_fd[0] = fd_x_accel;
+	accel_fd[1] = fd_y_accel;
+	accel_fd[2] = fd_z_accel;
+	angl_fd[0] = fd_x_angl;
+	angl_fd[1] = fd_y_angl;
+	angl_fd[2] = fd_z_angl;
 
 	while (1) {
 		printf("--------------------------------------\n");
@@ -204,9 +302,24 @@ int main(void)
 				return ret;
 			}
 
-			x_accel = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid x accleration value\n");
+				break;
+			}
+
+			val = raw * scale;
+
+			if (calibrated &&
+			    correct_axis(accel_fd, scale, &accel_corr, 0,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "acceleration\n");
+				break;
+			}
 
-			printf("\nX acceleration = %lf m/s^2\n", x_accel*scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nX acceleration = %s m/s^2\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 2:
@@ -227,9 +340,24 @@ int main(void)
 				return ret;
 			}
 
-			y_accel = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid y accleration value\n");
+				break;
+			}
+
+			val = raw * scale;
+
+			if (calibrated &&
+			    correct_axis(accel_fd, scale, &accel_corr, 1,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "acceleration\n");
+				break;
+			}
 
-			printf("\nY acceleration = %lf m/s^2\n", y_accel*scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nY acceleration = %s m/s^2\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 3:
@@ -250,9 +378,24 @@ int main(void)
 				return ret;
 			}
 
-			z_accel = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid z accleration value\n");
+				break;
+			}
+
+			val = raw * scale;
+
+			if (calibrated &&
+			    correct_axis(accel_fd, scale, &accel_corr, 2,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "acceleration\n");
+				break;
+			}
 
-			printf("\nZ acceleration = %lf m/s^2\n", z_accel*scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nZ acceleration = %s m/s^2\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 4:
@@ -273,9 +416,24 @@ int main(void)
 				return ret;
 			}
 
-			x_angl = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid x angle level value\n");
+				break;
+			}
+
+			val = raw * angl_scale;
+
+			if (calibrated &&
+			    correct_axis(angl_fd, angl_scale, &angl_corr, 0,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "angle level\n");
+				break;
+			}
 
-			printf("\nX angle level = %lf dps\n", x_angl*angl_scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nX angle level = %s dps\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 5:
@@ -296,9 +454,24 @@ int main(void)
 				return ret;
 			}
 
-			y_angl = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid y angle level value\n");
+				break;
+			}
+
+			val = raw * angl_scale;
+
+			if (calibrated &&
+			    correct_axis(angl_fd, angl_scale, &angl_corr, 1,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "angle level\n");
+				break;
+			}
 
-			printf("\nY angle level = %lf dps\n", y_angl*angl_scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nY angle level = %s dps\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 6:
@@ -319,9 +492,24 @@ int main(void)
 				return ret;
 			}
 
-			z_angl = atof(buf);
+			if (iio_parse_int(buf, ret, &raw) < 0) {
+				printf("\nInvalid z angle level value\n");
+				break;
+			}
+
+			val = raw * angl_scale;
+
+			if (calibrated &&
+			    correct_axis(angl_fd, angl_scale, &angl_corr, 2,
+					 &val) < 0) {
+				printf("\nFailed to read calibrated "
+				       "angle level\n");
+				break;
+			}
 
-			printf("\nZ angle level = %lf dps\n", z_angl*angl_scale);
+			iio_format_fixed(value, sizeof(value), val,
+					 IIO_NANO_DIGITS, PRINT_DIGITS);
+			printf("\nZ angle level = %s dps\n", value);
 			printf("\nret = %d\n", ret);
 			break;
 		case 7:
@@ -0,0 +1,453 @@
+/*
+ * Multi-sensor sampler
+ *
+ * - Discovers every supported sensor (HTU21D, LSM6DSV16X accel and gyro)
+ *   from the name attribute under /sys/bus/iio/devices, on any number of
+ *   I2C buses, and builds a channel table from it
+ * - A bounded pool of worker threads (-w) samples all of them on a
+ *   drift-free period (-i ms). Each I2C bus is owned by exactly one
+ *   worker, so transactions on the same bus are serialized while
+ *   different buses are read in parallel
+ * - The latest values of every device are printed once per second (not
+ *   with -q), per-worker cycle statistics when the application exits
+ * - Runs continuously until user presses any key to exit
+ *
+ * Usage: sensor_rack [-i interval_ms] [-w workers] [-r pread|uring] [-q]
+ *
+ * This is a generic Linux I2C user-space application.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/chan_reader.h"
+#include "../common/iio_parse.h"
+#include "../common/lat_hist.h"
+#include "../common/periodic.h"
+#include "../common/sensor_discover.h"
+#include "../common/sysfs.h"
+
+#define MAX_WORKERS		8
+#define DEFAULT_INTERVAL_MS	100
+#define PRINT_DIGITS		3
+#define PRINT_MS		1000
+#define LINE_LEN		256
+
+struct device_state {
+	const struct sensor_device *dev;
+	int fd[SENSOR_MAX_CHANNELS];
+	int64_t scale;			/* nano-units per count, 0: none */
+	struct chan_reader reader;
+	unsigned long reads, errors;
+
+	/* Latest sample, seqlock written by the owning worker only */
+	alignas(64) atomic_uint seq;
+	int64_t timestamp;
+	int64_t value[SENSOR_MAX_CHANNELS];
+};
+
+struct worker {
+	pthread_t thread;
+	unsigned int id;
+	struct device_state *dev[SENSOR_MAX_DEVICES];
+	unsigned int ndev;
+	int bus[SENSOR_MAX_DEVICES];
+	unsigned int nbus;
+	long interval_ms;
+	bool thread_stop;
+	struct periodic period;
+	struct lat_hist cycle;		/* ticks per sampling cycle */
+};
+
+static struct sensor_device devices[SENSOR_MAX_DEVICES];
+static struct device_state state[SENSOR_MAX_DEVICES];
+static struct worker workers[MAX_WORKERS];
+
+static void publish(struct device_state *s, int64_t timestamp,
+		    const int64_t *value)
+{
+	unsigned int seq;
+
+	seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+	atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	s->timestamp = timestamp;
+	memcpy(s->value, value, sizeof(s->value));
+	atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+/* Returns false when the device has no sample yet */
+static bool latest(struct device_state *s, int64_t *timestamp, int64_t *value)
+{
+	unsigned int seq;
+
+	do {
+		seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+		*timestamp = s->timestamp;
+		memcpy(value, s->value, sizeof(s->value));
+		atomic_thread_fence(memory_order_acquire);
+	} while ((seq & 1) ||
+		 seq != atomic_load_explicit(&s->seq, memory_order_relaxed));
+
+	return seq != 0;
+}
+
+static void sample_device(struct device_state *s)
+{
+	const struct sensor_type *type = s->dev->type;
+	int64_t value[SENSOR_MAX_CHANNELS] = { 0 };
+	int64_t timestamp = monotonic_ns();
+	struct chan_reader *r = &s->reader;
+	unsigned int i;
+	int32_t raw;
+
+	s->reads++;
+
+	if (chan_reader_read(r) < 0) {
+		s->errors++;
+		return;
+	}
+
+	for (i = 0; i < type->nchan; i++) {
+		if (iio_parse_int(r->buf[i], r->len[i], &raw) < 0) {
+			s->errors++;
+			return;
+		}
+
+		value[i] = s->scale ? raw * s->scale : raw;
+	}
+
+	publish(s, timestamp, value);
+}
+
+void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	uint64_t start;
+	unsigned int i;
+
+	periodic_start(&w->period, w->interval_ms);
+
+	while (!w->thread_stop) {
+		start = lat_clock();
+
+		for (i = 0; i < w->ndev; i++)
+			sample_device(w->dev[i]);
+
+		lat_hist_stage(&w->cycle, &start);
+		periodic_wait(&w->period);
+	}
+
+	return NULL;
+}
+
+static void close_device(struct device_state *s)
+{
+	unsigned int i;
+
+	chan_reader_close(&s->reader);
+
+	for (i = 0; i < SENSOR_MAX_CHANNELS; i++)
+		if (s->fd[i] >= 0)
+			close(s->fd[i]);
+}
+
+static int open_device(struct device_state *s, const struct sensor_device *dev,
+		       enum chan_reader_backend backend)
+{
+	const struct sensor_type *type = dev->type;
+	char path[PATH_MAX], val[32];
+	unsigned int i;
+	int ret;
+
+	memset(s, 0, sizeof(*s));
+	s->dev = dev;
+	atomic_init(&s->seq, 0);
+
+	for (i = 0; i < SENSOR_MAX_CHANNELS; i++)
+		s->fd[i] = -1;
+
+	ret = chan_reader_init(&s->reader, backend);
+
+	/* io_uring can be disabled by the kernel, pread always works */
+	if (ret < 0 && backend == CHAN_READER_URING)
+		ret = chan_reader_init(&s->reader, CHAN_READER_PREAD);
+
+	if (ret < 0)
+		return ret;
+
+	if (type->scale) {
+		ret = snprintf(path, sizeof(path), "%s/%s", dev->dir,
+			       type->scale);
+
+		if (ret < 0 || (size_t)ret >= sizeof(path)) {
+			close_device(s);
+			return -ENAMETOOLONG;
+		}
+
+		ret = sysfs_read_str(path, val, sizeof(val));
+
+		if (ret <= 0 || iio_parse_fixed(val, ret, IIO_NANO_DIGITS,
+						&s->scale) < 0) {
+			close_device(s);
+			return ret < 0 ? ret : -EINVAL;
+		}
+	}
+
+	for (i = 0; i < type->nchan; i++) {
+		ret = snprintf(path, sizeof(path), "%s/%s", dev->dir,
+			       type->chan[i].attr);
+
+		if (ret < 0 || (size_t)ret >= sizeof(path)) {
+			close_device(s);
+			return -ENAMETOOLONG;
+		}
+
+		s->fd[i] = open(path, O_RDONLY);
+
+		if (s->fd[i] < 0) {
+			ret = -errno;
+			close_device(s);
+			return ret;
+		}
+
+		chan_reader_add(&s->reader, s->fd[i]);
+	}
+
+	return 0;
+}
+
+/*
+ * Devices arrive sorted by bus, so each new bus goes to the next worker
+ * round robin and every device on it to the same worker.
+ */
+static unsigned int assign_workers(unsigned int ndev, unsigned int max_workers,
+				   long interval_ms)
+{
+	unsigned int i, nbus = 0, nworkers;
+	struct worker *w = NULL;
+
+	for (i = 0; i < ndev; i++)
+		if (!i || devices[i].bus != devices[i - 1].bus)
+			nbus++;
+
+	nworkers = nbus < max_workers ? nbus : max_workers;
+
+	for (i = 0; i < nworkers; i++) {
+		workers[i].id = i;
+		workers[i].interval_ms = interval_ms;
+	}
+
+	for (i = 0, nbus = 0; i < ndev; i++) {
+		if (!i || devices[i].bus != devices[i - 1].bus) {
+			w = &workers[nbus++ % nworkers];
+			w->bus[w->nbus++] = devices[i].bus;
+		}
+
+		w->dev[w->ndev++] = &state[i];
+	}
+
+	return nworkers;
+}
+
+static void print_devices(unsigned int ndev)
+{
+	int64_t value[SENSOR_MAX_CHANNELS], timestamp, now = monotonic_ns();
+	const struct sensor_type *type;
+	char line[LINE_LEN], str[32];
+	unsigned int i, j;
+	int len;
+
+	for (i = 0; i < ndev; i++) {
+		type = devices[i].type;
+		len = snprintf(line, sizeof(line), "%s %s:", devices[i].dev_name,
+			       type->label);
+
+		if (!latest(&state[i], &timestamp, value)) {
+			printf("%s no data\n", line);
+			continue;
+		}
+
+		for (j = 0; j < type->nchan; j++) {
+			iio_format_fixed(str, sizeof(str), value[j],
+					 state[i].scale ? IIO_NANO_DIGITS :
+					 type->digits, PRINT_DIGITS);
+			len += snprintf(line + len, sizeof(line) - len,
+					"%s %s %s %s", j ? "," : "",
+					type->chan[j].name, str,
+					type->chan[j].unit);
+		}
+
+		printf("%s (%lld ms old)\n", line,
+		       (long long)((now - timestamp) / 1000000));
+	}
+}
+
+static void print_stats(unsigned int nworkers)
+{
+	unsigned long reads, errors;
+	struct worker *w;
+	char name[64];
+	unsigned int i, j;
+	int len;
+
+	for (i = 0; i < nworkers; i++) {
+		w = &workers[i];
+		reads = 0;
+		errors = 0;
+
+		for (j = 0; j < w->ndev; j++) {
+			reads += w->dev[j]->reads;
+			errors += w->dev[j]->errors;
+		}
+
+		len = snprintf(name, sizeof(name), "Worker %u (bus", w->id);
+
+		for (j = 0; j < w->nbus && len < (int)sizeof(name); j++)
+			len += snprintf(name + len, sizeof(name) - len, "%s %d",
+					j ? "," : "", w->bus[j]);
+
+		printf("%s): %u devices, %lu reads, %lu errors, %lu missed "
+		       "deadlines, %lu overruns\n", name, w->ndev, reads,
+		       errors, w->period.missed, w->period.overruns);
+		lat_hist_print("  cycle", &w->cycle);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	enum chan_reader_backend backend = CHAN_READER_PREAD;
+	unsigned int max_workers = MAX_WORKERS, nworkers, ndev, i, opened;
+	struct pollfd pfd = { .fd = STDIN_FILENO, .events = POLLIN };
+	long interval_ms = DEFAULT_INTERVAL_MS;
+	bool quiet = false;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "i:w:r:q")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval_ms = atol(optarg);
+			break;
+		case 'w':
+			max_workers = atoi(optarg);
+			break;
+		case 'r':
+			if (chan_reader_parse_backend(optarg, &backend) < 0) {
+				printf("Invalid reader backend: %s\n", optarg);
+				return -EINVAL;
+			}
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			printf("Usage: %s [-i interval_ms] [-w workers] "
+			       "[-r pread|uring] [-q]\n", argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (interval_ms <= 0 || !max_workers || max_workers > MAX_WORKERS) {
+		printf("Interval must be positive and workers 1..%d\n",
+		       MAX_WORKERS);
+		return -EINVAL;
+	}
+
+	lat_clock_init();
+	ret = sensor_discover(devices, SENSOR_MAX_DEVICES);
+
+	if (ret < 0) {
+		printf("Failed to scan IIO devices: %s\n", strerror(-ret));
+		return ret;
+	}
+
+	if (!ret) {
+		printf("No supported sensors found\n");
+		return -ENODEV;
+	}
+
+	ndev = ret;
+
+	for (i = 0, opened = 0; i < ndev; i++) {
+		ret = open_device(&state[opened], &devices[i], backend);
+
+		if (ret < 0) {
+			printf("Skipping %s: %s\n", devices[i].dev_name,
+			       strerror(-ret));
+			continue;
+		}
+
+		/* Keep devices[] and state[] index aligned */
+		devices[opened] = devices[i];
+		state[opened].dev = &devices[opened];
+		opened++;
+	}
+
+	ndev = opened;
+
+	for (i = 0; i < ndev; i++)
+		printf("%s: %s, bus %d, address 0x%02x\n", devices[i].dev_name,
+		       devices[i].type->label, devices[i].bus,
+		       devices[i].addr);
+
+	if (!ndev)
+		return -ENODEV;
+
+	nworkers = assign_workers(ndev, max_workers, interval_ms);
+	printf("\nApplication to sample %u sensors every %ld ms with %u "
+	       "workers, Press Any key to stop the application execution\n",
+	       ndev, interval_ms, nworkers);
+
+	for (i = 0; i < nworkers; i++) {
+		ret = pthread_create(&workers[i].thread, NULL, worker_thread,
+				     &workers[i]);
+
+		if (ret) {
+			printf("Failed to create worker thread\n");
+			nworkers = i;
+			break;
+		}
+	}
+
+	while (!ret) {
+		ret = poll(&pfd, 1, PRINT_MS);
+
+		if (ret < 0 && errno == EINTR) {
+			ret = 0;
+			continue;
+		}
+
+		if (ret)
+			break;
+
+		if (!quiet) {
+			printf("\n");
+			print_devices(ndev);
+		}
+	}
+
+	for (i = 0; i < nworkers; i++)
+		workers[i].thread_stop = true;
+
+	for (i = 0; i < nworkers; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	printf("\n");
+	print_stats(nworkers);
+
+	for (i = 0; i < ndev; i++)
+		close_device(&state[i]);
+
+	printf("\nExit from application\n");
+
+	return 0;
+}
@@ -0,0 +1,185 @@
+/*
+ * Adaptive sampling benchmark
+ *
+ * - Replays a synthetic day of room temperature in milli-degrees: a slow
+ *   daily swing, sensor noise and an excursion every two hours (a door
+ *   left open: a fast drop, a plateau and a slow recovery), alternating
+ *   with short bumps just above delta
+ * - Samples it at the fixed minimum interval and with adaptive_rate,
+ *   and reports the sample counts, how many excursions the adaptive
+ *   series caught and its worst reconstruction error (linear
+ *   interpolation between samples) against the fixed series
+ *
+ * Usage: adaptive_rate_bench [min_ms] [max_ms] [delta_milli]
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../common/adaptive_rate.h"
+
+#define DAY_MS		(24LL * 3600 * 1000)
+#define EVENT_EVERY_MS	(2LL * 3600 * 1000)
+#define EVENT_OFFSET_MS	(1800LL * 1000)
+#define NOISE_MILLI	10
+#define MIN_MS		1000
+#define MAX_MS		60000
+#define DELTA_MILLI	200
+
+struct event {
+	int64_t start_ms, end_ms;
+	double depth;			/* milli-degrees, negative = drop */
+	bool caught;
+};
+
+#define EVENTS		(DAY_MS / EVENT_EVERY_MS)
+
+static struct event events[EVENTS];
+static int64_t delta = DELTA_MILLI;
+
+static uint32_t noise(uint64_t n)
+{
+	n = (n ^ (n >> 33)) * 0xff51afd7ed558ccdULL;
+	n = (n ^ (n >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+
+	return n ^ (n >> 33);
+}
+
+static void make_events(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < EVENTS; i++) {
+		events[i].start_ms = i * EVENT_EVERY_MS + EVENT_OFFSET_MS +
+				     noise(i) % 600000;
+
+		/* A door left open for 30 min, or a 5 min bump over delta */
+		if (i % 2 == 0) {
+			events[i].depth = -1500;
+			events[i].end_ms = events[i].start_ms + 1800000;
+		} else {
+			events[i].depth = delta * 1.5;
+			events[i].end_ms = events[i].start_ms + 300000;
+		}
+	}
+}
+
+/* Excursion offset at t: a 60 s ramp, a plateau, exponential recovery */
+static double excursion(const struct event *e, int64_t t)
+{
+	double ramp = 60000, plateau = 120000, tau = 300000;
+	double dt = t - e->start_ms;
+
+	if (dt < 0 || t >= e->end_ms)
+		return 0;
+
+	if (e->depth > 0)
+		return dt < ramp ? e->depth * dt / ramp : e->depth;
+
+	if (dt < ramp)
+		return e->depth * dt / ramp;
+
+	if (dt < ramp + plateau)
+		return e->depth;
+
+	return e->depth * exp(-(dt - ramp - plateau) / tau);
+}
+
+static int64_t baseline(int64_t t)
+{
+	return 22000 + 3000 * sin(2 * M_PI * t / DAY_MS);
+}
+
+static int64_t signal_at(int64_t t)
+{
+	double v = baseline(t);
+	unsigned int i;
+
+	for (i = 0; i < EVENTS; i++)
+		v += excursion(&events[i], t);
+
+	return llround(v) + (int64_t)(noise(t) % (2 * NOISE_MILLI + 1)) -
+	       NOISE_MILLI;
+}
+
+int main(int argc, char *argv[])
+{
+	struct adaptive_rate_config cfg = {
+		.min_ms = MIN_MS, .max_ms = MAX_MS, .delta = DELTA_MILLI,
+	};
+	uint64_t fixed, adaptive = 0, checked = 0, late = 0;
+	int64_t t, g, prev_t = 0, prev_v = 0, v, err, worst = 0, interp;
+	struct adaptive_rate rate;
+	unsigned int i, caught = 0;
+	long interval;
+
+	if (argc > 1)
+		cfg.min_ms = atol(argv[1]);
+
+	if (argc > 2)
+		cfg.max_ms = atol(argv[2]);
+
+	if (argc > 3)
+		cfg.delta = atoll(argv[3]);
+
+	if (cfg.min_ms <= 0 || cfg.max_ms < cfg.min_ms || cfg.delta <= 0) {
+		printf("Usage: %s [min_ms] [max_ms] [delta_milli]\n", argv[0]);
+		return 1;
+	}
+
+	delta = cfg.delta;
+	make_events();
+	adaptive_rate_init(&rate, &cfg);
+	interval = cfg.min_ms;
+
+	for (t = 0; t < DAY_MS; t += interval) {
+		v = signal_at(t);
+		adaptive++;
+
+		for (i = 0; i < EVENTS; i++)
+			if (t >= events[i].start_ms && t < events[i].end_ms &&
+			    llabs(v - baseline(t)) > cfg.delta)
+				events[i].caught = true;
+
+		/* Compare against every fixed-rate sample since the last one */
+		for (g = (prev_t / cfg.min_ms + 1) * cfg.min_ms;
+		     adaptive > 1 && g <= t; g += cfg.min_ms) {
+			interp = prev_v + (v - prev_v) * (g - prev_t) /
+				 (t - prev_t);
+			err = llabs(signal_at(g) - interp);
+
+			if (err > worst)
+				worst = err;
+
+			if (err > cfg.delta)
+				late++;
+
+			checked++;
+		}
+
+		prev_t = t;
+		prev_v = v;
+		interval = adaptive_rate_next(&rate, t * 1000000, v, interval);
+	}
+
+	for (i = 0; i < EVENTS; i++)
+		caught += events[i].caught;
+
+	fixed = DAY_MS / cfg.min_ms;
+	printf("24 h, min %ld ms, max %ld ms, delta %lld milli\n", cfg.min_ms,
+	       cfg.max_ms, (long long)cfg.delta);
+	printf("fixed every %ld ms  %10llu samples\n", cfg.min_ms,
+	       (unsigned long long)fixed);
+	printf("adaptive            %10llu samples (%.1fx fewer)\n",
+	       (unsigned long long)adaptive, (double)fixed / adaptive);
+	printf("excursions caught   %7u / %u\n", caught, (unsigned int)EVENTS);
+	printf("worst interpolation error %lld milli, %.2f%% of the fixed "
+	       "samples off by more than delta\n", (long long)worst,
+	       checked ? 100.0 * late / checked : 0.0);
+	adaptive_rate_print("adaptive_rate", &rate);
+
+	return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Converter for columnar compressed logs
+ *
+ * - Renders a log written by "htu21d_menu -c" or "imu_buffered -l" in the
+ *   text format of the menu application, values scaled to their units:
+ *
+ *     [12.004] Temperature: 23.456000 celsius
+ *     [12.004] Acceleration: 0.059855 0.059855 9.806643 m/s^2
+ *
+ * - -s prints per-channel statistics from the block headers instead:
+ *   samples, bytes per sample, time span and min/max
+ *
+ * Usage: colog_cat [-s] <log> [text file]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/colog.h"
+#include "../common/iio_parse.h"
+
+#define PRINT_DIGITS	6
+
+struct chan_stats {
+	uint64_t samples, bytes;
+	int64_t first_ts, last_ts;
+	int64_t min[COLOG_VALUES], max[COLOG_VALUES];
+};
+
+static int64_t ts[COLOG_BLOCK_SAMPLES];
+static int64_t val[COLOG_BLOCK_SAMPLES][COLOG_VALUES];
+static struct chan_stats stats[COLOG_CHANNELS];
+
+static void print_sample(FILE *fptr, const struct colog_file *file,
+			 const struct colog_channel *chan, int64_t t,
+			 const int64_t *v)
+{
+	char text[32];
+	unsigned int i;
+
+	t -= file->hdr->start_ns;
+	fprintf(fptr, "[%lld.%03lld] %s:", (long long)(t / 1000000000),
+		(long long)(t / 1000000 % 1000), chan->name);
+
+	for (i = 0; i < chan->nvals; i++) {
+		iio_format_fixed(text, sizeof(text), v[i] * chan->scale,
+				 chan->digits, PRINT_DIGITS);
+		fprintf(fptr, " %s", text);
+	}
+
+	fprintf(fptr, " %s\n", chan->unit);
+}
+
+static void add_stats(const struct colog_block_header *hdr)
+{
+	struct chan_stats *st = &stats[hdr->channel];
+	unsigned int v;
+
+	if (!st->samples) {
+		st->first_ts = hdr->first_ts;
+		memcpy(st->min, hdr->min, sizeof(st->min));
+		memcpy(st->max, hdr->max, sizeof(st->max));
+	}
+
+	for (v = 0; v < hdr->nvals; v++) {
+		if (hdr->min[v] < st->min[v])
+			st->min[v] = hdr->min[v];
+
+		if (hdr->max[v] > st->max[v])
+			st->max[v] = hdr->max[v];
+	}
+
+	st->samples += hdr->count;
+	st->bytes += sizeof(*hdr) + hdr->size;
+	st->last_ts = hdr->last_ts;
+}
+
+static void print_stats(FILE *fptr, const struct colog_file *file)
+{
+	const struct colog_channel *chan;
+	struct chan_stats *st;
+	char lo[32], hi[32];
+	unsigned int i, v;
+
+	for (i = 0; i < file->nchan; i++) {
+		chan = &file->chan[i];
+		st = &stats[i];
+
+		if (!st->samples) {
+			fprintf(fptr, "%s: no samples\n", chan->name);
+			continue;
+		}
+
+		fprintf(fptr, "%s: %llu samples, %.2f bytes/sample, %.3f s\n",
+			chan->name, (unsigned long long)st->samples,
+			(double)st->bytes / st->samples,
+			(st->last_ts - st->first_ts) / 1e9);
+
+		for (v = 0; v < chan->nvals; v++) {
+			iio_format_fixed(lo, sizeof(lo),
+					 st->min[v] * chan->scale,
+					 chan->digits, PRINT_DIGITS);
+			iio_format_fixed(hi, sizeof(hi),
+					 st->max[v] * chan->scale,
+					 chan->digits, PRINT_DIGITS);
+			fprintf(fptr, "  [%u] min %s max %s %s\n", v, lo, hi,
+				chan->unit);
+		}
+	}
+
+	fprintf(fptr, "%zu bytes total\n", file->size);
+}
+
+int main(int argc, char *argv[])
+{
+	const struct colog_block_header *hdr;
+	struct colog_file file;
+	FILE *fptr = stdout;
+	int opt, ret, stats_only = 0;
+	unsigned int i;
+
+	while ((opt = getopt(argc, argv, "s")) != -1) {
+		switch (opt) {
+		case 's':
+			stats_only = 1;
+			break;
+		default:
+			printf("Usage: %s [-s] <log> [text file]\n", argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (optind >= argc || argc - optind > 2) {
+		printf("Usage: %s [-s] <log> [text file]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	ret = colog_map(&file, argv[optind]);
+
+	if (ret < 0) {
+		printf("Failed to open log %s: %s\n", argv[optind],
+		       strerror(-ret));
+		return ret;
+	}
+
+	if (argc - optind == 2) {
+		fptr = fopen(argv[optind + 1], "w");
+
+		if (!fptr) {
+			printf("Failed to create %s\n", argv[optind + 1]);
+			colog_unmap(&file);
+			return -errno;
+		}
+	}
+
+	/* Blocks of different channels interleave, each is in time order */
+	while ((hdr = colog_next_block(&file, ts, val))) {
+		add_stats(hdr);
+
+		if (stats_only)
+			continue;
+
+		for (i = 0; i < hdr->count; i++)
+			print_sample(fptr, &file, &file.chan[hdr->channel],
+				     ts[i], val[i]);
+	}
+
+	if (file.offset != file.size)
+		printf("Stopped at a truncated or corrupt block, offset %zu\n",
+		       file.offset);
+
+	if (stats_only)
+		print_stats(fptr, &file);
+
+	if (fptr != stdout)
+		fclose(fptr);
+
+	colog_unmap(&file);
+
+	return 0;
+}
@@ -0,0 +1,634 @@
+/*
+ * Simulated HTU21D + LSM6DSV16X device tree.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/periodic.h"
+#include "../common/sysfs.h"
+#include "fake_iio.h"
+
+#define HTU21D_DIR	"/sys/bus/i2c/devices/0-0040/iio:device0"
+#define IIO_DIR		"/sys/bus/iio/devices"
+#define I2C_DEVICES_DIR	"/sys/devices/platform"
+#define HRTIMER_DIR	"/sys/kernel/config/iio/triggers/hrtimer"
+#define HTU21D_ADDR	0x40
+#define LSM6DSV16X_ADDR	0x6a
+#define DEFAULT_RATE	6664
+
+/* Frames per write(), FEED_CHUNK * largest scan stays below PIPE_BUF */
+#define FEED_CHUNK	128
+#define FEED_RETRY_US	10000
+#define SCAN_CHANNELS	4
+#define TRIGGER_POLL_US	2000
+#define TRIGGER_RATE	"100"
+#define TRIGGER_CHECK_NS 50000000
+
+static const char *const chan_type[FAKE_IIO_DEVICES] = { "anglvel", "accel" };
+static const char *const chan_scale[FAKE_IIO_DEVICES] = {
+	"0.000152716", "0.000598550"
+};
+static const char *const imu_name[FAKE_IIO_DEVICES] = {
+	"lsm6dsv16x_gyro", "lsm6dsv16x_accel"
+};
+
+/* snprintf() into a path buffer, -ENAMETOOLONG instead of truncating */
+__attribute__((format(printf, 3, 4)))
+static int format_path(char *path, size_t len, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(path, len, fmt, ap);
+	va_end(ap);
+
+	return n < 0 || (size_t)n >= len ? -ENAMETOOLONG : 0;
+}
+
+static int make_dirs(const char *path)
+{
+	char tmp[PATH_MAX], *p;
+
+	if (format_path(tmp, sizeof(tmp), "%s", path) < 0)
+		return -ENAMETOOLONG;
+
+	for (p = tmp + 1; *p; p++) {
+		if (*p != '/')
+			continue;
+
+		*p = '\0';
+
+		if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+			return -errno;
+
+		*p = '/';
+	}
+
+	if (mkdir(tmp, 0755) < 0 && errno != EEXIST)
+		return -errno;
+
+	return 0;
+}
+
+static int write_attr(const struct fake_iio *fake, const char *dir,
+		      const char *name, const char *val)
+{
+	char path[PATH_MAX];
+	int fd, ret;
+
+	ret = format_path(path, sizeof(path), "%s%s", fake->root, dir);
+
+	if (!ret)
+		ret = make_dirs(path);
+
+	if (!ret)
+		ret = format_path(path, sizeof(path), "%s%s/%s", fake->root,
+				  dir, name);
+
+	if (ret < 0)
+		return ret;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		return -errno;
+
+	ret = dprintf(fd, "%s\n", val);
+	close(fd);
+
+	return ret < 0 ? -EIO : 0;
+}
+
+static int create_imu(const struct fake_iio *fake, int dev)
+{
+	const char axis[3] = { 'x', 'y', 'z' };
+	char dir[PATH_MAX], scan[PATH_MAX], name[64], val[32];
+	int i, ret = 0;
+
+	snprintf(dir, sizeof(dir), IIO_DIR "/iio:device%d", dev);
+	snprintf(scan, sizeof(scan), IIO_DIR "/iio:device%d/scan_elements",
+		 dev);
+
+	for (i = 0; i < 3; i++) {
+		snprintf(name, sizeof(name), "in_%s_%c_raw", chan_type[dev],
+			 axis[i]);
+		ret |= write_attr(fake, dir, name, i == 2 ? "16384" : "100");
+		snprintf(name, sizeof(name), "in_%s_%c_en", chan_type[dev],
+			 axis[i]);
+		ret |= write_attr(fake, scan, name, "0");
+		snprintf(name, sizeof(name), "in_%s_%c_index", chan_type[dev],
+			 axis[i]);
+		snprintf(val, sizeof(val), "%d", i);
+		ret |= write_attr(fake, scan, name, val);
+		snprintf(name, sizeof(name), "in_%s_%c_type", chan_type[dev],
+			 axis[i]);
+		ret |= write_attr(fake, scan, name, "le:s16/16>>0");
+	}
+
+	ret |= write_attr(fake, scan, "in_timestamp_en", "0");
+	ret |= write_attr(fake, scan, "in_timestamp_index", "3");
+	ret |= write_attr(fake, scan, "in_timestamp_type", "le:s64/64>>0");
+
+	snprintf(name, sizeof(name), "in_%s_scale", chan_type[dev]);
+	ret |= write_attr(fake, dir, name, chan_scale[dev]);
+	ret |= write_attr(fake, dir, "name", imu_name[dev]);
+	snprintf(val, sizeof(val), "%u.000000",
+		 fake->rate ? fake->rate : DEFAULT_RATE);
+	ret |= write_attr(fake, dir, "sampling_frequency", val);
+
+	ret |= write_attr(fake, dir, "current_timestamp_clock", "realtime");
+	snprintf(scan, sizeof(scan), IIO_DIR "/iio:device%d/trigger", dev);
+	ret |= write_attr(fake, scan, "current_trigger", "");
+
+	snprintf(scan, sizeof(scan), IIO_DIR "/iio:device%d/buffer", dev);
+	ret |= write_attr(fake, scan, "enable", "0");
+	ret |= write_attr(fake, scan, "length", "0");
+	ret |= write_attr(fake, scan, "watermark", "1");
+
+	return ret < 0 ? -EIO : 0;
+}
+
+/*
+ * Scan layout as the kernel packs it: enabled channels in index order,
+ * each aligned to its storage size, the frame padded to the largest one.
+ */
+static size_t scan_layout(const struct fake_iio *fake, int dev,
+			  int offset[SCAN_CHANNELS])
+{
+	static const char *const suffix[SCAN_CHANNELS] = {
+		"x_en", "y_en", "z_en", NULL
+	};
+	static const size_t storage[SCAN_CHANNELS] = { 2, 2, 2, 8 };
+	char path[PATH_MAX];
+	size_t size = 0, largest = 1;
+	int i, en, ret;
+
+	for (i = 0; i < SCAN_CHANNELS; i++) {
+		ret = format_path(path, sizeof(path), "%s" IIO_DIR
+				  "/iio:device%d/scan_elements/in_%s_%s",
+				  fake->root, dev,
+				  suffix[i] ? chan_type[dev] : "timestamp",
+				  suffix[i] ? suffix[i] : "en");
+
+		if (ret < 0 || sysfs_read_int(path, &en) < 0 || !en) {
+			offset[i] = -1;
+			continue;
+		}
+
+		size = (size + storage[i] - 1) / storage[i] * storage[i];
+		offset[i] = size;
+		size += storage[i];
+
+		if (storage[i] > largest)
+			largest = storage[i];
+	}
+
+	return (size + largest - 1) / largest * largest;
+}
+
+static void fill_frame(unsigned char *frame, const int offset[SCAN_CHANNELS],
+		       unsigned long n, int64_t timestamp)
+{
+	int16_t axis[3];
+	int i;
+
+	axis[0] = (int16_t)(n % 2000) - 1000;
+	axis[1] = -axis[0];
+	axis[2] = 16384;
+
+	for (i = 0; i < 3; i++)
+		if (offset[i] >= 0)
+			memcpy(frame + offset[i], &axis[i], sizeof(axis[i]));
+
+	if (offset[3] >= 0)
+		memcpy(frame + offset[3], &timestamp, sizeof(timestamp));
+}
+
+static void sleep_until(int64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000,
+		.tv_nsec = ns % 1000000000,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+/* Trigger number of the trigger called name, or -1 */
+static int find_trigger(const struct fake_iio *fake, const char *name)
+{
+	char path[PATH_MAX], val[64];
+	int i;
+
+	for (i = 0; i < FAKE_IIO_TRIGGERS; i++) {
+		if (format_path(path, sizeof(path), "%s" IIO_DIR
+				"/trigger%d/name", fake->root, i) < 0)
+			break;
+
+		if (sysfs_read_str(path, val, sizeof(val)) >= 0 &&
+		    !strcmp(val, name))
+			return i;
+	}
+
+	return -1;
+}
+
+/* Nanoseconds between trigger ticks for dev, 0 when it has no trigger */
+static int64_t trigger_period(const struct fake_iio *fake, int dev)
+{
+	char path[PATH_MAX], val[64];
+	double freq;
+	int trig;
+
+	if (format_path(path, sizeof(path), "%s" IIO_DIR
+			"/iio:device%d/trigger/current_trigger", fake->root,
+			dev) < 0 ||
+	    sysfs_read_str(path, val, sizeof(val)) <= 0)
+		return 0;
+
+	trig = find_trigger(fake, val);
+
+	if (trig < 0)
+		return 0;
+
+	if (format_path(path, sizeof(path),
+			"%s" IIO_DIR "/trigger%d/sampling_frequency",
+			fake->root, trig) < 0 ||
+	    sysfs_read_str(path, val, sizeof(val)) <= 0)
+		return 0;
+
+	freq = atof(val);
+
+	return freq > 0 ? (int64_t)(1e9 / freq) : 0;
+}
+
+/*
+ * Frames due on the trigger grid up to now, stamped with their tick. The
+ * grid is counted from CLOCK_MONOTONIC zero so that every device on the
+ * trigger lands on the same ticks.
+ */
+static unsigned long feed_ticks(unsigned char *buf, size_t size,
+				const int offset[SCAN_CHANNELS],
+				unsigned long sent, int64_t period,
+				int64_t *tick, int64_t now)
+{
+	unsigned long i;
+
+	if (!*tick || now - *tick > period * FEED_CHUNK)
+		*tick = (now / period + 1) * period;
+
+	for (i = 0; i < FEED_CHUNK && *tick <= now; i++, *tick += period)
+		fill_frame(buf + i * size, offset, sent + i, *tick);
+
+	return i;
+}
+
+/* Streams frames into one reader until it closes the FIFO */
+static void feed(struct fake_iio_feeder *feeder, int fd)
+{
+	struct fake_iio *fake = feeder->fake;
+	unsigned char buf[FEED_CHUNK * 16];
+	int offset[SCAN_CHANNELS];
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+	unsigned long sent = 0, due, i;
+	int64_t start, now, period = 0, tick = 0, checked = 0, p;
+	size_t size;
+	ssize_t ret;
+
+	size = scan_layout(fake, feeder->dev, offset);
+
+	if (!size)
+		return;
+
+	memset(buf, 0, sizeof(buf));
+	start = monotonic_ns();
+
+	while (!__atomic_load_n(&fake->stop, __ATOMIC_ACQUIRE)) {
+		now = monotonic_ns();
+		due = FEED_CHUNK;
+
+		if (now - checked >= TRIGGER_CHECK_NS) {
+			p = trigger_period(fake, feeder->dev);
+
+			if (p != period)
+				tick = 0;
+
+			period = p;
+			checked = now;
+		}
+
+		if (period) {
+			due = feed_ticks(buf, size, offset, sent, period, &tick,
+					 now);
+
+			if (!due) {
+				sleep_until(tick);
+				continue;
+			}
+		} else if (fake->rate) {
+			due = (now - start) * fake->rate / 1000000000 - sent;
+
+			if (!due) {
+				sleep_until(start + (int64_t)(sent + 1) *
+					    1000000000 / fake->rate);
+				continue;
+			}
+
+			if (due > FEED_CHUNK)
+				due = FEED_CHUNK;
+		}
+
+		for (i = 0; !period && i < due; i++)
+			fill_frame(buf + i * size, offset, sent + i, now);
+
+		ret = write(fd, buf, due * size);
+
+		if (ret < 0 && errno == EAGAIN) {
+			/* A real FIFO overflows, flat out we wait instead */
+			if (fake->rate) {
+				feeder->overruns += due;
+				sent += due;
+			} else {
+				poll(&pfd, 1, 100);
+			}
+
+			continue;
+		}
+
+		if (ret < 0)
+			return;
+
+		feeder->frames += due;
+		sent += due;
+	}
+}
+
+/*
+ * configfs creates the trigger device inside mkdir(); here a directory
+ * made under HRTIMER_DIR becomes the next free triggerN a moment later.
+ */
+static void *trigger_thread(void *arg)
+{
+	struct fake_iio *fake = arg;
+	char path[PATH_MAX], name[PATH_MAX], dir[64];
+	struct dirent *ent;
+	DIR *hrtimer;
+	int n;
+
+	/* fake_iio_create() made this directory, so the path fits */
+	if (format_path(path, sizeof(path), "%s" HRTIMER_DIR, fake->root) < 0)
+		return NULL;
+
+	while (!__atomic_load_n(&fake->stop, __ATOMIC_ACQUIRE)) {
+		hrtimer = opendir(path);
+
+		while (hrtimer && (ent = readdir(hrtimer))) {
+			if (ent->d_name[0] == '.' ||
+			    find_trigger(fake, ent->d_name) >= 0)
+				continue;
+
+			for (n = 0; n < FAKE_IIO_TRIGGERS; n++) {
+				if (format_path(name, sizeof(name), "%s" IIO_DIR
+						"/trigger%d/name", fake->root,
+						n) < 0)
+					break;
+
+				if (access(name, F_OK) == 0)
+					continue;
+
+				snprintf(dir, sizeof(dir), IIO_DIR "/trigger%d",
+					 n);
+				write_attr(fake, dir, "sampling_frequency",
+					   TRIGGER_RATE);
+				write_attr(fake, dir, "name", ent->d_name);
+				break;
+			}
+		}
+
+		if (hrtimer)
+			closedir(hrtimer);
+
+		usleep(TRIGGER_POLL_US);
+	}
+
+	return NULL;
+}
+
+static void *feeder_thread(void *arg)
+{
+	struct fake_iio_feeder *feeder = arg;
+	struct fake_iio *fake = feeder->fake;
+	char path[PATH_MAX];
+	int fd;
+
+	if (format_path(path, sizeof(path), "%s/dev/iio:device%d",
+			fake->root, feeder->dev) < 0)
+		return NULL;
+
+	while (!__atomic_load_n(&fake->stop, __ATOMIC_ACQUIRE)) {
+		/* ENXIO until a reader opens the device */
+		fd = open(path, O_WRONLY | O_NONBLOCK);
+
+		if (fd < 0) {
+			if (errno != ENXIO)
+				break;
+
+			usleep(FEED_RETRY_US);
+			continue;
+		}
+
+		feed(feeder, fd);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+int fake_iio_create(struct fake_iio *fake, const char *root,
+		    unsigned int rate)
+{
+	char path[PATH_MAX];
+	int dev, ret;
+
+	memset(fake, 0, sizeof(*fake));
+
+	if (format_path(fake->root, sizeof(fake->root), "%s", root) < 0)
+		return -ENAMETOOLONG;
+
+	fake->rate = rate;
+
+	/* Readers closing the FIFO must not kill the process */
+	signal(SIGPIPE, SIG_IGN);
+
+	ret = write_attr(fake, HTU21D_DIR, "in_temp_input", "23456");
+
+	if (!ret)
+		ret = write_attr(fake, HTU21D_DIR, "in_humidityrelative_input",
+				 "45678");
+
+	for (dev = 0; !ret && dev < FAKE_IIO_DEVICES; dev++)
+		ret = create_imu(fake, dev);
+
+	if (ret < 0)
+		return ret;
+
+	ret = format_path(path, sizeof(path), "%s/dev", fake->root);
+
+	if (!ret)
+		ret = make_dirs(path);
+
+	if (ret < 0)
+		return ret;
+
+	for (dev = 0; dev < FAKE_IIO_DEVICES; dev++) {
+		ret = format_path(path, sizeof(path), "%s/dev/iio:device%d",
+				  fake->root, dev);
+
+		if (ret < 0)
+			return ret;
+
+		unlink(path);
+
+		if (mkfifo(path, 0644) < 0)
+			return -errno;
+	}
+
+	ret = format_path(path, sizeof(path), "%s" HRTIMER_DIR, fake->root);
+
+	if (!ret)
+		ret = make_dirs(path);
+
+	if (ret < 0)
+		return ret;
+
+	ret = pthread_create(&fake->trigger_thread, NULL, trigger_thread,
+			     fake);
+
+	if (ret)
+		return -ret;
+
+	fake->triggers = true;
+
+	for (dev = 0; dev < FAKE_IIO_DEVICES; dev++) {
+		fake->feeder[dev].fake = fake;
+		fake->feeder[dev].dev = dev;
+		ret = pthread_create(&fake->feeder[dev].thread, NULL,
+				     feeder_thread, &fake->feeder[dev]);
+
+		if (ret) {
+			fake->feeder[dev].fake = NULL;
+			fake_iio_stop(fake);
+			return -ret;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * iio:deviceN lives under its I2C client directory, /sys/bus/iio/devices
+ * only links to it, as on a real system.
+ */
+static int create_client(const struct fake_iio *fake, unsigned int bus,
+			 unsigned int addr, int dev, const char *name,
+			 const char *const *attr, const char *const *val)
+{
+	char dir[PATH_MAX], link[PATH_MAX], target[PATH_MAX];
+	int ret;
+
+	snprintf(dir, sizeof(dir),
+		 I2C_DEVICES_DIR "/i2c-%u/%u-%04x/iio:device%d", bus, bus, addr,
+		 dev);
+	ret = write_attr(fake, dir, "name", name);
+
+	for (; !ret && *attr; attr++, val++)
+		ret = write_attr(fake, dir, *attr, *val);
+
+	if (!ret)
+		ret = format_path(link, sizeof(link), "%s" IIO_DIR
+				  "/iio:device%d", fake->root, dev);
+
+	if (!ret)
+		ret = format_path(target, sizeof(target), "../../..%s",
+				  dir + 4);
+
+	if (ret < 0)
+		return ret;
+
+	unlink(link);
+
+	return symlink(target, link) < 0 ? -errno : 0;
+}
+
+int fake_iio_add_buses(struct fake_iio *fake, unsigned int buses)
+{
+	static const char *const htu21d_attr[] = {
+		"in_temp_input", "in_humidityrelative_input", NULL
+	};
+	static const char *const accel_attr[] = {
+		"in_accel_x_raw", "in_accel_y_raw", "in_accel_z_raw",
+		"in_accel_scale", NULL
+	};
+	static const char *const gyro_attr[] = {
+		"in_anglvel_x_raw", "in_anglvel_y_raw", "in_anglvel_z_raw",
+		"in_anglvel_scale", NULL
+	};
+	const char *accel_val[] = { "100", "-100", "16384", chan_scale[1] };
+	const char *gyro_val[] = { "10", "-10", "0", chan_scale[0] };
+	char temp[16], hum[16];
+	const char *htu21d_val[] = { temp, hum };
+	int dev = FAKE_IIO_DEVICES, ret = 0;
+	unsigned int bus;
+
+	for (bus = 1; !ret && bus <= buses; bus++) {
+		snprintf(temp, sizeof(temp), "%u", 20000 + bus * 250);
+		snprintf(hum, sizeof(hum), "%u", 40000 + bus * 500);
+		ret = create_client(fake, bus, HTU21D_ADDR, dev++, "htu21",
+				    htu21d_attr, htu21d_val);
+
+		if (!ret)
+			ret = create_client(fake, bus, LSM6DSV16X_ADDR, dev++,
+					    imu_name[1], accel_attr, accel_val);
+
+		if (!ret)
+			ret = create_client(fake, bus, LSM6DSV16X_ADDR, dev++,
+					    imu_name[0], gyro_attr, gyro_val);
+	}
+
+	return ret;
+}
+
+void fake_iio_stop(struct fake_iio *fake)
+{
+	int dev;
+
+	__atomic_store_n(&fake->stop, true, __ATOMIC_RELEASE);
+
+	for (dev = 0; dev < FAKE_IIO_DEVICES; dev++) {
+		if (!fake->feeder[dev].fake)
+			continue;
+
+		pthread_join(fake->feeder[dev].thread, NULL);
+		fake->feeder[dev].fake = NULL;
+	}
+
+	if (fake->triggers) {
+		pthread_join(fake->trigger_thread, NULL);
+		fake->triggers = false;
+	}
+}
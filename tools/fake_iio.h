@@ -0,0 +1,61 @@
+/*
+ * Simulated HTU21D + LSM6DSV16X device tree.
+ *
+ * Creates regular files that mirror the sysfs attributes the programs use
+ * (under <root>/sys/...) and FIFOs standing in for the IIO character
+ * devices (under <root>/dev). A feeder thread per FIFO emits synthetic scan
+ * frames laid out according to the enabled scan elements, with the
+ * CLOCK_MONOTONIC write time in the in_timestamp channel, so latency can be
+ * measured end to end.
+ *
+ * Directories made under the configfs hrtimer directory show up as IIO
+ * triggers a moment later. An IMU whose trigger/current_trigger names one
+ * samples at the trigger's sampling_frequency, on a grid shared by every
+ * device on that trigger, and is stamped with the grid time.
+ *
+ * Point the programs at it with
+ *   SENSOR_SYSFS_ROOT=<root> SENSOR_DEV_ROOT=<root>/dev
+ */
+
+#ifndef FAKE_IIO_H
+#define FAKE_IIO_H
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+#define FAKE_IIO_DEVICES	2
+#define FAKE_IIO_TRIGGERS	8
+
+struct fake_iio;
+
+struct fake_iio_feeder {
+	struct fake_iio *fake;
+	int dev;			/* iio:deviceN */
+	pthread_t thread;
+	unsigned long frames;		/* written */
+	unsigned long overruns;		/* dropped, FIFO full */
+};
+
+struct fake_iio {
+	char root[PATH_MAX];
+	unsigned int rate;		/* frames/s per device, 0 = flat out */
+	bool stop;
+	struct fake_iio_feeder feeder[FAKE_IIO_DEVICES];
+	pthread_t trigger_thread;	/* stands in for configfs */
+	bool triggers;			/* trigger_thread running */
+};
+
+int fake_iio_create(struct fake_iio *fake, const char *root,
+		    unsigned int rate);
+
+/*
+ * Adds buses I2C buses (1..buses), each with an HTU21D and an LSM6DSV16X
+ * accel + gyro pair, as polled-only devices iio:device2 onwards.
+ */
+int fake_iio_add_buses(struct fake_iio *fake, unsigned int buses);
+
+/* Stops the feeders, the files are left in place. */
+void fake_iio_stop(struct fake_iio *fake);
+
+#endif
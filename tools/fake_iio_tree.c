@@ -0,0 +1,72 @@
+/*
+ * Simulated sensor device tree
+ *
+ * - Creates the HTU21D and LSM6DSV16X sysfs attributes under <dir>/sys and
+ *   FIFO backed /dev/iio:device0 and iio:device1 under <dir>/dev
+ * - Streams synthetic scan frames at [rate] frames/s per device (0 = as fast
+ *   as the reader drains them) to whichever program opens the FIFOs
+ * - Optionally adds [buses] extra I2C buses, each with an HTU21D and an
+ *   LSM6DSV16X, for the multi-sensor sampler
+ * - Runs until Enter is pressed, then prints frames written and dropped
+ *
+ * Usage: fake_iio_tree <dir> [rate] [buses]
+ *
+ * Every program honours SENSOR_SYSFS_ROOT and SENSOR_DEV_ROOT, e.g.
+ *   SENSOR_SYSFS_ROOT=<dir> SENSOR_DEV_ROOT=<dir>/dev ./imu_buffered
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_iio.h"
+
+#define DEFAULT_RATE	1666
+
+int main(int argc, char *argv[])
+{
+	unsigned int rate = DEFAULT_RATE, buses = 0;
+	struct fake_iio fake;
+	int dev, ret;
+
+	if (argc < 2) {
+		printf("Usage: %s <dir> [rate] [buses]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	if (argc > 2)
+		rate = atoi(argv[2]);
+
+	if (argc > 3)
+		buses = atoi(argv[3]);
+
+	ret = fake_iio_create(&fake, argv[1], rate);
+
+	if (!ret && buses) {
+		ret = fake_iio_add_buses(&fake, buses);
+
+		if (ret < 0)
+			fake_iio_stop(&fake);
+	}
+
+	if (ret < 0) {
+		printf("Failed to create device tree in %s: %s\n", argv[1],
+		       strerror(-ret));
+		return ret;
+	}
+
+	printf("Simulated device tree in %s, %u frames/s\n", argv[1], rate);
+	printf("Run the programs with SENSOR_SYSFS_ROOT=%s "
+	       "SENSOR_DEV_ROOT=%s/dev\n", argv[1], argv[1]);
+	printf("Press Enter to stop\n");
+	getchar();
+
+	fake_iio_stop(&fake);
+
+	for (dev = 0; dev < FAKE_IIO_DEVICES; dev++)
+		printf("iio:device%d: %lu frames, %lu overruns\n", dev,
+		       fake.feeder[dev].frames, fake.feeder[dev].overruns);
+
+	return 0;
+}
@@ -0,0 +1,338 @@
+/*
+ * Acquisition path benchmark
+ *
+ * - Runs against the simulated device tree (tools/fake_iio.c), so no board
+ *   is needed
+ * - Reads N accelerometer samples (X, Y, Z) through each read mode:
+ *     sysfs     lseek() + read() per attribute, as the original programs
+ *     pread     chan_reader pread backend, one pread() per attribute
+ *     uring     chan_reader io_uring backend, one io_uring_enter() per frame
+ *     buffered  IIO buffer, packed frames from the /dev/iio:deviceN FIFO
+ * - Reports samples/s, syscalls/sample and p50/p99 sample latency. For the
+ *   sysfs modes latency is the time to read one frame; for the buffered
+ *   mode it is read time minus the frame's in_timestamp, i.e. producer to
+ *   consumer
+ *
+ * Usage: iio_bench [-n samples] [-r rate] [-b frames per read] [-d dir]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/chan_reader.h"
+#include "../common/iio_buffer.h"
+#include "../common/iio_parse.h"
+#include "../common/periodic.h"
+#include "../common/sysfs.h"
+#include "fake_iio.h"
+
+#define SAMPLES		20000
+#define RATE		6664
+#define BATCH		32
+#define MAX		32
+#define ACCEL_DIR	"/sys/bus/iio/devices/iio:device1"
+
+struct bench_result {
+	const char *mode;
+	unsigned long samples;
+	unsigned long syscalls;
+	int64_t elapsed;		/* ns */
+	int64_t *lat;			/* ns per sample */
+};
+
+static const char *const accel_attrs[3] = {
+	ACCEL_DIR "/in_accel_x_raw",
+	ACCEL_DIR "/in_accel_y_raw",
+	ACCEL_DIR "/in_accel_z_raw",
+};
+
+static int cmp_int64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void report(struct bench_result *res)
+{
+	qsort(res->lat, res->samples, sizeof(*res->lat), cmp_int64);
+	printf("%-9s %12.0f %16.2f %10lld %10lld\n", res->mode,
+	       res->samples * 1e9 / res->elapsed,
+	       (double)res->syscalls / res->samples,
+	       (long long)res->lat[res->samples / 2],
+	       (long long)res->lat[res->samples * 99 / 100]);
+}
+
+static int open_attrs(int fd[3])
+{
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		fd[i] = sysfs_open(accel_attrs[i], O_RDONLY);
+
+		if (fd[i] < 0) {
+			while (i--)
+				close(fd[i]);
+
+			return -ENOENT;
+		}
+	}
+
+	return 0;
+}
+
+static int bench_sysfs(struct bench_result *res, unsigned long n)
+{
+	char buf[MAX];
+	int32_t raw;
+	int64_t start, t;
+	unsigned long s;
+	int fd[3], i, ret;
+
+	ret = open_attrs(fd);
+
+	if (ret < 0)
+		return ret;
+
+	start = monotonic_ns();
+
+	for (s = 0; s < n; s++) {
+		t = monotonic_ns();
+
+		for (i = 0; i < 3; i++) {
+			lseek(fd[i], 0, SEEK_SET);
+			ret = read(fd[i], buf, MAX);
+
+			if (ret < 0 || iio_parse_int(buf, ret, &raw) < 0)
+				break;
+		}
+
+		res->lat[s] = monotonic_ns() - t;
+	}
+
+	res->elapsed = monotonic_ns() - start;
+	res->samples = n;
+	res->syscalls = n * 6;
+
+	for (i = 0; i < 3; i++)
+		close(fd[i]);
+
+	return 0;
+}
+
+static int bench_reader(struct bench_result *res, unsigned long n,
+			enum chan_reader_backend backend)
+{
+	struct chan_reader reader;
+	int64_t start, t;
+	unsigned long s;
+	int fd[3], i, ret;
+	int32_t raw;
+
+	ret = open_attrs(fd);
+
+	if (ret < 0)
+		return ret;
+
+	ret = chan_reader_init(&reader, backend);
+
+	if (ret < 0) {
+		for (i = 0; i < 3; i++)
+			close(fd[i]);
+
+		return ret;
+	}
+
+	for (i = 0; i < 3; i++)
+		chan_reader_add(&reader, fd[i]);
+
+	start = monotonic_ns();
+
+	for (s = 0; s < n; s++) {
+		t = monotonic_ns();
+
+		if (chan_reader_read(&reader) == 0)
+			for (i = 0; i < 3; i++)
+				iio_parse_int(reader.buf[i], reader.len[i],
+					      &raw);
+
+		res->lat[s] = monotonic_ns() - t;
+	}
+
+	res->elapsed = monotonic_ns() - start;
+	res->samples = n;
+	res->syscalls = reader.syscalls;
+	chan_reader_close(&reader);
+
+	for (i = 0; i < 3; i++)
+		close(fd[i]);
+
+	return 0;
+}
+
+static int bench_buffered(struct bench_result *res, unsigned long n,
+			  unsigned int batch)
+{
+	static const char *const chans[] = {
+		"in_accel_x", "in_accel_y", "in_accel_z", "in_timestamp", NULL
+	};
+	const struct iio_channel *ts;
+	struct iio_buffer buf;
+	int64_t start = 0, now;
+	ssize_t ret, i;
+
+	ret = iio_buffer_open(&buf, "iio:device1", chans, batch);
+
+	if (ret < 0)
+		return ret;
+
+	ts = iio_buffer_channel(&buf, "in_timestamp");
+
+	if (!ts) {
+		iio_buffer_close(&buf);
+		return -ENODEV;
+	}
+
+	res->samples = 0;
+	res->syscalls = 0;
+
+	while (res->samples < n) {
+		ret = iio_buffer_read(&buf);
+		res->syscalls++;
+
+		if (ret < 0 && ret != -EAGAIN && ret != -EINTR)
+			break;
+
+		if (ret <= 0)
+			continue;
+
+		now = monotonic_ns();
+
+		/* Start the clock at the first frame, not at open() */
+		if (!start)
+			start = iio_channel_raw(ts, iio_buffer_frame(&buf, 0));
+
+		for (i = 0; i < ret && res->samples < n; i++)
+			res->lat[res->samples++] = now -
+				iio_channel_raw(ts, iio_buffer_frame(&buf, i));
+	}
+
+	res->elapsed = monotonic_ns() - start;
+	iio_buffer_close(&buf);
+
+	return res->samples ? 0 : -EIO;
+}
+
+int main(int argc, char *argv[])
+{
+	char tmpl[] = "/tmp/iio_bench.XXXXXX", devdir[PATH_MAX];
+	unsigned long n = SAMPLES;
+	unsigned int rate = RATE, batch = BATCH;
+	struct bench_result res;
+	const char *dir = NULL;
+	struct fake_iio fake;
+	int opt, ret;
+
+	while ((opt = getopt(argc, argv, "n:r:b:d:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			printf("Usage: %s [-n samples] [-r rate] "
+			       "[-b frames per read] [-d dir]\n", argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (!n || !batch) {
+		printf("Invalid sample or batch count\n");
+		return -EINVAL;
+	}
+
+	if (!dir) {
+		dir = mkdtemp(tmpl);
+
+		if (!dir) {
+			printf("Failed to create temporary directory\n");
+			return -errno;
+		}
+	}
+
+	ret = fake_iio_create(&fake, dir, rate);
+
+	if (ret < 0) {
+		printf("Failed to create device tree in %s: %s\n", dir,
+		       strerror(-ret));
+		return ret;
+	}
+
+	snprintf(devdir, sizeof(devdir), "%s/dev", dir);
+	setenv("SENSOR_SYSFS_ROOT", dir, 1);
+	setenv("SENSOR_DEV_ROOT", devdir, 1);
+
+	res.lat = malloc(n * sizeof(*res.lat));
+
+	if (!res.lat) {
+		fake_iio_stop(&fake);
+		return -ENOMEM;
+	}
+
+	printf("Device tree %s, %lu samples, buffered: %u frames/s, "
+	       "%u frames per read\n\n", dir, n, rate, batch);
+	printf("%-9s %12s %16s %10s %10s\n", "mode", "samples/s",
+	       "syscalls/sample", "p50 ns", "p99 ns");
+
+	res.mode = "sysfs";
+	ret = bench_sysfs(&res, n);
+
+	if (ret == 0)
+		report(&res);
+	else
+		printf("%-9s failed: %s\n", res.mode, strerror(-ret));
+
+	res.mode = "pread";
+	ret = bench_reader(&res, n, CHAN_READER_PREAD);
+
+	if (ret == 0)
+		report(&res);
+	else
+		printf("%-9s failed: %s\n", res.mode, strerror(-ret));
+
+	res.mode = "uring";
+	ret = bench_reader(&res, n, CHAN_READER_URING);
+
+	if (ret == 0)
+		report(&res);
+	else
+		printf("%-9s unavailable: %s\n", res.mode, strerror(-ret));
+
+	res.mode = "buffered";
+	ret = bench_buffered(&res, n, batch);
+
+	if (ret == 0)
+		report(&res);
+	else
+		printf("%-9s failed: %s\n", res.mode, strerror(-ret));
+
+	fake_iio_stop(&fake);
+	printf("\nbuffered: %lu frames written, %lu overruns\n",
+	       fake.feeder[1].frames, fake.feeder[1].overruns);
+	free(res.lat);
+
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * Microbenchmark for the IIO sysfs value parsers
+ *
+ * - Decodes typical sysfs strings (raw axis counts, HTU21D milli-unit
+ *   readings and IIO_VAL_INT_PLUS_MICRO/NANO scales) in a tight loop
+ * - Compares atof() followed by a double multiply against iio_parse_int()
+ *   and iio_parse_fixed() keeping the value as a scaled integer
+ * - Prints ns per value for each path
+ *
+ * Usage: iio_parse_bench [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/iio_parse.h"
+
+#define ITERATIONS	2000000
+
+static const char *const raw_values[] = {
+	"-1234\n", "16384\n", "23456\n", "-7\n", "0\n", "45678\n",
+};
+
+static const char *const scale_values[] = {
+	"0.000598550\n", "0.061\n", "0.004375\n", "1.000000000\n",
+};
+
+#define NRAW	(sizeof(raw_values) / sizeof(raw_values[0]))
+#define NSCALE	(sizeof(scale_values) / sizeof(scale_values[0]))
+
+/* Keeps the compiler from dropping the loops */
+static volatile double sink_double;
+static volatile int64_t sink_int;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void report(const char *name, int64_t start, long n)
+{
+	printf("%-28s %8.2f ns/value\n", name,
+	       (double)(now_ns() - start) / n);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t raw_len[NRAW], scale_len[NSCALE];
+	long iterations = ITERATIONS, i;
+	double scale_d = 0.000598550;
+	int64_t scale_n = 598550;
+	int64_t start, fixed;
+	int32_t raw;
+	size_t j;
+
+	if (argc > 1)
+		iterations = atol(argv[1]);
+
+	if (iterations <= 0) {
+		printf("Invalid iteration count\n");
+		return -1;
+	}
+
+	for (j = 0; j < NRAW; j++)
+		raw_len[j] = strlen(raw_values[j]);
+
+	for (j = 0; j < NSCALE; j++)
+		scale_len[j] = strlen(scale_values[j]);
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++)
+		sink_double = atof(raw_values[i % NRAW]) * scale_d;
+
+	report("raw: atof * scale", start, iterations);
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		iio_parse_int(raw_values[i % NRAW], raw_len[i % NRAW], &raw);
+		sink_int = raw * scale_n;
+	}
+
+	report("raw: iio_parse_int * scale", start, iterations);
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++)
+		sink_double = atof(scale_values[i % NSCALE]);
+
+	report("scale: atof", start, iterations);
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		iio_parse_fixed(scale_values[i % NSCALE],
+				scale_len[i % NSCALE], IIO_NANO_DIGITS, &fixed);
+		sink_int = fixed;
+	}
+
+	report("scale: iio_parse_fixed", start, iterations);
+
+	return 0;
+}
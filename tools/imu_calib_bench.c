@@ -0,0 +1,215 @@
+/*
+ * IMU calibration benchmark
+ *
+ * - Builds an accelerometer with a known offset, scale error and axis
+ *   misalignment, simulates the six resting poses with noise and checks
+ *   that imu_calib_fit_accel() recovers it
+ * - Checks imu_correct() against a plain scalar loop
+ * - Times both on batches of frames and reports ns per frame
+ *
+ * Usage: imu_calib_bench [frames per batch] [runs]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/imu_calib.h"
+
+#define BATCH		64
+#define RUNS		200000
+#define POSE_FRAMES	2000
+
+static double cpu_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static float noise(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+	return (float)(*state >> 40) / (1 << 24) - 0.5f;
+}
+
+static void scalar_correct(const struct imu_correction *c, float (*xyz)[3],
+			   unsigned int n)
+{
+	unsigned int i;
+	float v[3];
+	int k;
+
+	for (i = 0; i < n; i++) {
+		for (k = 0; k < 3; k++)
+			v[k] = c->m[k][0] * xyz[i][0] + c->m[k][1] * xyz[i][1] +
+			       c->m[k][2] * xyz[i][2] + c->t[k];
+
+		memcpy(xyz[i], v, sizeof(v));
+	}
+}
+
+/*
+ * The simulated accelerometer reads raw = S * true + offset, S a scale
+ * and misalignment matrix; the fit should return S^-1 and offset.
+ */
+static int check_fit(void)
+{
+	static const float s[3][3] = {
+		{ 1.020f, 0.004f, -0.006f },
+		{ -0.003f, 0.985f, 0.008f },
+		{ 0.005f, -0.002f, 1.012f },
+	};
+	static const float offset[3] = { 0.12f, -0.08f, 0.21f };
+	double means[IMU_CALIB_POSES][3], rms, err = 0.0, d;
+	int poses[IMU_CALIB_POSES], p, i, j, k;
+	struct imu_calib_stats st;
+	struct imu_calib c;
+	uint64_t state = 3;
+	float g[3], raw[3];
+
+	imu_calib_init(&c);
+
+	for (p = 0; p < IMU_CALIB_POSES; p++) {
+		imu_calib_stats_reset(&st);
+
+		for (i = 0; i < POSE_FRAMES; i++) {
+			memset(g, 0, sizeof(g));
+			g[p / 2] = p % 2 ? -IMU_CALIB_GRAVITY :
+					   IMU_CALIB_GRAVITY;
+
+			for (j = 0; j < 3; j++)
+				raw[j] = s[j][0] * g[0] + s[j][1] * g[1] +
+					 s[j][2] * g[2] + offset[j] +
+					 0.05f * noise(&state);
+
+			imu_calib_stats_add(&st, raw);
+		}
+
+		imu_calib_stats_mean(&st, means[p]);
+		poses[p] = imu_calib_pose(means[p]);
+
+		if (poses[p] != p) {
+			printf("Pose %d detected as %d\n", p, poses[p]);
+			return -1;
+		}
+	}
+
+	if (imu_calib_fit_accel(&c, (const double (*)[3])means, poses,
+				IMU_CALIB_POSES, &rms) < 0) {
+		printf("Fit failed\n");
+		return -1;
+	}
+
+	/* matrix * S should be the identity */
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			d = -(i == j);
+
+			for (k = 0; k < 3; k++)
+				d += c.accel_matrix[i][k] * s[k][j];
+
+			err = fmax(err, fabs(d));
+		}
+
+		err = fmax(err, fabs(c.accel_offset[i] - offset[i]) /
+				IMU_CALIB_GRAVITY);
+	}
+
+	printf("Fit: residual %.4f m/s^2, worst matrix/offset error %.2e\n",
+	       rms, err);
+
+	return err < 1e-3 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int batch = BATCH, runs = RUNS, i, k;
+	struct imu_correction corr;
+	float (*src)[3], (*a)[3], (*b)[3];
+	double t, simd, scalar, err = 0;
+	struct imu_calib c;
+	uint64_t state = 1;
+
+	if (argc > 1)
+		batch = atoi(argv[1]);
+
+	if (argc > 2)
+		runs = atoi(argv[2]);
+
+	if (!batch || !runs) {
+		printf("Usage: %s [frames per batch] [runs]\n", argv[0]);
+		return 1;
+	}
+
+	if (check_fit() < 0)
+		return 1;
+
+	imu_calib_init(&c);
+
+	for (i = 0; i < 3; i++) {
+		c.accel_offset[i] = 0.1f * (i + 1);
+
+		for (k = 0; k < 3; k++)
+			c.accel_matrix[i][k] = (i == k) +
+					       0.01f * noise(&state);
+	}
+
+	imu_calib_accel(&c, &corr);
+	src = malloc(batch * sizeof(*src));
+	a = malloc(batch * sizeof(*a));
+	b = malloc(batch * sizeof(*b));
+
+	for (i = 0; i < batch; i++)
+		for (k = 0; k < 3; k++)
+			src[i][k] = 20.0f * noise(&state);
+
+	memcpy(a, src, batch * sizeof(*src));
+	memcpy(b, src, batch * sizeof(*src));
+	imu_correct(&corr, a, batch);
+	scalar_correct(&corr, b, batch);
+
+	for (i = 0; i < batch; i++)
+		for (k = 0; k < 3; k++)
+			err = fmax(err, fabs(a[i][k] - b[i][k]));
+
+	printf("SIMD vs scalar: max difference %.2e m/s^2\n", err);
+
+	/* A rotation keeps the repeatedly corrected frames bounded */
+	memset(&corr, 0, sizeof(corr));
+	corr.m[0][0] = corr.m[1][1] = cosf(0.01f);
+	corr.m[0][1] = -sinf(0.01f);
+	corr.m[1][0] = sinf(0.01f);
+	corr.m[2][2] = 1.0f;
+	t = cpu_sec();
+
+	for (i = 0; i < runs; i++) {
+		imu_correct(&corr, a, batch);
+		__asm__ volatile("" : : "r"(a) : "memory");
+	}
+
+	simd = (cpu_sec() - t) / runs / batch;
+	t = cpu_sec();
+
+	for (i = 0; i < runs; i++) {
+		scalar_correct(&corr, b, batch);
+		__asm__ volatile("" : : "r"(b) : "memory");
+	}
+
+	scalar = (cpu_sec() - t) / runs / batch;
+	printf("%u-frame batches: imu_correct %.2f ns/frame, scalar %.2f "
+	       "ns/frame (%.1fx)\n", batch, simd * 1e9, scalar * 1e9,
+	       scalar / simd);
+
+	free(src);
+	free(a);
+	free(b);
+
+	return 0;
+}
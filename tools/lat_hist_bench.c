@@ -0,0 +1,117 @@
+/*
+ * Cost of the per-stage latency instrumentation
+ *
+ * - Times a sample with three back to back stages (read, decode, sink) the
+ *   way the sampling threads do: one lat_hist_start() at the start and one
+ *   lat_hist_stage() per stage, so one sample in LAT_SAMPLE_EVERY is timed
+ * - Compares against timing every sample, with lat_clock() and with
+ *   clock_gettime(CLOCK_MONOTONIC) as the timestamp source
+ * - Prints ns of instrumentation overhead per sample and fails when the
+ *   sampled path is over the 50 ns budget
+ *
+ * Usage: lat_hist_bench [iterations]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/lat_hist.h"
+
+#define ITERATIONS	2000000
+#define STAGES		3
+#define BUDGET_NS	50.0
+
+static struct lat_hist hist[STAGES];
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double report(const char *name, int64_t start, long n)
+{
+	double ns = (double)(now_ns() - start) / n;
+
+	printf("%-32s %8.2f ns/sample\n", name, ns);
+
+	return ns;
+}
+
+int main(int argc, char *argv[])
+{
+	long iterations = ITERATIONS, i;
+	uint64_t t, prev;
+	int64_t start;
+	double sampled;
+	int s;
+
+	if (argc > 1)
+		iterations = atol(argv[1]);
+
+	if (iterations <= 0) {
+		printf("Invalid iteration count\n");
+		return -1;
+	}
+
+	lat_clock_init();
+	printf("lat_clock tick: %llu ns per 1000 ticks\n\n",
+	       (unsigned long long)lat_ticks_to_ns(1000));
+
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		t = lat_hist_start(&hist[0]);
+
+		for (s = 0; s < STAGES; s++)
+			lat_hist_stage(&hist[s], &t);
+	}
+
+	sampled = report("lat_hist_start, 3 stages", start, iterations);
+
+	for (s = 0; s < STAGES; s++)
+		lat_hist_print("stage", &hist[s]);
+
+	memset(hist, 0, sizeof(hist));
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		t = lat_clock();
+
+		for (s = 0; s < STAGES; s++)
+			lat_hist_stage(&hist[s], &t);
+	}
+
+	report("lat_clock every sample, 3 stages", start, iterations);
+
+	memset(hist, 0, sizeof(hist));
+	start = now_ns();
+
+	for (i = 0; i < iterations; i++) {
+		prev = now_ns();
+
+		for (s = 0; s < STAGES; s++) {
+			t = now_ns();
+			lat_hist_record(&hist[s], t - prev);
+			prev = t;
+		}
+	}
+
+	report("clock_gettime every sample", start, iterations);
+
+	if (sampled > BUDGET_NS) {
+		printf("\nFAIL: %.2f ns per sample is over the %.0f ns budget\n",
+		       sampled, BUDGET_NS);
+		return 1;
+	}
+
+	printf("\nWithin the %.0f ns budget\n", BUDGET_NS);
+
+	return 0;
+}
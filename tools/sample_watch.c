@@ -0,0 +1,149 @@
+/*
+ * Shared-memory sample reader
+ *
+ * - Maps a segment published by htu21d_menu, imu_continuous or
+ *   imu_buffered with -p /name (common/sample_shm.h)
+ * - Prints the newest value of every channel, its age and how many samples
+ *   were published, every [interval] ms; never touches the sensor
+ * - -b times sample_shm_read() instead, ns per read
+ *
+ * Usage: sample_watch [-i interval ms] [-n count] [-b] /name
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/iio_parse.h"
+#include "../common/sample_shm.h"
+
+#define INTERVAL_MS	1000
+#define PRINT_DIGITS	6
+#define BENCH_READS	10000000
+#define OPEN_RETRY_US	100000
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void print_channels(const struct sample_shm *shm)
+{
+	const struct sample_shm_channel *chan;
+	struct sample_shm_value val;
+	unsigned int i, n = sample_shm_channels(shm), v;
+	char text[32];
+	int ret;
+
+	printf("\n");
+
+	for (i = 0; i < n; i++) {
+		chan = &shm->seg->chan[i];
+		ret = sample_shm_read(shm, i, &val);
+
+		if (ret < 0) {
+			printf("%-12s %s\n", chan->name, strerror(-ret));
+			continue;
+		}
+
+		printf("%-12s", chan->name);
+
+		for (v = 0; v < chan->nvals; v++) {
+			iio_format_fixed(text, sizeof(text), val.value[v],
+					 chan->digits, PRINT_DIGITS);
+			printf(" %12s", text);
+		}
+
+		printf(" %s, %.1f ms old, %llu samples\n", chan->unit,
+		       (now_ns() - val.timestamp) / 1e6,
+		       (unsigned long long)val.count);
+	}
+
+	fflush(stdout);
+}
+
+static void bench(const struct sample_shm *shm)
+{
+	struct sample_shm_value val;
+	unsigned int n = sample_shm_channels(shm);
+	unsigned long i, failed = 0;
+	int64_t start;
+
+	if (!n) {
+		printf("No channels published\n");
+		return;
+	}
+
+	start = now_ns();
+
+	for (i = 0; i < BENCH_READS; i++)
+		if (sample_shm_read(shm, i % n, &val) < 0)
+			failed++;
+
+	printf("%.2f ns/read over %u channels, %lu reads without data\n",
+	       (double)(now_ns() - start) / BENCH_READS, n, failed);
+}
+
+int main(int argc, char *argv[])
+{
+	long interval = INTERVAL_MS, count = -1;
+	struct sample_shm shm;
+	int opt, ret, bench_mode = 0;
+
+	while ((opt = getopt(argc, argv, "i:n:b")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atol(optarg);
+			break;
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 'b':
+			bench_mode = 1;
+			break;
+		default:
+			printf("Usage: %s [-i interval ms] [-n count] [-b] /name\n",
+			       argv[0]);
+			return -EINVAL;
+		}
+	}
+
+	if (optind >= argc || interval <= 0) {
+		printf("Usage: %s [-i interval ms] [-n count] [-b] /name\n",
+		       argv[0]);
+		return -EINVAL;
+	}
+
+	/* The publisher may still be setting the segment up */
+	while ((ret = sample_shm_open(&shm, argv[optind])) == -EAGAIN)
+		usleep(OPEN_RETRY_US);
+
+	if (ret < 0) {
+		printf("Failed to open %s: %s\n", argv[optind], strerror(-ret));
+		return ret;
+	}
+
+	printf("%s: publisher pid %d, %u channels\n", argv[optind],
+	       shm.seg->hdr.pid, sample_shm_channels(&shm));
+
+	if (bench_mode) {
+		bench(&shm);
+	} else {
+		while (count < 0 || count-- > 0) {
+			print_channels(&shm);
+			usleep(interval * 1000);
+		}
+	}
+
+	sample_shm_close(&shm);
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * Rolling-window statistics benchmark
+ *
+ * - Feeds a synthetic temperature (daily cycle, weather drift, sensor
+ *   noise, a dropout every few hours) through tumbling and sliding
+ *   windows and checks every emitted result against a brute-force
+ *   recomputation over the stored samples
+ * - Times the incremental update over a longer run and reports CPU ns per
+ *   sample, results emitted and the memory the windows hold
+ *
+ * Usage: win_stats_bench [windows] [interval_ms] [days]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/win_stats.h"
+
+#define WINDOWS		"1m,1h,1d,1h/1m,10m/10s"
+#define INTERVAL_MS	1000
+#define DAYS		30
+#define CHECK_DAYS	2
+#define GAP_EVERY	(5 * 3600)	/* samples between dropouts */
+#define GAP_LEN		600
+
+struct check {
+	const int64_t *ts;
+	const int32_t *val;
+	size_t n;
+	uint64_t results;
+	double err;			/* worst relative mean/stddev error */
+	uint64_t mismatches;		/* n, min or max differ */
+};
+
+static double cpu_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static float noise(uint64_t *state)
+{
+	*state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+
+	return (float)(*state >> 40) / (1 << 24) - 0.5f;
+}
+
+/* Milli-celsius; returns 0 while the sensor is "unplugged" */
+static int sample(uint64_t i, int64_t t, uint64_t *state, int32_t *value)
+{
+	double day = t / 86400e9;
+
+	if (i % GAP_EVERY >= GAP_EVERY - GAP_LEN)
+		return 0;
+
+	*value = (int32_t)(22000 + 4000 * sin(2 * M_PI * day) +
+			   1500 * sin(2 * M_PI * day / 7.3) +
+			   80 * noise(state));
+
+	return 1;
+}
+
+static size_t lower_bound(const int64_t *ts, size_t n, int64_t t)
+{
+	size_t lo = 0, hi = n, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (ts[mid] < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void check_result(const struct win_result *r, void *arg)
+{
+	struct check *c = arg;
+	size_t i, first, last;
+	int32_t min = INT32_MAX, max = INT32_MIN;
+	double sum = 0, mean, m2 = 0, sd;
+
+	first = lower_bound(c->ts, c->n, r->end - r->spec->length);
+	last = lower_bound(c->ts, c->n, r->end);
+
+	for (i = first; i < last; i++) {
+		sum += c->val[i];
+		min = c->val[i] < min ? c->val[i] : min;
+		max = c->val[i] > max ? c->val[i] : max;
+	}
+
+	mean = sum / (last - first);
+
+	for (i = first; i < last; i++)
+		m2 += (c->val[i] - mean) * (c->val[i] - mean);
+
+	sd = last - first > 1 ? sqrt(m2 / (last - first - 1)) : 0;
+
+	if (r->n != last - first || r->min != min || r->max != max)
+		c->mismatches++;
+
+	c->err = fmax(c->err, fabs(r->mean - mean) / fmax(fabs(mean), 1));
+	c->err = fmax(c->err, fabs(r->stddev - sd) / fmax(sd, 1));
+	c->results++;
+}
+
+static void count_result(const struct win_result *r, void *arg)
+{
+	uint64_t *results = arg;
+
+	(void)r;
+	(*results)++;
+}
+
+int main(int argc, char *argv[])
+{
+	struct win_spec spec[WIN_STATS_MAX];
+	struct win_stats win[WIN_STATS_MAX];
+	const char *windows = WINDOWS;
+	long interval_ms = INTERVAL_MS, days = DAYS;
+	struct check c = { 0 };
+	uint64_t i, total, pushed = 0, results = 0, state = 5;
+	int64_t *ts, t = 0, step;
+	int32_t *val, v;
+	size_t mem = 0;
+	double start, ns;
+	int nwin, k;
+	char name[32];
+
+	if (argc > 1)
+		windows = argv[1];
+
+	if (argc > 2)
+		interval_ms = atol(argv[2]);
+
+	if (argc > 3)
+		days = atol(argv[3]);
+
+	nwin = win_stats_parse(spec, WIN_STATS_MAX, windows);
+
+	if (nwin < 0 || interval_ms <= 0 || days <= 0) {
+		printf("Usage: %s [windows] [interval_ms] [days]\n", argv[0]);
+		return 1;
+	}
+
+	for (k = 0; k < nwin; k++) {
+		if (win_stats_init(&win[k], &spec[k]) < 0) {
+			printf("Out of memory\n");
+			return 1;
+		}
+
+		mem += sizeof(win[k]) + win[k].npanes *
+		       (sizeof(struct win_acc) + 2 * sizeof(uint64_t));
+	}
+
+	step = interval_ms * 1000000LL;
+	total = CHECK_DAYS * 86400000ULL / interval_ms;
+	ts = malloc(total * sizeof(*ts));
+	val = malloc(total * sizeof(*val));
+
+	c.ts = ts;
+	c.val = val;
+
+	for (k = 0; k < nwin; k++)
+		win_stats_reset(&win[k], 0);
+
+	for (i = 0, t = 0; i < total; i++, t += step) {
+		if (!sample(i, t, &state, &v))
+			continue;
+
+		ts[c.n] = t;
+		val[c.n++] = v;
+
+		for (k = 0; k < nwin; k++)
+			win_stats_push(&win[k], t, v, check_result, &c);
+	}
+
+	for (k = 0; k < nwin; k++)
+		win_stats_flush(&win[k], t, check_result, &c);
+
+	printf("Check, %d days: %llu results, %llu with wrong count/min/max, "
+	       "worst mean/stddev error %.1e\n", CHECK_DAYS,
+	       (unsigned long long)c.results,
+	       (unsigned long long)c.mismatches, c.err);
+
+	/* Samples are generated first so only the updates are timed */
+	total = days * 86400000ULL / interval_ms;
+	ts = realloc(ts, total * sizeof(*ts));
+	val = realloc(val, total * sizeof(*val));
+
+	for (i = 0, t = 0; i < total; i++, t += step) {
+		if (!sample(i, t, &state, &v))
+			continue;
+
+		ts[pushed] = t;
+		val[pushed++] = v;
+	}
+
+	for (k = 0; k < nwin; k++)
+		win_stats_reset(&win[k], 0);
+
+	start = cpu_sec();
+
+	for (i = 0; i < pushed; i++)
+		for (k = 0; k < nwin; k++)
+			win_stats_push(&win[k], ts[i], val[i], count_result,
+				       &results);
+
+	ns = (cpu_sec() - start) * 1e9;
+
+	printf("%ld days at %ld ms, windows", days, interval_ms);
+
+	for (k = 0; k < nwin; k++) {
+		win_stats_format(name, sizeof(name), &spec[k]);
+		printf(" %s", name);
+	}
+
+	printf(": %llu samples, %llu results, %.1f ns CPU/sample for all "
+	       "windows, %zu bytes of state\n", (unsigned long long)pushed,
+	       (unsigned long long)results, ns / pushed, mem);
+
+	for (k = 0; k < nwin; k++)
+		win_stats_free(&win[k]);
+
+	free(ts);
+	free(val);
+
+	return c.mismatches ? 1 : 0;
+}